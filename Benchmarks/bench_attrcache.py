@@ -0,0 +1,123 @@
+"""
+Benchmark for the per-connection attribute name cache of _ldap
+
+Searches a throwaway slapd seeded with many entries sharing the same
+attribute types and compares the memory held by the result with a copy
+that uses one key string per attribute and entry, like the C extension
+did before attribute names were cached. The cache cannot be switched
+off at run time, so the saving is an estimate from these simulated
+copies, not a measurement of an uncached search.
+
+See https://www.python-ldap.org/ for details.
+"""
+import argparse
+import os
+import time
+import tracemalloc
+
+# Switch off processing .ldaprc or ldap.conf before importing _ldap
+os.environ['LDAPNOINIT'] = '1'
+
+import ldap
+from slapdtest import SlapdObject
+
+ENTRY_TEMPLATE = """dn: cn=user{num},{suffix}
+objectClass: inetOrgPerson
+cn: user{num}
+sn: User {num}
+givenName: Test
+mail: user{num}@example.com
+uid: user{num}
+telephoneNumber: +1 555 {num:07d}
+description: benchmark entry {num}
+title: Tester
+l: Somewhere
+"""
+
+
+def seed(server, entries):
+    ldif = [
+        'dn: {}\nobjectClass: dcObject\nobjectClass: organization\n'
+        'dc: {}\no: {}\n'.format(
+            server.suffix,
+            server.suffix.split(',')[0][3:],
+            server.suffix.split(',')[0][3:],
+        )
+    ]
+    for num in range(entries):
+        ldif.append(ENTRY_TEMPLATE.format(num=num, suffix=server.suffix))
+    server.ldapadd('\n'.join(ldif))
+
+
+def measure(func):
+    """Returns (result, seconds, blocks, bytes) allocated and retained"""
+    tracemalloc.start()
+    before = tracemalloc.take_snapshot()
+    start = time.perf_counter()
+    result = func()
+    elapsed = time.perf_counter() - start
+    after = tracemalloc.take_snapshot()
+    tracemalloc.stop()
+    stats = after.compare_to(before, 'filename')
+    blocks = sum(stat.count_diff for stat in stats)
+    size = sum(stat.size_diff for stat in stats)
+    return result, elapsed, blocks, size
+
+
+class BenchSlapdObject(SlapdObject):
+    openldap_schema_files = (
+        'core.ldif',
+        'cosine.ldif',
+        'inetorgperson.ldif',
+    )
+
+
+def copy_result(result, fresh_keys):
+    """
+    Copy of result sharing the value lists. With fresh_keys every entry
+    gets its own key objects, without the keys of the result are reused.
+    """
+    if fresh_keys:
+        return [
+            (dn, {k.encode('utf-8').decode('utf-8'): v for k, v in entry.items()})
+            for dn, entry in result
+        ]
+    return [(dn, {k: v for k, v in entry.items()}) for dn, entry in result]
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.split('\n\n')[0])
+    parser.add_argument('--entries', type=int, default=10000)
+    args = parser.parse_args()
+
+    with BenchSlapdObject() as server:
+        seed(server, args.entries)
+        conn = ldap.initialize(server.ldap_uri)
+        conn.simple_bind_s(server.root_dn, server.root_pw)
+
+        result, elapsed, blocks, size = measure(
+            lambda: conn.search_s(
+                server.suffix, ldap.SCOPE_ONELEVEL, '(objectClass=inetOrgPerson)'
+            )
+        )
+        keys = {id(k) for _, entry in result for k in entry}
+        print('search_s: {} entries in {:.3f}s, {} blocks, {} bytes'.format(
+            len(result), elapsed, blocks, size
+        ))
+        print('distinct attribute name objects: {}'.format(len(keys)))
+
+        _, _, blocks_shared, size_shared = measure(
+            lambda: copy_result(result, fresh_keys=False)
+        )
+        _, _, blocks_fresh, size_fresh = measure(
+            lambda: copy_result(result, fresh_keys=True)
+        )
+        print('estimated saving of cached names: {} blocks, {} bytes '
+              '(simulated copies)'.format(
+            blocks_fresh - blocks_shared, size_fresh - size_shared
+        ))
+        conn.unbind_s()
+
+
+if __name__ == '__main__':
+    main()
@@ -0,0 +1,326 @@
+"""
+Benchmark suite for python-ldap
+
+Seeds a throwaway slapd with a configurable number of entries and value
+sizes and measures the throughput of the C extension module and the pure
+Python modules most applications spend their time in. The results can be
+written as JSON and compared with the results of another run, e.g. those
+of the previous release:
+
+    python3 Benchmarks/bench_suite.py --output new.json --compare old.json
+
+See https://www.python-ldap.org/ for details.
+"""
+import argparse
+import gc
+import io
+import json
+import os
+import platform
+import statistics
+import sys
+import time
+
+# Switch off processing .ldaprc or ldap.conf before importing _ldap
+os.environ['LDAPNOINIT'] = '1'
+
+import ldap
+import ldap.dn
+import ldap.modlist
+import ldap.schema
+import ldif
+from slapdtest import SlapdObject
+
+# Version of the JSON format written with --output
+FORMAT_VERSION = 1
+
+ENTRY_TEMPLATE = """dn: cn=user{num},ou=People,{suffix}
+objectClass: inetOrgPerson
+cn: user{num}
+sn: User {num}
+givenName: Test
+mail: user{num}@example.com
+uid: user{num}
+telephoneNumber: +1 555 {num:07d}
+title: Tester
+l: Somewhere
+description: {description}
+"""
+
+
+class BenchSlapdObject(SlapdObject):
+    openldap_schema_files = (
+        'core.ldif',
+        'cosine.ldif',
+        'inetorgperson.ldif',
+    )
+    # logging every operation would dominate the measurements
+    slapd_loglevel = '0'
+
+
+def seed(server, entries, value_size, chunk_size=1000):
+    """
+    Adds the suffix entry, ou=People and entries inetOrgPerson entries
+    below it, each with a description of value_size characters
+    """
+    dc = server.suffix.split(',')[0][3:]
+    server.ldapadd(
+        'dn: {suffix}\nobjectClass: dcObject\nobjectClass: organization\n'
+        'dc: {dc}\no: {dc}\n\n'
+        'dn: ou=People,{suffix}\nobjectClass: organizationalUnit\n'
+        'ou: People\n'.format(suffix=server.suffix, dc=dc)
+    )
+    description = ('benchmark value ' * (value_size // 16 + 1))[:value_size]
+    for start in range(0, entries, chunk_size):
+        server.ldapadd('\n'.join(
+            ENTRY_TEMPLATE.format(
+                num=num, suffix=server.suffix, description=description
+            )
+            for num in range(start, min(start + chunk_size, entries))
+        ))
+
+
+class Context:
+    """
+    State shared by the benchmarks: the server, an authenticated
+    connection and the search result all further benchmarks work on
+    """
+
+    def __init__(self, server, args):
+        self.server = server
+        self.args = args
+        self.base = 'ou=People,' + server.suffix
+        self.filterstr = '(objectClass=inetOrgPerson)'
+        self.conn = self.connect()
+        self.result = self.search_all()
+        self.dns = [dn for dn, _ in self.result]
+        self.ldif = ldif_text(self.result)
+
+    def connect(self):
+        conn = ldap.initialize(self.server.ldap_uri)
+        conn.protocol_version = 3
+        conn.simple_bind_s(self.server.root_dn, self.server.root_pw)
+        return conn
+
+    def search_all(self):
+        return self.conn.search_s(self.base, ldap.SCOPE_ONELEVEL, self.filterstr)
+
+
+def ldif_text(result):
+    f = io.StringIO()
+    ldif.LDIFWriter(f).unparse_results(result)
+    return f.getvalue()
+
+
+def bench_search_s(ctx):
+    """search_s() of all entries, i.e. receiving and converting them"""
+    return len(ctx.search_all())
+
+
+def bench_result4(ctx):
+    """search_ext() and result4() of all entries with controls"""
+    msgid = ctx.conn.search_ext(ctx.base, ldap.SCOPE_ONELEVEL, ctx.filterstr)
+    _, result, _, _ = ctx.conn.result4(msgid, all=1, add_ctrls=1)
+    return len(result)
+
+
+def bench_result4_lazy(ctx):
+    """search_ext() and result4(lazy=1), converting entries on demand"""
+    msgid = ctx.conn.search_ext(ctx.base, ldap.SCOPE_ONELEVEL, ctx.filterstr)
+    _, result, _, _ = ctx.conn.result4(msgid, all=1, lazy=1)
+    return sum(1 for _ in result)
+
+
+def bench_async_search(ctx):
+    """concurrent outstanding searches for single entries"""
+    conn = ctx.conn
+    dns = ctx.dns[:ctx.args.async_searches]
+    msgids = [
+        conn.search_ext(dn, ldap.SCOPE_BASE, '(objectClass=*)')
+        for dn in dns
+    ]
+    for msgid in msgids:
+        conn.result4(msgid, all=1)
+    return len(msgids)
+
+
+def bench_paged_search(ctx):
+    """paged_search_ext() of all entries with Simple Paged Results"""
+    return sum(1 for _ in ctx.conn.paged_search_ext(
+        ctx.base, ldap.SCOPE_ONELEVEL, ctx.filterstr,
+        page_size=ctx.args.page_size,
+    ))
+
+
+def bench_bind(ctx):
+    """simple_bind_s() latency on an existing connection"""
+    for _ in range(ctx.args.binds):
+        ctx.conn.simple_bind_s(ctx.server.root_dn, ctx.server.root_pw)
+    return ctx.args.binds
+
+
+def bench_modlist(ctx):
+    """modifyModlist() between each entry and a modified copy"""
+    for _, entry in ctx.result:
+        new = dict(entry)
+        new['title'] = [b'Senior Tester']
+        new['employeeType'] = [b'benchmark']
+        del new['l']
+        ldap.modlist.modifyModlist(entry, new)
+    return len(ctx.result)
+
+
+def bench_str2dn(ctx):
+    """str2dn() of all DNs of the result"""
+    str2dn = ldap.dn.str2dn
+    for dn in ctx.dns:
+        str2dn(dn)
+    return len(ctx.dns)
+
+
+def bench_ldif_write(ctx):
+    """LDIFWriter.unparse_results() of all entries"""
+    ldif_text(ctx.result)
+    return len(ctx.result)
+
+
+def bench_ldif_parse(ctx):
+    """LDIFRecordList.parse() of all entries"""
+    records = ldif.LDIFRecordList(io.StringIO(ctx.ldif))
+    records.parse()
+    return len(records.all_records)
+
+
+def bench_schema_load(ctx):
+    """reading and parsing the subschema subentry"""
+    subschemasubentry_dn = ctx.conn.search_subschemasubentry_s()
+    entry = ctx.conn.read_subschemasubentry_s(subschemasubentry_dn)
+    ldap.schema.SubSchema(entry)
+    return 1
+
+
+BENCHMARKS = {
+    name[6:]: func
+    for name, func in globals().items()
+    if name.startswith('bench_')
+}
+
+
+def run(func, ctx, repeat):
+    """Returns the dictionary with the timings of repeat runs of func"""
+    times = []
+    for _ in range(repeat):
+        gc.collect()
+        start = time.perf_counter()
+        items = func(ctx)
+        times.append(time.perf_counter() - start)
+    median = statistics.median(times)
+    return {
+        'description': func.__doc__,
+        'items': items,
+        'repeat': repeat,
+        'min': min(times),
+        'median': median,
+        'mean': statistics.mean(times),
+        'stdev': statistics.stdev(times) if repeat > 1 else 0.0,
+        'items_per_second': items / median if median else None,
+    }
+
+
+def metadata(args):
+    """Returns a description of the environment of the run"""
+    return {
+        'format_version': FORMAT_VERSION,
+        'time': time.strftime('%Y-%m-%dT%H:%M:%SZ', time.gmtime()),
+        'python_ldap': ldap.__version__,
+        'api_info': ldap.get_option(ldap.OPT_API_INFO),
+        'python': sys.version,
+        'implementation': platform.python_implementation(),
+        'platform': platform.platform(),
+        'machine': platform.machine(),
+        'entries': args.entries,
+        'value_size': args.value_size,
+        'page_size': args.page_size,
+    }
+
+
+def compare(results, baseline, out):
+    """Prints the medians of results relative to those of baseline"""
+    print('\n{:<20} {:>12} {:>12} {:>8}'.format(
+        'benchmark', 'baseline', 'current', 'ratio'
+    ), file=out)
+    for name, current in results['benchmarks'].items():
+        old = baseline['benchmarks'].get(name)
+        if old is None:
+            print('{:<20} {:>12} {:>12.6f}'.format(
+                name, '-', current['median']
+            ), file=out)
+            continue
+        print('{:<20} {:>12.6f} {:>12.6f} {:>7.2f}x'.format(
+            name, old['median'], current['median'],
+            current['median'] / old['median'] if old['median'] else 0.0,
+        ), file=out)
+    for key in ('entries', 'value_size', 'page_size', 'python_ldap'):
+        if results['metadata'].get(key) != baseline['metadata'].get(key):
+            print('note: {} differs: {!r} != {!r}'.format(
+                key, baseline['metadata'].get(key), results['metadata'].get(key)
+            ), file=out)
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.split('\n\n')[0])
+    parser.add_argument('--entries', type=int, default=10000,
+                        help='number of entries to seed (default: %(default)s)')
+    parser.add_argument('--value-size', type=int, default=64,
+                        help='size of the description values (default: %(default)s)')
+    parser.add_argument('--repeat', type=int, default=5,
+                        help='runs of each benchmark (default: %(default)s)')
+    parser.add_argument('--page-size', type=int, default=500,
+                        help='page size of paged searches (default: %(default)s)')
+    parser.add_argument('--async-searches', type=int, default=1000,
+                        help='searches outstanding at once (default: %(default)s)')
+    parser.add_argument('--binds', type=int, default=200,
+                        help='binds per run (default: %(default)s)')
+    parser.add_argument('--output', metavar='FILE',
+                        help='write the results as JSON to FILE, - for stdout')
+    parser.add_argument('--compare', metavar='FILE',
+                        help='compare the results with those in FILE')
+    parser.add_argument('benchmarks', nargs='*', metavar='BENCHMARK',
+                        help='benchmarks to run (default: all of {})'.format(
+                            ', '.join(BENCHMARKS)))
+    args = parser.parse_args()
+
+    unknown = set(args.benchmarks) - set(BENCHMARKS)
+    if unknown:
+        parser.error('unknown benchmarks: {}'.format(', '.join(sorted(unknown))))
+    names = args.benchmarks or list(BENCHMARKS)
+    # keep stdout clean for the JSON output
+    out = sys.stderr if args.output == '-' else sys.stdout
+
+    results = {'metadata': metadata(args), 'benchmarks': {}}
+    with BenchSlapdObject() as server:
+        seed(server, args.entries, args.value_size)
+        ctx = Context(server, args)
+        for name in names:
+            result = run(BENCHMARKS[name], ctx, args.repeat)
+            results['benchmarks'][name] = result
+            print('{:<20} {:>8} items  median {:.6f}s  {:>12.1f} items/s'.format(
+                name, result['items'], result['median'],
+                result['items_per_second'] or 0.0,
+            ), file=out)
+        ctx.conn.unbind_s()
+
+    if args.output == '-':
+        json.dump(results, sys.stdout, indent=2)
+        sys.stdout.write('\n')
+    elif args.output:
+        with open(args.output, 'w') as f:
+            json.dump(results, f, indent=2)
+            f.write('\n')
+    if args.compare:
+        with open(args.compare) as f:
+            compare(results, json.load(f), out)
+
+
+if __name__ == '__main__':
+    main()
@@ -79,12 +79,12 @@ class LDAPLock:
     self._desc = desc
     self._lock = (lock_class or LDAPLockBaseClass)()
 
-  def acquire(self):
+  def acquire(self,blocking=True):
     if __debug__:
       global _trace_level
       if _trace_level>=self._min_trace_level:
         _trace_file.write('***{}.acquire() {} {}\n'.format(self.__class__.__name__,repr(self),self._desc))
-    return self._lock.acquire()
+    return self._lock.acquire(blocking)
 
   def release(self):
     if __debug__:
@@ -0,0 +1,318 @@
+"""
+ldap.aio - asyncio client driven by the connection's file descriptor
+
+See https://www.python-ldap.org/ for details.
+"""
+
+import asyncio
+
+import ldap
+from ldap.ldapobject import SimpleLDAPObject
+
+from ldap.pkginfo import __version__, __author__, __license__
+
+__all__ = [
+    'AIOLDAPObject',
+]
+
+# end of a search in the queue of _Search
+_DONE = object()
+
+
+class _Operation:
+    """
+    Pending operation which is finished by a single result message.
+    """
+
+    def __init__(self, loop):
+        self.future = loop.create_future()
+
+    def deliver(self, res_type, res_data, res_msgid, res_ctrls):
+        if not self.future.done():
+            self.future.set_result((res_type, res_data, res_msgid, res_ctrls))
+        return True
+
+    def fail(self, exc):
+        if not self.future.done():
+            self.future.set_exception(exc)
+
+    def cancel(self):
+        self.future.cancel()
+
+
+class _Search:
+    """
+    Pending search operation, results are queued until consumed.
+    """
+
+    def __init__(self):
+        self.queue = asyncio.Queue()
+
+    def deliver(self, res_type, res_data, res_msgid, res_ctrls):
+        if res_type in (ldap.RES_SEARCH_ENTRY, ldap.RES_SEARCH_REFERENCE):
+            for item in res_data:
+                self.queue.put_nowait(item)
+            return False
+        elif res_type == ldap.RES_SEARCH_RESULT:
+            self.queue.put_nowait(_DONE)
+            return True
+        # intermediate responses
+        return False
+
+    def fail(self, exc):
+        self.queue.put_nowait(exc)
+
+    def cancel(self):
+        self.queue.put_nowait(asyncio.CancelledError())
+
+
+class AIOLDAPObject:
+    """
+    asyncio client for one LDAP connection
+
+    Operations are sent with the asynchronous methods of a
+    :py:class:`ldap.ldapobject.SimpleLDAPObject` and their results are
+    read whenever the connection's socket becomes readable, by a reader
+    registered with :py:meth:`asyncio.loop.add_reader()`. Any number of
+    operations may be outstanding at the same time on one connection,
+    without a thread per operation.
+
+    ``uri`` and any keyword arguments are passed to ``ldap_object_class``
+    unless an already initialized ``ldap_object`` is passed. Note that the
+    connection itself is opened synchronously by the first operation.
+
+    ``batch_size`` is the maximum number of messages fetched with one call
+    of :py:meth:`ldap.ldapobject.SimpleLDAPObject.result_batch()`.
+
+    ``loop`` is the event loop to use, by default the loop running when
+    the first operation is started.
+    """
+
+    ldap_object_class = SimpleLDAPObject
+
+    def __init__(
+        self, uri=None, ldap_object=None, loop=None, batch_size=100, **kwargs
+    ):
+        if ldap_object is None:
+            ldap_object = self.ldap_object_class(uri, **kwargs)
+        self._l = ldap_object
+        self._loop = loop
+        self._batch_size = batch_size
+        self._pending = {}
+        self._fd = None
+
+    @property
+    def ldap_object(self):
+        """
+        The wrapped LDAPObject, e.g. for setting options.
+        """
+        return self._l
+
+    async def __aenter__(self):
+        return self
+
+    async def __aexit__(self, exc_type, exc_value, traceback):
+        self.unbind()
+
+    def _get_loop(self):
+        """
+        Returns the event loop, looked up on first use from a coroutine
+        """
+        if self._loop is None:
+            self._loop = asyncio.get_running_loop()
+        return self._loop
+
+    def _register(self, msgid, operation):
+        """
+        Tracks operation until the final result for msgid has been read.
+        """
+        self._pending[msgid] = operation
+        if self._fd is None:
+            # the socket exists as soon as a request has been sent
+            self._fd = self._l.fileno()
+            self._get_loop().add_reader(self._fd, self._on_readable)
+
+    def _remove_reader(self):
+        if self._fd is not None:
+            self._loop.remove_reader(self._fd)
+            self._fd = None
+
+    def _fail_all(self, exc=None):
+        """
+        Fails all pending operations with exc, or cancels them if None.
+        """
+        pending, self._pending = self._pending, {}
+        for operation in pending.values():
+            if exc is None:
+                operation.cancel()
+            else:
+                operation.fail(exc)
+
+    def _on_readable(self):
+        """
+        Reads all results which have arrived and hands them to the
+        pending operations.
+        """
+        while True:
+            try:
+                batch = self._l.result_batch(
+                    ldap.RES_ANY, self._batch_size, 0
+                )
+            except ldap.LDAPError as exc:
+                try:
+                    msgid = exc.args[0]['msgid']
+                except (IndexError, KeyError, TypeError):
+                    # not related to a single operation, e.g SERVER_DOWN
+                    self._remove_reader()
+                    self._fail_all(exc)
+                    return
+                operation = self._pending.pop(msgid, None)
+                if operation is not None:
+                    operation.fail(exc)
+                continue
+            if not batch:
+                return
+            for res_type, res_data, res_msgid, res_ctrls in batch:
+                operation = self._pending.get(res_msgid)
+                if operation is None:
+                    # abandoned or unsolicited notification
+                    continue
+                if operation.deliver(res_type, res_data, res_msgid, res_ctrls):
+                    del self._pending[res_msgid]
+
+    def _abandon(self, msgid):
+        if self._pending.pop(msgid, None) is not None:
+            try:
+                self._l.abandon(msgid)
+            except ldap.LDAPError:
+                pass
+
+    async def result(self, msgid):
+        """
+        Waits for the result of an operation started with one of the
+        asynchronous methods of the wrapped LDAPObject, except search
+        operations, and returns (res_type, res_data, res_msgid, res_ctrls)
+        like :py:meth:`ldap.ldapobject.SimpleLDAPObject.result3()`.
+
+        The operation is abandoned if the waiting task is cancelled.
+        """
+        operation = _Operation(self._get_loop())
+        self._register(msgid, operation)
+        try:
+            return await operation.future
+        except asyncio.CancelledError:
+            self._abandon(msgid)
+            raise
+
+    async def simple_bind(self, who=None, cred=None, serverctrls=None, clientctrls=None):
+        """
+        See :py:meth:`ldap.ldapobject.SimpleLDAPObject.simple_bind_s()`
+        """
+        msgid = self._l.simple_bind(who, cred, serverctrls, clientctrls)
+        return await self.result(msgid)
+
+    async def add(self, dn, modlist, serverctrls=None, clientctrls=None):
+        """
+        See :py:meth:`ldap.ldapobject.SimpleLDAPObject.add_ext_s()`
+        """
+        msgid = self._l.add_ext(dn, modlist, serverctrls, clientctrls)
+        return await self.result(msgid)
+
+    async def modify(self, dn, modlist, serverctrls=None, clientctrls=None):
+        """
+        See :py:meth:`ldap.ldapobject.SimpleLDAPObject.modify_ext_s()`
+        """
+        msgid = self._l.modify_ext(dn, modlist, serverctrls, clientctrls)
+        return await self.result(msgid)
+
+    async def delete(self, dn, serverctrls=None, clientctrls=None):
+        """
+        See :py:meth:`ldap.ldapobject.SimpleLDAPObject.delete_ext_s()`
+        """
+        msgid = self._l.delete_ext(dn, serverctrls, clientctrls)
+        return await self.result(msgid)
+
+    async def rename(self, dn, newrdn, newsuperior=None, delold=1, serverctrls=None, clientctrls=None):
+        """
+        See :py:meth:`ldap.ldapobject.SimpleLDAPObject.rename_s()`
+        """
+        msgid = self._l.rename(dn, newrdn, newsuperior, delold, serverctrls, clientctrls)
+        return await self.result(msgid)
+
+    async def compare(self, dn, attr, value, serverctrls=None, clientctrls=None):
+        """
+        Returns True or False,
+        see :py:meth:`ldap.ldapobject.SimpleLDAPObject.compare_ext_s()`
+        """
+        msgid = self._l.compare_ext(dn, attr, value, serverctrls, clientctrls)
+        try:
+            await self.result(msgid)
+        except ldap.COMPARE_TRUE:
+            return True
+        except ldap.COMPARE_FALSE:
+            return False
+        raise ldap.PROTOCOL_ERROR(
+            'Compare operation returned wrong result: {!r}'.format(msgid)
+        )
+
+    async def search_iter(
+        self, base, scope, filterstr=None, attrlist=None, attrsonly=0,
+        serverctrls=None, clientctrls=None, timeout=-1, sizelimit=0
+    ):
+        """
+        Asynchronous generator yielding the (dn, entry) tuples of a search
+        as they arrive, and (None, [url, ...]) for search references.
+
+        The arguments are the same as for
+        :py:meth:`ldap.ldapobject.SimpleLDAPObject.search_ext()`.
+        The search is abandoned if the generator is closed early.
+        """
+        msgid = self._l.search_ext(
+            base, scope, filterstr, attrlist, attrsonly,
+            serverctrls, clientctrls, timeout, sizelimit
+        )
+        search = _Search()
+        self._register(msgid, search)
+        try:
+            while True:
+                item = await search.queue.get()
+                if item is _DONE:
+                    return
+                if isinstance(item, BaseException):
+                    raise item
+                yield item
+        finally:
+            self._abandon(msgid)
+
+    async def search(
+        self, base, scope, filterstr=None, attrlist=None, attrsonly=0,
+        serverctrls=None, clientctrls=None, timeout=-1, sizelimit=0
+    ):
+        """
+        Returns the list of search results,
+        see :py:meth:`ldap.ldapobject.SimpleLDAPObject.search_ext_s()`
+        """
+        return [
+            item
+            async for item in self.search_iter(
+                base, scope, filterstr, attrlist, attrsonly,
+                serverctrls, clientctrls, timeout, sizelimit
+            )
+        ]
+
+    def abandon(self, msgid):
+        """
+        Abandons an outstanding operation, waiting tasks are cancelled.
+        """
+        operation = self._pending.get(msgid)
+        self._abandon(msgid)
+        if operation is not None:
+            operation.cancel()
+
+    def unbind(self):
+        """
+        Closes the connection, outstanding operations are cancelled.
+        """
+        self._remove_reader()
+        self._fail_all()
+        self._l.unbind_ext()
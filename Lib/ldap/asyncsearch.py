@@ -46,6 +46,16 @@ class AsyncSearchHandler:
     LDAPObject instance
   """
 
+  # maximum number of messages fetched with one call of
+  # LDAPObject.result_batch()
+  batchSize = 100
+
+  # high-water marks of the number and BER size of messages held back
+  # while other operations are read on the same connection, see
+  # LDAPObject.set_flow_control(), 0 means no limit
+  maxBufferedEntries = 0
+  maxBufferedBytes = 0
+
   def __init__(self,l):
     self._l = l
     self._msgId = None
@@ -88,9 +98,21 @@ class AsyncSearchHandler:
       searchRoot,searchScope,filterStr,
       attrList,attrsOnly,serverctrls,clientctrls,timeout,sizelimit
     )
+    if self.maxBufferedEntries or self.maxBufferedBytes:
+      self._l.set_flow_control(
+        self._msgId,self.maxBufferedEntries,self.maxBufferedBytes
+      )
     self._afterFirstResult = 1
     return # startSearch()
 
+  def flowControl(self):
+    """
+    Returns the state of flow control of the search as returned by
+    LDAPObject.flow_control(), or None if maxBufferedEntries and
+    maxBufferedBytes are not set or the search has ended
+    """
+    return self._l.flow_control(self._msgId)
+
   def preProcessing(self):
     """
     Do anything you want after starting search but
@@ -126,30 +148,33 @@ class AsyncSearchHandler:
     self.beginResultsDropped = 0
     self.endResultBreak = result_counter
     try:
-      result_type,result_list = None,None
       while go_ahead:
-        while result_type is None and not result_list:
-          result_type,result_list,result_msgid,result_serverctrls = self._l.result3(self._msgId,0,timeout)
+        batch = []
+        while not batch:
+          batch = self._l.result_batch(self._msgId,self.batchSize,timeout)
           if self._afterFirstResult:
             self.afterFirstResult()
             self._afterFirstResult = 0
-        if not result_list:
-          break
-        if result_type not in SEARCH_RESULT_TYPES:
-          raise WrongResultType(result_type,SEARCH_RESULT_TYPES)
-        # Loop over list of search results
-        for result_item in result_list:
-          if result_counter<ignoreResultsNumber:
-            self.beginResultsDropped = self.beginResultsDropped+1
-          elif processResultsCount==0 or result_counter<end_result_counter:
-            self._processSingleResult(result_type,result_item)
-          else:
+        for result_type,result_list,result_msgid,result_serverctrls in batch:
+          if not result_list:
             go_ahead = 0 # break-out from while go_ahead
-            partial = 1
-            break # break-out from this for-loop
-          result_counter = result_counter+1
-        result_type,result_list = None,None
-        self.endResultBreak = result_counter
+            break
+          if result_type not in SEARCH_RESULT_TYPES:
+            raise WrongResultType(result_type,SEARCH_RESULT_TYPES)
+          # Loop over list of search results
+          for result_item in result_list:
+            if result_counter<ignoreResultsNumber:
+              self.beginResultsDropped = self.beginResultsDropped+1
+            elif processResultsCount==0 or result_counter<end_result_counter:
+              self._processSingleResult(result_type,result_item)
+            else:
+              go_ahead = 0 # break-out from while go_ahead
+              partial = 1
+              break # break-out from this for-loop
+            result_counter = result_counter+1
+          self.endResultBreak = result_counter
+          if not go_ahead:
+            break
     finally:
       if partial and self._msgId!=None:
         self._l.abandon(self._msgId)
@@ -274,7 +299,7 @@ class LDIFWriter(FileWriter):
     if isinstance(writer_obj,ldif.LDIFWriter):
       self._ldif_writer = writer_obj
     else:
-      self._ldif_writer = ldif.LDIFWriter(writer_obj)
+      self._ldif_writer = ldif.LDIFWriter(writer_obj,native=True)
     FileWriter.__init__(self,l,self._ldif_writer._output_file,headerStr,footerStr)
 
   def _processSingleResult(self,resultType,resultItem):
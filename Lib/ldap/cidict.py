@@ -10,6 +10,8 @@ import warnings
 from collections.abc import MutableMapping
 from ldap import __version__
 
+from _ldap import CIDict
+
 
 class cidict(MutableMapping):
     """
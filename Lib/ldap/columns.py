@@ -0,0 +1,142 @@
+"""
+ldap.columns - search results stored by attribute instead of by entry
+
+See https://www.python-ldap.org/ for details.
+"""
+
+from ldap.cidict import cidict
+
+from ldap.pkginfo import __version__, __author__, __license__
+
+__all__ = [
+    'ColumnarResult',
+]
+
+
+def _offsets(buf):
+    return memoryview(buf).cast('q')
+
+
+class ColumnarResult:
+    """
+    Search result as returned by
+    :py:meth:`ldap.ldapobject.SimpleLDAPObject.search_columns_s()`
+
+    The DNs and the values of each requested attribute type are kept in a
+    few flat buffers laid out like Apache Arrow arrays, so that no Python
+    objects are created per entry or value unless asked for. Offsets are
+    64-bit integers in native byte order, i.e. like Arrow's
+    ``large_string`` and ``large_list<large_binary>`` types on
+    little-endian machines.
+
+    ``len()`` returns the number of entries. Search references are not
+    part of the result. The response controls of the search result are
+    in :py:attr:`ctrls`.
+    """
+
+    def __init__(self, count, dns, columns, ctrls):
+        self._count = count
+        self._dns = dns
+        self._columns = cidict(columns)
+        self.ctrls = ctrls
+
+    def __len__(self):
+        return self._count
+
+    def __repr__(self):
+        return '<{} entries={} attrs={!r}>'.format(
+            self.__class__.__name__, self._count, self.attrs
+        )
+
+    @property
+    def attrs(self):
+        """List of the attribute names as requested"""
+        return list(self._columns.keys())
+
+    def dn_buffers(self):
+        """
+        Returns (offsets, data) of the DN column: DN i is the UTF-8
+        encoded data[offsets[i]:offsets[i+1]]. offsets is a memoryview
+        of 64-bit integers, data a bytes object.
+        """
+        offsets, data = self._dns
+        return _offsets(offsets), data
+
+    def buffers(self, attr):
+        """
+        Returns (list_offsets, value_offsets, data) of the column of
+        attribute type attr, matched case-insensitively: the values of
+        entry i are the indexes list_offsets[i] to list_offsets[i+1],
+        value j is data[value_offsets[j]:value_offsets[j+1]]. The offsets
+        are memoryviews of 64-bit integers, data is a bytes object.
+        """
+        list_offsets, value_offsets, data = self._columns[attr]
+        return _offsets(list_offsets), _offsets(value_offsets), data
+
+    def dns(self):
+        """Returns the list of DNs as str"""
+        offsets, data = self.dn_buffers()
+        return [
+            data[offsets[i]:offsets[i + 1]].decode('utf-8')
+            for i in range(self._count)
+        ]
+
+    def values(self, attr):
+        """
+        Returns a list with the list of bytes values of attr for each
+        entry, empty if an entry does not have attr
+        """
+        list_offsets, value_offsets, data = self.buffers(attr)
+        values = [
+            data[value_offsets[j]:value_offsets[j + 1]]
+            for j in range(len(value_offsets) - 1)
+        ]
+        return [
+            values[list_offsets[i]:list_offsets[i + 1]]
+            for i in range(self._count)
+        ]
+
+    def entries(self):
+        """
+        Returns the result as list of (dn, entry) tuples like
+        :py:meth:`ldap.ldapobject.SimpleLDAPObject.search_s()`, without
+        the attributes an entry does not have
+        """
+        columns = [(attr, self.values(attr)) for attr in self.attrs]
+        result = []
+        for i, dn in enumerate(self.dns()):
+            entry = {}
+            for attr, values in columns:
+                if values[i]:
+                    entry[attr] = values[i]
+            result.append((dn, entry))
+        return result
+
+    def to_arrow(self):
+        """
+        Returns a :py:class:`pyarrow.Table` with a ``dn`` column of type
+        ``large_string`` and one column of type
+        ``large_list<large_binary>`` per attribute, sharing the buffers
+        without copying them. Requires pyarrow.
+        """
+        import pyarrow as pa
+
+        offsets, data = self._dns
+        names = ['dn']
+        arrays = [pa.Array.from_buffers(
+            pa.large_string(), self._count,
+            [None, pa.py_buffer(offsets), pa.py_buffer(data)],
+        )]
+        for attr in self.attrs:
+            list_offsets, value_offsets, data = self._columns[attr]
+            nvalues = len(value_offsets) // 8 - 1
+            values = pa.Array.from_buffers(
+                pa.large_binary(), nvalues,
+                [None, pa.py_buffer(value_offsets), pa.py_buffer(data)],
+            )
+            names.append(attr)
+            arrays.append(pa.Array.from_buffers(
+                pa.large_list(pa.large_binary()), self._count,
+                [None, pa.py_buffer(list_offsets)], children=[values],
+            ))
+        return pa.Table.from_arrays(arrays, names=names)
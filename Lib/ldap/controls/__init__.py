@@ -144,7 +144,7 @@ def DecodeControlTuples(ldapControlTuples,knownLDAPControls=None):
       control.controlType,control.criticality = controlType,criticality
       try:
         control.decodeControlValue(encodedControlValue)
-      except PyAsn1Error:
+      except (PyAsn1Error,ldap.DECODING_ERROR):
         if criticality:
           raise
       else:
@@ -10,12 +10,12 @@ __all__ = [
   'DereferenceControl',
 ]
 
+import _ldap
 import ldap.controls
 from ldap.controls import LDAPControl,KNOWN_RESPONSE_CONTROLS
 
 import pyasn1_modules.rfc2251
 from pyasn1.type import namedtype,univ,tag
-from pyasn1.codec.ber import encoder,decoder
 from pyasn1_modules.rfc2251 import LDAPDN,AttributeDescription,AttributeDescriptionList,AttributeValue
 
 
@@ -99,20 +99,15 @@ class DereferenceControl(LDAPControl):
     return deref_specs
 
   def encodeControlValue(self):
-    return encoder.encode(self._derefSpecs())
+    return _ldap.encode_deref_control(list(self.derefSpecs.items()))
 
   def decodeControlValue(self,encodedControlValue):
-    decodedValue,_ = decoder.decode(encodedControlValue,asn1Spec=DerefResultControlValue())
     self.derefRes = {}
-    for deref_res in decodedValue:
-      deref_attr,deref_val,deref_vals = deref_res[0],deref_res[1],deref_res[2]
-      partial_attrs_dict = {
-        str(tv[0]): [str(v) for v in tv[1]]
-        for tv in deref_vals or []
-      }
+    for deref_attr,deref_val,partial_attrs_dict in \
+        _ldap.decode_deref_control(encodedControlValue):
       try:
-        self.derefRes[str(deref_attr)].append((str(deref_val),partial_attrs_dict))
+        self.derefRes[deref_attr].append((deref_val,partial_attrs_dict))
       except KeyError:
-        self.derefRes[str(deref_attr)] = [(str(deref_val),partial_attrs_dict)]
+        self.derefRes[deref_attr] = [(deref_val,partial_attrs_dict)]
 
 KNOWN_RESPONSE_CONTROLS[DereferenceControl.controlType] = DereferenceControl
@@ -9,13 +9,14 @@ __all__ = [
   'SimplePagedResultsControl'
 ]
 
+import _ldap
+
 # Imports from python-ldap 2.4+
 import ldap.controls
 from ldap.controls import RequestControl,ResponseControl,KNOWN_RESPONSE_CONTROLS
 
 # Imports from pyasn1
 from pyasn1.type import tag,namedtype,univ,constraint
-from pyasn1.codec.ber import encoder,decoder
 from pyasn1_modules.rfc2251 import LDAPString
 
 
@@ -35,15 +36,10 @@ class SimplePagedResultsControl(RequestControl,ResponseControl):
     self.cookie = cookie or ''
 
   def encodeControlValue(self):
-    pc = PagedResultsControlValue()
-    pc.setComponentByName('size',univ.Integer(self.size))
-    pc.setComponentByName('cookie',LDAPString(self.cookie))
-    return encoder.encode(pc)
+    return _ldap.encode_page_control(self.size,self.cookie)
 
   def decodeControlValue(self,encodedControlValue):
-    decodedValue,_ = decoder.decode(encodedControlValue,asn1Spec=PagedResultsControlValue())
-    self.size = int(decodedValue.getComponentByName('size'))
-    self.cookie = bytes(decodedValue.getComponentByName('cookie'))
+    self.size,self.cookie = _ldap.decode_page_control(encodedControlValue)
 
 
 KNOWN_RESPONSE_CONTROLS[SimplePagedResultsControl.controlType] = SimplePagedResultsControl
@@ -9,6 +9,8 @@ __all__ = [
   'PasswordPolicyControl'
 ]
 
+import _ldap
+
 # Imports from python-ldap 2.4+
 from ldap.controls import (
   ResponseControl, ValueLessRequestControl, KNOWN_RESPONSE_CONTROLS
@@ -16,7 +18,6 @@ from ldap.controls import (
 
 # Imports from pyasn1
 from pyasn1.type import tag,namedtype,namedval,univ,constraint
-from pyasn1.codec.der import decoder
 
 
 class PasswordPolicyWarning(univ.Choice):
@@ -86,19 +87,8 @@ class PasswordPolicyControl(ValueLessRequestControl,ResponseControl):
     self.error = None
 
   def decodeControlValue(self,encodedControlValue):
-    ppolicyValue,_ = decoder.decode(encodedControlValue,asn1Spec=PasswordPolicyResponseValue())
-    warning = ppolicyValue.getComponentByName('warning')
-    if warning.hasValue():
-      if 'timeBeforeExpiration' in warning:
-        self.timeBeforeExpiration = int(
-          warning.getComponentByName('timeBeforeExpiration'))
-      if 'graceAuthNsRemaining' in warning:
-        self.graceAuthNsRemaining = int(
-          warning.getComponentByName('graceAuthNsRemaining'))
-
-    error = ppolicyValue.getComponentByName('error')
-    if error.hasValue():
-      self.error = int(error)
+    self.timeBeforeExpiration,self.graceAuthNsRemaining,self.error = \
+      _ldap.decode_ppolicy_control(encodedControlValue)
 
 
 KNOWN_RESPONSE_CONTROLS[PasswordPolicyControl.controlType] = PasswordPolicyControl
@@ -12,13 +12,14 @@ __all__ = [
   'CHANGE_TYPES_STR',
 ]
 
+import _ldap
+
 # Imports from python-ldap 2.4+
 import ldap.controls
 from ldap.controls import RequestControl,ResponseControl,KNOWN_RESPONSE_CONTROLS
 
 # Imports from pyasn1
 from pyasn1.type import namedtype,namedval,univ,constraint
-from pyasn1.codec.ber import encoder,decoder
 from pyasn1_modules.rfc2251 import LDAPDN
 
 #---------------------------------------------------------------------------
@@ -69,11 +70,7 @@ class PersistentSearchControl(RequestControl):
       for ct in self.changeTypes:
         changeTypes_int = changeTypes_int|CHANGE_TYPES_INT.get(ct,ct)
       self.changeTypes = changeTypes_int
-    p = self.PersistentSearchControlValue()
-    p.setComponentByName('changeTypes',univ.Integer(self.changeTypes))
-    p.setComponentByName('changesOnly',univ.Boolean(self.changesOnly))
-    p.setComponentByName('returnECs',univ.Boolean(self.returnECs))
-    return encoder.encode(p)
+    return _ldap.encode_psearch_control(self.changeTypes,self.changesOnly,self.returnECs)
 
 
 class ChangeType(univ.Enumerated):
@@ -112,18 +109,8 @@ class EntryChangeNotificationControl(ResponseControl):
   controlType = "2.16.840.1.113730.3.4.7"
 
   def decodeControlValue(self,encodedControlValue):
-    ecncValue,_ = decoder.decode(encodedControlValue,asn1Spec=EntryChangeNotificationValue())
-    self.changeType = int(ecncValue.getComponentByName('changeType'))
-    previousDN = ecncValue.getComponentByName('previousDN')
-    if previousDN.hasValue():
-      self.previousDN = str(previousDN)
-    else:
-      self.previousDN = None
-    changeNumber = ecncValue.getComponentByName('changeNumber')
-    if changeNumber.hasValue():
-      self.changeNumber = int(changeNumber)
-    else:
-      self.changeNumber = None
+    self.changeType,self.previousDN,self.changeNumber = \
+      _ldap.decode_entrychange_control(encodedControlValue)
     return (self.changeType,self.previousDN,self.changeNumber)
 
 KNOWN_RESPONSE_CONTROLS[EntryChangeNotificationControl.controlType] = EntryChangeNotificationControl
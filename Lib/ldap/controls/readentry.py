@@ -5,13 +5,11 @@ ldap.controls.readentry - classes for the Read Entry controls
 See https://www.python-ldap.org/ for project details.
 """
 
+import _ldap
 import ldap
 
-from pyasn1.codec.ber import encoder,decoder
 from ldap.controls import LDAPControl,KNOWN_RESPONSE_CONTROLS
 
-from pyasn1_modules.rfc2251 import AttributeDescriptionList,SearchResultEntry
-
 
 class ReadEntryControl(LDAPControl):
   """
@@ -32,17 +30,10 @@ class ReadEntryControl(LDAPControl):
     self.criticality,self.attrList,self.entry = criticality,attrList or [],None
 
   def encodeControlValue(self):
-    attributeSelection = AttributeDescriptionList()
-    for i in range(len(self.attrList)):
-      attributeSelection.setComponentByPosition(i,self.attrList[i])
-    return encoder.encode(attributeSelection)
+    return _ldap.encode_readentry_control(self.attrList)
 
   def decodeControlValue(self,encodedControlValue):
-    decodedEntry,_ = decoder.decode(encodedControlValue,asn1Spec=SearchResultEntry())
-    self.dn = str(decodedEntry[0])
-    self.entry = {}
-    for attr in decodedEntry[1]:
-      self.entry[str(attr[0])] = [ bytes(attr_value) for attr_value in attr[1] ]
+    self.dn,self.entry = _ldap.decode_readentry_control(encodedControlValue)
 
 
 class PreReadControl(ReadEntryControl):
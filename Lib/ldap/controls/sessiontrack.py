@@ -5,10 +5,11 @@ ldap.controls.sessiontrack - class for session tracking control
 See https://www.python-ldap.org/ for project details.
 """
 
+import _ldap
+
 from ldap.controls import RequestControl
 
 from pyasn1.type import namedtype,univ
-from pyasn1.codec.ber import encoder
 from pyasn1_modules.rfc2251 import LDAPString,LDAPOID
 
 
@@ -53,9 +54,9 @@ class SessionTrackingControl(RequestControl):
       sessionSourceIp,sessionSourceName,formatOID,sessionTrackingIdentifier
 
   def encodeControlValue(self):
-    s = self.SessionIdentifierControlValue()
-    s.setComponentByName('sessionSourceIp',LDAPString(self.sessionSourceIp))
-    s.setComponentByName('sessionSourceName',LDAPString(self.sessionSourceName))
-    s.setComponentByName('formatOID',LDAPOID(self.formatOID))
-    s.setComponentByName('sessionTrackingIdentifier',LDAPString(self.sessionTrackingIdentifier))
-    return encoder.encode(s)
+    return _ldap.encode_sessiontrack_control(
+      self.sessionSourceIp,
+      self.sessionSourceName,
+      self.formatOID,
+      self.sessionTrackingIdentifier,
+    )
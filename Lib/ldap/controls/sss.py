@@ -13,13 +13,13 @@ __all__ = [
 
 import sys
 
+import _ldap
 import ldap
 from ldap.ldapobject import LDAPObject
 from ldap.controls import (RequestControl, ResponseControl,
         KNOWN_RESPONSE_CONTROLS, DecodeControlTuples)
 
 from pyasn1.type import univ, namedtype, tag, namedval, constraint
-from pyasn1.codec.ber import encoder, decoder
 
 
 #    SortKeyList ::= SEQUENCE OF SEQUENCE {
@@ -64,10 +64,12 @@ class SSSRequestControl(RequestControl):
             rule = rule.split(':')
             assert len(rule) < 3, 'syntax for ordering rule: [-]<attribute-type>[:ordering-rule]'
 
-    def asn1(self):
-        p = SortKeyListType()
-        for i, rule in enumerate(self.ordering_rules):
-            q = SortKeyType()
+    def _sort_keys(self):
+        """
+        Returns list of (attributeType, orderingRule, reverseOrder) tuples
+        """
+        sort_keys = []
+        for rule in self.ordering_rules:
             reverse_order = rule.startswith('-')
             if reverse_order:
                 rule = rule[1:]
@@ -75,6 +77,14 @@ class SSSRequestControl(RequestControl):
                 attribute_type, ordering_rule = rule.split(':')
             else:
                 attribute_type, ordering_rule = rule, None
+            sort_keys.append((attribute_type, ordering_rule, reverse_order))
+        return sort_keys
+
+    def asn1(self):
+        p = SortKeyListType()
+        for i, (attribute_type, ordering_rule, reverse_order) in \
+                enumerate(self._sort_keys()):
+            q = SortKeyType()
             q.setComponentByName('attributeType', attribute_type)
             if ordering_rule:
                 q.setComponentByName('orderingRule', ordering_rule)
@@ -84,7 +94,7 @@ class SSSRequestControl(RequestControl):
         return p
 
     def encodeControlValue(self):
-        return encoder.encode(self.asn1())
+        return _ldap.encode_sss_control(self._sort_keys())
 
 
 class SortResultType(univ.Sequence):
@@ -118,15 +128,8 @@ class SSSResponseControl(ResponseControl):
         ResponseControl.__init__(self,self.controlType,criticality)
 
     def decodeControlValue(self, encoded):
-        p, rest = decoder.decode(encoded, asn1Spec=SortResultType())
-        assert not rest, 'all data could not be decoded'
-        sort_result = p.getComponentByName('sortResult')
-        self.sortResult = int(sort_result)
-        attribute_type = p.getComponentByName('attributeType')
-        if attribute_type.hasValue():
-            self.attributeType = attribute_type
-        else:
-            self.attributeType = None
+        self.sortResult, self.attributeType = \
+            _ldap.decode_sss_control(encoded)
         # backward compatibility class attributes
         self.result = self.sortResult
         self.attribute_type_error = self.attributeType
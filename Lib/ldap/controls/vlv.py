@@ -10,13 +10,13 @@ __all__ = [
   'VLVResponseControl',
 ]
 
+import _ldap
 import ldap
 from ldap.ldapobject import LDAPObject
 from ldap.controls import (RequestControl, ResponseControl,
         KNOWN_RESPONSE_CONTROLS, DecodeControlTuples)
 
 from pyasn1.type import univ, namedtype, tag, namedval, constraint
-from pyasn1.codec.ber import encoder, decoder
 
 
 class ByOffsetType(univ.Sequence):
@@ -70,23 +70,19 @@ class VLVRequestControl(RequestControl):
         self.context_id = context_id
 
     def encodeControlValue(self):
-        p = VirtualListViewRequestType()
-        p.setComponentByName('beforeCount', self.before_count)
-        p.setComponentByName('afterCount', self.after_count)
         if self.offset is not None and self.content_count is not None:
-            by_offset = ByOffsetType()
-            by_offset.setComponentByName('offset', self.offset)
-            by_offset.setComponentByName('contentCount', self.content_count)
-            target = TargetType()
-            target.setComponentByName('byOffset', by_offset)
+            offset, content_count = self.offset, self.content_count
+            greater_than_or_equal = None
         elif self.greater_than_or_equal:
-            target = TargetType()
-            target.setComponentByName('greaterThanOrEqual',
-                    self.greater_than_or_equal)
+            offset, content_count = 0, 0
+            greater_than_or_equal = self.greater_than_or_equal
         else:
             raise NotImplementedError
-        p.setComponentByName('target', target)
-        return encoder.encode(p)
+        # contextID is not sent, as before
+        return _ldap.encode_vlv_control(
+            self.before_count, self.after_count, offset, content_count,
+            greater_than_or_equal, None,
+        )
 
 KNOWN_RESPONSE_CONTROLS[VLVRequestControl.controlType] = VLVRequestControl
 
@@ -122,15 +118,11 @@ class VLVResponseControl(ResponseControl):
         ResponseControl.__init__(self,self.controlType,criticality)
 
     def decodeControlValue(self,encoded):
-        p, rest = decoder.decode(encoded, asn1Spec=VirtualListViewResponseType())
-        assert not rest, 'all data could not be decoded'
-        self.targetPosition = int(p.getComponentByName('targetPosition'))
-        self.contentCount = int(p.getComponentByName('contentCount'))
-        virtual_list_view_result = p.getComponentByName('virtualListViewResult')
-        self.virtualListViewResult = int(virtual_list_view_result)
-        context_id = p.getComponentByName('contextID')
-        if context_id.hasValue():
-            self.contextID = str(context_id)
+        (self.targetPosition, self.contentCount, self.virtualListViewResult,
+         context_id) = _ldap.decode_vlv_control(encoded)
+        if context_id is not None:
+            # str like the former pyasn1 OctetString
+            self.contextID = context_id.decode('latin-1')
         else:
             self.contextID = None
         # backward compatibility class attributes
@@ -17,21 +17,9 @@ def escape_dn_chars(s):
   Escape all DN special characters found in s
   with a back-slash (see RFC 4514, section 2.4)
   """
-  if s:
-    s = s.replace('\\','\\\\')
-    s = s.replace(',' ,'\\,')
-    s = s.replace('+' ,'\\+')
-    s = s.replace('"' ,'\\"')
-    s = s.replace('<' ,'\\<')
-    s = s.replace('>' ,'\\>')
-    s = s.replace(';' ,'\\;')
-    s = s.replace('=' ,'\\=')
-    s = s.replace('\000' ,'\\\000')
-    if s[-1]==' ':
-      s = ''.join((s[:-1],'\\ '))
-    if s[0]=='#' or s[0]==' ':
-      s = ''.join(('\\',s))
-  return s
+  if not s:
+    return s
+  return _ldap.escape_dn_chars(s)
 
 
 def str2dn(dn,flags=0):
@@ -48,18 +36,61 @@ def str2dn(dn,flags=0):
   return ldap.functions._ldap_function_call(None,_ldap.str2dn,dn,flags)
 
 
+def str2dn_batch(dns,flags=0):
+  """
+  Like str2dn() but takes a list of DNs and returns a list with
+  the decomposed DNs in the same order. All DNs are parsed in one call
+  to the C extension module.
+
+  Raises ldap.DECODING_ERROR if any of the DNs is invalid.
+  """
+  return ldap.functions._ldap_function_call(None,_ldap.str2dn_batch,dns,flags)
+
+
+def set_dn_cache_size(maxsize):
+  """
+  Sets the maximum number of str2dn() results kept in a least recently
+  used cache for str2dn() and str2dn_batch(). 0 disables and clears
+  the cache, which is the default.
+  """
+  return _ldap.set_dn_cache_size(maxsize)
+
+
+def dn_cache_info():
+  """
+  Returns a dictionary with the keys 'hits', 'misses', 'maxsize' and
+  'currsize' describing the str2dn() cache.
+  """
+  return _ldap.dn_cache_info()
+
+
 def dn2str(dn):
   """
   This function takes a decomposed DN as parameter and returns
   a single string. It's the inverse to str2dn() but will always
   return a DN in LDAPv3 format compliant to RFC 4514.
   """
-  return ','.join([
-    '+'.join([
-      '='.join((atype,escape_dn_chars(avalue or '')))
-      for atype,avalue,dummy in rdn])
-    for rdn in dn
-  ])
+  return _ldap.dn2str(dn)
+
+
+def normalize_dn(dn,flags=0):
+  """
+  Returns a normalised string form of dn which is equal for DNs
+  only differing in the case of ASCII letters, the order of the AVAs
+  within multi-valued RDNs or optional white-space.
+
+  The result is a str suitable as dictionary key or set member.
+  """
+  return ldap.functions._ldap_function_call(None,_ldap.normalize_dn,dn,flags)
+
+
+def normalize_dn_batch(dns,flags=0):
+  """
+  Like normalize_dn() but takes a list of DNs and returns a list
+  of normalised DNs in the same order.
+  """
+  return ldap.functions._ldap_function_call(None,_ldap.normalize_dn_batch,dns,flags)
+
 
 def explode_dn(dn, notypes=False, flags=0):
   """
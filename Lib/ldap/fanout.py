@@ -0,0 +1,257 @@
+"""
+ldap.fanout - parallel searches across several connections and bases
+
+See https://www.python-ldap.org/ for details.
+"""
+
+import selectors
+import time
+
+import ldap
+import ldap.dn
+
+from ldap.pkginfo import __version__, __author__, __license__
+
+__all__ = [
+    'FanoutSearch',
+    'fanout_search_s',
+    'naming_context_targets',
+]
+
+
+def naming_context_targets(conns):
+    """
+    Returns a list of (conn, base) targets for searching all naming
+    contexts of each connection in conns, as read with
+    :py:meth:`ldap.ldapobject.SimpleLDAPObject.get_naming_contexts()`.
+    """
+    return [
+        (conn, naming_context.decode('utf-8'))
+        for conn in conns
+        for naming_context in conn.get_naming_contexts()
+    ]
+
+
+class _SubSearch:
+    """
+    Book-keeping for one outstanding sub-search
+    """
+    __slots__ = ('index', 'conn', 'base', 'msgid')
+
+    def __init__(self, index, conn, base):
+        self.index = index
+        self.conn = conn
+        self.base = base
+        self.msgid = None
+
+
+class FanoutSearch:
+    """
+    Search running at the same time on several targets
+
+    All sub-searches are sent up-front, then the results are read
+    whenever one of the connections becomes readable and yielded as
+    (dn, entry) tuples in the order they arrive, or (None, [url, ...])
+    for search references. Wall-clock time is therefore about that of
+    the slowest sub-search instead of the sum of all.
+
+    targets
+        Iterable of (conn, base) tuples, conn being a bound
+        :py:class:`ldap.ldapobject.SimpleLDAPObject`. The connections may
+        be to different servers, and the same connection may be used for
+        several bases, see :py:func:`naming_context_targets()`.
+    scope, filterstr, attrlist, attrsonly, serverctrls
+        Like for :py:meth:`ldap.ldapobject.SimpleLDAPObject.search_ext()`,
+        the same for all sub-searches
+    timeout
+        Limit in seconds for the whole search, -1 for none. The
+        remaining sub-searches are abandoned and :py:exc:`ldap.TIMEOUT`
+        is raised when it is exceeded.
+    sizelimit
+        Maximum number of entries returned in total, 0 for none. The
+        remaining sub-searches are abandoned when it is reached and
+        :py:attr:`truncated` is set.
+    dedup
+        If true, entries with a DN already returned by another target,
+        compared with :py:func:`ldap.dn.normalize_dn()`, are skipped,
+        e.g. when searching several replicas.
+    ignore_errors
+        Tuple of :py:exc:`ldap.LDAPError` subclasses which only end the
+        sub-search they occur in and are recorded in :py:attr:`errors`
+        instead of being raised, e.g. ``(ldap.NO_SUCH_OBJECT,
+        ldap.SERVER_DOWN)``. Other errors abandon all sub-searches.
+    batch_size
+        Maximum number of messages read with one call of
+        :py:meth:`ldap.ldapobject.SimpleLDAPObject.result_batch()`
+
+    After iterating, :py:attr:`counts` holds the number of entries
+    returned for each target, by index in targets.
+    """
+
+    def __init__(
+        self, targets, scope=ldap.SCOPE_SUBTREE, filterstr=None,
+        attrlist=None, attrsonly=0, serverctrls=None, timeout=-1,
+        sizelimit=0, dedup=False, ignore_errors=(), batch_size=100
+    ):
+        self._subsearches = [
+            _SubSearch(index, conn, base)
+            for index, (conn, base) in enumerate(targets)
+        ]
+        self._scope = scope
+        self._filterstr = filterstr
+        self._attrlist = attrlist
+        self._attrsonly = attrsonly
+        self._serverctrls = serverctrls
+        self._timeout = timeout
+        self._sizelimit = sizelimit
+        self._dedup = dedup
+        self._ignore_errors = tuple(ignore_errors)
+        self._batch_size = batch_size
+        self._started = False
+        self.counts = [0] * len(self._subsearches)
+        self.errors = {}
+        self.truncated = False
+
+    def __iter__(self):
+        if self._started:
+            raise RuntimeError('FanoutSearch can only be iterated once')
+        self._started = True
+        return self._run()
+
+    def _send(self, subsearch):
+        subsearch.msgid = subsearch.conn.search_ext(
+            subsearch.base, self._scope, self._filterstr,
+            attrlist=self._attrlist, attrsonly=self._attrsonly,
+            serverctrls=self._serverctrls, timeout=self._timeout,
+            sizelimit=self._sizelimit,
+        )
+
+    def _fail(self, subsearch, exc):
+        """
+        Ends subsearch because of exc, returns False if exc is to be
+        raised.
+        """
+        if isinstance(exc, ldap.SIZELIMIT_EXCEEDED):
+            # per sub-search limit of the server or from sizelimit
+            self.truncated = True
+            return True
+        if isinstance(exc, self._ignore_errors):
+            self.errors[subsearch.index] = exc
+            return True
+        return False
+
+    def _run(self):
+        deadline = None
+        if self._timeout >= 0:
+            deadline = time.monotonic() + self._timeout
+
+        selector = selectors.DefaultSelector()
+        seen = set()
+        total = 0
+        try:
+            # connection -> list of its outstanding sub-searches
+            pending = {}
+            for subsearch in self._subsearches:
+                try:
+                    self._send(subsearch)
+                except ldap.LDAPError as exc:
+                    if not self._fail(subsearch, exc):
+                        raise
+                    continue
+                pending.setdefault(subsearch.conn, []).append(subsearch)
+            for conn in pending:
+                selector.register(conn.fileno(), selectors.EVENT_READ, conn)
+
+            while pending:
+                if deadline is None:
+                    wait = None
+                else:
+                    wait = deadline - time.monotonic()
+                    if wait <= 0:
+                        raise ldap.TIMEOUT({
+                            'desc': 'Timed out',
+                            'info': 'fan-out search exceeded {}s'.format(
+                                self._timeout
+                            ),
+                        })
+                for key, _ in selector.select(wait):
+                    conn = key.data
+                    conn_pending = pending[conn]
+                    # Reading one sub-search lets libldap queue messages
+                    # of the others on the same connection, which select()
+                    # does not report, so go on until nothing is left.
+                    busy = True
+                    while busy and conn_pending:
+                        busy = False
+                        for subsearch in list(conn_pending):
+                            items = self._read(subsearch, conn_pending)
+                            if items is None:
+                                continue
+                            busy = True
+                            for item in items:
+                                dn = item[0]
+                                if dn is not None:
+                                    if self._dedup:
+                                        key_dn = ldap.dn.normalize_dn(dn)
+                                        if key_dn in seen:
+                                            continue
+                                        seen.add(key_dn)
+                                    self.counts[subsearch.index] += 1
+                                    total += 1
+                                yield item
+                                if self._sizelimit and total >= self._sizelimit:
+                                    self.truncated = True
+                                    return
+                    if not conn_pending:
+                        del pending[conn]
+                        selector.unregister(key.fd)
+        finally:
+            selector.close()
+            self._abandon_all()
+
+    def _read(self, subsearch, conn_pending):
+        """
+        Returns the list of results of subsearch which have arrived
+        already, or None if nothing has arrived. subsearch is removed
+        from conn_pending when it has ended.
+        """
+        try:
+            batch = subsearch.conn.result_batch(
+                subsearch.msgid, self._batch_size, 0
+            )
+        except ldap.LDAPError as exc:
+            conn_pending.remove(subsearch)
+            subsearch.msgid = None
+            if not self._fail(subsearch, exc):
+                raise
+            return []
+        if not batch:
+            return None
+        items = []
+        for res_type, res_data, _, _ in batch:
+            if res_type == ldap.RES_SEARCH_RESULT:
+                conn_pending.remove(subsearch)
+                subsearch.msgid = None
+            elif res_type in (ldap.RES_SEARCH_ENTRY, ldap.RES_SEARCH_REFERENCE):
+                items.extend(res_data)
+        return items
+
+    def _abandon_all(self):
+        for subsearch in self._subsearches:
+            if subsearch.msgid is not None:
+                try:
+                    subsearch.conn.abandon(subsearch.msgid)
+                except ldap.LDAPError:
+                    pass
+                subsearch.msgid = None
+
+
+def fanout_search_s(targets, scope=ldap.SCOPE_SUBTREE, filterstr=None,
+                    attrlist=None, **kwargs):
+    """
+    Returns the list of all results of a :py:class:`FanoutSearch` with
+    the same arguments
+    """
+    return list(FanoutSearch(
+        targets, scope, filterstr, attrlist, **kwargs
+    ))
@@ -11,6 +11,7 @@ from ldap import __version__
 
 from ldap.functions import strf_secs
 
+import _ldap
 import time
 
 
@@ -24,26 +25,7 @@ def escape_filter_chars(assertion_value,escape_mode=0):
       If 1 all NON-ASCII chars are escaped.
       If 2 all chars are escaped.
   """
-  if escape_mode:
-    r = []
-    if escape_mode==1:
-      for c in assertion_value:
-        if c < '0' or c > 'z' or c in "\\*()":
-          c = "\\%02x" % ord(c)
-        r.append(c)
-    elif escape_mode==2:
-      for c in assertion_value:
-        r.append("\\%02x" % ord(c))
-    else:
-      raise ValueError('escape_mode must be 0, 1 or 2.')
-    s = ''.join(r)
-  else:
-    s = assertion_value.replace('\\', r'\5c')
-    s = s.replace(r'*', r'\2a')
-    s = s.replace(r'(', r'\28')
-    s = s.replace(r')', r'\29')
-    s = s.replace('\x00', r'\00')
-  return s
+  return _ldap.escape_filter_chars(assertion_value,escape_mode)
 
 
 def filter_format(filter_template,assertion_values):
@@ -54,7 +36,23 @@ def filter_format(filter_template,assertion_values):
         List or tuple of assertion values. Length must match
         count of %s in filter_template.
   """
-  return filter_template % tuple(escape_filter_chars(v) for v in assertion_values)
+  return filter_template % tuple(map(_ldap.escape_filter_chars,assertion_values))
+
+
+def compile_filter(filter_template,escape_mode=0):
+  """
+  Returns a compiled form of filter_template, which is parsed only once.
+
+  filter_template
+        String containing %s as placeholder for assertion values,
+        %% for a literal %. Other format characters are not allowed.
+  escape_mode
+        Passed to escape_filter_chars() for each assertion value.
+
+  Its method render(assertion_values) returns the same as
+  filter_format(filter_template,assertion_values).
+  """
+  return _ldap.compile_filter(filter_template,escape_mode)
 
 
 def time_span_filter(
@@ -19,12 +19,13 @@ if __debug__:
   # Tracing is only supported in debugging mode
   import traceback
 
-import sys,time,pprint,_ldap,ldap,ldap.sasl,ldap.functions
+import sys,time,pprint,threading,weakref,collections,_ldap,ldap,ldap.sasl,ldap.functions
 import warnings
 
 from ldap.schema import SCHEMA_ATTRS
 from ldap.controls import LDAPControl,DecodeControlTuples,RequestControlTuples
 from ldap.extop import ExtendedRequest,ExtendedResponse,PasswordModifyResponse
+from ldap.columns import ColumnarResult
 
 from ldap import LDAPError
 
@@ -47,6 +48,59 @@ class NO_UNIQUE_ENTRY(ldap.NO_SUCH_OBJECT):
   """
 
 
+class PreparedSearch:
+  """
+  Search returned by SimpleLDAPObject.prepare_search()
+
+  The base, attribute list, controls and limits are converted for the
+  C library only once. Each search only renders the filter template
+  with the assertion values given and sends the request.
+  """
+
+  def __init__(self,ldap_object,base,scope,filter_template,attrlist,attrsonly,serverctrls,clientctrls,timeout,sizelimit,escape_mode):
+    self._ldap_object = ldap_object
+    self.timeout = timeout
+    self._args = (
+      base,scope,
+      _ldap.compile_filter(filter_template,escape_mode),
+      attrlist,attrsonly,
+      RequestControlTuples(serverctrls),
+      RequestControlTuples(clientctrls),
+      timeout,sizelimit,
+    )
+    self._l = None
+    self._prepared = None
+    self._prepare()
+
+  def _prepare(self):
+    # prepare again after ReconnectLDAPObject replaced the connection
+    l = self._ldap_object._l
+    if self._l is not l:
+      self._prepared = self._ldap_object._ldap_call(l.prepare_search,*self._args)
+      self._l = l
+    return self._prepared
+
+  def search(self,assertion_values=()):
+    """
+    search([assertion_values=()]) -> int
+
+        Sends the search request with the escaped assertion_values
+        filled into the filter template and returns the message ID
+        like SimpleLDAPObject.search_ext() does.
+    """
+    return self._ldap_object._ldap_call(self._prepare().search,assertion_values)
+
+  def search_s(self,assertion_values=()):
+    """
+    search_s([assertion_values=()]) -> list
+
+        Like search() but waits for and returns all results like
+        SimpleLDAPObject.search_ext_s() does.
+    """
+    msgid = self.search(assertion_values)
+    return self._ldap_object.result(msgid,all=1,timeout=self.timeout)[1]
+
+
 class SimpleLDAPObject:
   """
   This basic class wraps all methods of the underlying C API object.
@@ -75,7 +129,13 @@ class SimpleLDAPObject:
     self._trace_file = trace_file or ldap._trace_file
     self._trace_stack_limit = trace_stack_limit
     self._uri = uri
-    self._ldap_object_lock = self._ldap_lock('opcall')
+    # with a thread-safe libldap, _ldap serialises the calls of each
+    # connection itself and lets waits for results overlap, unless the
+    # diagnostic message of each call is traced right after it
+    self._ldap_object_lock = self._ldap_lock('opcall') \
+      if not ldap.LIBLDAP_R or self._trace_level>=2 else None
+    self._lock_waits = 0
+    self._lock_wait_ns = 0
     if fileno is not None:
       if not hasattr(_ldap, "initialize_fd"):
         raise ValueError("libldap does not support initialize_fd")
@@ -111,7 +171,13 @@ class SimpleLDAPObject:
     Wrapper method mainly for serializing calls into OpenLDAP libs
     and trace logs
     """
-    self._ldap_object_lock.acquire()
+    lock = self._ldap_object_lock
+    if lock is not None and not lock.acquire(False):
+      # another thread is calling into libldap, count the time waited
+      start = time.monotonic()
+      lock.acquire()
+      self._lock_waits += 1
+      self._lock_wait_ns += int((time.monotonic()-start)*1e9)
     if __debug__:
       if self._trace_level>=1:
         self._trace_file.write('*** {} {} - {}\n{}\n'.format(
@@ -130,7 +196,8 @@ class SimpleLDAPObject:
           if func.__name__!="unbind_ext":
             diagnostic_message_success = self._l.get_option(ldap.OPT_DIAGNOSTIC_MESSAGE)
       finally:
-        self._ldap_object_lock.release()
+        if lock is not None:
+          lock.release()
     except LDAPError as e:
       try:
         if 'info' not in e.args[0] and 'errno' in e.args[0]:
@@ -481,6 +548,33 @@ class SimpleLDAPObject:
     resp_type, resp_data, resp_msgid, resp_ctrls = self.result3(msgid,all=1,timeout=self.timeout)
     return resp_type, resp_data, resp_msgid, resp_ctrls
 
+  def submit_batch(self,ops):
+    """
+    submit_batch(ops) -> list
+        Sends many add, modify and delete requests with a single call,
+        without waiting for any result, and returns a list with the
+        message id of each operation.
+
+        ops is a sequence of tuples (op, dn, payload[, serverctrls])
+        where op is one of REQ_ADD, REQ_MODIFY or REQ_DELETE and
+        payload is the modlist passed to add_ext() or modify_ext()
+        respectively. It is ignored for REQ_DELETE.
+
+        If sending a request fails, e.g. because the server went away,
+        the list holds the LDAPError instance for it instead of a message
+        id and None for all operations after it, which were not sent.
+
+        Note that the server may process the operations of a batch in
+        any order, so operations depending on each other, like adding
+        an entry and its children, must be sent in separate batches.
+
+        Use collect_batch() for reading the results.
+    """
+    return self._ldap_call(self._l.submit_batch,[
+      (op[0],op[1],op[2],RequestControlTuples(op[3])) if len(op)>3 else op
+      for op in ops
+    ])
+
   def result(self,msgid=ldap.RES_ANY,all=1,timeout=None):
     """
     result([msgid=RES_ANY [,all=1 [,timeout=None]]]) -> (result_type, result_data)
@@ -547,10 +641,10 @@ class SimpleLDAPObject:
     )
     return resp_type, resp_data, resp_msgid, decoded_resp_ctrls
 
-  def result4(self,msgid=ldap.RES_ANY,all=1,timeout=None,add_ctrls=0,add_intermediates=0,add_extop=0,resp_ctrl_classes=None):
+  def result4(self,msgid=ldap.RES_ANY,all=1,timeout=None,add_ctrls=0,add_intermediates=0,add_extop=0,resp_ctrl_classes=None,lazy=0,zero_copy=0,cidict=0):
     if timeout is None:
       timeout = self.timeout
-    ldap_result = self._ldap_call(self._l.result4,msgid,all,timeout,add_ctrls,add_intermediates,add_extop)
+    ldap_result = self._ldap_call(self._l.result4,msgid,all,timeout,add_ctrls,add_intermediates,add_extop,lazy,zero_copy,cidict)
     if ldap_result is None:
         resp_type, resp_data, resp_msgid, resp_ctrls, resp_name, resp_value = (None,None,None,None,None,None)
     else:
@@ -560,10 +654,117 @@ class SimpleLDAPObject:
       else:
         resp_type, resp_data, resp_msgid, resp_ctrls, resp_name, resp_value = ldap_result
       if add_ctrls:
-        resp_data = [ (t,r,DecodeControlTuples(c,resp_ctrl_classes)) for t,r,c in resp_data ]
+        if lazy:
+          resp_data = ( (t,r,DecodeControlTuples(c,resp_ctrl_classes)) for t,r,c in resp_data )
+        else:
+          resp_data = [ (t,r,DecodeControlTuples(c,resp_ctrl_classes)) for t,r,c in resp_data ]
     decoded_resp_ctrls = DecodeControlTuples(resp_ctrls,resp_ctrl_classes)
     return resp_type, resp_data, resp_msgid, decoded_resp_ctrls, resp_name, resp_value
 
+  def result_batch(self,msgid=ldap.RES_ANY,max_msgs=100,timeout=None,add_ctrls=0,add_intermediates=0,resp_ctrl_classes=None):
+    """
+    result_batch([msgid=RES_ANY [,max_msgs=100 [,timeout=None [,add_ctrls=0 [,add_intermediates=0 [,resp_ctrl_classes=None]]]]]]) -> list
+
+        Returns a list of up to max_msgs 4-tuples like returned by
+        result3() with all set to 0, one for each message received.
+
+        The method waits for the first message like result3() does,
+        then also returns all further messages for msgid which have
+        already been received, without blocking again. The list ends
+        with the final result of an operation if that has been
+        received. This saves the per-call overhead of result3() when
+        processing large search results one entry at a time.
+
+        A result with an error code following other messages is held
+        back and raised by the next call to result_batch() for that
+        msgid, so that the results received before it are not lost.
+
+        If polling (timeout = 0) and nothing has been received yet,
+        an empty list is returned.
+    """
+    if timeout is None:
+      timeout = self.timeout
+    ldap_results = self._ldap_call(self._l.result_batch,msgid,max_msgs,timeout,add_ctrls,add_intermediates)
+    batch = []
+    for resp_type, resp_data, resp_msgid, resp_ctrls in ldap_results:
+      if add_ctrls:
+        resp_data = [ (t,r,DecodeControlTuples(c,resp_ctrl_classes)) for t,r,c in resp_data ]
+      batch.append((resp_type, resp_data, resp_msgid, DecodeControlTuples(resp_ctrls,resp_ctrl_classes)))
+    return batch
+
+  def set_value_decoders(self,decoders):
+    """
+    set_value_decoders(decoders) -> None
+        Sets how attribute values are returned in the search results of
+        this connection. decoders is a dictionary mapping attribute names,
+        matched case-insensitively and also without options like
+        ";lang-de", to one of DECODE_BYTES, DECODE_STR (UTF-8 text),
+        DECODE_INT or DECODE_GENERALIZED_TIME (timezone-aware
+        datetime.datetime), e.g. as returned by
+        ldap.schema.SubSchema.value_decoders(). Values are converted in
+        the C extension module together with the rest of the result.
+        Values not valid for their mode are returned as bytes. Attributes
+        not in decoders are returned as bytes, like all attributes after
+        passing None.
+    """
+    return self._ldap_call(self._l.set_value_decoders,decoders)
+
+  def set_flow_control(self,msgid,max_entries=0,max_bytes=0):
+    """
+    set_flow_control(msgid [,max_entries=0 [,max_bytes=0]]) -> None
+        Limits the number and BER size of the messages of the outstanding
+        search msgid which are held back while results of other
+        operations are read. While either high-water mark is reached, no
+        more messages are read from the connection for other operations
+        until the results of msgid are consumed, so that the server is
+        slowed down by TCP flow control instead. Reads of single results
+        of other operations wait for that up to their timeout, polls
+        return right away. A value of 0 means no limit. The marks also limit the size of the lists returned by
+        result_batch() for msgid.
+
+        The results of msgid must be read one at a time, i.e. with
+        result3() or result4() with all=0, result_batch() or
+        ResultProcessor.allresults(). Flow control ends with the final
+        result of the search or when it is abandoned.
+    """
+    return self._ldap_call(self._l.set_flow_control,msgid,max_entries,max_bytes)
+
+  def flow_control(self,msgid):
+    """
+    flow_control(msgid) -> dict or None
+        Returns the high-water marks of the flow controlled search msgid,
+        the number and size of its messages currently held back, their
+        peak values and the number of reads held up because of the marks,
+        or None if msgid is not flow controlled.
+    """
+    return self._ldap_call(self._l.flow_control,msgid)
+
+  def collect_batch(self,msgids,timeout=None,resp_ctrl_classes=None):
+    """
+    collect_batch(msgids [,timeout=None [,resp_ctrl_classes=None]]) -> list
+        Waits for the results of all operations in msgids, e.g. as
+        returned by submit_batch(), and returns a list with one item per
+        operation in the same order: the 4-tuple returned by result3()
+        with all set to 1, or the LDAPError instance if the operation
+        failed. Errors are not raised, so that a failed operation does
+        not hide the results of the others.
+
+        timeout is the time to wait for all results together, measured
+        from the start of the call. Operations whose result has not been
+        received by then are reported with a TIMEOUT instance. Items of
+        msgids which are no message ids, like the errors reported by
+        submit_batch(), are returned unchanged.
+    """
+    if timeout is None:
+      timeout = self.timeout
+    results = []
+    for res in self._ldap_call(self._l.collect_batch,msgids,timeout):
+      if isinstance(res,tuple):
+        resp_type, resp_data, resp_msgid, resp_ctrls = res
+        res = (resp_type, resp_data, resp_msgid, DecodeControlTuples(resp_ctrls,resp_ctrl_classes))
+      results.append(res)
+    return results
+
   def search_ext(self,base,scope,filterstr=None,attrlist=None,attrsonly=0,serverctrls=None,clientctrls=None,timeout=-1,sizelimit=0):
     """
     search(base, scope [,filterstr='(objectClass=*)' [,attrlist=None [,attrsonly=0]]]) -> int
@@ -620,18 +821,116 @@ class SimpleLDAPObject:
       timeout,sizelimit,
     )
 
-  def search_ext_s(self,base,scope,filterstr=None,attrlist=None,attrsonly=0,serverctrls=None,clientctrls=None,timeout=-1,sizelimit=0):
+  def search_ext_s(self,base,scope,filterstr=None,attrlist=None,attrsonly=0,serverctrls=None,clientctrls=None,timeout=-1,sizelimit=0,cidict=0):
     msgid = self.search_ext(base,scope,filterstr,attrlist,attrsonly,serverctrls,clientctrls,timeout,sizelimit)
+    if cidict:
+      return self.result4(msgid,all=1,timeout=timeout,cidict=cidict)[1]
     return self.result(msgid,all=1,timeout=timeout)[1]
 
+  def result_columns(self,msgid,attrlist,timeout=None,resp_ctrl_classes=None):
+    """
+    result_columns(msgid, attrlist [,timeout=None [,resp_ctrl_classes=None]]) -> ColumnarResult
+        Waits for all results of the search msgid like result3() with
+        all set to 1, and returns them as ldap.columns.ColumnarResult
+        with one column for each attribute type in attrlist. The values
+        are copied into a few flat buffers per column right away,
+        without creating objects for each entry.
+
+        If polling (timeout = 0) and the search has not finished yet,
+        None is returned.
+    """
+    if timeout is None:
+      timeout = self.timeout
+    attrs = []
+    seen = set()
+    for attr in attrlist:
+      if not isinstance(attr,str):
+        raise TypeError('attrlist must contain str, not %r' % (attr,))
+      if attr.lower() not in seen:
+        seen.add(attr.lower())
+        attrs.append(attr)
+    res = self._ldap_call(self._l.result_columns,msgid,attrs,timeout)
+    if res is None:
+      return None
+    (count, dns, columns), resp_ctrls = res
+    return ColumnarResult(
+      count, dns, columns, DecodeControlTuples(resp_ctrls,resp_ctrl_classes)
+    )
+
+  def search_columns_s(self,base,scope,filterstr=None,attrlist=None,serverctrls=None,clientctrls=None,timeout=-1,sizelimit=0,resp_ctrl_classes=None):
+    """
+    search_columns_s(base, scope, filterstr, attrlist [,serverctrls=None [,clientctrls=None [,timeout=-1 [,sizelimit=0 [,resp_ctrl_classes=None]]]]]) -> ColumnarResult
+        Like search_ext_s() but returns the result as columns of the
+        attribute types in attrlist, see result_columns().
+    """
+    if not attrlist:
+      raise ValueError('attrlist must name the attribute types to return')
+    msgid = self.search_ext(base,scope,filterstr,attrlist,0,serverctrls,clientctrls,timeout,sizelimit)
+    return self.result_columns(msgid,attrlist,timeout,resp_ctrl_classes)
+
+  def paged_search_ext(self,base,scope,filterstr=None,attrlist=None,attrsonly=0,serverctrls=None,timeout=-1,sizelimit=0,page_size=1000,criticality=False,add_ctrls=0,resp_ctrl_classes=None):
+    """
+    paged_search_ext(base,scope [,filterstr='(objectClass=*)' [,attrlist=None [,attrsonly=0 [,serverctrls=None [,timeout=-1 [,sizelimit=0 [,page_size=1000 [,criticality=False [,add_ctrls=0 [,resp_ctrl_classes=None]]]]]]]]]])
+        Generator yielding the results of a search like search_ext_s()
+        one by one, retrieved in pages of page_size entries with the
+        Simple Paged Results Control (RFC 2696).
+
+        The request for the next page is sent as soon as a page has been
+        received, so that the server prepares it while the caller still
+        processes the current page. serverctrls must not contain a
+        SimplePagedResultsControl, criticality is the one of the control
+        sent. timeout applies to each page.
+
+        The search is abandoned if the generator is closed before all
+        pages have been retrieved.
+    """
+    if filterstr is None:
+      filterstr = '(objectClass=*)'
+    pages = self._ldap_call(
+      self._l.paged_search_ext,
+      base,scope,filterstr,page_size,
+      attrlist,attrsonly,
+      RequestControlTuples(serverctrls),
+      timeout,sizelimit,criticality,add_ctrls,
+    )
+    try:
+      while True:
+        page = self._ldap_call(pages.next_page)
+        if page is None:
+          return
+        if add_ctrls:
+          page = [ (t,r,DecodeControlTuples(c,resp_ctrl_classes)) for t,r,c in page ]
+        yield from page
+    finally:
+      self._ldap_call(pages.abandon)
+
+  def prepare_search(self,base,scope,filterstr=None,attrlist=None,attrsonly=0,serverctrls=None,clientctrls=None,timeout=-1,sizelimit=0,escape_mode=0):
+    """
+    prepare_search(base,scope [,filterstr='(objectClass=*)' [,attrlist=None [,attrsonly=0 [,serverctrls=None [,clientctrls=None [,timeout=-1 [,sizelimit=0 [,escape_mode=0]]]]]]]]) -> PreparedSearch
+        Returns a PreparedSearch for searches which only differ in the
+        assertion values of the filter. filterstr is a template like
+        for ldap.filter.filter_format(), the assertion values passed to
+        the search methods of the returned object are escaped with
+        ldap.filter.escape_filter_chars() using escape_mode.
+    """
+    if filterstr is None:
+      filterstr = '(objectClass=*)'
+    return PreparedSearch(
+      self,
+      base,scope,filterstr,
+      attrlist,attrsonly,
+      serverctrls,clientctrls,
+      timeout,sizelimit,escape_mode,
+    )
+
   def search(self,base,scope,filterstr=None,attrlist=None,attrsonly=0):
     return self.search_ext(base,scope,filterstr,attrlist,attrsonly,None,None)
 
-  def search_s(self,base,scope,filterstr=None,attrlist=None,attrsonly=0):
-    return self.search_ext_s(base,scope,filterstr,attrlist,attrsonly,None,None,timeout=self.timeout)
+  def search_s(self,base,scope,filterstr=None,attrlist=None,attrsonly=0,cidict=0):
+    return self.search_ext_s(base,scope,filterstr,attrlist,attrsonly,None,None,timeout=self.timeout,cidict=cidict)
 
-  def search_st(self,base,scope,filterstr=None,attrlist=None,attrsonly=0,timeout=-1):
-    return self.search_ext_s(base,scope,filterstr,attrlist,attrsonly,None,None,timeout)
+  def search_st(self,base,scope,filterstr=None,attrlist=None,attrsonly=0,timeout=-1,cidict=0):
+    return self.search_ext_s(base,scope,filterstr,attrlist,attrsonly,None,None,timeout,cidict=cidict)
 
   def start_tls_s(self):
     """
@@ -686,6 +985,22 @@ class SimpleLDAPObject:
   def whoami_s(self,serverctrls=None,clientctrls=None):
     return self._ldap_call(self._l.whoami_s,serverctrls,clientctrls)
 
+  def stats(self,reset=False):
+    """
+    stats([reset=False]) -> dict
+
+        Returns the counters and latency histograms kept for this
+        connection, see the documentation for the keys. If reset is
+        true, they start from zero again afterwards.
+    """
+    result = self._l.stats(reset)
+    result['lock_waits'] += self._lock_waits
+    result['lock_wait_ns'] += self._lock_wait_ns
+    if reset:
+      self._lock_waits = 0
+      self._lock_wait_ns = 0
+    return result
+
   def get_option(self,option):
     result = self._ldap_call(self._l.get_option,option)
     if option==ldap.OPT_SERVER_CONTROLS or option==ldap.OPT_CLIENT_CONTROLS:
@@ -756,6 +1071,63 @@ class SimpleLDAPObject:
     else:
       return None
 
+  def read_many(self,dns,filterstr=None,attrlist=None,window=64,serverctrls=None,clientctrls=None,timeout=-1):
+    """
+    read_many(dns [,filterstr=None [,attrlist=None [,window=64 [,serverctrls=None [,clientctrls=None [,timeout=-1]]]]]]) -> iterator
+        Reads the entries specified by the DNs in dns like read_s(), but
+        keeps up to window base searches outstanding instead of waiting
+        for each result before sending the next request, so that the
+        round trips overlap.
+
+        Yields a tuple (dn, entry) for each item of dns, in the same
+        order, as soon as its result has arrived. entry is the entry
+        dictionary, None if the entry does not match filterstr, or the
+        LDAPError instance if reading it failed, e.g. NO_SUCH_OBJECT.
+        Errors of the connection, SERVER_DOWN and CONNECT_ERROR, and
+        TIMEOUT if a result has not arrived within timeout seconds are
+        raised. The searches still outstanding are abandoned if
+        iterating ends early.
+    """
+    if window<1:
+      raise ValueError('window must be positive')
+    # (dn, msgid) of the outstanding searches in the order sent
+    pending = collections.deque()
+    dns = iter(dns)
+    try:
+      while True:
+        for dn in dns:
+          msgid = self.search_ext(
+            dn,
+            ldap.SCOPE_BASE,
+            filterstr,
+            attrlist=attrlist,
+            serverctrls=serverctrls,
+            clientctrls=clientctrls,
+            timeout=timeout,
+          )
+          pending.append((dn,msgid))
+          if len(pending)>=window:
+            break
+        if not pending:
+          return
+        dn,msgid = pending[0]
+        try:
+          r = self.result(msgid,all=1,timeout=timeout)[1]
+        except (ldap.SERVER_DOWN,ldap.CONNECT_ERROR,ldap.TIMEOUT):
+          raise
+        except LDAPError as e:
+          pending.popleft()
+          yield dn,e
+        else:
+          pending.popleft()
+          yield dn,r[0][1] if r else None
+    finally:
+      for dn,msgid in pending:
+        try:
+          self.abandon(msgid)
+        except LDAPError:
+          pass
+
   def read_subschemasubentry_s(self,subschemasubentry_dn,attrs=None):
     """
     Returns the sub schema sub entry's data
@@ -832,6 +1204,11 @@ class ReconnectLDAPObject(SimpleLDAPObject):
 
   * retry_delay: specifies the time in seconds between reconnect attempts.
 
+  * standby_uris: list of further LDAP URIs of replicas. A background
+    thread keeps a standby connection to the next of them ready, bound
+    like this connection, and a request failing with
+    :py:exc:`ldap.SERVER_DOWN` is re-tried on it at once.
+
   This class also implements the pickle protocol.
   """
 
@@ -841,12 +1218,19 @@ class ReconnectLDAPObject(SimpleLDAPObject):
     '_trace_file',
     '_reconnect_lock',
     '_last_bind',
+    '_standby',
+    '_standby_generation',
+    '_standby_closed',
+    '_standby_lock',
+    '_standby_wakeup',
+    '_standby_thread',
   }
 
   def __init__(
     self,uri,
     trace_level=0,trace_file=None,trace_stack_limit=5,bytes_mode=None,
-    bytes_strictness=None, retry_max=1, retry_delay=60.0, fileno=None
+    bytes_strictness=None, retry_max=1, retry_delay=60.0, fileno=None,
+    standby_uris=None
   ):
     """
     Parameters like SimpleLDAPObject.__init__() with these
@@ -856,10 +1240,14 @@ class ReconnectLDAPObject(SimpleLDAPObject):
         Maximum count of reconnect trials
     retry_delay
         Time span to wait between two reconnect trials
+    standby_uris
+        List of LDAP URIs to fail over to, tried in order after uri
     """
     self._uri = uri
+    self._uris = [uri] + list(standby_uris or ())
     self._options = []
     self._last_bind = None
+    self._standby_wakeup = None
     SimpleLDAPObject.__init__(self, uri, trace_level, trace_file,
                               trace_stack_limit, bytes_mode,
                               bytes_strictness=bytes_strictness,
@@ -869,6 +1257,8 @@ class ReconnectLDAPObject(SimpleLDAPObject):
     self._retry_delay = retry_delay
     self._start_tls = 0
     self._reconnects_done = 0
+    self._failovers_done = 0
+    self._start_standby()
 
   def __getstate__(self):
     """return data representation for pickled object"""
@@ -887,29 +1277,141 @@ class ReconnectLDAPObject(SimpleLDAPObject):
         d.setdefault('bytes_strictness', 'error')
     else:
         d.setdefault('bytes_strictness', 'warn')
+    d.setdefault('_lock_waits', 0)
+    d.setdefault('_lock_wait_ns', 0)
+    d.setdefault('_uris', [d['_uri']])
+    d.setdefault('_failovers_done', 0)
     self.__dict__.update(d)
     self._last_bind = getattr(SimpleLDAPObject, self._last_bind[0]), self._last_bind[1], self._last_bind[2]
-    self._ldap_object_lock = self._ldap_lock()
+    self._ldap_object_lock = self._ldap_lock() \
+      if not ldap.LIBLDAP_R or self._trace_level>=2 else None
     self._reconnect_lock = ldap.LDAPLock(desc='reconnect lock within %s' % (repr(self)))
     # XXX cannot pickle file, use default trace file
     self._trace_file = ldap._trace_file
+    self._standby_wakeup = None
     self.reconnect(self._uri)
+    self._start_standby()
+
+  def _start_standby(self):
+    """Starts the thread keeping a standby connection ready"""
+    if len(self._uris) < 2:
+      return
+    self._standby = None
+    self._standby_generation = 0
+    self._standby_closed = False
+    self._standby_lock = threading.Lock()
+    self._standby_wakeup = wakeup = threading.Event()
+    # the thread only holds a weak reference, setting wakeup when self
+    # is garbage-collected lets it end
+    ref = weakref.ref(self, lambda ref: wakeup.set())
+    self._standby_thread = threading.Thread(
+      target=_standby_worker, args=(ref, wakeup),
+      name='ReconnectLDAPObject standby', daemon=True,
+    )
+    self._standby_thread.start()
+    wakeup.set()
+
+  def _standby_uri(self, attempt):
+    """Returns the URI to connect the standby to after attempt failures"""
+    n = len(self._uris)
+    start = self._uris.index(self._uri) + 1 if self._uri in self._uris else 0
+    # the URIs following the current one first
+    uris = [self._uris[(start + i) % n] for i in range(n)]
+    uris = [uri for uri in uris if uri != self._uri] or uris
+    return uris[attempt % len(uris)]
+
+  def _open_standby(self, uri):
+    """
+    Returns a new connection to uri with the recorded options, StartTLS
+    and bind replayed
+    """
+    conn = SimpleLDAPObject(
+      uri, self._trace_level, self._trace_file, self._trace_stack_limit
+    )
+    try:
+      self._restore_options(conn)
+      if self._start_tls:
+        SimpleLDAPObject.start_tls_s(conn)
+      self._apply_last_bind(conn)
+    except ldap.LDAPError:
+      _close_quietly(conn._l)
+      raise
+    return conn
+
+  def _invalidate_standby(self):
+    """Discards the standby after the bind, options or StartTLS changed"""
+    wakeup = self._standby_wakeup
+    if wakeup is None:
+      return
+    with self._standby_lock:
+      standby, self._standby = self._standby, None
+      self._standby_generation += 1
+    if standby is not None:
+      _close_quietly(standby[1]._l)
+    wakeup.set()
+
+  def _close_standby(self):
+    """Ends the standby thread and closes the standby connection"""
+    if self._standby_wakeup is None:
+      return
+    self._standby_closed = True
+    self._invalidate_standby()
+    self._standby_wakeup = None
+
+  def _failover(self, failed):
+    """
+    Replaces the failed connection with the standby connection, returns
+    False if there is none ready
+    """
+    wakeup = self._standby_wakeup
+    if wakeup is None:
+      return False
+    self._reconnect_lock.acquire()
+    try:
+      current = getattr(self, '_l', None)
+      if current is not None and current is not failed:
+        # another thread has replaced it already
+        return True
+      with self._standby_lock:
+        standby, self._standby = self._standby, None
+      if standby is None:
+        return False
+      uri, conn = standby
+      self._l = conn._l
+      self._uri = uri
+      self._failovers_done = self._failovers_done + 1
+      if __debug__ and self._trace_level>=1:
+        self._trace_file.write('*** failed over to standby {} => repeat last operation\n'.format(uri))
+    finally:
+      self._reconnect_lock.release()
+    wakeup.set()
+    if failed is not None:
+      _close_quietly(failed)
+    return True
 
   def _store_last_bind(self,method,*args,**kwargs):
     self._last_bind = (method,args,kwargs)
+    self._invalidate_standby()
 
-  def _apply_last_bind(self):
+  def _apply_last_bind(self, conn=None):
+    if conn is None:
+      conn = self
     if self._last_bind!=None:
       func,args,kwargs = self._last_bind
-      func(self,*args,**kwargs)
+      func(conn,*args,**kwargs)
     else:
       # Send explicit anon simple bind request to provoke ldap.SERVER_DOWN in method reconnect()
-      SimpleLDAPObject.simple_bind_s(self, None, None)
+      SimpleLDAPObject.simple_bind_s(conn, None, None)
 
-  def _restore_options(self):
+  def _restore_options(self, conn=None):
     """Restore all recorded options"""
+    if conn is None:
+      conn = self
     for k,v in self._options:
-      SimpleLDAPObject.set_option(self,k,v)
+      SimpleLDAPObject.set_option(conn,k,v)
+    value_decoders = getattr(self, '_value_decoders', None)
+    if value_decoders is not None:
+      SimpleLDAPObject.set_value_decoders(conn,value_decoders)
 
   def passwd_s(self,*args,**kwargs):
     return self._apply_method_s(SimpleLDAPObject.passwd_s,*args,**kwargs)
@@ -937,7 +1439,7 @@ class ReconnectLDAPObject(SimpleLDAPObject):
             # Repeat last simple or SASL bind
             self._apply_last_bind()
           except ldap.LDAPError:
-            SimpleLDAPObject.unbind_s(self)
+            SimpleLDAPObject.unbind_ext(self)
             raise
         except (ldap.SERVER_DOWN,ldap.TIMEOUT):
           if __debug__ and self._trace_level>=1:
@@ -964,10 +1466,17 @@ class ReconnectLDAPObject(SimpleLDAPObject):
   def _apply_method_s(self,func,*args,**kwargs):
     if not hasattr(self,'_l'):
       self.reconnect(self._uri,retry_max=self._retry_max,retry_delay=self._retry_delay)
+    l = self._l
     try:
       return func(self,*args,**kwargs)
     except ldap.SERVER_DOWN:
-      SimpleLDAPObject.unbind_s(self)
+      if self._failover(l):
+        # Re-try last operation on the standby connection
+        try:
+          return func(self,*args,**kwargs)
+        except ldap.SERVER_DOWN:
+          pass
+      SimpleLDAPObject.unbind_ext(self)
       # Try to reconnect
       self.reconnect(self._uri,retry_max=self._retry_max,retry_delay=self._retry_delay)
       # Re-try last operation
@@ -975,7 +1484,19 @@ class ReconnectLDAPObject(SimpleLDAPObject):
 
   def set_option(self,option,invalue):
     self._options.append((option,invalue))
-    return SimpleLDAPObject.set_option(self,option,invalue)
+    res = SimpleLDAPObject.set_option(self,option,invalue)
+    self._invalidate_standby()
+    return res
+
+  def set_value_decoders(self,decoders):
+    res = SimpleLDAPObject.set_value_decoders(self,decoders)
+    self._value_decoders = None if decoders is None else dict(decoders)
+    self._invalidate_standby()
+    return res
+
+  def unbind_ext(self,serverctrls=None,clientctrls=None):
+    self._close_standby()
+    return SimpleLDAPObject.unbind_ext(self,serverctrls,clientctrls)
 
   def bind_s(self,*args,**kwargs):
     res = self._apply_method_s(SimpleLDAPObject.bind_s,*args,**kwargs)
@@ -990,6 +1511,7 @@ class ReconnectLDAPObject(SimpleLDAPObject):
   def start_tls_s(self,*args,**kwargs):
     res = self._apply_method_s(SimpleLDAPObject.start_tls_s,*args,**kwargs)
     self._start_tls = 1
+    self._invalidate_standby()
     return res
 
   def sasl_interactive_bind_s(self,*args,**kwargs):
@@ -1029,10 +1551,63 @@ class ReconnectLDAPObject(SimpleLDAPObject):
   def search_ext_s(self,*args,**kwargs):
     return self._apply_method_s(SimpleLDAPObject.search_ext_s,*args,**kwargs)
 
+  def search_columns_s(self,*args,**kwargs):
+    return self._apply_method_s(SimpleLDAPObject.search_columns_s,*args,**kwargs)
+
   def whoami_s(self,*args,**kwargs):
     return self._apply_method_s(SimpleLDAPObject.whoami_s,*args,**kwargs)
 
 
+def _close_quietly(l):
+  """Unbinds the _ldap connection object l, ignoring errors"""
+  try:
+    l.unbind_ext(None,None)
+  except ldap.LDAPError:
+    pass
+
+
+def _standby_worker(ref, wakeup):
+  """
+  Thread keeping a standby connection ready for the ReconnectLDAPObject
+  referenced weakly by ref, woken up with wakeup whenever it has to be
+  (re-)opened
+  """
+  attempt = 0
+  delay = None
+  while True:
+    wakeup.wait(delay)
+    wakeup.clear()
+    obj = ref()
+    if obj is None or obj._standby_closed:
+      return
+    with obj._standby_lock:
+      need = obj._standby is None
+      generation = obj._standby_generation
+    if not need:
+      attempt, delay = 0, None
+      del obj
+      continue
+    uri = obj._standby_uri(attempt)
+    try:
+      conn = obj._open_standby(uri)
+    except ldap.LDAPError as exc:
+      if __debug__ and obj._trace_level>=1:
+        obj._trace_file.write('*** standby connection to {} failed: {!r}\n'.format(uri, exc))
+      # try the next one after retry_delay
+      attempt, delay = attempt + 1, obj._retry_delay
+      del obj
+      continue
+    with obj._standby_lock:
+      if obj._standby_generation == generation and not obj._standby_closed:
+        obj._standby, conn = (uri, conn), None
+    if conn is not None:
+      # bind or options have changed meanwhile, start over
+      _close_quietly(conn._l)
+      wakeup.set()
+    attempt, delay = 0, None
+    del obj
+
+
 # The class called LDAPObject will be used as default for
 # ldap.open() and ldap.initialize()
 LDAPObject = SimpleLDAPObject
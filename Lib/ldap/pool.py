@@ -0,0 +1,289 @@
+"""
+ldap.pool - thread-safe pool of LDAP connections
+
+See https://www.python-ldap.org/ for details.
+"""
+
+import contextlib
+import threading
+import time
+import weakref
+
+import ldap
+from ldap.ldapobject import SimpleLDAPObject, ReconnectLDAPObject
+
+from ldap.pkginfo import __version__, __author__, __license__
+
+__all__ = [
+    'ConnectionPool',
+    'PoolTimeout',
+]
+
+
+class PoolTimeout(Exception):
+    """
+    Raised if no connection became available within the checkout timeout.
+    """
+
+
+class _PooledConnection:
+    """
+    Book-keeping for a connection of the pool
+    """
+    __slots__ = ('conn', 'created', 'last_used')
+
+    def __init__(self, conn, now):
+        self.conn = conn
+        self.created = now
+        self.last_used = now
+
+
+class ConnectionPool:
+    """
+    Thread-safe pool of bound connections to the same server
+
+    Each connection has its own lock, so threads using different
+    connections of the pool do not wait for each other (with libldap_r,
+    see :py:const:`ldap.LIBLDAP_R`).
+
+    uri
+        LDAP URI passed to ``connection_class``
+    size
+        Maximum number of connections, all opened and bound up-front
+        unless ``prefill`` is false
+    who, cred
+        Credentials for :py:meth:`simple_bind_s()` of new connections
+    setup
+        Callable invoked with each new connection instead of the simple
+        bind, e.g. for setting options, StartTLS and SASL binds
+    idle_timeout
+        Connections unused for longer than this many seconds are replaced
+        by a new one on checkout, e.g. before the server drops them
+    max_lifetime
+        Connections older than this many seconds are replaced
+    probe_interval
+        Connections unused for longer than this many seconds are probed
+        with a Who Am I? extended operation on checkout and replaced if
+        that fails
+    checkout_timeout
+        Default for the ``timeout`` argument of :py:meth:`checkout()`
+
+    Any further keyword arguments are passed to ``connection_class``.
+    """
+
+    connection_class = ReconnectLDAPObject
+
+    def __init__(
+        self, uri, size=4, who=None, cred=None, setup=None,
+        idle_timeout=None, max_lifetime=None, probe_interval=None,
+        checkout_timeout=None, prefill=True, **kwargs
+    ):
+        if size < 1:
+            raise ValueError('size must be positive')
+        self._uri = uri
+        self._size = size
+        self._who = who
+        self._cred = cred
+        self._setup = setup
+        self._conn_kwargs = kwargs
+        self.idle_timeout = idle_timeout
+        self.max_lifetime = max_lifetime
+        self.probe_interval = probe_interval
+        self.checkout_timeout = checkout_timeout
+        self._cond = threading.Condition(threading.Lock())
+        # idle connections, most recently used last
+        self._idle = []
+        # id(conn) -> _PooledConnection of checked out connections
+        self._in_use = {}
+        # number of connections opened or being opened
+        self._num_conns = 0
+        self._closed = False
+        # last connection used by each thread
+        self._affinity = threading.local()
+        if prefill:
+            pooled = []
+            try:
+                for _ in range(size):
+                    pooled.append(self._open())
+            except Exception:
+                for item in pooled:
+                    self._close_conn(item.conn)
+                raise
+            self._idle.extend(pooled)
+            self._num_conns = size
+
+    def _open(self):
+        """
+        Returns a new bound connection
+        """
+        conn = self.connection_class(self._uri, **self._conn_kwargs)
+        try:
+            if self._setup is not None:
+                self._setup(conn)
+            else:
+                conn.simple_bind_s(self._who, self._cred)
+        except Exception:
+            self._close_conn(conn)
+            raise
+        return _PooledConnection(conn, time.monotonic())
+
+    @staticmethod
+    def _close_conn(conn):
+        try:
+            conn.unbind_s()
+        except (ldap.LDAPError, AttributeError):
+            # already gone
+            pass
+
+    def _expired(self, item, now):
+        return (
+            (self.max_lifetime is not None and
+             now - item.created > self.max_lifetime) or
+            (self.idle_timeout is not None and
+             now - item.last_used > self.idle_timeout)
+        )
+
+    def _alive(self, item, now):
+        if self.probe_interval is None or now - item.last_used <= self.probe_interval:
+            return True
+        try:
+            # plain operation, reconnecting is done by replacing
+            SimpleLDAPObject.whoami_s(item.conn)
+        except (ldap.LDAPError, AttributeError):
+            return False
+        return True
+
+    def _take_idle(self):
+        """
+        Removes an idle connection from the pool, preferring the one
+        last used by the current thread. Must hold self._cond.
+        """
+        ref = getattr(self._affinity, 'conn', None)
+        last = ref() if ref is not None else None
+        if last is not None:
+            for i, item in enumerate(self._idle):
+                if item.conn is last:
+                    return self._idle.pop(i)
+        return self._idle.pop()
+
+    def checkout(self, timeout=None):
+        """
+        Returns a connection for exclusive use by the caller, which has
+        to be returned with :py:meth:`checkin()`.
+
+        Waits for up to ``timeout`` seconds (default ``checkout_timeout``,
+        None means forever) if all connections are in use and raises
+        :py:exc:`PoolTimeout` after that.
+        """
+        if timeout is None:
+            timeout = self.checkout_timeout
+        deadline = None if timeout is None else time.monotonic() + timeout
+        with self._cond:
+            while True:
+                if self._closed:
+                    raise ValueError('connection pool is closed')
+                if self._idle:
+                    item = self._take_idle()
+                    break
+                if self._num_conns < self._size:
+                    # open a new connection below, without holding the lock
+                    item = None
+                    self._num_conns += 1
+                    break
+                remaining = None
+                if deadline is not None:
+                    remaining = deadline - time.monotonic()
+                    if remaining <= 0:
+                        raise PoolTimeout(
+                            'no connection available within {} s'.format(timeout)
+                        )
+                self._cond.wait(remaining)
+        try:
+            now = time.monotonic()
+            if item is not None and (
+                self._expired(item, now) or not self._alive(item, now)
+            ):
+                self._close_conn(item.conn)
+                item = None
+            if item is None:
+                item = self._open()
+        except Exception:
+            with self._cond:
+                self._num_conns -= 1
+                self._cond.notify()
+            raise
+        with self._cond:
+            self._in_use[id(item.conn)] = item
+        self._affinity.conn = weakref.ref(item.conn)
+        return item.conn
+
+    def checkin(self, conn, discard=False):
+        """
+        Returns a connection obtained by :py:meth:`checkout()` to the pool.
+
+        If ``discard`` is true, the connection is closed and will be
+        replaced by a new one on demand.
+        """
+        with self._cond:
+            item = self._in_use.pop(id(conn))
+            now = time.monotonic()
+            item.last_used = now
+            if (
+                discard or self._closed or
+                (self.max_lifetime is not None and
+                 now - item.created > self.max_lifetime)
+            ):
+                self._num_conns -= 1
+            else:
+                self._idle.append(item)
+                item = None
+            self._cond.notify()
+        if item is not None:
+            self._close_conn(item.conn)
+
+    @contextlib.contextmanager
+    def connection(self, timeout=None):
+        """
+        Context manager for a connection checked out from the pool.
+
+        The connection is discarded if the block raises an exception
+        other than :py:exc:`ldap.LDAPError`, since an operation might have
+        been interrupted half-way.
+        """
+        conn = self.checkout(timeout)
+        try:
+            yield conn
+        except ldap.LDAPError:
+            self.checkin(conn)
+            raise
+        except BaseException:
+            self.checkin(conn, discard=True)
+            raise
+        else:
+            self.checkin(conn)
+
+    def close(self):
+        """
+        Closes all idle connections. Connections currently checked out
+        are closed when checked in.
+        """
+        with self._cond:
+            self._closed = True
+            idle, self._idle = self._idle, []
+            self._num_conns -= len(idle)
+            self._cond.notify_all()
+        for item in idle:
+            self._close_conn(item.conn)
+
+    def __enter__(self):
+        return self
+
+    def __exit__(self, exc_type, exc_value, traceback):
+        self.close()
+
+    def __len__(self):
+        """
+        Number of open connections, idle or in use
+        """
+        with self._cond:
+            return self._num_conns
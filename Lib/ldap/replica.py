@@ -0,0 +1,344 @@
+"""
+ldap.replica - in-memory replica kept current with syncrepl
+
+See https://www.python-ldap.org/ for details.
+"""
+
+import threading
+
+import ldap
+import ldap.dn
+from ldap.ldapobject import ReconnectLDAPObject
+from ldap.syncrepl import SyncreplConsumer
+
+from ldap.pkginfo import __version__, __author__, __license__
+
+__all__ = [
+    'LocalReplica',
+    'ReplicaConsumer',
+    'ignore_case',
+    'dn_value',
+]
+
+# e-syncRefreshRequired (RFC 4533): the cookie is too old for the server
+SYNC_REFRESH_REQUIRED = 0x1000
+
+
+def ignore_case(value):
+    """
+    Index key for values compared ignoring the case of ASCII letters, e.g.
+    of uid or mail
+    """
+    return value.lower()
+
+
+def dn_value(value):
+    """
+    Index key for DN values, e.g. of member, see
+    :py:func:`ldap.dn.normalize_dn()`. Values which are no valid DN are
+    compared ignoring case.
+    """
+    try:
+        return ldap.dn.normalize_dn(value)
+    except ldap.LDAPError:
+        return value.lower()
+
+
+def _dn_key(dn):
+    try:
+        return ldap.dn.normalize_dn(dn)
+    except ldap.LDAPError:
+        return dn.lower()
+
+
+class LocalReplica:
+    """
+    In-memory copy of the entries returned by a syncrepl search, with
+    hash indexes for equality lookups
+
+    indexes
+        Dictionary mapping the attribute types to index to a function
+        returning the index key of a value given as bytes, like
+        :py:func:`ignore_case()` and :py:func:`dn_value()`, or a list of
+        attribute types indexed with :py:func:`ignore_case()`. Defaults to
+        uid and mail ignoring case and member as DN.
+
+    Lookups take a lock only held for the dictionary operations, so that
+    any number of threads can use the replica while a
+    :py:class:`ReplicaConsumer` updates it. They return the entry
+    dictionaries as received, which must not be modified.
+
+    The methods after :py:meth:`wait_refreshed()` are called by the
+    consumer.
+    """
+
+    def __init__(self, indexes=None):
+        if indexes is None:
+            indexes = {'uid': ignore_case, 'mail': ignore_case,
+                       'member': dn_value}
+        elif not isinstance(indexes, dict):
+            indexes = dict.fromkeys(indexes, ignore_case)
+        self._keyfuncs = {
+            attr.lower(): keyfunc for attr, keyfunc in indexes.items()
+        }
+        self._lock = threading.Lock()
+        # entryUUID -> (dn, entry)
+        self._entries = {}
+        # normalised DN -> entryUUID
+        self._dns = {}
+        # attribute type -> index key -> set of entryUUIDs
+        self._index = {attr: {} for attr in self._keyfuncs}
+        # entryUUIDs seen during the refresh phase
+        self._present = set()
+        self._full_refresh = False
+        self._refreshed = threading.Event()
+        #: Sync cookie of the last change applied, None before the first
+        self.cookie = None
+
+    def __len__(self):
+        return len(self._entries)
+
+    def __contains__(self, dn):
+        return _dn_key(dn) in self._dns
+
+    def get(self, dn):
+        """
+        Returns the entry dictionary of dn, matched like
+        :py:func:`ldap.dn.normalize_dn()` does, or None
+        """
+        key = _dn_key(dn)
+        with self._lock:
+            uuid = self._dns.get(key)
+            if uuid is None:
+                return None
+            return self._entries[uuid][1]
+
+    def find(self, attr, value):
+        """
+        Returns a list of (dn, entry) tuples of the entries with value
+        among the values of the indexed attribute type attr. value is
+        bytes or str, which is UTF-8 encoded. Raises ValueError if attr
+        is not indexed.
+        """
+        attr = attr.lower()
+        try:
+            keyfunc = self._keyfuncs[attr]
+        except KeyError:
+            raise ValueError('attribute {!r} is not indexed'.format(attr))
+        if isinstance(value, str):
+            value = value.encode('utf-8')
+        key = keyfunc(value)
+        with self._lock:
+            uuids = self._index[attr].get(key, ())
+            return [self._entries[uuid] for uuid in uuids]
+
+    def wait_refreshed(self, timeout=None):
+        """
+        Waits until the replica has received all entries after starting,
+        the end of the first refresh phase. Returns False if timeout
+        seconds have passed before.
+        """
+        return self._refreshed.wait(timeout)
+
+    def _index_entry(self, uuid, entry, add):
+        for attr, values in entry.items():
+            attr = attr.lower()
+            index = self._index.get(attr)
+            if index is None:
+                continue
+            keyfunc = self._keyfuncs[attr]
+            for value in values:
+                key = keyfunc(value)
+                if add:
+                    index.setdefault(key, set()).add(uuid)
+                else:
+                    uuids = index.get(key)
+                    if uuids is not None:
+                        uuids.discard(uuid)
+                        if not uuids:
+                            del index[key]
+
+    def _remove(self, uuid):
+        old = self._entries.pop(uuid, None)
+        if old is None:
+            return
+        dn, entry = old
+        key = _dn_key(dn)
+        if self._dns.get(key) == uuid:
+            del self._dns[key]
+        self._index_entry(uuid, entry, False)
+
+    def put(self, entries):
+        """
+        Adds or replaces entries, given as (dn, entry, uuid) tuples like
+        for :py:meth:`ldap.syncrepl.SyncreplConsumer.syncrepl_entries()`
+        """
+        # normalise the DNs before taking the lock
+        entries = [(_dn_key(dn), dn, entry, uuid)
+                   for dn, entry, uuid in entries]
+        with self._lock:
+            for key, dn, entry, uuid in entries:
+                self._remove(uuid)
+                self._entries[uuid] = (dn, entry)
+                self._dns[key] = uuid
+                self._index_entry(uuid, entry, True)
+
+    def delete(self, uuids):
+        """Removes the entries with the entryUUIDs in uuids"""
+        with self._lock:
+            for uuid in uuids:
+                self._remove(uuid)
+
+    def begin_refresh(self, full):
+        """
+        Called when a syncrepl search starts, with full set if it has no
+        cookie and all entries are sent again
+        """
+        with self._lock:
+            self._present.clear()
+            self._full_refresh = full
+
+    def mark_present(self, uuids):
+        """Records the entryUUIDs in uuids as present in the directory"""
+        with self._lock:
+            self._present.update(uuids)
+
+    def end_present(self, refresh_deletes):
+        """
+        Ends a present phase. Unless refresh_deletes is set, i.e. the
+        server has sent the deleted entries itself, the entries not
+        recorded as present are removed.
+        """
+        with self._lock:
+            if not refresh_deletes:
+                self._sweep()
+            elif not self._full_refresh:
+                self._present.clear()
+
+    def end_refresh(self):
+        """Called at the end of the refresh phase"""
+        with self._lock:
+            if self._full_refresh:
+                self._sweep()
+        self._refreshed.set()
+
+    def _sweep(self):
+        for uuid in [uuid for uuid in self._entries
+                     if uuid not in self._present]:
+            self._remove(uuid)
+        self._present.clear()
+        self._full_refresh = False
+
+
+class ReplicaConsumer(ReconnectLDAPObject, SyncreplConsumer):
+    """
+    Connection keeping a :py:class:`LocalReplica` current with a
+    refreshAndPersist syncrepl search
+
+    replica
+        The :py:class:`LocalReplica` to update
+    base, scope, filterstr, attrlist
+        Of the syncrepl search, like for
+        :py:meth:`ldap.ldapobject.SimpleLDAPObject.search_ext()`
+    batch_size
+        Maximum number of messages applied to the replica at once, see
+        :py:meth:`ldap.syncrepl.SyncreplConsumer.syncrepl_poll()`
+
+    The other arguments are those of
+    :py:class:`ldap.ldapobject.ReconnectLDAPObject`. Bind before calling
+    :py:meth:`run()`.
+    """
+
+    def __init__(self, uri, replica, base, scope=ldap.SCOPE_SUBTREE,
+                 filterstr='(objectClass=*)', attrlist=None, batch_size=100,
+                 **kwargs):
+        ReconnectLDAPObject.__init__(self, uri, **kwargs)
+        self._replica = replica
+        self._base = base
+        self._scope = scope
+        self._filterstr = filterstr
+        self._attrlist = attrlist
+        self._batch_size = batch_size
+        self._stopped = threading.Event()
+
+    def run(self, poll_interval=1.0):
+        """
+        Applies the changes sent by the server to the replica until
+        :py:meth:`stop()` is called, checking every poll_interval
+        seconds. Usually run on a thread of its own.
+
+        When the connection is lost, it reconnects and rebinds like
+        :py:class:`ldap.ldapobject.ReconnectLDAPObject` does and resumes
+        with the cookie of the replica, so only the changes missed are
+        sent. If the server requires a full refresh instead, all entries
+        are read again while the replica keeps answering lookups.
+        """
+        self._stopped.clear()
+        while not self._stopped.is_set():
+            self._replica.begin_refresh(self._replica.cookie is None)
+            msgid = self.syncrepl_search(
+                self._base, self._scope, mode='refreshAndPersist',
+                filterstr=self._filterstr, attrlist=self._attrlist,
+            )
+            try:
+                while not self._stopped.is_set():
+                    try:
+                        if not self.syncrepl_poll(
+                            msgid=msgid, timeout=poll_interval, all=1,
+                            batch_size=self._batch_size,
+                        ):
+                            # ended by the server, start again
+                            msgid = None
+                            break
+                    except ldap.TIMEOUT:
+                        pass
+            except ldap.SERVER_DOWN:
+                msgid = None
+                if not self._stopped.is_set():
+                    self.reconnect(self._uri, retry_max=self._retry_max,
+                                   retry_delay=self._retry_delay)
+            except ldap.LDAPError as e:
+                msgid = None
+                info = e.args[0] if e.args else None
+                if not isinstance(info, dict) or \
+                        info.get('result') != SYNC_REFRESH_REQUIRED:
+                    raise
+                self._replica.cookie = None
+            finally:
+                if msgid is not None:
+                    try:
+                        self.abandon(msgid)
+                    except ldap.LDAPError:
+                        pass
+
+    def stop(self):
+        """
+        Makes :py:meth:`run()` return, after at most its poll_interval
+        """
+        self._stopped.set()
+
+    def syncrepl_get_cookie(self):
+        return self._replica.cookie
+
+    def syncrepl_set_cookie(self, cookie):
+        self._replica.cookie = cookie
+
+    def syncrepl_entry(self, dn, attrs, uuid):
+        self._replica.put([(dn, attrs, uuid)])
+
+    def syncrepl_entries(self, entries):
+        self._replica.put(entries)
+
+    def syncrepl_delete(self, uuids):
+        self._replica.delete(uuids)
+
+    def syncrepl_present(self, uuids, refreshDeletes=False):
+        if uuids is None:
+            self._replica.end_present(refreshDeletes)
+        elif refreshDeletes:
+            self._replica.delete(uuids)
+        else:
+            self._replica.mark_present(uuids)
+
+    def syncrepl_refreshdone(self):
+        self._replica.end_refresh()
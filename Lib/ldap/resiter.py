@@ -12,30 +12,29 @@ class ResultProcessor:
     Mix-in class used with ldap.ldapopbject.LDAPObject or derived classes.
     """
 
-    def allresults(self, msgid, timeout=-1, add_ctrls=0):
+    def allresults(self, msgid, timeout=-1, add_ctrls=0, max_msgs=100):
         """
         Generator function which returns an iterator for processing all LDAP operation
         results of the given msgid like retrieved with LDAPObject.result3() -> 4-tuple
+
+        Results are fetched in batches of up to max_msgs already received
+        messages with LDAPObject.result_batch().
         """
-        result_type, result_list, result_msgid, result_serverctrls, _, _ = \
-            self.result4(
+        while True:
+            batch = self.result_batch(
                 msgid,
-                0,
+                max_msgs,
                 timeout,
                 add_ctrls=add_ctrls
             )
-        while result_type and result_list:
-            yield (
-                result_type,
-                result_list,
-                result_msgid,
-                result_serverctrls
-            )
-            result_type, result_list, result_msgid, result_serverctrls, _, _ = \
-                self.result4(
-                    msgid,
-                    0,
-                    timeout,
-                    add_ctrls=add_ctrls
+            if not batch:
+                return
+            for result_type, result_list, result_msgid, result_serverctrls in batch:
+                if not (result_type and result_list):
+                    return
+                yield (
+                    result_type,
+                    result_list,
+                    result_msgid,
+                    result_serverctrls
                 )
-        return # allresults()
@@ -5,6 +5,10 @@ See https://www.python-ldap.org/ for details.
 """
 
 import copy
+import hashlib
+import marshal
+import os
+import tempfile
 from urllib.request import urlopen
 
 import ldap.cidict,ldap.schema
@@ -24,6 +28,45 @@ for o in list(vars().values()):
 
 SCHEMA_ATTRS = list(SCHEMA_CLASS_MAPPING)
 
+# Version of the format returned by SubSchema.dumps()
+COMPILED_SCHEMA_FORMAT = 1
+
+# Decode modes of the text syntaxes of RFC 4517 and RFC 4512, used by
+# SubSchema.value_decoders(). Values of other syntaxes stay bytes.
+SYNTAX_DECODE_MODES = {
+  '1.3.6.1.4.1.1466.115.121.1.3': ldap.DECODE_STR,   # Attribute Type Description
+  '1.3.6.1.4.1.1466.115.121.1.6': ldap.DECODE_STR,   # Bit String
+  '1.3.6.1.4.1.1466.115.121.1.7': ldap.DECODE_STR,   # Boolean
+  '1.3.6.1.4.1.1466.115.121.1.11': ldap.DECODE_STR,  # Country String
+  '1.3.6.1.4.1.1466.115.121.1.12': ldap.DECODE_STR,  # DN
+  '1.3.6.1.4.1.1466.115.121.1.14': ldap.DECODE_STR,  # Delivery Method
+  '1.3.6.1.4.1.1466.115.121.1.15': ldap.DECODE_STR,  # Directory String
+  '1.3.6.1.4.1.1466.115.121.1.16': ldap.DECODE_STR,  # DIT Content Rule Description
+  '1.3.6.1.4.1.1466.115.121.1.17': ldap.DECODE_STR,  # DIT Structure Rule Description
+  '1.3.6.1.4.1.1466.115.121.1.21': ldap.DECODE_STR,  # Enhanced Guide
+  '1.3.6.1.4.1.1466.115.121.1.22': ldap.DECODE_STR,  # Facsimile Telephone Number
+  '1.3.6.1.4.1.1466.115.121.1.24': ldap.DECODE_GENERALIZED_TIME, # Generalized Time
+  '1.3.6.1.4.1.1466.115.121.1.25': ldap.DECODE_STR,  # Guide
+  '1.3.6.1.4.1.1466.115.121.1.26': ldap.DECODE_STR,  # IA5 String
+  '1.3.6.1.4.1.1466.115.121.1.27': ldap.DECODE_INT,  # INTEGER
+  '1.3.6.1.4.1.1466.115.121.1.30': ldap.DECODE_STR,  # Matching Rule Description
+  '1.3.6.1.4.1.1466.115.121.1.31': ldap.DECODE_STR,  # Matching Rule Use Description
+  '1.3.6.1.4.1.1466.115.121.1.34': ldap.DECODE_STR,  # Name And Optional UID
+  '1.3.6.1.4.1.1466.115.121.1.35': ldap.DECODE_STR,  # Name Form Description
+  '1.3.6.1.4.1.1466.115.121.1.36': ldap.DECODE_STR,  # Numeric String
+  '1.3.6.1.4.1.1466.115.121.1.37': ldap.DECODE_STR,  # Object Class Description
+  '1.3.6.1.4.1.1466.115.121.1.38': ldap.DECODE_STR,  # OID
+  '1.3.6.1.4.1.1466.115.121.1.39': ldap.DECODE_STR,  # Other Mailbox
+  '1.3.6.1.4.1.1466.115.121.1.41': ldap.DECODE_STR,  # Postal Address
+  '1.3.6.1.4.1.1466.115.121.1.44': ldap.DECODE_STR,  # Printable String
+  '1.3.6.1.4.1.1466.115.121.1.50': ldap.DECODE_STR,  # Telephone Number
+  '1.3.6.1.4.1.1466.115.121.1.51': ldap.DECODE_STR,  # Teletex Terminal Identifier
+  '1.3.6.1.4.1.1466.115.121.1.52': ldap.DECODE_STR,  # Telex Number
+  '1.3.6.1.4.1.1466.115.121.1.53': ldap.DECODE_STR,  # UTC Time
+  '1.3.6.1.4.1.1466.115.121.1.54': ldap.DECODE_STR,  # LDAP Syntax Description
+  '1.3.6.1.4.1.1466.115.121.1.58': ldap.DECODE_STR,  # Substring Assertion
+}
+
 
 class SubschemaError(ValueError):
   pass
@@ -77,6 +120,9 @@ class SubSchema:
     List of OIDs used at least twice in the subschema
   non_unique_names
     List of NAMEs used at least twice in the subschema for the same schema element
+  modify_timestamp
+    Value of attribute modifyTimestamp of the sub schema sub entry if
+    present, used to check whether a cached schema is still valid
   """
 
   def __init__(self,sub_schema_sub_entry,check_uniqueness=1):
@@ -94,6 +140,8 @@ class SubSchema:
     # Transform entry dict to case-insensitive dict
     e = ldap.cidict.cidict(sub_schema_sub_entry)
 
+    self.modify_timestamp = _modify_timestamp(e)
+
     # Build the schema registry in dictionaries
     for attr_type in SCHEMA_ATTRS:
 
@@ -133,6 +181,59 @@ class SubSchema:
 
     return # subSchema.__init__()
 
+  def dumps(self):
+    """
+    Returns the parsed subschema as bytes which can be stored and turned
+    into a SubSchema instance again by SubSchema.loads() without parsing
+    the schema element descriptions
+    """
+    sed = []
+    for se_class,se_dict in self.sed.items():
+      sed.append((
+        se_class.schema_attribute,
+        [ (se_id,se_obj.__dict__) for se_id,se_obj in se_dict.items() ],
+        _dump_cidict(self.name2oid[se_class]),
+        _dump_cidict(self.non_unique_names[se_class]),
+      ))
+    return marshal.dumps((
+      COMPILED_SCHEMA_FORMAT,
+      self.modify_timestamp,
+      sed,
+      self.non_unique_oids,
+    ))
+
+  @classmethod
+  def loads(cls,data):
+    """
+    Returns a SubSchema instance from data returned by SubSchema.dumps()
+
+    Raises ValueError if data is not a compiled subschema of the
+    current format.
+    """
+    try:
+      compiled_format,modify_timestamp,sed,non_unique_oids = marshal.loads(data)
+    except (EOFError,TypeError,ValueError) as e:
+      raise ValueError('Invalid compiled subschema: %s' % e)
+    if compiled_format!=COMPILED_SCHEMA_FORMAT:
+      raise ValueError('Unsupported compiled subschema format %r' % (compiled_format,))
+    self = cls.__new__(cls)
+    self.modify_timestamp = modify_timestamp
+    self.name2oid = {}
+    self.sed = {}
+    self.non_unique_oids = non_unique_oids
+    self.non_unique_names = {}
+    for schema_attribute,elements,name2oid,non_unique_names in sed:
+      se_class = SCHEMA_CLASS_MAPPING[schema_attribute]
+      se_dict = {}
+      for se_id,se_attrs in elements:
+        se_obj = se_class.__new__(se_class)
+        se_obj.__dict__ = se_attrs
+        se_dict[se_id] = se_obj
+      self.sed[se_class] = se_dict
+      self.name2oid[se_class] = _load_cidict(name2oid)
+      self.non_unique_names[se_class] = _load_cidict(non_unique_names)
+    return self
+
 
   def ldap_entry(self):
     """
@@ -283,6 +384,35 @@ class SubSchema:
       return at_obj.syntax
 
 
+  def value_decoders(self,syntax_modes=None):
+    """
+    Returns a dictionary mapping the names and OIDs of all attribute types
+    to the decode mode of their, possibly inherited, syntax, to be passed
+    to SimpleLDAPObject.set_value_decoders().
+
+    syntax_modes
+        Dictionary mapping syntax OIDs to decode modes, SYNTAX_DECODE_MODES
+        if None. Attribute types with syntaxes not in it are left out,
+        i.e. their values are returned as bytes.
+    """
+    if syntax_modes is None:
+      syntax_modes = SYNTAX_DECODE_MODES
+    decoders = {}
+    for at_oid,at_obj in self.sed[AttributeType].items():
+      try:
+        syntax = self.get_inheritedattr(AttributeType,at_oid,'syntax')
+      except KeyError:
+        # superior attribute type missing in the schema
+        continue
+      mode = syntax_modes.get(syntax)
+      if mode is None:
+        continue
+      decoders[at_oid] = mode
+      for name in at_obj.names:
+        decoders[name] = mode
+    return decoders
+
+
   def get_structural_oc(self,oc_list):
     """
     Returns OID of structural object class in oc_list
@@ -447,15 +577,84 @@ class SubSchema:
     return r_must,r_may # attribute_types()
 
 
-def urlfetch(uri,trace_level=0):
+def _modify_timestamp(entry):
+  """
+  Returns the modifyTimestamp of cidict entry as str or None
+  """
+  value = (entry.get('modifyTimestamp') or [None])[0]
+  if isinstance(value,bytes):
+    value = value.decode('utf-8')
+  return value
+
+
+def _dump_cidict(d):
+  return d._keys,d._data
+
+
+def _load_cidict(dumped):
+  d = ldap.cidict.cidict.__new__(ldap.cidict.cidict)
+  d._keys,d._data = dumped
+  return d
+
+
+def _cache_file(cache_dir,uri,subschemasubentry_dn):
+  """
+  Returns the name of the file caching the subschema found at uri
+  """
+  key = '\0'.join((uri,subschemasubentry_dn)).encode('utf-8')
+  return os.path.join(cache_dir,hashlib.sha256(key).hexdigest()+'.schema')
+
+
+def _read_cache(cache_file,modify_timestamp):
+  """
+  Returns the cached SubSchema if still valid, None otherwise
+  """
+  try:
+    with open(cache_file,'rb') as f:
+      sub_schema = SubSchema.loads(f.read())
+  except (OSError,KeyError,ValueError):
+    return None
+  if sub_schema.modify_timestamp!=modify_timestamp:
+    return None
+  return sub_schema
+
+
+def _write_cache(cache_file,sub_schema):
+  """
+  Atomically replaces cache_file with the compiled sub_schema,
+  failures are ignored
+  """
+  try:
+    data = sub_schema.dumps()
+    fd,tmp_name = tempfile.mkstemp(dir=os.path.dirname(cache_file) or '.')
+  except (OSError,ValueError):
+    return
+  try:
+    with os.fdopen(fd,'wb') as f:
+      f.write(data)
+    os.replace(tmp_name,cache_file)
+  except OSError:
+    try:
+      os.unlink(tmp_name)
+    except OSError:
+      pass
+
+
+def urlfetch(uri,trace_level=0,cache_dir=None):
   """
   Fetches a parsed schema entry by uri.
 
   If uri is a LDAP URL the LDAP server is queried directly.
   Otherwise uri is assumed to point to a LDIF file which
   is loaded with urllib.
+
+  If cache_dir is set the parsed schema is stored in this directory
+  and reused as long as the modifyTimestamp of the sub schema sub entry
+  does not change. For LDAP URLs only the modifyTimestamp is read from
+  the server then.
   """
   uri = uri.strip()
+  modify_timestamp = None
   if uri.startswith(('ldap:', 'ldaps:', 'ldapi:')):
     ldap_url = ldapurl.LDAPUrl(uri)
 
@@ -463,6 +662,19 @@ def urlfetch(uri,trace_level=0):
     l.protocol_version = ldap.VERSION3
     l.simple_bind_s(ldap_url.who or '', ldap_url.cred or '')
     subschemasubentry_dn = l.search_subschemasubentry_s(ldap_url.dn)
+    if subschemasubentry_dn is not None and cache_dir is not None:
+      modify_timestamp = _modify_timestamp(ldap.cidict.cidict(
+        l.read_subschemasubentry_s(
+          subschemasubentry_dn,attrs=['modifyTimestamp']
+        ) or {}
+      ))
+      if modify_timestamp is not None:
+        cached_sub_schema = _read_cache(
+          _cache_file(cache_dir,uri,subschemasubentry_dn),modify_timestamp
+        )
+        if cached_sub_schema is not None:
+          l.unbind_s()
+          return subschemasubentry_dn,cached_sub_schema
     if subschemasubentry_dn is None:
       s_temp = None
     else:
@@ -480,6 +692,14 @@ def urlfetch(uri,trace_level=0):
     ldif_parser = ldif.LDIFRecordList(ldif_file,max_entries=1)
     ldif_parser.parse()
     subschemasubentry_dn,s_temp = ldif_parser.all_records[0]
+    modify_timestamp = _modify_timestamp(ldap.cidict.cidict(s_temp))
+    if cache_dir is not None:
+      if modify_timestamp is not None:
+        cached_sub_schema = _read_cache(
+          _cache_file(cache_dir,uri,subschemasubentry_dn),modify_timestamp
+        )
+        if cached_sub_schema is not None:
+          return subschemasubentry_dn,cached_sub_schema
   # Work-around for mixed-cased attribute names
   subschemasubentry_entry = ldap.cidict.cidict()
   s_temp = s_temp or {}
@@ -492,6 +712,12 @@ def urlfetch(uri,trace_level=0):
   # Finally parse the schema
   if subschemasubentry_dn!=None:
     parsed_sub_schema = ldap.schema.SubSchema(subschemasubentry_entry)
+    if modify_timestamp is not None:
+      parsed_sub_schema.modify_timestamp = modify_timestamp
+      if cache_dir is not None:
+        _write_cache(
+          _cache_file(cache_dir,uri,subschemasubentry_dn),parsed_sub_schema
+        )
   else:
     parsed_sub_schema = None
   return subschemasubentry_dn, parsed_sub_schema
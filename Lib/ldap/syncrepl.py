@@ -4,11 +4,11 @@ ldap.syncrepl - for implementing syncrepl consumer (see RFC 4533)
 See https://www.python-ldap.org/ for project details.
 """
 
-from uuid import UUID
+import _ldap
 
 # Imports from pyasn1
 from pyasn1.type import tag, namedtype, namedval, univ, constraint
-from pyasn1.codec.ber import encoder, decoder
+from pyasn1.codec.ber import encoder
 
 from ldap.pkginfo import __version__, __author__, __license__
 from ldap.controls import RequestControl, ResponseControl, KNOWN_RESPONSE_CONTROLS
@@ -147,16 +147,10 @@ class SyncStateControl(ResponseControl):
     opnames = ('present', 'add', 'modify', 'delete')
 
     def decodeControlValue(self, encodedControlValue):
-        d = decoder.decode(encodedControlValue, asn1Spec=SyncStateValue())
-        state = d[0].getComponentByName('state')
-        uuid = UUID(bytes=bytes(d[0].getComponentByName('entryUUID')))
-        cookie = d[0].getComponentByName('cookie')
-        if cookie is not None and cookie.hasValue():
-            self.cookie = str(cookie)
-        else:
-            self.cookie = None
-        self.state = self.__class__.opnames[int(state)]
-        self.entryUUID = str(uuid)
+        state, self.entryUUID, self.cookie = _ldap.decode_syncstate_control(
+            encodedControlValue
+        )
+        self.state = self.__class__.opnames[state]
 
 KNOWN_RESPONSE_CONTROLS[SyncStateControl.controlType] = SyncStateControl
 
@@ -187,17 +181,9 @@ class SyncDoneControl(ResponseControl):
     controlType = '1.3.6.1.4.1.4203.1.9.1.3'
 
     def decodeControlValue(self, encodedControlValue):
-        d = decoder.decode(encodedControlValue, asn1Spec=SyncDoneValue())
-        cookie = d[0].getComponentByName('cookie')
-        if cookie.hasValue():
-            self.cookie = str(cookie)
-        else:
-            self.cookie = None
-        refresh_deletes = d[0].getComponentByName('refreshDeletes')
-        if refresh_deletes.hasValue():
-            self.refreshDeletes = bool(refresh_deletes)
-        else:
-            self.refreshDeletes = None
+        self.cookie, self.refreshDeletes = _ldap.decode_syncdone_control(
+            encodedControlValue
+        )
 
 KNOWN_RESPONSE_CONTROLS[SyncDoneControl.controlType] = SyncDoneControl
 
@@ -306,42 +292,29 @@ class SyncInfoMessage:
     """
     responseName = '1.3.6.1.4.1.4203.1.9.1.4'
 
+    # names of the syncInfoValue choices
+    choices = ('newcookie', 'refreshDelete', 'refreshPresent', 'syncIdSet')
+
     def __init__(self, encodedMessage):
-        d = decoder.decode(encodedMessage, asn1Spec=SyncInfoValue())
+        choice, cookie, flag, uuids = _ldap.decode_syncinfo_value(encodedMessage)
         self.newcookie = None
         self.refreshDelete = None
         self.refreshPresent = None
         self.syncIdSet = None
 
-        # Due to the way pyasn1 works, refreshDelete and refreshPresent are both
-        # valid in the components as they are fully populated defaults. We must
-        # get the component directly from the message, not by iteration.
-        attr = d[0].getName()
-        comp = d[0].getComponent()
-
-        if comp is not None and comp.hasValue():
-            if attr == 'newcookie':
-                self.newcookie = str(comp)
-                return
-
-            val = {}
-
-            cookie = comp.getComponentByName('cookie')
-            if cookie.hasValue():
-                val['cookie'] = str(cookie)
+        if choice == 0:
+            self.newcookie = cookie
+            return
 
-            if attr.startswith('refresh'):
-                val['refreshDone'] = bool(comp.getComponentByName('refreshDone'))
-            elif attr == 'syncIdSet':
-                uuids = []
-                ids = comp.getComponentByName('syncUUIDs')
-                for i in range(len(ids)):
-                    uuid = UUID(bytes=bytes(ids.getComponentByPosition(i)))
-                    uuids.append(str(uuid))
-                val['syncUUIDs'] = uuids
-                val['refreshDeletes'] = bool(comp.getComponentByName('refreshDeletes'))
-
-            setattr(self, attr, val)
+        val = {}
+        if cookie is not None:
+            val['cookie'] = cookie
+        if choice == 3:
+            val['syncUUIDs'] = uuids
+            val['refreshDeletes'] = flag
+        else:
+            val['refreshDone'] = flag
+        setattr(self, self.choices[choice], val)
 
 
 class SyncreplConsumer:
@@ -386,7 +359,7 @@ class SyncreplConsumer:
         self.__refreshDone = False
         return self.search_ext(base, scope, **search_args)
 
-    def syncrepl_poll(self, msgid=-1, timeout=None, all=0):
+    def syncrepl_poll(self, msgid=-1, timeout=None, all=0, batch_size=0):
         """
         polls for and processes responses to the syncrepl_search() operation.
         Returns False when operation finishes, True if it is in progress, or
@@ -397,81 +370,147 @@ class SyncreplConsumer:
         If all is set to a nonzero value, poll() will return only when finished
         or when an exception is raised.
 
+        If batch_size is non-zero, up to batch_size responses already
+        received are fetched at once with result_batch(). Added or
+        modified entries are then passed to syncrepl_entries() in lists
+        and presented UUIDs to syncrepl_present() in one list, both as
+        late as possible, i.e. before any other callback and at the end of
+        each batch. syncrepl_set_cookie() is only called with the latest
+        cookie after the entries it covers have been passed on. If a
+        callback raises an exception, the entries and cookie held back
+        are dropped, so a new syncrepl_search() with the last cookie
+        stored receives them again.
         """
         while True:
-            type, msg, mid, ctrls, n, v = self.result4(
-                msgid=msgid,
-                timeout=timeout,
-                add_intermediates=1,
-                add_ctrls=1,
-                all=0,
-            )
+            if batch_size:
+                responses = self.result_batch(
+                    msgid=msgid,
+                    max_msgs=batch_size,
+                    timeout=timeout,
+                    add_intermediates=1,
+                    add_ctrls=1,
+                )
+            else:
+                type, msg, mid, ctrls, n, v = self.result4(
+                    msgid=msgid,
+                    timeout=timeout,
+                    add_intermediates=1,
+                    add_ctrls=1,
+                    all=0,
+                )
+                responses = [(type, msg, mid, ctrls)]
+
+            self.__batched = bool(batch_size)
+            self.__pending_entries = []
+            self.__pending_uuids = []
+            self.__pending_cookie = None
+            for type, msg, mid, ctrls in responses:
+                if not self.__syncrepl_process(type, msg, ctrls):
+                    return False
+            self.__syncrepl_flush()
 
-            if type == 101:
-                # search result. This marks the end of a refreshOnly session.
-                # look for a SyncDone control, save the cookie, and if necessary
-                # delete non-present entries.
+            if all == 0:
+                return True
+
+    def __syncrepl_flush(self):
+        """
+        Passes on the entries, UUIDs and cookie held back in batch mode
+        """
+        if self.__pending_entries:
+            entries, self.__pending_entries = self.__pending_entries, []
+            self.syncrepl_entries(entries)
+        if self.__pending_uuids:
+            uuids, self.__pending_uuids = self.__pending_uuids, []
+            self.syncrepl_present(uuids)
+        if self.__pending_cookie is not None:
+            cookie, self.__pending_cookie = self.__pending_cookie, None
+            self.syncrepl_set_cookie(cookie)
+
+    def __syncrepl_cookie(self, cookie):
+        if self.__batched:
+            self.__pending_cookie = cookie
+        else:
+            self.syncrepl_set_cookie(cookie)
+
+    def __syncrepl_process(self, type, msg, ctrls):
+        """
+        Processes a single response, returns False for the final one
+        """
+        if type == 101:
+            # search result. This marks the end of a refreshOnly session.
+            # look for a SyncDone control, save the cookie, and if necessary
+            # delete non-present entries.
+            self.__syncrepl_flush()
+            for c in ctrls:
+                if c.__class__.__name__ != 'SyncDoneControl':
+                    continue
+                self.syncrepl_present(None, refreshDeletes=c.refreshDeletes)
+                if c.cookie is not None:
+                    self.syncrepl_set_cookie(c.cookie)
+
+            return False
+
+        elif type == 100:
+            # search entry with associated SyncState control
+            for m in msg:
+                dn, attrs, ctrls = m
                 for c in ctrls:
-                    if c.__class__.__name__ != 'SyncDoneControl':
+                    if c.__class__.__name__ != 'SyncStateControl':
                         continue
-                    self.syncrepl_present(None, refreshDeletes=c.refreshDeletes)
-                    if c.cookie is not None:
-                        self.syncrepl_set_cookie(c.cookie)
-
-                return False
-
-            elif type == 100:
-                # search entry with associated SyncState control
-                for m in msg:
-                    dn, attrs, ctrls = m
-                    for c in ctrls:
-                        if c.__class__.__name__ != 'SyncStateControl':
-                            continue
-                        if c.state == 'present':
-                            self.syncrepl_present([c.entryUUID])
-                        elif c.state == 'delete':
-                            self.syncrepl_delete([c.entryUUID])
+                    if c.state == 'present':
+                        if self.__batched:
+                            self.__pending_uuids.append(c.entryUUID)
                         else:
-                            self.syncrepl_entry(dn, attrs, c.entryUUID)
-                            if self.__refreshDone is False:
-                                self.syncrepl_present([c.entryUUID])
-                        if c.cookie is not None:
-                            self.syncrepl_set_cookie(c.cookie)
-                        break
-
-            elif type == 121:
-                # Intermediate message. If it is a SyncInfoMessage, parse it
-                for m in msg:
-                    rname, resp, ctrls = m
-                    if rname != SyncInfoMessage.responseName:
-                        continue
-                    sim = SyncInfoMessage(resp)
-                    if sim.newcookie is not None:
-                        self.syncrepl_set_cookie(sim.newcookie)
-                    elif sim.refreshPresent is not None:
-                        self.syncrepl_present(None, refreshDeletes=False)
-                        if 'cookie' in sim.refreshPresent:
-                            self.syncrepl_set_cookie(sim.refreshPresent['cookie'])
-                        if sim.refreshPresent['refreshDone']:
-                            self.__refreshDone = True
-                            self.syncrepl_refreshdone()
-                    elif sim.refreshDelete is not None:
-                        self.syncrepl_present(None, refreshDeletes=True)
-                        if 'cookie' in sim.refreshDelete:
-                            self.syncrepl_set_cookie(sim.refreshDelete['cookie'])
-                        if sim.refreshDelete['refreshDone']:
-                            self.__refreshDone = True
-                            self.syncrepl_refreshdone()
-                    elif sim.syncIdSet is not None:
-                        if sim.syncIdSet['refreshDeletes'] is True:
-                            self.syncrepl_delete(sim.syncIdSet['syncUUIDs'])
-                        else:
-                            self.syncrepl_present(sim.syncIdSet['syncUUIDs'])
-                        if 'cookie' in sim.syncIdSet:
-                            self.syncrepl_set_cookie(sim.syncIdSet['cookie'])
-
-            if all == 0:
-                return True
+                            self.syncrepl_present([c.entryUUID])
+                    elif c.state == 'delete':
+                        self.__syncrepl_flush()
+                        self.syncrepl_delete([c.entryUUID])
+                    elif self.__batched:
+                        self.__pending_entries.append((dn, attrs, c.entryUUID))
+                        if self.__refreshDone is False:
+                            self.__pending_uuids.append(c.entryUUID)
+                    else:
+                        self.syncrepl_entry(dn, attrs, c.entryUUID)
+                        if self.__refreshDone is False:
+                            self.syncrepl_present([c.entryUUID])
+                    if c.cookie is not None:
+                        self.__syncrepl_cookie(c.cookie)
+                    break
+
+        elif type == 121:
+            # Intermediate message. If it is a SyncInfoMessage, parse it
+            for m in msg:
+                rname, resp, ctrls = m
+                if rname != SyncInfoMessage.responseName:
+                    continue
+                sim = SyncInfoMessage(resp)
+                if sim.newcookie is not None:
+                    self.__syncrepl_cookie(sim.newcookie)
+                    continue
+                self.__syncrepl_flush()
+                if sim.refreshPresent is not None:
+                    self.syncrepl_present(None, refreshDeletes=False)
+                    if 'cookie' in sim.refreshPresent:
+                        self.syncrepl_set_cookie(sim.refreshPresent['cookie'])
+                    if sim.refreshPresent['refreshDone']:
+                        self.__refreshDone = True
+                        self.syncrepl_refreshdone()
+                elif sim.refreshDelete is not None:
+                    self.syncrepl_present(None, refreshDeletes=True)
+                    if 'cookie' in sim.refreshDelete:
+                        self.syncrepl_set_cookie(sim.refreshDelete['cookie'])
+                    if sim.refreshDelete['refreshDone']:
+                        self.__refreshDone = True
+                        self.syncrepl_refreshdone()
+                elif sim.syncIdSet is not None:
+                    if sim.syncIdSet['refreshDeletes'] is True:
+                        self.syncrepl_delete(sim.syncIdSet['syncUUIDs'])
+                    else:
+                        self.syncrepl_present(sim.syncIdSet['syncUUIDs'])
+                    if 'cookie' in sim.syncIdSet:
+                        self.syncrepl_set_cookie(sim.syncIdSet['cookie'])
+
+        return True
 
 
     # virtual methods -- subclass must override these to do useful work
@@ -526,6 +565,17 @@ class SyncreplConsumer:
         """
         pass
 
+    def syncrepl_entries(self, entries):
+        """
+        Called by syncrepl_poll() in batch mode for a list of added or
+        modified entries, given as (dn, attrs, uuid) tuples in the order
+        received.
+
+        The default implementation calls syncrepl_entry() for each entry.
+        """
+        for dn, attrs, uuid in entries:
+            self.syncrepl_entry(dn, attrs, uuid)
+
     def syncrepl_refreshdone(self):
         """
         Called by syncrepl_poll() between refresh and persist phase.
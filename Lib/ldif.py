@@ -17,14 +17,19 @@ __all__ = [
   'LDIFCopy',
 ]
 
+import codecs
+import mmap
 import re
 from base64 import b64encode, b64decode
+from functools import partial
 from io import StringIO
 import warnings
 
 from urllib.parse import urlparse
 from urllib.request import urlopen
 
+import _ldap
+
 attrtype_pattern = r'[\w;.-]+(;[\w_-]+)*'
 attrvalue_pattern = r'(([^,]|\\,)+|".*?")'
 attrtypeandvalue_pattern = attrtype_pattern + r'[ ]*=[ ]*' + attrvalue_pattern
@@ -46,6 +51,12 @@ MOD_OP_STR = {
 }
 
 CHANGE_TYPES = ['add','delete','modify','modrdn']
+
+# Size of the chunks in which text files are encoded for the native reader
+NATIVE_READ_CHUNK_SIZE = 1024*1024
+
+# Encodings of text files whose bytes the native reader maps directly
+NATIVE_MMAP_ENCODINGS = ('utf-8','ascii')
 valid_changetype_dict = {}
 for c in CHANGE_TYPES:
   valid_changetype_dict[c]=None
@@ -71,6 +82,16 @@ def list_dict(l):
   return {i: None for i in l}
 
 
+def _fetch_url(process_url_schemes,url):
+  """
+  return the data found at url if its scheme is in process_url_schemes
+  """
+  u = urlparse(url)
+  if u[0] in process_url_schemes:
+    return urlopen(url).read()
+  return None
+
+
 class LDIFWriter:
   """
   Write LDIF entry or change records to file object
@@ -78,7 +99,7 @@ class LDIFWriter:
   via URLs
   """
 
-  def __init__(self,output_file,base64_attrs=None,cols=76,line_sep='\n'):
+  def __init__(self,output_file,base64_attrs=None,cols=76,line_sep='\n',native=False):
     """
     output_file
         file object for output; should be opened in *text* mode
@@ -89,11 +110,14 @@ class LDIFWriter:
         folded into many lines.
     line_sep
         String used as line separator
+    native
+        If True entry records are written by the C extension module
     """
     self._output_file = output_file
     self._base64_attrs = list_dict([a.lower() for a in (base64_attrs or [])])
     self._cols = cols
     self._last_line_sep = line_sep
+    self._native = native
     self.records_written = 0
 
   def _unfold_lines(self,line):
@@ -188,6 +212,9 @@ class LDIFWriter:
           Either a dictionary holding the LDAP entry {attrtype:record}
           or a list with a modify list like for LDAPObject.modify().
     """
+    if self._native and isinstance(record,dict):
+      self.unparse_results([(dn,record)])
+      return
     # Start with line containing the distinguished name
     dn = dn.encode('utf-8')
     self._unparseAttrTypeandValue('dn', dn)
@@ -204,6 +231,28 @@ class LDIFWriter:
     self.records_written = self.records_written+1
     return # unparse()
 
+  def unparse_results(self,results):
+    """
+    results
+          List of 2-tuples (dn, entry) like returned by
+          LDAPObject.result4() or search_s(). Search continuations
+          are skipped.
+
+    All entry records are written with a single write() call.
+    """
+    if self._native:
+      ldif_str,count = _ldap.ldif_unparse(
+        results,self._base64_attrs,self._cols,self._last_line_sep
+      )
+      if ldif_str:
+        self._output_file.write(ldif_str)
+      self.records_written = self.records_written+count
+    else:
+      for dn,entry in results:
+        if isinstance(entry,dict):
+          self.unparse(dn,entry)
+    return # unparse_results()
+
 
 def CreateLDIF(dn,record,base64_attrs=None,cols=76):
   """
@@ -252,7 +301,8 @@ class LDIFParser:
     ignored_attr_types=None,
     max_entries=0,
     process_url_schemes=None,
-    line_sep='\n'
+    line_sep='\n',
+    native=False
   ):
     """
     Parameters:
@@ -269,6 +319,9 @@ class LDIFParser:
         is ignored completely.
     line_sep
         String used as line separator
+    native
+        If True the input is parsed by the C extension module,
+        reading from a memory-mapped file if possible.
     """
     self._input_file = input_file
     # Detect whether the file is open in text or bytes mode.
@@ -285,12 +338,65 @@ class LDIFParser:
     self.changetype_counter = {}.fromkeys(CHANGE_TYPES,0)
     # Store some symbols for better performance
     self._b64decode = b64decode
+    self._reader = None
+    if native:
+      self._reader = self._native_reader()
+      self._next_key_and_value = self._reader.next_key_and_value
+      return
     # Read very first line
     try:
       self._last_line = self._readline()
     except EOFError:
       self._last_line = ''
 
+  def _native_reader(self):
+    """
+    Return a _ldap.ldif_reader() for the remaining input
+    """
+    data = None
+    offset = 0
+    if self._file_sends_bytes or self._text_file_is_utf8():
+      try:
+        offset = self._input_file.tell()
+        data = mmap.mmap(self._input_file.fileno(),0,access=mmap.ACCESS_READ)
+      except (AttributeError,OSError,ValueError):
+        # no real file, e.g. io.BytesIO, or an empty file
+        data = None
+        offset = 0
+    if data is None:
+      if self._file_sends_bytes:
+        data = self._input_file.read()
+      else:
+        # encode chunk-wise instead of holding the whole text twice
+        data = bytearray()
+        while True:
+          chunk = self._input_file.read(NATIVE_READ_CHUNK_SIZE)
+          if not chunk:
+            break
+          data += chunk.encode('utf-8')
+    if self._process_url_schemes:
+      url_handler = partial(_fetch_url,self._process_url_schemes)
+    else:
+      url_handler = None
+    return _ldap.ldif_reader(
+      data,offset,url_handler,set(self._ignored_attr_types) or None,is_dn
+    )
+
+  def _text_file_is_utf8(self):
+    """
+    Return whether the text file's bytes can be mapped as UTF-8 as is
+    """
+    try:
+      encoding = codecs.lookup(self._input_file.encoding).name
+    except (AttributeError,LookupError,TypeError):
+      # e.g. io.StringIO
+      return False
+    return encoding in NATIVE_MMAP_ENCODINGS
+
+  def _update_counters(self):
+    self.line_counter = self._reader.line_counter
+    self.byte_counter = self._reader.byte_counter
+
   def handle(self,dn,entry):
     """
     Process a single content LDIF record. This method should be
@@ -398,10 +504,46 @@ class LDIFParser:
       k,v = None,None
     return k,v
 
+  def _next_entries(self,max_records):
+    """
+    Return up to max_records entry records read by the native reader
+    """
+    if self._max_entries:
+      max_records = min(max_records,self._max_entries-self.records_read)
+    try:
+      records = self._reader.next_entries(max_records)
+    finally:
+      self._update_counters()
+    if self.version is None and self._reader.version is not None:
+      self.version = int(self._reader.version.decode('ascii'))
+    return records
+
+  def read_entry_records(self,max_records=1000):
+    """
+    Read and parse up to max_records LDIF entry records and return
+    them as list of 2-tuples (dn, entry) without calling handle().
+    An empty list is returned at the end of the input.
+
+    Only available with native=True.
+    """
+    if self._reader is None:
+      raise ValueError('read_entry_records() requires native=True')
+    records = self._next_entries(max_records)
+    self.records_read = self.records_read + len(records)
+    return records
+
   def parse_entry_records(self):
     """
     Continuously read and parse LDIF entry records
     """
+    if self._reader is not None:
+      records = self._next_entries(1000)
+      while records:
+        for dn,entry in records:
+          self.handle(dn,entry)
+          self.records_read = self.records_read + 1
+        records = self._next_entries(1000)
+      return
     # Local symbol for better performance
     next_key_and_value = self._next_key_and_value
 
@@ -467,6 +609,14 @@ class LDIFParser:
     pass
 
   def parse_change_records(self):
+    if self._reader is not None:
+      try:
+        return self._parse_change_records()
+      finally:
+        self._update_counters()
+    return self._parse_change_records()
+
+  def _parse_change_records(self):
     # Local symbol for better performance
     next_key_and_value = self._next_key_and_value
     # Consume empty lines
@@ -570,7 +720,7 @@ class LDIFParser:
         self.changetype_counter[changetype] = 1
       self.records_read = self.records_read + 1
 
-    return # parse_change_records()
+    return # _parse_change_records()
 
 
 class LDIFRecordList(LDIFParser):
@@ -584,9 +734,13 @@ class LDIFRecordList(LDIFParser):
   def __init__(
     self,
     input_file,
-    ignored_attr_types=None,max_entries=0,process_url_schemes=None
+    ignored_attr_types=None,max_entries=0,process_url_schemes=None,
+    native=False
   ):
-    LDIFParser.__init__(self,input_file,ignored_attr_types,max_entries,process_url_schemes)
+    LDIFParser.__init__(
+      self,input_file,ignored_attr_types,max_entries,process_url_schemes,
+      native=native
+    )
 
     #: List storing parsed records.
     self.all_records = []
@@ -9,8 +9,12 @@
 #include "LDAPObject.h"
 #include "ldapcontrol.h"
 #include "message.h"
+#include "columns.h"
 #include "berval.h"
+#include "cidict.h"
+#include "filter.h"
 #include "options.h"
+#include "wait.h"
 
 #ifdef HAVE_SASL
 #include <sasl/sasl.h>
@@ -23,13 +27,28 @@ static void free_attrs(char ***);
 LDAPObject *
 newLDAPObject(LDAP *l)
 {
-    LDAPObject *self = (LDAPObject *)PyObject_NEW(LDAPObject, &LDAP_Type);
+    PyThread_type_lock lock = PyThread_allocate_lock();
+    LDAPObject *self;
 
-    if (self == NULL)
+    if (lock == NULL) {
+        PyErr_NoMemory();
         return NULL;
+    }
+    self = (LDAPObject *)PyObject_NEW(LDAPObject, &LDAP_Type);
+    if (self == NULL) {
+        PyThread_free_lock(lock);
+        return NULL;
+    }
     self->ldap = l;
-    self->_save = NULL;
+    self->lock = lock;
     self->valid = 1;
+    self->attrcache = NULL;
+    self->attrcache_used = 0;
+    self->pending = NULL;
+    self->num_pending = 0;
+    LDAPstats_reset(&self->stats);
+    LDAPflow_init(&self->flow);
+    self->value_decoders = NULL;
     return self;
 }
 
@@ -47,9 +66,47 @@ dealloc(LDAPObject *self)
         }
         self->ldap = NULL;
     }
+    while (self->num_pending > 0)
+        ldap_msgfree(self->pending[--self->num_pending]);
+    PyMem_DEL(self->pending);
+    self->pending = NULL;
+    LDAPflow_clear(&self->flow);
+    LDAPattrcache_clear(self);
+    Py_CLEAR(self->value_decoders);
+    PyThread_free_lock(self->lock);
     PyObject_DEL(self);
 }
 
+/*
+ * Acquires the lock of l without the GIL, counting the waits if another
+ * thread holds it
+ */
+void
+LDAPlock_nogil(LDAPObject *l)
+{
+    LDAPStatsCount start;
+
+    if (PyThread_acquire_lock(l->lock, NOWAIT_LOCK))
+        return;
+    start = LDAPstats_now();
+    PyThread_acquire_lock(l->lock, WAIT_LOCK);
+    l->stats.lock_waits++;
+    l->stats.lock_wait_ns += LDAPstats_now() - start;
+}
+
+/* Acquires the lock of l while attached, detaching while waiting for it */
+void
+LDAPlock(LDAPObject *l)
+{
+    PyThreadState *save;
+
+    if (PyThread_acquire_lock(l->lock, NOWAIT_LOCK))
+        return;
+    save = PyEval_SaveThread();
+    LDAPlock_nogil(l);
+    PyEval_RestoreThread(save);
+}
+
 /*------------------------------------------------------------
  * utility functions
  */
@@ -71,6 +128,39 @@ not_valid(LDAPObject *l)
     }
 }
 
+/*
+ * The counters in l->stats are updated while attached, in a critical
+ * section so that concurrent calls on free-threaded builds lose none.
+ */
+
+static void
+count_request(LDAPObject *l, int op)
+{
+    Py_BEGIN_CRITICAL_SECTION(l);
+    LDAPstats_request(&l->stats, op);
+    Py_END_CRITICAL_SECTION();
+}
+
+/* Records a wait for a result, and the messages received if any */
+static void
+count_result(LDAPObject *l, int res_type, LDAPStatsCount wait_ns,
+             LDAPStatsCount decode_ns, LDAPMessage *msg)
+{
+    Py_BEGIN_CRITICAL_SECTION(l);
+    LDAPstats_result(&l->stats, res_type, wait_ns, decode_ns);
+    if (res_type > 0 && msg != NULL)
+        LDAPstats_received(&l->stats, l->ldap, msg);
+    Py_END_CRITICAL_SECTION();
+}
+
+static void
+count_convert(LDAPObject *l, int res_type, LDAPStatsCount convert_ns)
+{
+    Py_BEGIN_CRITICAL_SECTION(l);
+    LDAPstats_convert(&l->stats, res_type, convert_ns);
+    Py_END_CRITICAL_SECTION();
+}
+
 /* free a LDAPMod (complete or partially) allocated in Tuple_to_LDAPMod() */
 
 static void
@@ -391,6 +481,7 @@ l_ldap_unbind_ext(LDAPObject *self, PyObject *args)
     LDAPControl **client_ldcs = NULL;
 
     int ldaperror;
+    LDAPErrorState err;
 
     if (!PyArg_ParseTuple(args, "|OO:unbind_ext", &serverctrls, &clientctrls))
         return NULL;
@@ -409,17 +500,23 @@ l_ldap_unbind_ext(LDAPObject *self, PyObject *args)
         }
     }
 
+    /* threads waiting in LDAPwait_result() notice that valid is cleared */
     LDAP_BEGIN_ALLOW_THREADS(self);
     ldaperror = ldap_unbind_ext(self->ldap, server_ldcs, client_ldcs);
+    if (ldaperror == LDAP_SUCCESS) {
+        self->valid = 0;
+        LDAPflow_clear(&self->flow);
+    }
+    if (ldaperror != LDAP_SUCCESS)
+        LDAPerror_save(self->ldap, &err);
     LDAP_END_ALLOW_THREADS(self);
 
     LDAPControl_List_DEL(server_ldcs);
     LDAPControl_List_DEL(client_ldcs);
 
     if (ldaperror != LDAP_SUCCESS)
-        return LDAPerror(self->ldap);
+        return LDAPerror_raise(&err);
 
-    self->valid = 0;
     Py_INCREF(Py_None);
     return Py_None;
 }
@@ -436,6 +533,7 @@ l_ldap_abandon_ext(LDAPObject *self, PyObject *args)
     LDAPControl **client_ldcs = NULL;
 
     int ldaperror;
+    LDAPErrorState err;
 
     if (!PyArg_ParseTuple
         (args, "i|OO:abandon_ext", &msgid, &serverctrls, &clientctrls))
@@ -457,13 +555,16 @@ l_ldap_abandon_ext(LDAPObject *self, PyObject *args)
 
     LDAP_BEGIN_ALLOW_THREADS(self);
     ldaperror = ldap_abandon_ext(self->ldap, msgid, server_ldcs, client_ldcs);
+    LDAPflow_remove(&self->flow, msgid);
+    if (ldaperror != LDAP_SUCCESS)
+        LDAPerror_save(self->ldap, &err);
     LDAP_END_ALLOW_THREADS(self);
 
     LDAPControl_List_DEL(server_ldcs);
     LDAPControl_List_DEL(client_ldcs);
 
     if (ldaperror != LDAP_SUCCESS)
-        return LDAPerror(self->ldap);
+        return LDAPerror_raise(&err);
 
     Py_INCREF(Py_None);
     return Py_None;
@@ -483,6 +584,7 @@ l_ldap_add_ext(LDAPObject *self, PyObject *args)
 
     int msgid;
     int ldaperror;
+    LDAPErrorState err;
     LDAPMod **mods;
 
     if (!PyArg_ParseTuple
@@ -513,14 +615,17 @@ l_ldap_add_ext(LDAPObject *self, PyObject *args)
     LDAP_BEGIN_ALLOW_THREADS(self);
     ldaperror =
         ldap_add_ext(self->ldap, dn, mods, server_ldcs, client_ldcs, &msgid);
+    if (ldaperror != LDAP_SUCCESS)
+        LDAPerror_save(self->ldap, &err);
     LDAP_END_ALLOW_THREADS(self);
     LDAPMods_DEL(mods);
     LDAPControl_List_DEL(server_ldcs);
     LDAPControl_List_DEL(client_ldcs);
 
     if (ldaperror != LDAP_SUCCESS)
-        return LDAPerror(self->ldap);
+        return LDAPerror_raise(&err);
 
+    count_request(self, LDAP_STATS_ADD);
     return PyInt_FromLong(msgid);
 }
 
@@ -532,6 +637,7 @@ l_ldap_simple_bind(LDAPObject *self, PyObject *args)
     char *who;
     int msgid;
     int ldaperror;
+    LDAPErrorState err;
     Py_ssize_t cred_len;
     PyObject *serverctrls = Py_None;
     PyObject *clientctrls = Py_None;
@@ -564,14 +670,17 @@ l_ldap_simple_bind(LDAPObject *self, PyObject *args)
     ldaperror =
         ldap_sasl_bind(self->ldap, who, LDAP_SASL_SIMPLE, &cred, server_ldcs,
                        client_ldcs, &msgid);
+    if (ldaperror != LDAP_SUCCESS)
+        LDAPerror_save(self->ldap, &err);
     LDAP_END_ALLOW_THREADS(self);
 
     LDAPControl_List_DEL(server_ldcs);
     LDAPControl_List_DEL(client_ldcs);
 
     if (ldaperror != LDAP_SUCCESS)
-        return LDAPerror(self->ldap);
+        return LDAPerror_raise(&err);
 
+    count_request(self, LDAP_STATS_BIND);
     return PyInt_FromLong(msgid);
 }
 
@@ -611,6 +720,13 @@ l_ldap_simple_bind(LDAPObject *self, PyObject *args)
      argument specifies, which information should be passed back to
      the SASL lib (see SASL_CB_xxx in sasl.h)
 */
+
+/* passed as defaults to py_ldap_sasl_interaction() */
+typedef struct {
+    LDAPObject *ldo;
+    PyObject *SASLObject;
+} LDAPSASLDefaults;
+
 static int
 interaction(unsigned flags, sasl_interact_t *interact, PyObject *SASLObject)
 {
@@ -653,6 +769,8 @@ interaction(unsigned flags, sasl_interact_t *interact, PyObject *SASLObject)
   reference). The last interact in the array has an interact->id of
   SASL_CB_LIST_END.
 
+  It is called holding the lock of the connection, which is released
+  while calling back into Python.
 */
 
 int
@@ -660,18 +778,17 @@ py_ldap_sasl_interaction(LDAP *ld, unsigned flags, void *defaults, void *in)
 {
     /* These are just typecasts */
     sasl_interact_t *interact = (sasl_interact_t *)in;
-    PyObject *SASLObject = (PyObject *)defaults;
+    LDAPSASLDefaults *d = (LDAPSASLDefaults *)defaults;
+    int rc = LDAP_SUCCESS;
 
+    LDAPunlock(d->ldo);
     /* Loop over the array of sasl_interact_t structs */
-    while (interact->id != SASL_CB_LIST_END) {
-        int rc = 0;
-
-        rc = interaction(flags, interact, SASLObject);
-        if (rc)
-            return rc;
+    while (rc == LDAP_SUCCESS && interact->id != SASL_CB_LIST_END) {
+        rc = interaction(flags, interact, d->SASLObject);
         interact++;
     }
-    return LDAP_SUCCESS;
+    LDAPlock(d->ldo);
+    return rc;
 }
 
 static PyObject *
@@ -689,6 +806,7 @@ l_ldap_sasl_bind_s(LDAPObject *self, PyObject *args)
 
     struct berval *servercred;
     int ldaperror;
+    LDAPErrorState err;
 
     if (!PyArg_ParseTuple
         (args, "zzz#OO:sasl_bind_s", &dn, &mechanism, &cred.bv_val, &cred_len,
@@ -718,7 +836,11 @@ l_ldap_sasl_bind_s(LDAPObject *self, PyObject *args)
                                  cred.bv_val ? &cred : NULL,
                                  (LDAPControl **)server_ldcs,
                                  (LDAPControl **)client_ldcs, &servercred);
+    if (ldaperror != LDAP_SUCCESS &&
+        ldaperror != LDAP_SASL_BIND_IN_PROGRESS)
+        LDAPerror_save(self->ldap, &err);
     LDAP_END_ALLOW_THREADS(self);
+    count_request(self, LDAP_STATS_BIND);
 
     LDAPControl_List_DEL(server_ldcs);
     LDAPControl_List_DEL(client_ldcs);
@@ -729,7 +851,7 @@ l_ldap_sasl_bind_s(LDAPObject *self, PyObject *args)
                                              servercred->bv_len);
     }
     else if (ldaperror != LDAP_SUCCESS)
-        return LDAPerror(self->ldap);
+        return LDAPerror_raise(&err);
     return PyInt_FromLong(ldaperror);
 }
 
@@ -747,6 +869,8 @@ l_ldap_sasl_interactive_bind_s(LDAPObject *self, PyObject *args)
     PyObject *SASLObject = NULL;
     PyObject *mechanism = NULL;
     int msgid;
+    LDAPSASLDefaults defaults;
+    LDAPErrorState err;
 
     static unsigned sasl_flags = LDAP_SASL_QUIET;
 
@@ -788,27 +912,36 @@ l_ldap_sasl_interactive_bind_s(LDAPObject *self, PyObject *args)
     if (mechanism == NULL)
         return NULL;
     c_mechanism = PyBytes_AsString(mechanism);
-    Py_DECREF(mechanism);
-    mechanism = NULL;
 
     /* Don't know if it is the "intended use" of the defaults
        parameter of ldap_sasl_interactive_bind_s when we pass the
        Python object SASLObject, but passing it through some
        static variable would destroy thread safety, IMHO.
+
+       The GIL is kept for the callbacks into SASLObject, the lock of
+       the connection is only released during them.
      */
+    defaults.ldo = self;
+    defaults.SASLObject = SASLObject;
+    LDAPlock(self);
     msgid = ldap_sasl_interactive_bind_s(self->ldap,
                                          who,
                                          c_mechanism,
                                          (LDAPControl **)server_ldcs,
                                          (LDAPControl **)client_ldcs,
                                          sasl_flags,
-                                         py_ldap_sasl_interaction, SASLObject);
+                                         py_ldap_sasl_interaction, &defaults);
+    if (msgid != LDAP_SUCCESS)
+        LDAPerror_save(self->ldap, &err);
+    LDAPunlock(self);
 
+    Py_DECREF(mechanism);
     LDAPControl_List_DEL(server_ldcs);
     LDAPControl_List_DEL(client_ldcs);
 
     if (msgid != LDAP_SUCCESS)
-        return LDAPerror(self->ldap);
+        return LDAPerror_raise(&err);
+    count_request(self, LDAP_STATS_BIND);
     return PyInt_FromLong(msgid);
 }
 #endif
@@ -828,6 +961,7 @@ l_ldap_cancel(LDAPObject *self, PyObject *args)
     LDAPControl **client_ldcs = NULL;
 
     int ldaperror;
+    LDAPErrorState err;
 
     if (!PyArg_ParseTuple
         (args, "i|OO:cancel", &cancelid, &serverctrls, &clientctrls))
@@ -850,14 +984,17 @@ l_ldap_cancel(LDAPObject *self, PyObject *args)
     LDAP_BEGIN_ALLOW_THREADS(self);
     ldaperror =
         ldap_cancel(self->ldap, cancelid, server_ldcs, client_ldcs, &msgid);
+    if (ldaperror != LDAP_SUCCESS)
+        LDAPerror_save(self->ldap, &err);
     LDAP_END_ALLOW_THREADS(self);
 
     LDAPControl_List_DEL(server_ldcs);
     LDAPControl_List_DEL(client_ldcs);
 
     if (ldaperror != LDAP_SUCCESS)
-        return LDAPerror(self->ldap);
+        return LDAPerror_raise(&err);
 
+    count_request(self, LDAP_STATS_EXTENDED);
     return PyInt_FromLong(msgid);
 }
 
@@ -876,6 +1013,7 @@ l_ldap_compare_ext(LDAPObject *self, PyObject *args)
 
     int msgid;
     int ldaperror;
+    LDAPErrorState err;
     Py_ssize_t value_len;
     struct berval value;
 
@@ -904,14 +1042,17 @@ l_ldap_compare_ext(LDAPObject *self, PyObject *args)
     ldaperror =
         ldap_compare_ext(self->ldap, dn, attr, &value, server_ldcs,
                          client_ldcs, &msgid);
+    if (ldaperror != LDAP_SUCCESS)
+        LDAPerror_save(self->ldap, &err);
     LDAP_END_ALLOW_THREADS(self);
 
     LDAPControl_List_DEL(server_ldcs);
     LDAPControl_List_DEL(client_ldcs);
 
     if (ldaperror != LDAP_SUCCESS)
-        return LDAPerror(self->ldap);
+        return LDAPerror_raise(&err);
 
+    count_request(self, LDAP_STATS_COMPARE);
     return PyInt_FromLong(msgid);
 }
 
@@ -928,6 +1069,7 @@ l_ldap_delete_ext(LDAPObject *self, PyObject *args)
 
     int msgid;
     int ldaperror;
+    LDAPErrorState err;
 
     if (!PyArg_ParseTuple
         (args, "s|OO:delete_ext", &dn, &serverctrls, &clientctrls))
@@ -950,14 +1092,17 @@ l_ldap_delete_ext(LDAPObject *self, PyObject *args)
     LDAP_BEGIN_ALLOW_THREADS(self);
     ldaperror =
         ldap_delete_ext(self->ldap, dn, server_ldcs, client_ldcs, &msgid);
+    if (ldaperror != LDAP_SUCCESS)
+        LDAPerror_save(self->ldap, &err);
     LDAP_END_ALLOW_THREADS(self);
 
     LDAPControl_List_DEL(server_ldcs);
     LDAPControl_List_DEL(client_ldcs);
 
     if (ldaperror != LDAP_SUCCESS)
-        return LDAPerror(self->ldap);
+        return LDAPerror_raise(&err);
 
+    count_request(self, LDAP_STATS_DELETE);
     return PyInt_FromLong(msgid);
 }
 
@@ -975,6 +1120,7 @@ l_ldap_modify_ext(LDAPObject *self, PyObject *args)
 
     int msgid;
     int ldaperror;
+    LDAPErrorState err;
     LDAPMod **mods;
 
     if (!PyArg_ParseTuple
@@ -1006,6 +1152,8 @@ l_ldap_modify_ext(LDAPObject *self, PyObject *args)
     ldaperror =
         ldap_modify_ext(self->ldap, dn, mods, server_ldcs, client_ldcs,
                         &msgid);
+    if (ldaperror != LDAP_SUCCESS)
+        LDAPerror_save(self->ldap, &err);
     LDAP_END_ALLOW_THREADS(self);
 
     LDAPMods_DEL(mods);
@@ -1013,8 +1161,9 @@ l_ldap_modify_ext(LDAPObject *self, PyObject *args)
     LDAPControl_List_DEL(client_ldcs);
 
     if (ldaperror != LDAP_SUCCESS)
-        return LDAPerror(self->ldap);
+        return LDAPerror_raise(&err);
 
+    count_request(self, LDAP_STATS_MODIFY);
     return PyInt_FromLong(msgid);
 }
 
@@ -1033,6 +1182,7 @@ l_ldap_rename(LDAPObject *self, PyObject *args)
 
     int msgid;
     int ldaperror;
+    LDAPErrorState err;
 
     if (!PyArg_ParseTuple
         (args, "ss|ziOO:rename", &dn, &newrdn, &newSuperior, &delold,
@@ -1057,76 +1207,234 @@ l_ldap_rename(LDAPObject *self, PyObject *args)
     ldaperror =
         ldap_rename(self->ldap, dn, newrdn, newSuperior, delold, server_ldcs,
                     client_ldcs, &msgid);
+    if (ldaperror != LDAP_SUCCESS)
+        LDAPerror_save(self->ldap, &err);
     LDAP_END_ALLOW_THREADS(self);
 
     LDAPControl_List_DEL(server_ldcs);
     LDAPControl_List_DEL(client_ldcs);
 
     if (ldaperror != LDAP_SUCCESS)
-        return LDAPerror(self->ldap);
+        return LDAPerror_raise(&err);
 
+    count_request(self, LDAP_STATS_MODRDN);
     return PyInt_FromLong(msgid);
 }
 
-/* ldap_result4 */
+/*
+ * Returns the raised LDAPError as exception instance and clears it, so
+ * that errors can be reported per operation. Other exceptions are left
+ * in place and NULL is returned.
+ */
+static PyObject *
+take_ldap_error(void)
+{
+    PyObject *type, *value, *tb;
+
+    if (!PyErr_ExceptionMatches(LDAPexception_class))
+        return NULL;
+    PyErr_Fetch(&type, &value, &tb);
+    PyErr_NormalizeException(&type, &value, &tb);
+    if (tb != NULL)
+        PyException_SetTraceback(value, tb);
+    Py_DECREF(type);
+    Py_XDECREF(tb);
+    return value;
+}
+
+/* a write operation converted by submit_batch() */
+typedef struct {
+    int op;
+    char *dn;
+    LDAPMod **mods;
+    LDAPControl **ctrls;
+    int msgid;
+} LDAPBatchOp;
+
+/* ldap_add_ext, ldap_modify_ext and ldap_delete_ext for many entries */
 
 static PyObject *
-l_ldap_result4(LDAPObject *self, PyObject *args)
+l_ldap_submit_batch(LDAPObject *self, PyObject *args)
 {
-    int msgid = LDAP_RES_ANY;
-    int all = 1;
-    double timeout = -1.0;
-    int add_ctrls = 0;
-    int add_intermediates = 0;
-    int add_extop = 0;
-    struct timeval tv;
-    struct timeval *tvp;
-    int res_type;
-    LDAPMessage *msg = NULL;
-    PyObject *retval, *pmsg, *pyctrls = 0;
-    int res_msgid = 0;
-    char *retoid = 0;
-    PyObject *valuestr = NULL;
-    int result = LDAP_SUCCESS;
-    LDAPControl **serverctrls = 0;
+    PyObject *ops_arg, *ops = NULL, *result = NULL, *item, *senderr = NULL;
+    LDAPBatchOp *ops_c = NULL;
+    Py_ssize_t i, num_ops, num_conv = 0, num_sent;
+    int ldaperror = LDAP_SUCCESS;
+    LDAPErrorState err;
 
-    if (!PyArg_ParseTuple
-        (args, "|iidiii:result4", &msgid, &all, &timeout, &add_ctrls,
-         &add_intermediates, &add_extop))
+    if (!PyArg_ParseTuple(args, "O:submit_batch", &ops_arg))
         return NULL;
     if (not_valid(self))
         return NULL;
 
-    if (timeout >= 0) {
-        tvp = &tv;
-        set_timeval_from_double(tvp, timeout);
-    }
-    else {
-        tvp = NULL;
+    /* a private copy, the strings referenced by the converted operations
+     * must stay alive while the GIL is released */
+    ops = PySequence_List(ops_arg);
+    if (ops == NULL)
+        return NULL;
+    num_ops = PyList_GET_SIZE(ops);
+    if (num_ops == 0)
+        return ops;
+
+    ops_c = PyMem_NEW(LDAPBatchOp, num_ops);
+    if (ops_c == NULL) {
+        PyErr_NoMemory();
+        goto failed;
+    }
+
+    for (num_conv = 0; num_conv < num_ops; num_conv++) {
+        LDAPBatchOp *op = &ops_c[num_conv];
+        PyObject *payload, *serverctrls = Py_None;
+
+        op->mods = NULL;
+        op->ctrls = NULL;
+        if (!PyArg_ParseTuple(PyList_GET_ITEM(ops, num_conv),
+                              "isO|O:submit_batch", &op->op, &op->dn,
+                              &payload, &serverctrls))
+            goto failed;
+
+        switch (op->op) {
+        case LDAP_REQ_ADD:
+            op->mods = List_to_LDAPMods(payload, 1);
+            if (op->mods == NULL)
+                goto failed;
+            break;
+        case LDAP_REQ_MODIFY:
+            op->mods = List_to_LDAPMods(payload, 0);
+            if (op->mods == NULL)
+                goto failed;
+            break;
+        case LDAP_REQ_DELETE:
+            break;
+        default:
+            PyErr_Format(PyExc_ValueError,
+                         "unsupported operation %d, expected REQ_ADD, "
+                         "REQ_MODIFY or REQ_DELETE", op->op);
+            goto failed;
+        }
+
+        if (!PyNone_Check(serverctrls)) {
+            if (!LDAPControls_from_object(serverctrls, &op->ctrls)) {
+                if (op->mods != NULL)
+                    LDAPMods_DEL(op->mods);
+                goto failed;
+            }
+        }
     }
 
+    /* send all requests without waiting for any result */
     LDAP_BEGIN_ALLOW_THREADS(self);
-    res_type = ldap_result(self->ldap, msgid, all, tvp, &msg);
+    for (num_sent = 0; num_sent < num_ops; num_sent++) {
+        LDAPBatchOp *op = &ops_c[num_sent];
+
+        switch (op->op) {
+        case LDAP_REQ_ADD:
+            ldaperror = ldap_add_ext(self->ldap, op->dn, op->mods,
+                                     op->ctrls, NULL, &op->msgid);
+            break;
+        case LDAP_REQ_MODIFY:
+            ldaperror = ldap_modify_ext(self->ldap, op->dn, op->mods,
+                                        op->ctrls, NULL, &op->msgid);
+            break;
+        default:
+            ldaperror = ldap_delete_ext(self->ldap, op->dn, op->ctrls,
+                                        NULL, &op->msgid);
+            break;
+        }
+        if (ldaperror != LDAP_SUCCESS) {
+            LDAPerror_save(self->ldap, &err);
+            break;
+        }
+    }
     LDAP_END_ALLOW_THREADS(self);
 
-    if (res_type < 0)   /* LDAP or system error */
-        return LDAPerror(self->ldap);
+    /* msgids of the operations sent, the error for the first one which
+     * could not be sent and None for the ones not attempted */
+    for (i = 0; i < num_sent; i++) {
+        count_request(self,
+                      ops_c[i].op == LDAP_REQ_ADD ? LDAP_STATS_ADD :
+                      ops_c[i].op == LDAP_REQ_MODIFY ? LDAP_STATS_MODIFY :
+                      LDAP_STATS_DELETE);
+    }
+    if (num_sent < num_ops) {
+        LDAPerror_raise(&err);
+        senderr = take_ldap_error();
+        if (senderr == NULL)
+            goto failed;
+    }
 
-    if (res_type == 0) {
-        /* Polls return (None, None, None, None); timeouts raise an exception */
-        if (timeout == 0) {
-            if (add_extop) {
-                return Py_BuildValue("(OOOOOO)", Py_None, Py_None, Py_None,
-                                     Py_None, Py_None, Py_None);
-            }
-            else {
-                return Py_BuildValue("(OOOO)", Py_None, Py_None, Py_None,
-                                     Py_None);
-            }
+    result = PyList_New(num_ops);
+    if (result == NULL)
+        goto failed;
+    for (i = 0; i < num_ops; i++) {
+        if (i < num_sent) {
+            item = PyInt_FromLong(ops_c[i].msgid);
         }
-        else
-            return LDAPerr(LDAP_TIMEOUT);
+        else if (i == num_sent) {
+            item = senderr;
+            senderr = NULL;
+        }
+        else {
+            Py_INCREF(Py_None);
+            item = Py_None;
+        }
+        if (item == NULL) {
+            Py_CLEAR(result);
+            goto failed;
+        }
+        PyList_SET_ITEM(result, i, item);
+    }
+
+  failed:
+    for (i = 0; i < num_conv; i++) {
+        if (ops_c[i].mods != NULL)
+            LDAPMods_DEL(ops_c[i].mods);
+        LDAPControl_List_DEL(ops_c[i].ctrls);
     }
+    PyMem_DEL(ops_c);
+    Py_DECREF(ops);
+    Py_XDECREF(senderr);
+    return result;
+}
+
+/*
+ * Raises the exception for the failed result msg and frees it. The
+ * result is parsed holding the lock, as parsing sets the error state of
+ * the connection.
+ */
+static PyObject *
+raise_for_message(LDAPObject *self, LDAPMessage *msg)
+{
+    LDAPErrorState err;
+
+    LDAP_BEGIN_ALLOW_THREADS(self);
+    LDAPerror_save_message(self->ldap, msg, &err);
+    LDAP_END_ALLOW_THREADS(self);
+    ldap_msgfree(msg);
+    return LDAPerror_raise(&err);
+}
+
+/*
+ * Converts a message returned by ldap_result() into the tuple returned by
+ * result4(), see there for the meaning of the flags. If not NULL, arena
+ * holds the search entries of msg already decoded by LDAPmessage_decode().
+ *
+ * Returns a new reference, or NULL with an exception set if the result
+ * code signals an error or conversion failed. msg is always taken over.
+ */
+static PyObject *
+result_to_python(LDAPObject *self, LDAPMessage *msg, int res_type,
+                 int add_ctrls, int add_intermediates, int add_extop,
+                 int lazy, int zero_copy, int cidict,
+                 LDAPDecodeArena *arena)
+{
+    PyObject *retval, *pmsg, *pyctrls = 0;
+    int res_msgid = 0;
+    char *retoid = 0;
+    PyObject *valuestr = NULL;
+    int result = LDAP_SUCCESS;
+    LDAPControl **serverctrls = 0;
+    LDAPStatsCount start;
 
     if (msg)
         res_msgid = ldap_msgid(msg);
@@ -1166,24 +1474,28 @@ l_ldap_result4(LDAPObject *self, PyObject *args)
     if (result != LDAP_SUCCESS) {       /* result error */
         ldap_controls_free(serverctrls);
         Py_XDECREF(valuestr);
-        return LDAPraise_for_message(self->ldap, msg);
+        return raise_for_message(self, msg);
     }
 
     if (!(pyctrls = LDAPControls_to_List(serverctrls))) {
-        int err = LDAP_NO_MEMORY;
-
-        LDAP_BEGIN_ALLOW_THREADS(self);
-        ldap_set_option(self->ldap, LDAP_OPT_ERROR_NUMBER, &err);
-        LDAP_END_ALLOW_THREADS(self);
         ldap_controls_free(serverctrls);
         ldap_msgfree(msg);
         Py_XDECREF(valuestr);
-        return LDAPerror(self->ldap);
+        return PyErr_NoMemory();
     }
     ldap_controls_free(serverctrls);
 
-    pmsg =
-        LDAPmessage_to_python(self->ldap, msg, add_ctrls, add_intermediates);
+    if (lazy) {
+        /* the iterator takes over msg and converts entries on demand */
+        pmsg = LDAPmessage_iter_new(self, msg, add_ctrls, add_intermediates,
+                                    zero_copy, cidict);
+    }
+    else {
+        start = LDAPstats_now();
+        pmsg = LDAPmessage_to_python(self, msg, add_ctrls, add_intermediates,
+                                     zero_copy, cidict, arena);
+        count_convert(self, res_type, LDAPstats_now() - start);
+    }
 
     if (pmsg == NULL) {
         retval = NULL;
@@ -1209,42 +1521,58 @@ l_ldap_result4(LDAPObject *self, PyObject *args)
     return retval;
 }
 
-/* ldap_search_ext */
-
+/* Raises ValueError for reading a flow controlled search all at once */
 static PyObject *
-l_ldap_search_ext(LDAPObject *self, PyObject *args)
+flow_controlled_error(int msgid)
 {
-    char *base;
-    int scope;
-    char *filter;
-    PyObject *attrlist = Py_None;
-    char **attrs;
-    int attrsonly = 0;
+    PyErr_Format(PyExc_ValueError,
+                 "results of flow controlled msgid %d must be read one "
+                 "at a time", msgid);
+    return NULL;
+}
 
-    PyObject *serverctrls = Py_None;
-    PyObject *clientctrls = Py_None;
-    LDAPControl **server_ldcs = NULL;
-    LDAPControl **client_ldcs = NULL;
+/* Returns non-zero if msgid is registered with set_flow_control() */
+static int
+is_flow_controlled(LDAPObject *self, int msgid)
+{
+    int found;
+
+    LDAPlock(self);
+    found = (LDAPflow_find(&self->flow, msgid) != NULL);
+    LDAPunlock(self);
+    return found;
+}
+
+/* ldap_result4 */
 
+static PyObject *
+l_ldap_result4(LDAPObject *self, PyObject *args)
+{
+    int msgid = LDAP_RES_ANY;
+    int all = 1;
     double timeout = -1.0;
+    int add_ctrls = 0;
+    int add_intermediates = 0;
+    int add_extop = 0;
+    int lazy = 0;
+    int zero_copy = 0;
+    int cidict = 0;
     struct timeval tv;
     struct timeval *tvp;
+    int res_type;
+    LDAPMessage *msg = NULL;
+    LDAPErrorState err;
+    LDAPDecodeArena arena;
+    LDAPStatsCount start, wait_ns, decode_ns = 0;
+    PyObject *retval;
 
-    int sizelimit = 0;
-
-    int msgid;
-    int ldaperror;
-
-    if (!PyArg_ParseTuple(args, "sis|OiOOdi:search_ext",
-                          &base, &scope, &filter, &attrlist, &attrsonly,
-                          &serverctrls, &clientctrls, &timeout, &sizelimit))
+    if (!PyArg_ParseTuple
+        (args, "|iidiiiiii:result4", &msgid, &all, &timeout, &add_ctrls,
+         &add_intermediates, &add_extop, &lazy, &zero_copy, &cidict))
         return NULL;
     if (not_valid(self))
         return NULL;
 
-    if (!attrs_from_List(attrlist, &attrs))
-        return NULL;
-
     if (timeout >= 0) {
         tvp = &tv;
         set_timeval_from_double(tvp, timeout);
@@ -1253,43 +1581,1210 @@ l_ldap_search_ext(LDAPObject *self, PyObject *args)
         tvp = NULL;
     }
 
-    if (!PyNone_Check(serverctrls)) {
-        if (!LDAPControls_from_object(serverctrls, &server_ldcs)) {
-            free_attrs(&attrs);
-            return NULL;
-        }
+    if (all != LDAP_MSG_ONE && is_flow_controlled(self, msgid))
+        return flow_controlled_error(msgid);
+
+    LDAPdecode_init(&arena);
+
+    LDAP_BEGIN_UNLOCKED(self);
+    start = LDAPstats_now();
+    res_type = LDAPwait_result(self, msgid, all, tvp, &msg, &err);
+    wait_ns = LDAPstats_now() - start;
+    /* decode received search entries while not holding the GIL anyway */
+    if (res_type > 0 && !lazy) {
+        LDAPmessage_decode(self->ldap, msg, &arena);
+        decode_ns = LDAPstats_now() - start - wait_ns;
     }
+    LDAP_END_UNLOCKED(self);
 
-    if (!PyNone_Check(clientctrls)) {
-        if (!LDAPControls_from_object(clientctrls, &client_ldcs)) {
-            free_attrs(&attrs);
-            LDAPControl_List_DEL(server_ldcs);
-            return NULL;
+    if (res_type == LDAP_WAIT_CLOSED) {
+        not_valid(self);
+        return NULL;
+    }
+    count_result(self, res_type, wait_ns, decode_ns, msg);
+
+    if (res_type < 0)   /* LDAP or system error */
+        return LDAPerror_raise(&err);
+
+    if (res_type == 0) {
+        /* Polls return (None, None, None, None); timeouts raise an exception */
+        if (timeout == 0) {
+            if (add_extop) {
+                return Py_BuildValue("(OOOOOO)", Py_None, Py_None, Py_None,
+                                     Py_None, Py_None, Py_None);
+            }
+            else {
+                return Py_BuildValue("(OOOO)", Py_None, Py_None, Py_None,
+                                     Py_None);
+            }
         }
+        else
+            return LDAPerr(LDAP_TIMEOUT);
     }
 
-    LDAP_BEGIN_ALLOW_THREADS(self);
-    ldaperror =
-        ldap_search_ext(self->ldap, base, scope, filter, attrs, attrsonly,
-                        server_ldcs, client_ldcs, tvp, sizelimit, &msgid);
-    LDAP_END_ALLOW_THREADS(self);
+    retval = result_to_python(self, msg, res_type, add_ctrls,
+                              add_intermediates, add_extop, lazy, zero_copy,
+                              cidict, lazy ? NULL : &arena);
+    LDAPdecode_clear(&arena);
+    return retval;
+}
 
-    free_attrs(&attrs);
-    LDAPControl_List_DEL(server_ldcs);
-    LDAPControl_List_DEL(client_ldcs);
+/*
+ * Returns non-zero if msg is the last message of an operation, i.e. not a
+ * search entry, search reference or intermediate response.
+ */
+static int
+is_final_result(int res_type)
+{
+    return (res_type != LDAP_RES_SEARCH_ENTRY &&
+            res_type != LDAP_RES_SEARCH_REFERENCE &&
+            res_type != LDAP_RES_INTERMEDIATE);
+}
 
-    if (ldaperror != LDAP_SUCCESS)
-        return LDAPerror(self->ldap);
+/*
+ * Removes and returns the failed result of msgid held back by
+ * result_batch(), the oldest one for LDAP_RES_ANY, or NULL if there is
+ * none
+ */
+static LDAPMessage *
+take_pending(LDAPObject *self, int msgid)
+{
+    LDAPMessage *msg = NULL;
+    int i;
+
+    Py_BEGIN_CRITICAL_SECTION(self);
+    for (i = 0; i < self->num_pending; i++) {
+        if (msgid == LDAP_RES_ANY || ldap_msgid(self->pending[i]) == msgid) {
+            msg = self->pending[i];
+            self->num_pending--;
+            memmove(&self->pending[i], &self->pending[i + 1],
+                    (self->num_pending - i) * sizeof(LDAPMessage *));
+            break;
+        }
+    }
+    Py_END_CRITICAL_SECTION();
+    return msg;
+}
 
-    return PyInt_FromLong(msgid);
+/*
+ * Holds back the failed result msg for the next result_batch() call.
+ * Returns -1 with an exception set if out of memory, msg is freed then.
+ */
+static int
+hold_pending(LDAPObject *self, LDAPMessage *msg)
+{
+    LDAPMessage **pending;
+    int rc = 0;
+
+    Py_BEGIN_CRITICAL_SECTION(self);
+    pending = self->pending;
+    PyMem_RESIZE(pending, LDAPMessage *, self->num_pending + 1);
+    if (pending != NULL) {
+        self->pending = pending;
+        self->pending[self->num_pending++] = msg;
+    }
+    else {
+        rc = -1;
+    }
+    Py_END_CRITICAL_SECTION();
+    if (rc == -1) {
+        ldap_msgfree(msg);
+        PyErr_NoMemory();
+    }
+    return rc;
 }
 
-/* ldap_whoami_s (available since OpenLDAP 2.1.13) */
+/* ldap_result_batch */
 
 static PyObject *
-l_ldap_whoami_s(LDAPObject *self, PyObject *args)
+l_ldap_result_batch(LDAPObject *self, PyObject *args)
 {
-    PyObject *serverctrls = Py_None;
+    int msgid;
+    int max_msgs;
+    double timeout = -1.0;
+    int add_ctrls = 0;
+    int add_intermediates = 0;
+    struct timeval tv;
+    struct timeval *tvp;
+    struct timeval tv_poll = { 0, 0 };
+    LDAPMessage **msgs, *pending;
+    LDAPDecodeArena *arenas;
+    LDAPFlow *flow;
+    Py_ssize_t max_entries = 0, max_bytes = 0, num_bytes = 0;
+    int num_msgs = 0;
+    int res_type;
+    int i;
+    LDAPErrorState err;
+    LDAPStatsCount start, wait_ns, decode_ns = 0;
+    PyObject *result, *item;
+
+    if (!PyArg_ParseTuple
+        (args, "ii|dii:result_batch", &msgid, &max_msgs, &timeout,
+         &add_ctrls, &add_intermediates))
+        return NULL;
+    if (not_valid(self))
+        return NULL;
+
+    if (max_msgs < 1) {
+        PyErr_SetString(PyExc_ValueError, "max_msgs must be positive");
+        return NULL;
+    }
+
+    /* a failed result held back by a previous call comes first */
+    pending = take_pending(self, msgid);
+    if (pending != NULL)
+        return raise_for_message(self, pending);
+
+    if (timeout >= 0) {
+        tvp = &tv;
+        set_timeval_from_double(tvp, timeout);
+    }
+    else {
+        tvp = NULL;
+    }
+
+    msgs = PyMem_NEW(LDAPMessage *, max_msgs);
+    arenas = PyMem_NEW(LDAPDecodeArena, max_msgs);
+    if (msgs == NULL || arenas == NULL) {
+        PyMem_DEL(msgs);
+        PyMem_DEL(arenas);
+        return PyErr_NoMemory();
+    }
+    for (i = 0; i < max_msgs; i++)
+        LDAPdecode_init(&arenas[i]);
+
+    /* the marks of a flow controlled search also limit the batch */
+    LDAPlock(self);
+    flow = LDAPflow_find(&self->flow, msgid);
+    if (flow != NULL) {
+        max_entries = flow->max_entries;
+        max_bytes = flow->max_bytes;
+    }
+    LDAPunlock(self);
+
+    /* Wait for the first message, then take whatever else has arrived
+     * already, up to the end of the operation, without blocking again.
+     * Search entries are decoded right away, still without the GIL. */
+    LDAP_BEGIN_UNLOCKED(self);
+    start = LDAPstats_now();
+    res_type = LDAPwait_result(self, msgid, LDAP_MSG_ONE, tvp,
+                               &msgs[num_msgs], &err);
+    wait_ns = LDAPstats_now() - start;
+    while (res_type > 0) {
+        start = LDAPstats_now();
+        LDAPmessage_decode(self->ldap, msgs[num_msgs], &arenas[num_msgs]);
+        decode_ns += LDAPstats_now() - start;
+        if (max_bytes > 0)
+            num_bytes += LDAPstats_message_bytes(msgs[num_msgs]);
+        num_msgs++;
+        if (num_msgs >= max_msgs || is_final_result(res_type) ||
+            (max_entries > 0 && num_msgs >= max_entries) ||
+            (max_bytes > 0 && num_bytes >= max_bytes))
+            break;
+        res_type = LDAPwait_result(self, msgid, LDAP_MSG_ONE, &tv_poll,
+                                   &msgs[num_msgs], &err);
+    }
+    LDAP_END_UNLOCKED(self);
+
+    /* the whole batch counts as one wait of the first message's type */
+    Py_BEGIN_CRITICAL_SECTION(self);
+    LDAPstats_result(&self->stats, num_msgs ? ldap_msgtype(msgs[0]) : res_type,
+                     wait_ns, decode_ns);
+    for (i = 0; i < num_msgs; i++)
+        LDAPstats_received(&self->stats, self->ldap, msgs[i]);
+    Py_END_CRITICAL_SECTION();
+
+    if (num_msgs == 0) {
+        PyMem_DEL(msgs);
+        PyMem_DEL(arenas);
+        if (res_type == LDAP_WAIT_CLOSED) {
+            not_valid(self);
+            return NULL;
+        }
+        if (res_type < 0)       /* LDAP or system error */
+            return LDAPerror_raise(&err);
+        /* Polls return an empty list; timeouts raise an exception */
+        if (timeout == 0)
+            return PyList_New(0);
+        return LDAPerr(LDAP_TIMEOUT);
+    }
+    /* errors after the first message are reported by the next call */
+    if (res_type == -1)
+        LDAPerror_discard(&err);
+
+    result = PyList_New(0);
+    if (result == NULL)
+        goto failed;
+
+    for (i = 0; i < num_msgs; i++) {
+        LDAPMessage *msg = msgs[i];
+
+        msgs[i] = NULL;
+        res_type = ldap_msgtype(msg);
+
+        if (i > 0 && is_final_result(res_type)) {
+            int rc = LDAP_SUCCESS;
+
+            LDAP_BEGIN_ALLOW_THREADS(self);
+            ldap_parse_result(self->ldap, msg, &rc, NULL, NULL, NULL, NULL,
+                              0);
+            LDAP_END_ALLOW_THREADS(self);
+            if (rc != LDAP_SUCCESS) {
+                /* keep the error for a later call, so that the other
+                 * results of the batch are not lost */
+                if (hold_pending(self, msg) == -1) {
+                    Py_CLEAR(result);
+                    goto failed;
+                }
+                continue;
+            }
+        }
+
+        item = result_to_python(self, msg, res_type, add_ctrls,
+                                add_intermediates, 0, 0, 0, 0, &arenas[i]);
+        if (item == NULL || PyList_Append(result, item) == -1) {
+            Py_XDECREF(item);
+            Py_CLEAR(result);
+            goto failed;
+        }
+        Py_DECREF(item);
+    }
+
+  failed:
+    for (i = 0; i < num_msgs; i++) {
+        if (msgs[i] != NULL)
+            ldap_msgfree(msgs[i]);
+        LDAPdecode_clear(&arenas[i]);
+    }
+    PyMem_DEL(msgs);
+    PyMem_DEL(arenas);
+    return result;
+}
+
+/* ldap_result for many operations */
+
+static PyObject *
+l_ldap_collect_batch(LDAPObject *self, PyObject *args)
+{
+    PyObject *msgids_arg, *msgids = NULL, *result = NULL, *item;
+    PyObject *conn_error = NULL;
+    LDAPErrorState err;
+    double timeout = -1.0;
+    int add_ctrls = 0;
+    struct timeval tv;
+    struct timeval *tvp;
+    struct timeval tv_poll = { 0, 0 };
+    LDAPMessage **msgs = NULL;
+    int *ids = NULL, *res_types = NULL;
+    LDAPStatsCount *waits = NULL, start, deadline = 0, left;
+    Py_ssize_t i, j, num_ids, num_waited;
+
+    if (!PyArg_ParseTuple
+        (args, "O|di:collect_batch", &msgids_arg, &timeout, &add_ctrls))
+        return NULL;
+    if (not_valid(self))
+        return NULL;
+
+    msgids = PySequence_List(msgids_arg);
+    if (msgids == NULL)
+        return NULL;
+    num_ids = PyList_GET_SIZE(msgids);
+    if (num_ids == 0)
+        return msgids;
+
+    msgs = PyMem_NEW(LDAPMessage *, num_ids);
+    ids = PyMem_NEW(int, num_ids);
+    res_types = PyMem_NEW(int, num_ids);
+    waits = PyMem_NEW(LDAPStatsCount, num_ids);
+    if (msgs == NULL || ids == NULL || res_types == NULL || waits == NULL) {
+        PyErr_NoMemory();
+        goto failed;
+    }
+
+    for (i = 0; i < num_ids; i++) {
+        item = PyList_GET_ITEM(msgids, i);
+        msgs[i] = NULL;
+        /* not yet waited for */
+        res_types[i] = -1;
+        if (PyLong_Check(item)) {
+            long msgid = PyLong_AsLong(item);
+
+            if (msgid == -1 && PyErr_Occurred())
+                goto failed;
+            if (msgid <= 0 || msgid > INT_MAX) {
+                PyErr_Format(PyExc_ValueError, "invalid msgid %ld", msgid);
+                goto failed;
+            }
+            if (is_flow_controlled(self, (int)msgid)) {
+                flow_controlled_error((int)msgid);
+                goto failed;
+            }
+            ids[i] = (int)msgid;
+        }
+        else {
+            /* e.g. an error of submit_batch(), returned unchanged */
+            ids[i] = 0;
+        }
+    }
+
+    /* timeout applies to the whole batch, each wait gets what is left */
+    tvp = timeout >= 0 ? &tv : NULL;
+
+    LDAP_BEGIN_UNLOCKED(self);
+    if (tvp != NULL)
+        deadline = LDAPstats_now() + (LDAPStatsCount)(timeout * 1e9);
+    for (i = 0; i < num_ids; i++) {
+        if (ids[i] == 0)
+            continue;
+        start = LDAPstats_now();
+        if (tvp != NULL && tvp != &tv_poll) {
+            left = deadline > start ? deadline - start : 0;
+            tv.tv_sec = (long)(left / 1000000000);
+            tv.tv_usec = (long)(left % 1000000000 / 1000);
+        }
+        res_types[i] = LDAPwait_result(self, ids[i], LDAP_MSG_ALL, tvp,
+                                       &msgs[i], &err);
+        waits[i] = LDAPstats_now() - start;
+        if (res_types[i] < 0)   /* LDAP or system error, or unbound */
+            break;
+        if (res_types[i] == 0)  /* timed out, only poll for the others */
+            tvp = &tv_poll;
+    }
+    LDAP_END_UNLOCKED(self);
+
+    if (i < num_ids && res_types[i] == LDAP_WAIT_CLOSED) {
+        not_valid(self);
+        goto failed;
+    }
+
+    /* up to the error, if any */
+    num_waited = i < num_ids ? i + 1 : num_ids;
+    for (j = 0; j < num_waited; j++) {
+        if (ids[j] != 0)
+            count_result(self, res_types[j], waits[j], 0, msgs[j]);
+    }
+
+    if (i < num_ids) {
+        LDAPerror_raise(&err);
+        conn_error = take_ldap_error();
+        if (conn_error == NULL)
+            goto failed;
+    }
+
+    result = PyList_New(num_ids);
+    if (result == NULL)
+        goto failed;
+
+    for (i = 0; i < num_ids; i++) {
+        if (ids[i] == 0) {
+            item = PyList_GET_ITEM(msgids, i);
+            Py_INCREF(item);
+        }
+        else if (res_types[i] > 0) {
+            LDAPMessage *msg = msgs[i];
+
+            msgs[i] = NULL;
+            item = result_to_python(self, msg, res_types[i], add_ctrls, 0, 0,
+                                    0, 0, 0, NULL);
+            if (item == NULL)
+                item = take_ldap_error();
+        }
+        else if (res_types[i] == 0) {
+            LDAPerr(LDAP_TIMEOUT);
+            item = take_ldap_error();
+        }
+        else {
+            Py_INCREF(conn_error);
+            item = conn_error;
+        }
+        if (item == NULL) {
+            Py_CLEAR(result);
+            goto failed;
+        }
+        PyList_SET_ITEM(result, i, item);
+    }
+
+  failed:
+    if (msgs != NULL) {
+        for (i = 0; i < num_ids; i++) {
+            if (msgs[i] != NULL)
+                ldap_msgfree(msgs[i]);
+        }
+    }
+    PyMem_DEL(msgs);
+    PyMem_DEL(ids);
+    PyMem_DEL(res_types);
+    PyMem_DEL(waits);
+    Py_XDECREF(conn_error);
+    Py_DECREF(msgids);
+    return result;
+}
+
+/* ldap_result of a whole search converted into columns */
+
+static PyObject *
+l_ldap_result_columns(LDAPObject *self, PyObject *args)
+{
+    int msgid;
+    PyObject *attrlist;
+    double timeout = -1.0;
+    struct timeval tv;
+    struct timeval *tvp;
+    int res_type, result = LDAP_SUCCESS;
+    LDAPMessage *msg = NULL;
+    LDAPControl **serverctrls = NULL;
+    LDAPErrorState err;
+    LDAPDecodeArena arena;
+    LDAPStatsCount start, wait_ns, decode_ns = 0;
+    PyObject *columns, *pyctrls, *retval = NULL;
+
+    if (!PyArg_ParseTuple
+        (args, "iO|d:result_columns", &msgid, &attrlist, &timeout))
+        return NULL;
+    if (not_valid(self))
+        return NULL;
+
+    if (timeout >= 0) {
+        tvp = &tv;
+        set_timeval_from_double(tvp, timeout);
+    }
+    else {
+        tvp = NULL;
+    }
+
+    if (is_flow_controlled(self, msgid))
+        return flow_controlled_error(msgid);
+
+    LDAPdecode_init(&arena);
+
+    LDAP_BEGIN_UNLOCKED(self);
+    start = LDAPstats_now();
+    res_type = LDAPwait_result(self, msgid, LDAP_MSG_ALL, tvp, &msg, &err);
+    wait_ns = LDAPstats_now() - start;
+    if (res_type > 0) {
+        LDAPmessage_decode(self->ldap, msg, &arena);
+        decode_ns = LDAPstats_now() - start - wait_ns;
+    }
+    LDAP_END_UNLOCKED(self);
+
+    if (res_type == LDAP_WAIT_CLOSED) {
+        not_valid(self);
+        return NULL;
+    }
+    count_result(self, res_type, wait_ns, decode_ns, msg);
+
+    if (res_type < 0)   /* LDAP or system error */
+        return LDAPerror_raise(&err);
+    if (res_type == 0) {
+        /* Polls return None; timeouts raise an exception */
+        if (timeout == 0)
+            Py_RETURN_NONE;
+        return LDAPerr(LDAP_TIMEOUT);
+    }
+
+    if (res_type != LDAP_RES_SEARCH_RESULT) {
+        LDAPdecode_clear(&arena);
+        ldap_msgfree(msg);
+        PyErr_Format(PyExc_ValueError,
+                     "msgid %d is not a search, got result type %d",
+                     msgid, res_type);
+        return NULL;
+    }
+    if (arena.err != LDAP_SUCCESS) {
+        LDAPdecode_clear(&arena);
+        ldap_msgfree(msg);
+        return LDAPerror_code(arena.err);
+    }
+
+    LDAP_BEGIN_ALLOW_THREADS(self);
+    ldap_parse_result(self->ldap, msg, &result, NULL, NULL, NULL,
+                      &serverctrls, 0);
+    LDAP_END_ALLOW_THREADS(self);
+
+    if (result != LDAP_SUCCESS) {       /* result error */
+        ldap_controls_free(serverctrls);
+        LDAPdecode_clear(&arena);
+        return raise_for_message(self, msg);
+    }
+
+    start = LDAPstats_now();
+    columns = LDAPcolumns_to_python(&arena, attrlist);
+    count_convert(self, res_type, LDAPstats_now() - start);
+    pyctrls = LDAPControls_to_List(serverctrls);
+    ldap_controls_free(serverctrls);
+    LDAPdecode_clear(&arena);
+    ldap_msgfree(msg);
+
+    if (columns != NULL && pyctrls == NULL && !PyErr_Occurred())
+        PyErr_NoMemory();
+    if (columns != NULL && pyctrls != NULL)
+        retval = Py_BuildValue("(OO)", columns, pyctrls);
+    Py_XDECREF(columns);
+    Py_XDECREF(pyctrls);
+    return retval;
+}
+
+/* ldap_search_ext */
+
+static PyObject *
+l_ldap_search_ext(LDAPObject *self, PyObject *args)
+{
+    char *base;
+    int scope;
+    char *filter;
+    PyObject *attrlist = Py_None;
+    char **attrs;
+    int attrsonly = 0;
+
+    PyObject *serverctrls = Py_None;
+    PyObject *clientctrls = Py_None;
+    LDAPControl **server_ldcs = NULL;
+    LDAPControl **client_ldcs = NULL;
+
+    double timeout = -1.0;
+    struct timeval tv;
+    struct timeval *tvp;
+
+    int sizelimit = 0;
+
+    int msgid;
+    int ldaperror;
+    LDAPErrorState err;
+
+    if (!PyArg_ParseTuple(args, "sis|OiOOdi:search_ext",
+                          &base, &scope, &filter, &attrlist, &attrsonly,
+                          &serverctrls, &clientctrls, &timeout, &sizelimit))
+        return NULL;
+    if (not_valid(self))
+        return NULL;
+
+    if (!attrs_from_List(attrlist, &attrs))
+        return NULL;
+
+    if (timeout >= 0) {
+        tvp = &tv;
+        set_timeval_from_double(tvp, timeout);
+    }
+    else {
+        tvp = NULL;
+    }
+
+    if (!PyNone_Check(serverctrls)) {
+        if (!LDAPControls_from_object(serverctrls, &server_ldcs)) {
+            free_attrs(&attrs);
+            return NULL;
+        }
+    }
+
+    if (!PyNone_Check(clientctrls)) {
+        if (!LDAPControls_from_object(clientctrls, &client_ldcs)) {
+            free_attrs(&attrs);
+            LDAPControl_List_DEL(server_ldcs);
+            return NULL;
+        }
+    }
+
+    LDAP_BEGIN_ALLOW_THREADS(self);
+    ldaperror =
+        ldap_search_ext(self->ldap, base, scope, filter, attrs, attrsonly,
+                        server_ldcs, client_ldcs, tvp, sizelimit, &msgid);
+    if (ldaperror != LDAP_SUCCESS)
+        LDAPerror_save(self->ldap, &err);
+    LDAP_END_ALLOW_THREADS(self);
+
+    free_attrs(&attrs);
+    LDAPControl_List_DEL(server_ldcs);
+    LDAPControl_List_DEL(client_ldcs);
+
+    if (ldaperror != LDAP_SUCCESS)
+        return LDAPerror_raise(&err);
+
+    count_request(self, LDAP_STATS_SEARCH);
+    return PyInt_FromLong(msgid);
+}
+
+/*
+ * Paged search (RFC 2696) with all request state kept in C: the page
+ * for the next call of next_page() is requested as soon as the current
+ * one has been received, so the server prepares it while the caller
+ * processes the current page.
+ */
+
+typedef struct {
+    PyObject_HEAD LDAPObject *ldo;      /* keeps the LDAP handle alive */
+    char *base;
+    int scope;
+    char *filter;
+    char **attrs;
+    int attrsonly;
+    LDAPControl **ctrls;        /* caller's controls, then the page control */
+    Py_ssize_t page_slot;       /* index of the page control in ctrls */
+    int page_size;
+    int criticality;
+    struct timeval tv;
+    struct timeval *tvp;
+    int sizelimit;
+    int add_ctrls;
+    int msgid;                  /* outstanding page request, -1 if none */
+    PyObject *error;            /* failure to request the next page */
+    LDAPDecodeArena arena;      /* reused for each page */
+} LDAPPagedSearchObject;
+
+/* Returns a copy of s allocated with PyMem_NEW, or NULL */
+static char *
+paged_search_strdup(const char *s)
+{
+    size_t len = strlen(s);
+    char *copy = PyMem_NEW(char, len + 1);
+
+    if (copy != NULL)
+        memcpy(copy, s, len + 1);
+    return copy;
+}
+
+/*
+ * Sends the request for the page following cookie, or for the first
+ * page if cookie is NULL. Called without the GIL and with the lock of
+ * the connection, returns an LDAP error code.
+ */
+static int
+paged_search_send(LDAPPagedSearchObject *self, struct berval *cookie)
+{
+    LDAP *ld = self->ldo->ldap;
+    LDAPControl *page_ctrl = NULL;
+    int ldaperror;
+
+    ldaperror = ldap_create_page_control(ld, self->page_size, cookie,
+                                         self->criticality, &page_ctrl);
+    if (ldaperror != LDAP_SUCCESS)
+        return ldaperror;
+
+    self->ctrls[self->page_slot] = page_ctrl;
+    ldaperror = ldap_search_ext(ld, self->base, self->scope, self->filter,
+                                self->attrs, self->attrsonly, self->ctrls,
+                                NULL, self->tvp, self->sizelimit,
+                                &self->msgid);
+    self->ctrls[self->page_slot] = NULL;
+    ldap_control_free(page_ctrl);
+
+    if (ldaperror != LDAP_SUCCESS)
+        self->msgid = -1;
+    return ldaperror;
+}
+
+static void
+paged_search_abandon(LDAPPagedSearchObject *self)
+{
+    if (self->msgid < 0)
+        return;
+    LDAPlock(self->ldo);
+    if (self->ldo->valid)
+        ldap_abandon_ext(self->ldo->ldap, self->msgid, NULL, NULL);
+    LDAPunlock(self->ldo);
+    self->msgid = -1;
+}
+
+static void
+LDAPPagedSearch_dealloc(LDAPPagedSearchObject *self)
+{
+    paged_search_abandon(self);
+    PyMem_DEL(self->base);
+    PyMem_DEL(self->filter);
+    free_attrs(&self->attrs);
+    LDAPControl_List_DEL(self->ctrls);
+    Py_XDECREF(self->error);
+    LDAPdecode_clear(&self->arena);
+    Py_XDECREF(self->ldo);
+    PyObject_DEL(self);
+}
+
+/* next_page(): results of the next page, None after the last one */
+
+static PyObject *
+LDAPPagedSearch_next_page(LDAPPagedSearchObject *self, PyObject *unused)
+{
+    LDAP *ld;
+    LDAPMessage *msg = NULL;
+    LDAPControl **res_ctrls = NULL;
+    LDAPControl *page_ctrl;
+    struct berval cookie = { 0, NULL };
+    ber_int_t count;
+    int res_type, result = LDAP_SUCCESS, send_error = LDAP_SUCCESS;
+    int sent = 0;
+    LDAPErrorState err;
+    LDAPStatsCount start, wait_ns, decode_ns = 0;
+    PyObject *page;
+
+    if (self->msgid < 0) {
+        if (self->error != NULL) {
+            PyObject *error = self->error;
+
+            self->error = NULL;
+            PyErr_SetObject((PyObject *)Py_TYPE(error), error);
+            Py_DECREF(error);
+            return NULL;
+        }
+        Py_INCREF(Py_None);
+        return Py_None;
+    }
+    if (not_valid(self->ldo))
+        return NULL;
+    ld = self->ldo->ldap;
+
+    LDAP_BEGIN_UNLOCKED(self->ldo);
+    start = LDAPstats_now();
+    res_type = LDAPwait_result(self->ldo, self->msgid, LDAP_MSG_ALL,
+                               self->tvp, &msg, &err);
+    wait_ns = LDAPstats_now() - start;
+    if (res_type > 0) {
+        /* parsing sets the error of ld, sending uses it */
+        LDAPlock_nogil(self->ldo);
+        ldap_parse_result(ld, msg, &result, NULL, NULL, NULL, &res_ctrls, 0);
+        self->msgid = -1;
+        if (result != LDAP_SUCCESS) {
+            LDAPerror_save_message(ld, msg, &err);
+        }
+        else {
+            page_ctrl = ldap_control_find(LDAP_CONTROL_PAGEDRESULTS,
+                                          res_ctrls, NULL);
+            if (page_ctrl != NULL &&
+                ldap_parse_pageresponse_control(ld, page_ctrl, &count,
+                                                &cookie) == LDAP_SUCCESS &&
+                cookie.bv_len > 0) {
+                /* prefetch the next page */
+                send_error = paged_search_send(self, &cookie);
+                sent = (send_error == LDAP_SUCCESS);
+                if (!sent)
+                    LDAPerror_save(ld, &err);
+            }
+        }
+        LDAPunlock(self->ldo);
+        if (result == LDAP_SUCCESS) {
+            start = LDAPstats_now();
+            LDAPmessage_decode(ld, msg, &self->arena);
+            decode_ns = LDAPstats_now() - start;
+        }
+        ldap_memfree(cookie.bv_val);
+        ldap_controls_free(res_ctrls);
+    }
+    LDAP_END_UNLOCKED(self->ldo);
+
+    if (res_type == LDAP_WAIT_CLOSED) {
+        self->msgid = -1;
+        not_valid(self->ldo);
+        return NULL;
+    }
+    count_result(self->ldo, res_type, wait_ns, decode_ns, msg);
+    if (sent)
+        count_request(self->ldo, LDAP_STATS_SEARCH);
+
+    if (res_type < 0) {         /* LDAP or system error */
+        self->msgid = -1;
+        return LDAPerror_raise(&err);
+    }
+    if (res_type == 0)          /* the page can still be waited for */
+        return LDAPerr(LDAP_TIMEOUT);
+    if (result != LDAP_SUCCESS) {
+        LDAPdecode_reset(&self->arena);
+        ldap_msgfree(msg);
+        return LDAPerror_raise(&err);
+    }
+
+    if (send_error != LDAP_SUCCESS) {
+        /* reported after the current page has been returned */
+        LDAPerror_raise(&err);
+        self->error = take_ldap_error();
+        if (self->error == NULL) {
+            ldap_msgfree(msg);
+            LDAPdecode_reset(&self->arena);
+            return NULL;
+        }
+    }
+
+    start = LDAPstats_now();
+    page = LDAPmessage_to_python(self->ldo, msg, self->add_ctrls, 0, 0, 0,
+                                 &self->arena);
+    count_convert(self->ldo, LDAP_RES_SEARCH_RESULT,
+                  LDAPstats_now() - start);
+    LDAPdecode_reset(&self->arena);
+    return page;
+}
+
+/* abandon(): stops the search */
+
+static PyObject *
+LDAPPagedSearch_abandon(LDAPPagedSearchObject *self, PyObject *unused)
+{
+    paged_search_abandon(self);
+    Py_CLEAR(self->error);
+    Py_INCREF(Py_None);
+    return Py_None;
+}
+
+static PyMethodDef LDAPPagedSearch_methods[] = {
+    {"next_page", (PyCFunction)LDAPPagedSearch_next_page, METH_NOARGS},
+    {"abandon", (PyCFunction)LDAPPagedSearch_abandon, METH_NOARGS},
+    {NULL, NULL}
+};
+
+PyTypeObject LDAPPagedSearch_Type = {
+    PyVarObject_HEAD_INIT(NULL, 0)
+        "LDAPPagedSearch",      /*tp_name */
+    sizeof(LDAPPagedSearchObject),      /*tp_basicsize */
+    0,                  /*tp_itemsize */
+    /* methods */
+    (destructor) LDAPPagedSearch_dealloc,       /*tp_dealloc */
+    0,                  /*tp_print */
+    0,                  /*tp_getattr */
+    0,                  /*tp_setattr */
+    0,                  /*tp_compare */
+    0,                  /*tp_repr */
+    0,                  /*tp_as_number */
+    0,                  /*tp_as_sequence */
+    0,                  /*tp_as_mapping */
+    0,                  /*tp_hash */
+    0,                  /*tp_call */
+    0,                  /*tp_str */
+    0,                  /*tp_getattro */
+    0,                  /*tp_setattro */
+    0,                  /*tp_as_buffer */
+    Py_TPFLAGS_DEFAULT, /*tp_flags */
+    0,                  /*tp_doc */
+    0,                  /*tp_traverse */
+    0,                  /*tp_clear */
+    0,                  /*tp_richcompare */
+    0,                  /*tp_weaklistoffset */
+    0,                  /*tp_iter */
+    0,                  /*tp_iternext */
+    LDAPPagedSearch_methods,    /*tp_methods */
+};
+
+/* ldap_search_ext with the paged results control */
+
+static PyObject *
+l_ldap_paged_search_ext(LDAPObject *self, PyObject *args)
+{
+    char *base;
+    int scope;
+    char *filter;
+    PyObject *attrlist = Py_None;
+    int attrsonly = 0;
+    PyObject *serverctrls = Py_None;
+    double timeout = -1.0;
+    int sizelimit = 0;
+    int page_size;
+    int criticality = 0;
+    int add_ctrls = 0;
+    LDAPControl **user_ctrls = NULL;
+    Py_ssize_t i, num_ctrls = 0;
+    LDAPPagedSearchObject *ps;
+    int ldaperror;
+    LDAPErrorState err;
+
+    if (!PyArg_ParseTuple(args, "sisi|OiOdiii:paged_search_ext",
+                          &base, &scope, &filter, &page_size, &attrlist,
+                          &attrsonly, &serverctrls, &timeout, &sizelimit,
+                          &criticality, &add_ctrls))
+        return NULL;
+    if (not_valid(self))
+        return NULL;
+
+    if (page_size < 1) {
+        PyErr_SetString(PyExc_ValueError, "page_size must be positive");
+        return NULL;
+    }
+
+    ps = PyObject_NEW(LDAPPagedSearchObject, &LDAPPagedSearch_Type);
+    if (ps == NULL)
+        return NULL;
+    Py_INCREF(self);
+    ps->ldo = self;
+    ps->base = paged_search_strdup(base);
+    ps->scope = scope;
+    ps->filter = paged_search_strdup(filter);
+    ps->attrs = NULL;
+    ps->attrsonly = attrsonly;
+    ps->ctrls = NULL;
+    ps->page_size = page_size;
+    ps->criticality = criticality;
+    if (timeout >= 0) {
+        ps->tvp = &ps->tv;
+        set_timeval_from_double(ps->tvp, timeout);
+    }
+    else {
+        ps->tvp = NULL;
+    }
+    ps->sizelimit = sizelimit;
+    ps->add_ctrls = add_ctrls;
+    ps->msgid = -1;
+    ps->error = NULL;
+    LDAPdecode_init(&ps->arena);
+
+    if (ps->base == NULL || ps->filter == NULL) {
+        PyErr_NoMemory();
+        goto failed;
+    }
+
+    if (!attrs_from_List(attrlist, &ps->attrs))
+        goto failed;
+
+    if (!PyNone_Check(serverctrls)) {
+        if (!LDAPControls_from_object(serverctrls, &user_ctrls))
+            goto failed;
+        while (user_ctrls[num_ctrls] != NULL)
+            num_ctrls++;
+    }
+    /* room for the page control and the terminating NULL */
+    ps->ctrls = PyMem_NEW(LDAPControl *, num_ctrls + 2);
+    if (ps->ctrls == NULL) {
+        LDAPControl_List_DEL(user_ctrls);
+        PyErr_NoMemory();
+        goto failed;
+    }
+    for (i = 0; i < num_ctrls; i++)
+        ps->ctrls[i] = user_ctrls[i];
+    ps->ctrls[num_ctrls] = NULL;
+    ps->ctrls[num_ctrls + 1] = NULL;
+    ps->page_slot = num_ctrls;
+    /* the controls themselves are owned by ps->ctrls now */
+    PyMem_DEL(user_ctrls);
+
+    LDAP_BEGIN_ALLOW_THREADS(self);
+    ldaperror = paged_search_send(ps, NULL);
+    if (ldaperror != LDAP_SUCCESS)
+        LDAPerror_save(self->ldap, &err);
+    LDAP_END_ALLOW_THREADS(self);
+
+    if (ldaperror != LDAP_SUCCESS) {
+        LDAPerror_raise(&err);
+        goto failed;
+    }
+    count_request(self, LDAP_STATS_SEARCH);
+
+    return (PyObject *)ps;
+
+  failed:
+    Py_DECREF(ps);
+    return NULL;
+}
+
+/*
+ * Prepared search: base, attribute list, controls and limits are
+ * converted to their C form once, each search() only renders the filter
+ * template with the assertion values and sends the request.
+ */
+
+typedef struct {
+    PyObject_HEAD LDAPObject *ldo;      /* keeps the LDAP handle alive */
+    char *base;
+    int scope;
+    PyObject *filter;           /* FilterTemplate or str */
+    char **attrs;
+    int attrsonly;
+    LDAPControl **server_ldcs;
+    LDAPControl **client_ldcs;
+    struct timeval tv;
+    struct timeval *tvp;
+    int sizelimit;
+} LDAPPreparedSearchObject;
+
+static void
+LDAPPreparedSearch_dealloc(LDAPPreparedSearchObject *self)
+{
+    PyMem_DEL(self->base);
+    Py_XDECREF(self->filter);
+    free_attrs(&self->attrs);
+    LDAPControl_List_DEL(self->server_ldcs);
+    LDAPControl_List_DEL(self->client_ldcs);
+    Py_XDECREF(self->ldo);
+    PyObject_DEL(self);
+}
+
+/* search([assertion_values]): sends the request, returns the msgid */
+
+static PyObject *
+LDAPPreparedSearch_search(LDAPPreparedSearchObject *self, PyObject *args)
+{
+    PyObject *values = NULL, *filterstr;
+    const char *filter;
+    Py_ssize_t len;
+    int msgid;
+    int ldaperror;
+    LDAPErrorState err;
+
+    if (!PyArg_ParseTuple(args, "|O:search", &values))
+        return NULL;
+    if (not_valid(self->ldo))
+        return NULL;
+
+    if (PyObject_TypeCheck(self->filter, &LDAPFilterTemplate_Type)) {
+        if (values == NULL)
+            values = PyTuple_New(0);
+        else
+            Py_INCREF(values);
+        if (values == NULL)
+            return NULL;
+        filterstr = LDAPfilter_render(self->filter, values);
+        Py_DECREF(values);
+        if (filterstr == NULL)
+            return NULL;
+    }
+    else if (values != NULL && (len = PyObject_Length(values)) != 0) {
+        if (len > 0)
+            PyErr_SetString(PyExc_TypeError,
+                            "search(): filter takes no assertion values");
+        return NULL;
+    }
+    else {
+        filterstr = self->filter;
+        Py_INCREF(filterstr);
+    }
+
+    filter = PyUnicode_AsUTF8AndSize(filterstr, &len);
+    if (filter == NULL) {
+        Py_DECREF(filterstr);
+        return NULL;
+    }
+    if (strlen(filter) != (size_t)len) {
+        Py_DECREF(filterstr);
+        PyErr_SetString(PyExc_ValueError, "embedded null character");
+        return NULL;
+    }
+
+    LDAP_BEGIN_ALLOW_THREADS(self->ldo);
+    ldaperror = ldap_search_ext(self->ldo->ldap, self->base, self->scope,
+                                filter, self->attrs, self->attrsonly,
+                                self->server_ldcs, self->client_ldcs,
+                                self->tvp, self->sizelimit, &msgid);
+    if (ldaperror != LDAP_SUCCESS)
+        LDAPerror_save(self->ldo->ldap, &err);
+    LDAP_END_ALLOW_THREADS(self->ldo);
+    Py_DECREF(filterstr);
+
+    if (ldaperror != LDAP_SUCCESS)
+        return LDAPerror_raise(&err);
+
+    count_request(self->ldo, LDAP_STATS_SEARCH);
+    return PyInt_FromLong(msgid);
+}
+
+static PyMethodDef LDAPPreparedSearch_methods[] = {
+    {"search", (PyCFunction)LDAPPreparedSearch_search, METH_VARARGS},
+    {NULL, NULL}
+};
+
+PyTypeObject LDAPPreparedSearch_Type = {
+    PyVarObject_HEAD_INIT(NULL, 0)
+        "LDAPPreparedSearch",   /*tp_name */
+    sizeof(LDAPPreparedSearchObject),   /*tp_basicsize */
+    0,                  /*tp_itemsize */
+    /* methods */
+    (destructor) LDAPPreparedSearch_dealloc,    /*tp_dealloc */
+    0,                  /*tp_print */
+    0,                  /*tp_getattr */
+    0,                  /*tp_setattr */
+    0,                  /*tp_compare */
+    0,                  /*tp_repr */
+    0,                  /*tp_as_number */
+    0,                  /*tp_as_sequence */
+    0,                  /*tp_as_mapping */
+    0,                  /*tp_hash */
+    0,                  /*tp_call */
+    0,                  /*tp_str */
+    0,                  /*tp_getattro */
+    0,                  /*tp_setattro */
+    0,                  /*tp_as_buffer */
+    Py_TPFLAGS_DEFAULT, /*tp_flags */
+    0,                  /*tp_doc */
+    0,                  /*tp_traverse */
+    0,                  /*tp_clear */
+    0,                  /*tp_richcompare */
+    0,                  /*tp_weaklistoffset */
+    0,                  /*tp_iter */
+    0,                  /*tp_iternext */
+    LDAPPreparedSearch_methods, /*tp_methods */
+};
+
+/* prepare_search(base, scope, filter [, attrlist [, attrsonly [, ...]]]) */
+
+static PyObject *
+l_ldap_prepare_search(LDAPObject *self, PyObject *args)
+{
+    char *base;
+    int scope;
+    PyObject *filter;
+    PyObject *attrlist = Py_None;
+    int attrsonly = 0;
+    PyObject *serverctrls = Py_None;
+    PyObject *clientctrls = Py_None;
+    double timeout = -1.0;
+    int sizelimit = 0;
+    LDAPPreparedSearchObject *ps;
+
+    if (!PyArg_ParseTuple(args, "siO|OiOOdi:prepare_search",
+                          &base, &scope, &filter, &attrlist, &attrsonly,
+                          &serverctrls, &clientctrls, &timeout, &sizelimit))
+        return NULL;
+    if (not_valid(self))
+        return NULL;
+
+    if (!PyUnicode_Check(filter) &&
+        !PyObject_TypeCheck(filter, &LDAPFilterTemplate_Type)) {
+        LDAPerror_TypeError
+            ("prepare_search(): expected str or FilterTemplate", filter);
+        return NULL;
+    }
+
+    ps = PyObject_NEW(LDAPPreparedSearchObject, &LDAPPreparedSearch_Type);
+    if (ps == NULL)
+        return NULL;
+    Py_INCREF(self);
+    ps->ldo = self;
+    ps->base = paged_search_strdup(base);
+    ps->scope = scope;
+    Py_INCREF(filter);
+    ps->filter = filter;
+    ps->attrs = NULL;
+    ps->attrsonly = attrsonly;
+    ps->server_ldcs = NULL;
+    ps->client_ldcs = NULL;
+    if (timeout >= 0) {
+        ps->tvp = &ps->tv;
+        set_timeval_from_double(ps->tvp, timeout);
+    }
+    else {
+        ps->tvp = NULL;
+    }
+    ps->sizelimit = sizelimit;
+
+    if (ps->base == NULL) {
+        PyErr_NoMemory();
+        goto failed;
+    }
+    if (!attrs_from_List(attrlist, &ps->attrs))
+        goto failed;
+    if (!PyNone_Check(serverctrls)) {
+        if (!LDAPControls_from_object(serverctrls, &ps->server_ldcs))
+            goto failed;
+    }
+    if (!PyNone_Check(clientctrls)) {
+        if (!LDAPControls_from_object(clientctrls, &ps->client_ldcs))
+            goto failed;
+    }
+
+    return (PyObject *)ps;
+
+  failed:
+    Py_DECREF(ps);
+    return NULL;
+}
+
+/* ldap_whoami_s (available since OpenLDAP 2.1.13) */
+
+static PyObject *
+l_ldap_whoami_s(LDAPObject *self, PyObject *args)
+{
+    PyObject *serverctrls = Py_None;
     PyObject *clientctrls = Py_None;
     LDAPControl **server_ldcs = NULL;
     LDAPControl **client_ldcs = NULL;
@@ -1299,6 +2794,7 @@ l_ldap_whoami_s(LDAPObject *self, PyObject *args)
     PyObject *result;
 
     int ldaperror;
+    LDAPErrorState err;
 
     if (!PyArg_ParseTuple(args, "|OO:whoami_s", &serverctrls, &clientctrls))
         return NULL;
@@ -1319,14 +2815,17 @@ l_ldap_whoami_s(LDAPObject *self, PyObject *args)
 
     LDAP_BEGIN_ALLOW_THREADS(self);
     ldaperror = ldap_whoami_s(self->ldap, &bvalue, server_ldcs, client_ldcs);
+    if (ldaperror != LDAP_SUCCESS)
+        LDAPerror_save(self->ldap, &err);
     LDAP_END_ALLOW_THREADS(self);
+    count_request(self, LDAP_STATS_EXTENDED);
 
     LDAPControl_List_DEL(server_ldcs);
     LDAPControl_List_DEL(client_ldcs);
 
     if (ldaperror != LDAP_SUCCESS) {
         ber_bvfree(bvalue);
-        return LDAPerror(self->ldap);
+        return LDAPerror_raise(&err);
     }
 
     result = LDAPberval_to_unicode_object(bvalue);
@@ -1342,6 +2841,7 @@ static PyObject *
 l_ldap_start_tls_s(LDAPObject *self, PyObject *args)
 {
     int ldaperror;
+    LDAPErrorState err;
 
     if (!PyArg_ParseTuple(args, ":start_tls_s"))
         return NULL;
@@ -1350,11 +2850,14 @@ l_ldap_start_tls_s(LDAPObject *self, PyObject *args)
 
     LDAP_BEGIN_ALLOW_THREADS(self);
     ldaperror = ldap_start_tls_s(self->ldap, NULL, NULL);
-    LDAP_END_ALLOW_THREADS(self);
     if (ldaperror != LDAP_SUCCESS) {
         ldap_set_option(self->ldap, LDAP_OPT_ERROR_NUMBER, &ldaperror);
-        return LDAPerror(self->ldap);
+        LDAPerror_save(self->ldap, &err);
     }
+    LDAP_END_ALLOW_THREADS(self);
+    count_request(self, LDAP_STATS_EXTENDED);
+    if (ldaperror != LDAP_SUCCESS)
+        return LDAPerror_raise(&err);
 
     Py_INCREF(Py_None);
     return Py_None;
@@ -1412,6 +2915,7 @@ l_ldap_passwd(LDAPObject *self, PyObject *args)
 
     int msgid;
     int ldaperror;
+    LDAPErrorState err;
 
     if (!PyArg_ParseTuple
         (args, "z#z#z#|OO:passwd", &user.bv_val, &user_len, &oldpw.bv_val,
@@ -1443,14 +2947,17 @@ l_ldap_passwd(LDAPObject *self, PyObject *args)
                             oldpw.bv_val != NULL ? &oldpw : NULL,
                             newpw.bv_val != NULL ? &newpw : NULL,
                             server_ldcs, client_ldcs, &msgid);
+    if (ldaperror != LDAP_SUCCESS)
+        LDAPerror_save(self->ldap, &err);
     LDAP_END_ALLOW_THREADS(self);
 
     LDAPControl_List_DEL(server_ldcs);
     LDAPControl_List_DEL(client_ldcs);
 
     if (ldaperror != LDAP_SUCCESS)
-        return LDAPerror(self->ldap);
+        return LDAPerror_raise(&err);
 
+    count_request(self, LDAP_STATS_EXTENDED);
     return PyInt_FromLong(msgid);
 }
 
@@ -1468,6 +2975,7 @@ l_ldap_extended_operation(LDAPObject *self, PyObject *args)
 
     int msgid;
     int ldaperror;
+    LDAPErrorState err;
 
     if (!PyArg_ParseTuple
         (args, "sz#|OO:extended_operation", &reqoid, &reqvalue.bv_val,
@@ -1494,17 +3002,177 @@ l_ldap_extended_operation(LDAPObject *self, PyObject *args)
                                         reqvalue.bv_val !=
                                         NULL ? &reqvalue : NULL, server_ldcs,
                                         client_ldcs, &msgid);
+    if (ldaperror != LDAP_SUCCESS)
+        LDAPerror_save(self->ldap, &err);
     LDAP_END_ALLOW_THREADS(self);
 
     LDAPControl_List_DEL(server_ldcs);
     LDAPControl_List_DEL(client_ldcs);
 
     if (ldaperror != LDAP_SUCCESS)
-        return LDAPerror(self->ldap);
+        return LDAPerror_raise(&err);
 
+    count_request(self, LDAP_STATS_EXTENDED);
     return PyInt_FromLong(msgid);
 }
 
+/* stats([reset]) */
+
+static PyObject *
+l_ldap_stats(LDAPObject *self, PyObject *args)
+{
+    int reset = 0;
+    LDAPStats snapshot;
+
+    if (!PyArg_ParseTuple(args, "|i:stats", &reset))
+        return NULL;
+
+    /* the lock counters are updated with the lock, the others in a
+     * critical section */
+    Py_BEGIN_CRITICAL_SECTION(self);
+    LDAPlock(self);
+    snapshot = self->stats;
+    if (reset)
+        LDAPstats_reset(&self->stats);
+    LDAPunlock(self);
+    Py_END_CRITICAL_SECTION();
+
+    return LDAPstats_to_python(&snapshot);
+}
+
+/* set_flow_control */
+
+static PyObject *
+l_ldap_set_flow_control(LDAPObject *self, PyObject *args)
+{
+    int msgid, result;
+    Py_ssize_t max_entries = 0, max_bytes = 0;
+
+    if (!PyArg_ParseTuple(args, "i|nn:set_flow_control", &msgid,
+                          &max_entries, &max_bytes))
+        return NULL;
+    if (not_valid(self))
+        return NULL;
+
+    if (msgid <= 0) {
+        PyErr_Format(PyExc_ValueError, "invalid msgid %d", msgid);
+        return NULL;
+    }
+    if (max_entries < 0 || max_bytes < 0) {
+        PyErr_SetString(PyExc_ValueError,
+                        "high-water marks must not be negative");
+        return NULL;
+    }
+    LDAPlock(self);
+    result = LDAPflow_set(&self->flow, msgid, max_entries, max_bytes);
+    LDAPunlock(self);
+    if (result == -1)
+        return NULL;
+
+    Py_INCREF(Py_None);
+    return Py_None;
+}
+
+/* flow_control */
+
+static PyObject *
+l_ldap_flow_control(LDAPObject *self, PyObject *args)
+{
+    int msgid;
+    LDAPFlow *flow, copy;
+
+    if (!PyArg_ParseTuple(args, "i:flow_control", &msgid))
+        return NULL;
+
+    LDAPlock(self);
+    flow = LDAPflow_find(&self->flow, msgid);
+    if (flow != NULL)
+        copy = *flow;
+    LDAPunlock(self);
+    if (flow == NULL) {
+        Py_INCREF(Py_None);
+        return Py_None;
+    }
+    return LDAPflow_to_python(&copy);
+}
+
+/* set_value_decoders */
+
+/* Replaces the decoders, which other threads may be converting with */
+static void
+swap_value_decoders(LDAPObject *self, PyObject *decoders)
+{
+    PyObject *old;
+
+    Py_BEGIN_CRITICAL_SECTION(self);
+    old = self->value_decoders;
+    self->value_decoders = decoders;
+    Py_END_CRITICAL_SECTION();
+    Py_XDECREF(old);
+}
+
+static PyObject *
+l_ldap_set_value_decoders(LDAPObject *self, PyObject *args)
+{
+    PyObject *decoders, *result = NULL, *key, *value, *folded;
+    Py_ssize_t pos = 0;
+    long mode;
+
+    if (!PyArg_ParseTuple(args, "O:set_value_decoders", &decoders))
+        return NULL;
+
+    if (PyNone_Check(decoders)) {
+        swap_value_decoders(self, NULL);
+        Py_RETURN_NONE;
+    }
+    if (!PyDict_Check(decoders)) {
+        PyErr_SetString(PyExc_TypeError,
+                        "expected dict of attribute names to decode modes "
+                        "or None");
+        return NULL;
+    }
+
+    /* keyed by lower-cased name like the folded names of CIDict */
+    result = PyDict_New();
+    if (result == NULL)
+        return NULL;
+    while (PyDict_Next(decoders, &pos, &key, &value)) {
+        if (!PyUnicode_Check(key)) {
+            PyErr_Format(PyExc_TypeError,
+                         "attribute name must be str, not %.200s",
+                         Py_TYPE(key)->tp_name);
+            goto failed;
+        }
+        mode = PyLong_AsLong(value);
+        if (mode == -1 && PyErr_Occurred())
+            goto failed;
+        if (mode < 0 || mode >= LDAP_DECODE_NUM_MODES) {
+            PyErr_Format(PyExc_ValueError, "invalid decode mode %ld for %R",
+                         mode, key);
+            goto failed;
+        }
+        folded = LDAPcidict_fold(key);
+        if (folded == NULL)
+            goto failed;
+        PyUnicode_InternInPlace(&folded);
+        value = PyLong_FromLong(mode);
+        if (value == NULL || PyDict_SetItem(result, folded, value) == -1) {
+            Py_XDECREF(value);
+            Py_DECREF(folded);
+            goto failed;
+        }
+        Py_DECREF(value);
+        Py_DECREF(folded);
+    }
+
+    swap_value_decoders(self, result);
+    Py_RETURN_NONE;
+
+  failed:
+    Py_DECREF(result);
+    return NULL;
+}
+
 /* methods */
 
 static PyMethodDef methods[] = {
@@ -1521,8 +3189,14 @@ static PyMethodDef methods[] = {
     {"delete_ext", (PyCFunction)l_ldap_delete_ext, METH_VARARGS},
     {"modify_ext", (PyCFunction)l_ldap_modify_ext, METH_VARARGS},
     {"rename", (PyCFunction)l_ldap_rename, METH_VARARGS},
+    {"submit_batch", (PyCFunction)l_ldap_submit_batch, METH_VARARGS},
     {"result4", (PyCFunction)l_ldap_result4, METH_VARARGS},
+    {"result_batch", (PyCFunction)l_ldap_result_batch, METH_VARARGS},
+    {"collect_batch", (PyCFunction)l_ldap_collect_batch, METH_VARARGS},
+    {"result_columns", (PyCFunction)l_ldap_result_columns, METH_VARARGS},
     {"search_ext", (PyCFunction)l_ldap_search_ext, METH_VARARGS},
+    {"paged_search_ext", (PyCFunction)l_ldap_paged_search_ext, METH_VARARGS},
+    {"prepare_search", (PyCFunction)l_ldap_prepare_search, METH_VARARGS},
 #ifdef HAVE_TLS
     {"start_tls_s", (PyCFunction)l_ldap_start_tls_s, METH_VARARGS},
 #endif
@@ -1534,6 +3208,11 @@ static PyMethodDef methods[] = {
     {"cancel", (PyCFunction)l_ldap_cancel, METH_VARARGS},
 #endif
     {"extop", (PyCFunction)l_ldap_extended_operation, METH_VARARGS},
+    {"stats", (PyCFunction)l_ldap_stats, METH_VARARGS},
+    {"set_flow_control", (PyCFunction)l_ldap_set_flow_control, METH_VARARGS},
+    {"flow_control", (PyCFunction)l_ldap_flow_control, METH_VARARGS},
+    {"set_value_decoders", (PyCFunction)l_ldap_set_value_decoders,
+     METH_VARARGS},
     {NULL, NULL}
 };
 
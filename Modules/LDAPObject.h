@@ -4,35 +4,88 @@
 #define __h_LDAPObject
 
 #include "common.h"
+#include "stats.h"
+#include "flow.h"
+
+/* slot of the per-connection attribute name cache, see message.c */
+typedef struct {
+    Py_uhash_t hash;            /* hash of key */
+    char *key;                  /* attribute name as returned by libldap */
+    PyObject *name;             /* interned str, NULL for empty slots */
+} LDAPAttrCacheSlot;
+
+#define LDAP_ATTRCACHE_SIZE     256     /* must be a power of two */
+#define LDAP_ATTRCACHE_MAX      (LDAP_ATTRCACHE_SIZE / 4 * 3)
 
 typedef struct {
     PyObject_HEAD LDAP *ldap;
-    PyThreadState *_save;         /* for thread saving on referrals */
+    PyThread_type_lock lock;    /* see LDAP_BEGIN_ALLOW_THREADS() */
     int valid;
+    LDAPAttrCacheSlot *attrcache;       /* allocated on first use */
+    Py_ssize_t attrcache_used;
+    LDAPMessage **pending;      /* failed results held back by result_batch */
+    int num_pending;
+    LDAPStats stats;            /* see stats() */
+    LDAPFlowTable flow;         /* see set_flow_control() */
+    PyObject *value_decoders;   /* see set_value_decoders(), may be NULL */
 } LDAPObject;
 
 extern PyTypeObject LDAP_Type;
+extern PyTypeObject LDAPPagedSearch_Type;
+extern PyTypeObject LDAPPreparedSearch_Type;
 
 #define LDAPObject_Check(v)     (Py_TYPE(v) == &LDAP_Type)
 
 extern LDAPObject *newLDAPObject(LDAP *);
+extern void LDAPlock_nogil(LDAPObject *l);
+extern void LDAPlock(LDAPObject *l);
 
-/* macros to allow thread saving in the context of an LDAP connection */
+#define LDAPunlock(l)   PyThread_release_lock((l)->lock)
 
-#define LDAP_BEGIN_ALLOW_THREADS( l )                                   \
+/*
+ * Macros to allow threads in the context of an LDAP connection.
+ *
+ * LDAP_BEGIN_ALLOW_THREADS(l) and LDAP_END_ALLOW_THREADS(l) enclose
+ * libldap calls for connection l and must be used in the same block,
+ * like Py_BEGIN_ALLOW_THREADS. The thread state is kept in a local
+ * variable, so that any number of threads may call into libldap for the
+ * same connection. In between, the GIL is released (the thread is
+ * detached on free-threaded builds) and l->lock is held, which
+ * serialises the libldap calls for the connection and guards l->flow,
+ * l->valid and the lock counters of l->stats.
+ *
+ * LDAP_BEGIN_UNLOCKED(l) and LDAP_END_UNLOCKED(l) only release the GIL,
+ * for waiting with LDAPwait_result() and for decoding messages received
+ * already. Code attached to the interpreter takes l->lock with
+ * LDAPlock(), which detaches while waiting for it. l->lock is never
+ * held while calling back into Python.
+ *
+ * The other fields of LDAPObject are only used while attached, in a
+ * critical section of l on free-threaded builds.
+ */
+
+#define LDAP_BEGIN_UNLOCKED( l )                                        \
 	{                                                               \
-	  LDAPObject *lo = (l);                                         \
-	  if (lo->_save != NULL)                                        \
-	  	Py_FatalError( "saving thread twice?" );                \
-	  lo->_save = PyEval_SaveThread();                              \
+	  LDAPObject *_lo = (l);                                        \
+	  PyThreadState *_save = PyEval_SaveThread();
+
+#define LDAP_END_UNLOCKED( l )                                          \
+	  {                                                             \
+	    LDAPStatsCount _start = LDAPstats_now();                    \
+	    PyEval_RestoreThread( _save );                              \
+	    Py_BEGIN_CRITICAL_SECTION( _lo );                           \
+	    _lo->stats.gil_waits++;                                     \
+	    _lo->stats.gil_wait_ns += LDAPstats_now() - _start;         \
+	    Py_END_CRITICAL_SECTION();                                  \
+	  }                                                             \
 	}
 
+#define LDAP_BEGIN_ALLOW_THREADS( l )                                   \
+	LDAP_BEGIN_UNLOCKED( l )                                        \
+	  LDAPlock_nogil( _lo );
+
 #define LDAP_END_ALLOW_THREADS( l )                                     \
-	{                                                               \
-	  LDAPObject *lo = (l);                                         \
-	  PyThreadState *_save = lo->_save;                               \
-	  lo->_save = NULL;                                             \
-	  PyEval_RestoreThread( _save );                                \
-	}
+	  LDAPunlock( _lo );                                            \
+	LDAP_END_UNLOCKED( l )
 
 #endif /* __h_LDAPObject */
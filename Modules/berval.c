@@ -2,6 +2,7 @@
 
 #include "common.h"
 #include "berval.h"
+#include <datetime.h>
 
 /*
  * Copies out the data from a berval, and returns it as a new Python object,
@@ -49,3 +50,371 @@ LDAPberval_to_unicode_object(const struct berval *bv)
 
     return ret;
 }
+
+/*
+ * Returns a new int for a value of the INTEGER syntax (RFC 4517, section
+ * 3.3.16), or NULL without an exception set if bv is malformed.
+ */
+static PyObject *
+integer_to_object(const struct berval *bv)
+{
+    char buf[64], *s;
+    PyObject *ret;
+    ber_len_t i = 0;
+
+    if (bv->bv_len > 0 && bv->bv_val[0] == '-')
+        i++;
+    if (i == bv->bv_len)
+        return NULL;
+    /* PyLong_FromString() would also accept whitespace and underscores */
+    for (; i < bv->bv_len; i++) {
+        if (bv->bv_val[i] < '0' || bv->bv_val[i] > '9')
+            return NULL;
+    }
+
+    s = buf;
+    if (bv->bv_len >= sizeof(buf)) {
+        s = PyMem_Malloc(bv->bv_len + 1);
+        if (s == NULL)
+            return PyErr_NoMemory();
+    }
+    memcpy(s, bv->bv_val, bv->bv_len);
+    s[bv->bv_len] = '\0';
+    ret = PyLong_FromString(s, NULL, 10);
+    if (s != buf)
+        PyMem_Free(s);
+    return ret;
+}
+
+/*
+ * Parses len decimal digits at *p, advancing *p. Returns -1 if there are
+ * not as many digits.
+ */
+static int
+parse_digits(const char **p, const char *end, int len)
+{
+    int value = 0;
+
+    if (end - *p < len)
+        return -1;
+    for (; len > 0; len--, (*p)++) {
+        if (**p < '0' || **p > '9')
+            return -1;
+        value = value * 10 + (**p - '0');
+    }
+    return value;
+}
+
+/* tzinfo objects, created by LDAPinit_berval() */
+static PyObject *tz_utc = NULL;
+static PyObject *tz_type = NULL;
+
+/*
+ * Imports the datetime C API and the timezone objects when the module is
+ * initialised rather than on first use, where threads could race on a
+ * free-threaded build. Returns -1 with an exception set on failure.
+ */
+int
+LDAPinit_berval(void)
+{
+    PyObject *mod;
+
+    PyDateTime_IMPORT;
+    if (PyDateTimeAPI == NULL)
+        return -1;
+    mod = PyImport_ImportModule("datetime");
+    if (mod == NULL)
+        return -1;
+    tz_type = PyObject_GetAttrString(mod, "timezone");
+    if (tz_type != NULL)
+        tz_utc = PyObject_GetAttrString(tz_type, "utc");
+    Py_DECREF(mod);
+    if (tz_utc == NULL) {
+        Py_CLEAR(tz_type);
+        return -1;
+    }
+    return 0;
+}
+
+/* Returns a new reference to a datetime.timezone for offset minutes */
+static PyObject *
+timezone_for_offset(int offset)
+{
+    PyObject *delta, *tz;
+
+    if (offset == 0) {
+        Py_INCREF(tz_utc);
+        return tz_utc;
+    }
+    delta = PyDelta_FromDSU(0, offset * 60, 0);
+    if (delta == NULL)
+        return NULL;
+    tz = PyObject_CallFunctionObjArgs(tz_type, delta, NULL);
+    Py_DECREF(delta);
+    return tz;
+}
+
+/*
+ * Returns a new timezone-aware datetime.datetime for a value of the
+ * GeneralizedTime syntax (RFC 4517, section 3.3.13), or NULL without an
+ * exception set if bv is malformed. A fraction applies to the last of
+ * hour, minute or second given.
+ */
+static PyObject *
+generalized_time_to_object(const struct berval *bv)
+{
+    const char *p = bv->bv_val, *end = bv->bv_val + bv->bv_len;
+    int year, month, day, hour, minute = 0, second = 0, usecond = 0;
+    int offset = 0, sign;
+    long long unit = 3600000000LL, frac, scale;
+    PyObject *tz, *ret;
+
+    year = parse_digits(&p, end, 4);
+    month = parse_digits(&p, end, 2);
+    day = parse_digits(&p, end, 2);
+    hour = parse_digits(&p, end, 2);
+    if (year < 0 || month < 0 || day < 0 || hour < 0)
+        return NULL;
+    if (p < end && *p >= '0' && *p <= '9') {
+        if ((minute = parse_digits(&p, end, 2)) < 0)
+            return NULL;
+        unit = 60000000LL;
+        if (p < end && *p >= '0' && *p <= '9') {
+            if ((second = parse_digits(&p, end, 2)) < 0)
+                return NULL;
+            unit = 1000000LL;
+        }
+    }
+    if (p < end && (*p == '.' || *p == ',')) {
+        p++;
+        if (p == end || *p < '0' || *p > '9')
+            return NULL;
+        /* digits beyond microseconds of seconds are dropped */
+        for (frac = 0, scale = 1; p < end && *p >= '0' && *p <= '9'; p++) {
+            if (scale < 1000000000LL) {
+                frac = frac * 10 + (*p - '0');
+                scale *= 10;
+            }
+        }
+        frac = frac * unit / scale;
+        minute += (int)(frac / 60000000LL);
+        second += (int)(frac / 1000000LL % 60);
+        usecond = (int)(frac % 1000000LL);
+    }
+    if (p == end)
+        return NULL;
+    if (*p == 'Z') {
+        p++;
+    }
+    else if (*p == '+' || *p == '-') {
+        int off_hour, off_minute = 0;
+
+        sign = *p++ == '-' ? -1 : 1;
+        if ((off_hour = parse_digits(&p, end, 2)) < 0)
+            return NULL;
+        if (p < end && (off_minute = parse_digits(&p, end, 2)) < 0)
+            return NULL;
+        if (off_hour > 23 || off_minute > 59)
+            return NULL;
+        offset = sign * (off_hour * 60 + off_minute);
+    }
+    else {
+        return NULL;
+    }
+    if (p != end)
+        return NULL;
+
+    tz = timezone_for_offset(offset);
+    if (tz == NULL)
+        return NULL;
+    /* raises ValueError for days, hours etc. out of range */
+    ret = PyDateTimeAPI->DateTime_FromDateAndTime(
+        year, month, day, hour, minute, second, usecond, tz,
+        PyDateTimeAPI->DateTimeType);
+    Py_DECREF(tz);
+    return ret;
+}
+
+/*
+ * Converts the attribute value bv according to mode, one of the
+ * LDAP_DECODE_* constants. Values which are malformed for mode, e.g. text
+ * which is no valid UTF-8, are returned as bytes like
+ * LDAPberval_to_object() does.
+ *
+ * Returns a new Python object on success, or NULL on failure.
+ */
+PyObject *
+LDAPberval_decode(const struct berval *bv, int mode)
+{
+    PyObject *ret;
+
+    switch (mode) {
+    case LDAP_DECODE_STR:
+        ret = PyUnicode_DecodeUTF8(bv->bv_val, bv->bv_len, "strict");
+        break;
+    case LDAP_DECODE_INT:
+        ret = integer_to_object(bv);
+        break;
+    case LDAP_DECODE_GENERALIZED_TIME:
+        ret = generalized_time_to_object(bv);
+        break;
+    default:
+        return LDAPberval_to_object(bv);
+    }
+    if (ret == NULL) {
+        /* UnicodeDecodeError is a ValueError, too */
+        if (PyErr_Occurred() && !PyErr_ExceptionMatches(PyExc_ValueError))
+            return NULL;
+        PyErr_Clear();
+        ret = LDAPberval_to_object(bv);
+    }
+    return ret;
+}
+
+/*
+ * Read-only view of a berval that is owned by some other object, e.g.
+ * an attribute value inside the BER buffer of a search result message.
+ *
+ * Views implement the buffer protocol, so memoryview(), bytes() and most
+ * functions taking bytes-like objects accept them without a copy. The
+ * owner is kept alive as long as the view exists.
+ */
+
+typedef struct {
+    PyObject_HEAD PyObject *owner;      /* keeps buf alive */
+    const char *buf;
+    Py_ssize_t len;
+} LDAPBervalViewObject;
+
+/*
+ * Returns a new LDAPBervalView of bv, holding a reference to owner.
+ * Returns None if the berval pointer is NULL, and NULL on failure.
+ */
+PyObject *
+LDAPberval_to_view(const struct berval *bv, PyObject *owner)
+{
+    LDAPBervalViewObject *self;
+
+    if (!bv) {
+        Py_INCREF(Py_None);
+        return Py_None;
+    }
+
+    self = PyObject_NEW(LDAPBervalViewObject, &LDAPBervalView_Type);
+    if (self == NULL)
+        return NULL;
+    Py_INCREF(owner);
+    self->owner = owner;
+    self->buf = bv->bv_val;
+    self->len = bv->bv_len;
+    return (PyObject *)self;
+}
+
+static void
+LDAPBervalView_dealloc(LDAPBervalViewObject *self)
+{
+    Py_XDECREF(self->owner);
+    PyObject_DEL(self);
+}
+
+static int
+LDAPBervalView_getbuffer(LDAPBervalViewObject *self, Py_buffer *view,
+                         int flags)
+{
+    return PyBuffer_FillInfo(view, (PyObject *)self, (void *)self->buf,
+                             self->len, 1, flags);
+}
+
+static Py_ssize_t
+LDAPBervalView_length(LDAPBervalViewObject *self)
+{
+    return self->len;
+}
+
+/* Compares the view with any bytes-like object by content */
+static PyObject *
+LDAPBervalView_richcompare(LDAPBervalViewObject *self, PyObject *other,
+                           int op)
+{
+    Py_buffer view;
+    int equal;
+
+    if ((op != Py_EQ && op != Py_NE) || !PyObject_CheckBuffer(other)) {
+        Py_RETURN_NOTIMPLEMENTED;
+    }
+    if (PyObject_GetBuffer(other, &view, PyBUF_SIMPLE) == -1)
+        return NULL;
+    equal = (view.len == self->len &&
+             memcmp(view.buf, self->buf, self->len) == 0);
+    PyBuffer_Release(&view);
+
+    if (equal == (op == Py_EQ)) {
+        Py_RETURN_TRUE;
+    }
+    Py_RETURN_FALSE;
+}
+
+static PyObject *
+LDAPBervalView_bytes(LDAPBervalViewObject *self, PyObject *unused)
+{
+    return PyBytes_FromStringAndSize(self->buf, self->len);
+}
+
+static PyObject *
+LDAPBervalView_repr(LDAPBervalViewObject *self)
+{
+    PyObject *value, *repr;
+
+    value = PyBytes_FromStringAndSize(self->buf, self->len);
+    if (value == NULL)
+        return NULL;
+    repr = PyUnicode_FromFormat("LDAPBervalView(%R)", value);
+    Py_DECREF(value);
+    return repr;
+}
+
+static PyMethodDef LDAPBervalView_methods[] = {
+    {"__bytes__", (PyCFunction)LDAPBervalView_bytes, METH_NOARGS},
+    {NULL, NULL}
+};
+
+static PySequenceMethods LDAPBervalView_as_sequence = {
+    (lenfunc) LDAPBervalView_length,    /*sq_length */
+};
+
+static PyBufferProcs LDAPBervalView_as_buffer = {
+    (getbufferproc) LDAPBervalView_getbuffer,   /*bf_getbuffer */
+    0,                  /*bf_releasebuffer */
+};
+
+PyTypeObject LDAPBervalView_Type = {
+    PyVarObject_HEAD_INIT(NULL, 0)
+        "LDAPBervalView",       /*tp_name */
+    sizeof(LDAPBervalViewObject),       /*tp_basicsize */
+    0,                  /*tp_itemsize */
+    /* methods */
+    (destructor) LDAPBervalView_dealloc,        /*tp_dealloc */
+    0,                  /*tp_print */
+    0,                  /*tp_getattr */
+    0,                  /*tp_setattr */
+    0,                  /*tp_compare */
+    (reprfunc) LDAPBervalView_repr,     /*tp_repr */
+    0,                  /*tp_as_number */
+    &LDAPBervalView_as_sequence,        /*tp_as_sequence */
+    0,                  /*tp_as_mapping */
+    PyObject_HashNotImplemented,        /*tp_hash */
+    0,                  /*tp_call */
+    0,                  /*tp_str */
+    0,                  /*tp_getattro */
+    0,                  /*tp_setattro */
+    &LDAPBervalView_as_buffer,  /*tp_as_buffer */
+    Py_TPFLAGS_DEFAULT, /*tp_flags */
+    0,                  /*tp_doc */
+    0,                  /*tp_traverse */
+    0,                  /*tp_clear */
+    (richcmpfunc) LDAPBervalView_richcompare,   /*tp_richcompare */
+    0,                  /*tp_weaklistoffset */
+    0,                  /*tp_iter */
+    0,                  /*tp_iternext */
+    LDAPBervalView_methods,     /*tp_methods */
+};
@@ -7,5 +7,19 @@
 
 PyObject *LDAPberval_to_object(const struct berval *bv);
 PyObject *LDAPberval_to_unicode_object(const struct berval *bv);
+PyObject *LDAPberval_to_view(const struct berval *bv, PyObject *owner);
+PyObject *LDAPberval_decode(const struct berval *bv, int mode);
+int LDAPinit_berval(void);
+
+/* how attribute values are returned, see set_value_decoders() */
+enum {
+    LDAP_DECODE_BYTES,
+    LDAP_DECODE_STR,
+    LDAP_DECODE_INT,
+    LDAP_DECODE_GENERALIZED_TIME,
+    LDAP_DECODE_NUM_MODES
+};
+
+extern PyTypeObject LDAPBervalView_Type;
 
 #endif /* __h_berval_ */
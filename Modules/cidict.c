@@ -0,0 +1,604 @@
+/* See https://www.python-ldap.org/ for details. */
+
+#include "common.h"
+#include "cidict.h"
+
+/*
+ * Case-insensitive but case-respecting dictionary for search entries.
+ *
+ * This is a dict subclass, so the dict itself maps the attribute names
+ * in the case last set (or received from the server) to their values.
+ * Iteration, len(), comparison and dict(d) therefore behave like those
+ * of a plain dict. The additional dict folded maps the lower-cased form
+ * of each key to the key itself, it is used for looking up keys given
+ * in a different case. Both are kept in sync by all methods of the type,
+ * but not by the methods of dict called explicitly on an instance.
+ *
+ * The methods hold a critical section on the instance, which also guards
+ * folded as it is only used through them. The helpers below expect to be
+ * called within one.
+ */
+
+typedef struct {
+    PyDictObject dict;
+    PyObject *folded;           /* lower-cased key -> key */
+} LDAPCIDictObject;
+
+#define CIDICT_FOLDED(o) (((LDAPCIDictObject *)(o))->folded)
+
+static PyObject *lower_name;    /* "lower" */
+static PyObject *empty_tuple;
+
+/*
+ * Returns a new reference to the lower-cased key. ASCII strings without
+ * upper-case letters, e.g. the usual attribute type names, are returned
+ * as is.
+ */
+PyObject *
+LDAPcidict_fold(PyObject *key)
+{
+    if (PyUnicode_CheckExact(key) && PyUnicode_IS_READY(key) &&
+        PyUnicode_IS_ASCII(key)) {
+        const Py_UCS1 *s = PyUnicode_1BYTE_DATA(key);
+        Py_ssize_t i, len = PyUnicode_GET_LENGTH(key);
+
+        for (i = 0; i < len; i++) {
+            if (s[i] >= 'A' && s[i] <= 'Z')
+                break;
+        }
+        if (i == len) {
+            Py_INCREF(key);
+            return key;
+        }
+    }
+    return PyObject_CallMethodObjArgs(key, lower_name, NULL);
+}
+
+/*
+ * Returns the key stored for the lower-cased key folded as borrowed
+ * reference, or NULL without an exception set if there is none. Only
+ * for dictionaries not yet shared with other threads.
+ */
+PyObject *
+LDAPcidict_lookup_folded(PyObject *self, PyObject *folded)
+{
+    return PyDict_GetItemWithError(CIDICT_FOLDED(self), folded);
+}
+
+/*
+ * Sets self[key] = value, where folded is the lower-cased key. A key only
+ * differing in case is replaced. Returns 0 on success or -1 with an
+ * exception set.
+ */
+int
+LDAPcidict_insert(PyObject *self, PyObject *key, PyObject *folded,
+                  PyObject *value)
+{
+    PyObject *old;
+
+    old = PyDict_GetItemWithError(CIDICT_FOLDED(self), folded);
+    if (old == NULL && PyErr_Occurred())
+        return -1;
+    if (old != NULL && old != key) {
+        int rc = PyObject_RichCompareBool(old, key, Py_EQ);
+
+        if (rc == -1)
+            return -1;
+        if (rc == 0) {
+            /* keeps old alive while being replaced in folded */
+            Py_INCREF(old);
+            rc = PyDict_DelItem(self, old);
+            Py_DECREF(old);
+            if (rc == -1)
+                return -1;
+        }
+    }
+    if (PyDict_SetItem(self, key, value) == -1)
+        return -1;
+    return PyDict_SetItem(CIDICT_FOLDED(self), folded, key);
+}
+
+/*
+ * Returns a new reference to the key stored for key. If there is none,
+ * NULL is returned with KeyError set if raise is non-zero or else
+ * without an exception set. Other errors always return NULL with an
+ * exception set.
+ */
+static PyObject *
+cidict_find(PyObject *self, PyObject *key, int raise)
+{
+    PyObject *folded, *stored;
+
+    /* the case of the received attribute names is the most common one */
+    if (PyDict_GetItemWithError(self, key) != NULL) {
+        Py_INCREF(key);
+        return key;
+    }
+    if (PyErr_Occurred())
+        return NULL;
+
+    folded = LDAPcidict_fold(key);
+    if (folded == NULL)
+        return NULL;
+    stored = PyDict_GetItemWithError(CIDICT_FOLDED(self), folded);
+    Py_XINCREF(stored);
+    Py_DECREF(folded);
+    if (stored == NULL && raise && !PyErr_Occurred())
+        PyErr_SetObject(PyExc_KeyError, key);
+    return stored;
+}
+
+/*
+ * Returns a new reference to the value of key, like cidict_find() does
+ * for the key
+ */
+static PyObject *
+cidict_value(PyObject *self, PyObject *key, int raise)
+{
+    PyObject *stored, *value;
+
+    stored = cidict_find(self, key, raise);
+    if (stored == NULL)
+        return NULL;
+    value = PyDict_GetItemWithError(self, stored);
+    Py_XINCREF(value);
+    Py_DECREF(stored);
+    return value;
+}
+
+/* Deletes the key stored for key, raising KeyError if there is none */
+static int
+cidict_delete(PyObject *self, PyObject *key)
+{
+    PyObject *stored, *folded;
+    int rc;
+
+    stored = cidict_find(self, key, 1);
+    if (stored == NULL)
+        return -1;
+    folded = LDAPcidict_fold(stored);
+    if (folded == NULL) {
+        Py_DECREF(stored);
+        return -1;
+    }
+    rc = PyDict_DelItem(self, stored);
+    if (rc == 0)
+        rc = PyDict_DelItem(CIDICT_FOLDED(self), folded);
+    Py_DECREF(stored);
+    Py_DECREF(folded);
+    return rc;
+}
+
+static int
+cidict_setitem(PyObject *self, PyObject *key, PyObject *value)
+{
+    PyObject *folded;
+    int rc;
+
+    folded = LDAPcidict_fold(key);
+    if (folded == NULL)
+        return -1;
+    rc = LDAPcidict_insert(self, key, folded, value);
+    Py_DECREF(folded);
+    return rc;
+}
+
+/* Sets all items of arg (a mapping or iterable of pairs) and kwds */
+static int
+cidict_update_common(PyObject *self, PyObject *arg, PyObject *kwds)
+{
+    PyObject *key, *value, *keys = NULL, *iter = NULL, *item;
+    Py_ssize_t pos = 0;
+    int rc = -1;
+
+    if (arg == NULL || arg == Py_None) {
+        /* nothing but kwds */
+    }
+    else if (PyDict_Check(arg)) {
+        while (PyDict_Next(arg, &pos, &key, &value)) {
+            Py_INCREF(key);
+            Py_INCREF(value);
+            rc = cidict_setitem(self, key, value);
+            Py_DECREF(key);
+            Py_DECREF(value);
+            if (rc == -1)
+                return -1;
+        }
+    }
+    else if (PyObject_HasAttrString(arg, "keys")) {
+        keys = PyMapping_Keys(arg);
+        if (keys == NULL || (iter = PyObject_GetIter(keys)) == NULL)
+            goto failed;
+        while ((key = PyIter_Next(iter)) != NULL) {
+            value = PyObject_GetItem(arg, key);
+            rc = (value == NULL) ? -1 : cidict_setitem(self, key, value);
+            Py_DECREF(key);
+            Py_XDECREF(value);
+            if (rc == -1)
+                goto failed;
+        }
+        if (PyErr_Occurred())
+            goto failed;
+        Py_CLEAR(iter);
+        Py_CLEAR(keys);
+    }
+    else {
+        iter = PyObject_GetIter(arg);
+        if (iter == NULL)
+            goto failed;
+        while ((item = PyIter_Next(iter)) != NULL) {
+            PyObject *pair = PySequence_Fast(item, "");
+
+            Py_DECREF(item);
+            if (pair == NULL || PySequence_Fast_GET_SIZE(pair) != 2) {
+                Py_XDECREF(pair);
+                PyErr_SetString(PyExc_ValueError,
+                                "update sequence element must be a pair");
+                goto failed;
+            }
+            rc = cidict_setitem(self, PySequence_Fast_GET_ITEM(pair, 0),
+                                PySequence_Fast_GET_ITEM(pair, 1));
+            Py_DECREF(pair);
+            if (rc == -1)
+                goto failed;
+        }
+        if (PyErr_Occurred())
+            goto failed;
+        Py_CLEAR(iter);
+    }
+
+    if (kwds != NULL) {
+        pos = 0;
+        while (PyDict_Next(kwds, &pos, &key, &value)) {
+            if (cidict_setitem(self, key, value) == -1)
+                return -1;
+        }
+    }
+    return 0;
+
+  failed:
+    Py_XDECREF(iter);
+    Py_XDECREF(keys);
+    return -1;
+}
+
+/* type slots */
+
+static PyObject *
+LDAPCIDict_new(PyTypeObject *type, PyObject *args, PyObject *kwds)
+{
+    PyObject *self;
+
+    self = PyDict_Type.tp_new(type, args, kwds);
+    if (self == NULL)
+        return NULL;
+    CIDICT_FOLDED(self) = PyDict_New();
+    if (CIDICT_FOLDED(self) == NULL) {
+        Py_DECREF(self);
+        return NULL;
+    }
+    return self;
+}
+
+PyObject *
+LDAPcidict_new(void)
+{
+    return LDAPCIDict_new(&LDAPCIDict_Type, empty_tuple, NULL);
+}
+
+static int
+LDAPCIDict_init(PyObject *self, PyObject *args, PyObject *kwds)
+{
+    PyObject *arg = NULL;
+    int rc;
+
+    if (!PyArg_ParseTuple(args, "|O:CIDict", &arg))
+        return -1;
+    Py_BEGIN_CRITICAL_SECTION(self);
+    rc = cidict_update_common(self, arg, kwds);
+    Py_END_CRITICAL_SECTION();
+    return rc;
+}
+
+static void
+LDAPCIDict_dealloc(PyObject *self)
+{
+    PyObject_GC_UnTrack(self);
+    Py_CLEAR(CIDICT_FOLDED(self));
+    PyDict_Type.tp_dealloc(self);
+}
+
+static PyObject *
+LDAPCIDict_subscript(PyObject *self, PyObject *key)
+{
+    PyObject *value;
+
+    Py_BEGIN_CRITICAL_SECTION(self);
+    value = cidict_value(self, key, 1);
+    Py_END_CRITICAL_SECTION();
+    return value;
+}
+
+static int
+LDAPCIDict_ass_subscript(PyObject *self, PyObject *key, PyObject *value)
+{
+    int rc;
+
+    Py_BEGIN_CRITICAL_SECTION(self);
+    if (value == NULL)
+        rc = cidict_delete(self, key);
+    else
+        rc = cidict_setitem(self, key, value);
+    Py_END_CRITICAL_SECTION();
+    return rc;
+}
+
+static int
+LDAPCIDict_contains(PyObject *self, PyObject *key)
+{
+    PyObject *stored;
+    int rc;
+
+    Py_BEGIN_CRITICAL_SECTION(self);
+    stored = cidict_find(self, key, 0);
+    Py_END_CRITICAL_SECTION();
+    if (stored != NULL)
+        rc = 1;
+    else
+        rc = PyErr_Occurred() ? -1 : 0;
+    Py_XDECREF(stored);
+    return rc;
+}
+
+/* methods */
+
+static PyObject *
+LDAPCIDict_get(PyObject *self, PyObject *args)
+{
+    PyObject *key, *dflt = Py_None, *value;
+
+    if (!PyArg_ParseTuple(args, "O|O:get", &key, &dflt))
+        return NULL;
+    Py_BEGIN_CRITICAL_SECTION(self);
+    value = cidict_value(self, key, 0);
+    Py_END_CRITICAL_SECTION();
+    if (value == NULL && !PyErr_Occurred()) {
+        Py_INCREF(dflt);
+        value = dflt;
+    }
+    return value;
+}
+
+static PyObject *
+cidict_pop(PyObject *self, PyObject *key, PyObject *dflt)
+{
+    PyObject *stored, *value;
+
+    stored = cidict_find(self, key, dflt == NULL);
+    if (stored == NULL) {
+        if (PyErr_Occurred())
+            return NULL;
+        Py_INCREF(dflt);
+        return dflt;
+    }
+    value = PyDict_GetItemWithError(self, stored);
+    Py_XINCREF(value);
+    if (value != NULL && cidict_delete(self, stored) == -1)
+        Py_CLEAR(value);
+    Py_DECREF(stored);
+    return value;
+}
+
+static PyObject *
+LDAPCIDict_pop(PyObject *self, PyObject *args)
+{
+    PyObject *key, *dflt = NULL, *value;
+
+    if (!PyArg_ParseTuple(args, "O|O:pop", &key, &dflt))
+        return NULL;
+    Py_BEGIN_CRITICAL_SECTION(self);
+    value = cidict_pop(self, key, dflt);
+    Py_END_CRITICAL_SECTION();
+    return value;
+}
+
+static PyObject *
+cidict_popitem(PyObject *self)
+{
+    PyObject *item, *folded;
+
+    item = PyObject_CallMethod((PyObject *)&PyDict_Type, "popitem", "O",
+                               self);
+    if (item == NULL)
+        return NULL;
+    folded = LDAPcidict_fold(PyTuple_GET_ITEM(item, 0));
+    if (folded == NULL ||
+        PyDict_DelItem(CIDICT_FOLDED(self), folded) == -1) {
+        Py_XDECREF(folded);
+        Py_DECREF(item);
+        return NULL;
+    }
+    Py_DECREF(folded);
+    return item;
+}
+
+static PyObject *
+LDAPCIDict_popitem(PyObject *self, PyObject *unused)
+{
+    PyObject *item;
+
+    Py_BEGIN_CRITICAL_SECTION(self);
+    item = cidict_popitem(self);
+    Py_END_CRITICAL_SECTION();
+    return item;
+}
+
+static PyObject *
+cidict_setdefault(PyObject *self, PyObject *key, PyObject *dflt)
+{
+    PyObject *value;
+
+    value = cidict_value(self, key, 0);
+    if (value != NULL || PyErr_Occurred())
+        return value;
+    if (cidict_setitem(self, key, dflt) == -1)
+        return NULL;
+    Py_INCREF(dflt);
+    return dflt;
+}
+
+static PyObject *
+LDAPCIDict_setdefault(PyObject *self, PyObject *args)
+{
+    PyObject *key, *dflt = Py_None, *value;
+
+    if (!PyArg_ParseTuple(args, "O|O:setdefault", &key, &dflt))
+        return NULL;
+    Py_BEGIN_CRITICAL_SECTION(self);
+    value = cidict_setdefault(self, key, dflt);
+    Py_END_CRITICAL_SECTION();
+    return value;
+}
+
+static PyObject *
+LDAPCIDict_update(PyObject *self, PyObject *args, PyObject *kwds)
+{
+    PyObject *arg = NULL;
+    int rc;
+
+    if (!PyArg_ParseTuple(args, "|O:update", &arg))
+        return NULL;
+    Py_BEGIN_CRITICAL_SECTION(self);
+    rc = cidict_update_common(self, arg, kwds);
+    Py_END_CRITICAL_SECTION();
+    if (rc == -1)
+        return NULL;
+    Py_RETURN_NONE;
+}
+
+static PyObject *
+LDAPCIDict_clear(PyObject *self, PyObject *unused)
+{
+    Py_BEGIN_CRITICAL_SECTION(self);
+    PyDict_Clear(self);
+    PyDict_Clear(CIDICT_FOLDED(self));
+    Py_END_CRITICAL_SECTION();
+    Py_RETURN_NONE;
+}
+
+static PyObject *
+LDAPCIDict_copy(PyObject *self, PyObject *unused)
+{
+    PyObject *copy;
+    int rc;
+
+    copy = LDAPcidict_new();
+    if (copy == NULL)
+        return NULL;
+    Py_BEGIN_CRITICAL_SECTION(self);
+    rc = PyDict_Merge(copy, self, 1);
+    if (rc == 0)
+        rc = PyDict_Merge(CIDICT_FOLDED(copy), CIDICT_FOLDED(self), 1);
+    Py_END_CRITICAL_SECTION();
+    if (rc == -1) {
+        Py_DECREF(copy);
+        return NULL;
+    }
+    return copy;
+}
+
+static PyObject *
+LDAPCIDict_has_key(PyObject *self, PyObject *key)
+{
+    int rc = LDAPCIDict_contains(self, key);
+
+    if (rc == -1)
+        return NULL;
+    return PyBool_FromLong(rc);
+}
+
+static PyMethodDef LDAPCIDict_methods[] = {
+    {"get", (PyCFunction)LDAPCIDict_get, METH_VARARGS},
+    {"pop", (PyCFunction)LDAPCIDict_pop, METH_VARARGS},
+    {"popitem", (PyCFunction)LDAPCIDict_popitem, METH_NOARGS},
+    {"setdefault", (PyCFunction)LDAPCIDict_setdefault, METH_VARARGS},
+    {"update", (PyCFunction)LDAPCIDict_update,
+     METH_VARARGS | METH_KEYWORDS},
+    {"clear", (PyCFunction)LDAPCIDict_clear, METH_NOARGS},
+    {"copy", (PyCFunction)LDAPCIDict_copy, METH_NOARGS},
+    {"__copy__", (PyCFunction)LDAPCIDict_copy, METH_NOARGS},
+    {"has_key", (PyCFunction)LDAPCIDict_has_key, METH_O},
+    {NULL, NULL}
+};
+
+static PySequenceMethods LDAPCIDict_as_sequence = {
+    0,                  /*sq_length */
+    0,                  /*sq_concat */
+    0,                  /*sq_repeat */
+    0,                  /*sq_item */
+    0,                  /*sq_slice */
+    0,                  /*sq_ass_item */
+    0,                  /*sq_ass_slice */
+    LDAPCIDict_contains,        /*sq_contains */
+};
+
+static PyMappingMethods LDAPCIDict_as_mapping = {
+    0,                  /*mp_length */
+    LDAPCIDict_subscript,       /*mp_subscript */
+    LDAPCIDict_ass_subscript,   /*mp_ass_subscript */
+};
+
+/* tp_base is set to dict by init_ldap_module() before PyType_Ready() */
+PyTypeObject LDAPCIDict_Type = {
+    PyVarObject_HEAD_INIT(NULL, 0)
+        "ldap.cidict.CIDict",   /*tp_name */
+    sizeof(LDAPCIDictObject),   /*tp_basicsize */
+    0,                  /*tp_itemsize */
+    /* methods */
+    LDAPCIDict_dealloc, /*tp_dealloc */
+    0,                  /*tp_print */
+    0,                  /*tp_getattr */
+    0,                  /*tp_setattr */
+    0,                  /*tp_compare */
+    0,                  /*tp_repr */
+    0,                  /*tp_as_number */
+    &LDAPCIDict_as_sequence,    /*tp_as_sequence */
+    &LDAPCIDict_as_mapping,     /*tp_as_mapping */
+    0,                  /*tp_hash */
+    0,                  /*tp_call */
+    0,                  /*tp_str */
+    0,                  /*tp_getattro */
+    0,                  /*tp_setattro */
+    0,                  /*tp_as_buffer */
+    Py_TPFLAGS_DEFAULT | Py_TPFLAGS_BASETYPE,   /*tp_flags */
+    0,                  /*tp_doc */
+    0,                  /*tp_traverse */
+    0,                  /*tp_clear */
+    0,                  /*tp_richcompare */
+    0,                  /*tp_weaklistoffset */
+    0,                  /*tp_iter */
+    0,                  /*tp_iternext */
+    LDAPCIDict_methods, /*tp_methods */
+    0,                  /*tp_members */
+    0,                  /*tp_getset */
+    0,                  /*tp_base */
+    0,                  /*tp_dict */
+    0,                  /*tp_descr_get */
+    0,                  /*tp_descr_set */
+    0,                  /*tp_dictoffset */
+    LDAPCIDict_init,    /*tp_init */
+    0,                  /*tp_alloc */
+    LDAPCIDict_new,     /*tp_new */
+};
+
+/* initialisation */
+
+void
+LDAPinit_cidict(PyObject *d)
+{
+    lower_name = PyUnicode_InternFromString("lower");
+    empty_tuple = PyTuple_New(0);
+    if (lower_name == NULL || empty_tuple == NULL)
+        return;
+    PyDict_SetItemString(d, "CIDict", (PyObject *)&LDAPCIDict_Type);
+}
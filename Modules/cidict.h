@@ -0,0 +1,17 @@
+/* See https://www.python-ldap.org/ for details. */
+
+#ifndef __h_cidict_
+#define __h_cidict_
+
+#include "common.h"
+
+extern PyTypeObject LDAPCIDict_Type;
+
+extern PyObject *LDAPcidict_new(void);
+extern PyObject *LDAPcidict_fold(PyObject *key);
+extern PyObject *LDAPcidict_lookup_folded(PyObject *self, PyObject *folded);
+extern int LDAPcidict_insert(PyObject *self, PyObject *key, PyObject *folded,
+                             PyObject *value);
+extern void LDAPinit_cidict(PyObject *);
+
+#endif /* __h_cidict_ */
@@ -0,0 +1,232 @@
+/* See https://www.python-ldap.org/ for details. */
+
+#include "common.h"
+#include "columns.h"
+
+/*
+ * Columnar conversion of search entries.
+ *
+ * Instead of one (dn, attrs) tuple per entry, the values of each
+ * requested attribute type are copied into three flat buffers laid out
+ * like an Arrow large_list<large_binary> array: the values of entry i
+ * are list_offsets[i] to list_offsets[i+1], the bytes of value j are
+ * data[value_offsets[j]:value_offsets[j+1]]. The DNs are stored like a
+ * large_string array. Offsets are native 64-bit integers. Only a few
+ * bytes objects are created per column, no matter how many entries
+ * there are.
+ */
+
+typedef struct {
+    PyObject *name;             /* borrowed from attrlist */
+    const char *key;            /* UTF-8 encoding of name */
+    Py_ssize_t keylen;
+    Py_ssize_t nvalues;         /* totals counted in pass one */
+    Py_ssize_t nbytes;
+    PyObject *pylist_offsets;   /* bytes objects filled in pass two */
+    PyObject *pyvalue_offsets;
+    PyObject *pydata;
+    LDAPColumnOffset *list_offsets;
+    LDAPColumnOffset *value_offsets;
+    char *data;
+    Py_ssize_t values_done;     /* positions while filling */
+    Py_ssize_t bytes_done;
+} LDAPColumn;
+
+/* Returns non-zero if the attribute name equals key, ignoring ASCII case */
+static int
+name_matches(const struct berval *name, const char *key, Py_ssize_t keylen)
+{
+    ber_len_t i;
+
+    if (name->bv_len != (ber_len_t)keylen)
+        return 0;
+    for (i = 0; i < name->bv_len; i++) {
+        unsigned char c1 = name->bv_val[i], c2 = key[i];
+
+        if (c1 >= 'A' && c1 <= 'Z')
+            c1 += 'a' - 'A';
+        if (c2 >= 'A' && c2 <= 'Z')
+            c2 += 'a' - 'A';
+        if (c1 != c2)
+            return 0;
+    }
+    return 1;
+}
+
+/*
+ * Returns the index of the column for name, or -1 if it was not
+ * requested. Servers send the attributes of all entries in the same
+ * order, so the search starts after the column *last matched before.
+ */
+static Py_ssize_t
+find_column(const LDAPColumn *cols, Py_ssize_t ncols,
+            const struct berval *name, Py_ssize_t *last)
+{
+    Py_ssize_t i, c;
+
+    for (i = 1; i <= ncols; i++) {
+        c = (*last + i) % ncols;
+        if (name_matches(name, cols[c].key, cols[c].keylen)) {
+            *last = c;
+            return c;
+        }
+    }
+    return -1;
+}
+
+/* Returns a new bytes object of size bytes, whose buffer is put in *buf */
+static PyObject *
+new_buffer(Py_ssize_t size, char **buf)
+{
+    PyObject *b = PyBytes_FromStringAndSize(NULL, size);
+
+    if (b != NULL)
+        *buf = PyBytes_AS_STRING(b);
+    return b;
+}
+
+/*
+ * Converts the search entries decoded into the arena a into the tuple
+ * (count, (dn_offsets, dn_data), {attr: (list_offsets, value_offsets,
+ * data)}) with one item per attribute name in the sequence attrlist.
+ * Attribute types not in attrlist are skipped, entries without an
+ * attribute get an empty list. Entry controls are not converted.
+ *
+ * Returns a new reference, or NULL with an exception set.
+ */
+PyObject *
+LDAPcolumns_to_python(const LDAPDecodeArena *a, PyObject *attrlist)
+{
+    PyObject *seq, *pycols = NULL, *item;
+    PyObject *pydn_offsets = NULL, *pydn_data = NULL, *result = NULL;
+    LDAPColumn *cols = NULL;
+    Py_ssize_t *match = NULL;
+    Py_ssize_t ncols, c, last = -1, dn_bytes = 0, pos;
+    Py_ssize_t nentries = (Py_ssize_t)a->nentries;
+    LDAPColumnOffset *dn_offsets;
+    char *dn_data;
+    size_t i, j, k;
+
+    seq = PySequence_Fast(attrlist, "expected list of attribute names");
+    if (seq == NULL)
+        return NULL;
+    ncols = PySequence_Fast_GET_SIZE(seq);
+
+    cols = PyMem_NEW(LDAPColumn, ncols ? ncols : 1);
+    match = PyMem_NEW(Py_ssize_t, a->nattrs ? a->nattrs : 1);
+    if (cols == NULL || match == NULL) {
+        PyErr_NoMemory();
+        goto failed;
+    }
+    memset(cols, 0, (ncols ? ncols : 1) * sizeof(LDAPColumn));
+    for (c = 0; c < ncols; c++) {
+        cols[c].name = PySequence_Fast_GET_ITEM(seq, c);
+        cols[c].key = PyUnicode_AsUTF8AndSize(cols[c].name, &cols[c].keylen);
+        if (cols[c].key == NULL)
+            goto failed;
+    }
+
+    /* pass one: match attributes to columns and count their sizes */
+    for (i = 0; i < a->nentries; i++) {
+        const LDAPDecodedEntry *e = &a->entries[i];
+
+        dn_bytes += e->dn.bv_len;
+        for (j = e->attrs; j < e->attrs + e->nattrs; j++) {
+            const LDAPDecodedAttr *at = &a->attrs[j];
+            LDAPColumn *col;
+
+            match[j] = ncols ? find_column(cols, ncols, &at->name, &last) : -1;
+            if (match[j] < 0)
+                continue;
+            col = &cols[match[j]];
+            col->nvalues += at->nvalues;
+            for (k = 0; k < at->nvalues; k++)
+                col->nbytes += a->values[at->values + k].bv_len;
+        }
+    }
+
+    /* pass two: copy DNs and values into buffers of the right size */
+    pydn_offsets = new_buffer((nentries + 1) * sizeof(LDAPColumnOffset),
+                              (char **)&dn_offsets);
+    pydn_data = new_buffer(dn_bytes, &dn_data);
+    if (pydn_offsets == NULL || pydn_data == NULL)
+        goto failed;
+    for (c = 0; c < ncols; c++) {
+        LDAPColumn *col = &cols[c];
+
+        col->pylist_offsets = new_buffer(
+            (nentries + 1) * sizeof(LDAPColumnOffset),
+            (char **)&col->list_offsets);
+        col->pyvalue_offsets = new_buffer(
+            (col->nvalues + 1) * sizeof(LDAPColumnOffset),
+            (char **)&col->value_offsets);
+        col->pydata = new_buffer(col->nbytes, &col->data);
+        if (col->pylist_offsets == NULL || col->pyvalue_offsets == NULL ||
+            col->pydata == NULL)
+            goto failed;
+    }
+
+    pos = 0;
+    for (i = 0; i < a->nentries; i++) {
+        const LDAPDecodedEntry *e = &a->entries[i];
+
+        dn_offsets[i] = pos;
+        memcpy(dn_data + pos, e->dn.bv_val, e->dn.bv_len);
+        pos += e->dn.bv_len;
+
+        for (c = 0; c < ncols; c++)
+            cols[c].list_offsets[i] = cols[c].values_done;
+        for (j = e->attrs; j < e->attrs + e->nattrs; j++) {
+            const LDAPDecodedAttr *at = &a->attrs[j];
+            LDAPColumn *col;
+
+            if (match[j] < 0)
+                continue;
+            col = &cols[match[j]];
+            for (k = 0; k < at->nvalues; k++) {
+                const struct berval *bv = &a->values[at->values + k];
+
+                col->value_offsets[col->values_done++] = col->bytes_done;
+                memcpy(col->data + col->bytes_done, bv->bv_val, bv->bv_len);
+                col->bytes_done += bv->bv_len;
+            }
+        }
+    }
+    dn_offsets[nentries] = pos;
+
+    pycols = PyDict_New();
+    if (pycols == NULL)
+        goto failed;
+    for (c = 0; c < ncols; c++) {
+        LDAPColumn *col = &cols[c];
+
+        col->list_offsets[nentries] = col->values_done;
+        col->value_offsets[col->values_done] = col->bytes_done;
+        item = Py_BuildValue("(OOO)", col->pylist_offsets,
+                             col->pyvalue_offsets, col->pydata);
+        if (item == NULL || PyDict_SetItem(pycols, col->name, item) == -1) {
+            Py_XDECREF(item);
+            goto failed;
+        }
+        Py_DECREF(item);
+    }
+
+    result = Py_BuildValue("(n(OO)O)", nentries, pydn_offsets, pydn_data,
+                           pycols);
+
+  failed:
+    if (cols != NULL) {
+        for (c = 0; c < ncols; c++) {
+            Py_XDECREF(cols[c].pylist_offsets);
+            Py_XDECREF(cols[c].pyvalue_offsets);
+            Py_XDECREF(cols[c].pydata);
+        }
+        PyMem_DEL(cols);
+    }
+    PyMem_DEL(match);
+    Py_XDECREF(pydn_offsets);
+    Py_XDECREF(pydn_data);
+    Py_XDECREF(pycols);
+    Py_DECREF(seq);
+    return result;
+}
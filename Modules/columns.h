@@ -0,0 +1,15 @@
+/* See https://www.python-ldap.org/ for details. */
+
+#ifndef __h_columns
+#define __h_columns
+
+#include "common.h"
+#include "message.h"
+
+/* type of the offsets in the column buffers, like Arrow's large types */
+typedef int64_t LDAPColumnOffset;
+
+extern PyObject *LDAPcolumns_to_python(const LDAPDecodeArena *a,
+                                       PyObject *attrlist);
+
+#endif /* __h_columns */
@@ -59,6 +59,13 @@ void LDAPadd_methods(PyObject *d, PyMethodDef *methods);
 
 #define PyNone_Check(o) ((o) == Py_None)
 
+/* Critical sections guard objects shared between threads on free-threaded
+ * builds of Python 3.13+. Elsewhere the GIL does, and they are no-ops. */
+#ifndef Py_BEGIN_CRITICAL_SECTION
+#define Py_BEGIN_CRITICAL_SECTION(op) {
+#define Py_END_CRITICAL_SECTION() }
+#endif
+
 /* Py2/3 compatibility */
 #if PY_VERSION_HEX >= 0x03000000
 /* In Python 3, alias PyInt to PyLong */
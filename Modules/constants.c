@@ -4,6 +4,7 @@
 #include "common.h"
 #include "constants.h"
 #include "ldapcontrol.h"
+#include "berval.h"
 
 /* the base exception class */
 
@@ -46,145 +47,234 @@ LDAPerr(int errnum)
     return NULL;
 }
 
-/* Convert an LDAP error into an informative python exception */
-PyObject *
-LDAPraise_for_message(LDAP *l, LDAPMessage *m)
+/*
+ * Saves the error state of l for LDAPerror_raise(). It does not use the
+ * Python API, so that it can be called right after the failed call
+ * while still holding the lock of the connection.
+ */
+void
+LDAPerror_save(LDAP *l, LDAPErrorState *state)
 {
-    if (l == NULL) {
-        PyErr_SetFromErrno(LDAPexception_class);
-        ldap_msgfree(m);
-        return NULL;
+    int opt_errnum;
+
+    /* at first save errno for later use before it gets overwritten by another call */
+    state->myerrno = errno;
+    state->matched = NULL;
+    state->error = NULL;
+    state->msgid = -1;
+    state->msgtype = 0;
+    state->refs = NULL;
+    state->serverctrls = NULL;
+
+    opt_errnum = ldap_get_option(l, LDAP_OPT_ERROR_NUMBER, &state->errnum);
+    if (opt_errnum != LDAP_OPT_SUCCESS)
+        state->errnum = opt_errnum;
+
+    if (state->errnum != LDAP_NO_MEMORY) {
+        ldap_get_option(l, LDAP_OPT_MATCHED_DN, &state->matched);
+        ldap_get_option(l, LDAP_OPT_ERROR_STRING, &state->error);
     }
-    else {
-        int myerrno, errnum, opt_errnum, msgid = -1, msgtype = 0;
-        PyObject *errobj;
-        PyObject *info;
-        PyObject *str;
-        PyObject *pyerrno;
-        PyObject *pyresult;
-        PyObject *pyctrls = NULL;
-        char *matched = NULL, *error = NULL, **refs = NULL;
-        LDAPControl **serverctrls = NULL;
-
-        /* at first save errno for later use before it gets overwritten by another call */
-        myerrno = errno;
-
-        if (m != NULL) {
-            msgid = ldap_msgid(m);
-            msgtype = ldap_msgtype(m);
-            ldap_parse_result(l, m, &errnum, &matched, &error, &refs,
-                              &serverctrls, 1);
-        }
+}
 
-        if (msgtype <= 0) {
-            opt_errnum = ldap_get_option(l, LDAP_OPT_ERROR_NUMBER, &errnum);
-            if (opt_errnum != LDAP_OPT_SUCCESS)
-                errnum = opt_errnum;
+/*
+ * Saves the error of the failed result m for LDAPerror_raise(). Like
+ * LDAPerror_save(), it is called holding the lock of the connection,
+ * since parsing the result sets the error state of l. m is not freed.
+ */
+void
+LDAPerror_save_message(LDAP *l, LDAPMessage *m, LDAPErrorState *state)
+{
+    /* at first save errno before it gets overwritten */
+    state->myerrno = errno;
+    state->errnum = LDAP_OTHER;
+    state->matched = NULL;
+    state->error = NULL;
+    state->msgid = ldap_msgid(m);
+    state->msgtype = ldap_msgtype(m);
+    state->refs = NULL;
+    state->serverctrls = NULL;
+    ldap_parse_result(l, m, &state->errnum, &state->matched,
+                      &state->error, &state->refs, &state->serverctrls, 0);
+}
 
-            if (errnum == LDAP_NO_MEMORY) {
-                return PyErr_NoMemory();
-            }
+/* Raises the exception for the error state, freeing it */
+static PyObject *
+raise_error(LDAPErrorState *state)
+{
+    int errnum = state->errnum;
+    int msgid = state->msgid, msgtype = state->msgtype;
+    char *matched = state->matched, *error = state->error;
+    char **refs = state->refs;
+    LDAPControl **serverctrls = state->serverctrls;
+    PyObject *errobj;
+    PyObject *info;
+    PyObject *str;
+    PyObject *pyerrno;
+    PyObject *pyresult;
+    PyObject *pyctrls = NULL;
+
+    if (msgtype <= 0 && errnum == LDAP_NO_MEMORY) {
+        return PyErr_NoMemory();
+    }
 
-            ldap_get_option(l, LDAP_OPT_MATCHED_DN, &matched);
-            ldap_get_option(l, LDAP_OPT_ERROR_STRING, &error);
-        }
+    if (errnum >= LDAP_ERROR_MIN && errnum <= LDAP_ERROR_MAX &&
+            errobjects[errnum + LDAP_ERROR_OFFSET] != NULL) {
+        errobj = errobjects[errnum + LDAP_ERROR_OFFSET];
+    }
+    else {
+        errobj = LDAPexception_class;
+    }
 
-        if (errnum >= LDAP_ERROR_MIN && errnum <= LDAP_ERROR_MAX &&
-                errobjects[errnum + LDAP_ERROR_OFFSET] != NULL) {
-            errobj = errobjects[errnum + LDAP_ERROR_OFFSET];
-        }
-        else {
-            errobj = LDAPexception_class;
-        }
+    info = PyDict_New();
+    if (info == NULL) {
+        ldap_memfree(matched);
+        ldap_memfree(error);
+        ldap_memvfree((void **)refs);
+        ldap_controls_free(serverctrls);
+        return NULL;
+    }
 
-        info = PyDict_New();
-        if (info == NULL) {
-            ldap_memfree(matched);
-            ldap_memfree(error);
-            ldap_memvfree((void **)refs);
-            ldap_controls_free(serverctrls);
-            return NULL;
-        }
+    if (msgtype > 0) {
+        pyresult = PyInt_FromLong(msgtype);
+        if (pyresult)
+            PyDict_SetItemString(info, "msgtype", pyresult);
+        Py_XDECREF(pyresult);
+    }
 
-        if (msgtype > 0) {
-            pyresult = PyInt_FromLong(msgtype);
-            if (pyresult)
-                PyDict_SetItemString(info, "msgtype", pyresult);
-            Py_XDECREF(pyresult);
-        }
+    if (msgid >= 0) {
+        pyresult = PyInt_FromLong(msgid);
+        if (pyresult)
+            PyDict_SetItemString(info, "msgid", pyresult);
+        Py_XDECREF(pyresult);
+    }
+
+    pyresult = PyInt_FromLong(errnum);
+    if (pyresult)
+        PyDict_SetItemString(info, "result", pyresult);
+    Py_XDECREF(pyresult);
+
+    str = PyUnicode_FromString(ldap_err2string(errnum));
+    if (str)
+        PyDict_SetItemString(info, "desc", str);
+    Py_XDECREF(str);
+
+    if (state->myerrno != 0) {
+        pyerrno = PyInt_FromLong(state->myerrno);
+        if (pyerrno)
+            PyDict_SetItemString(info, "errno", pyerrno);
+        Py_XDECREF(pyerrno);
+    }
 
-        if (msgid >= 0) {
-            pyresult = PyInt_FromLong(msgid);
-            if (pyresult)
-                PyDict_SetItemString(info, "msgid", pyresult);
-            Py_XDECREF(pyresult);
+    if (!(pyctrls = LDAPControls_to_List(serverctrls))) {
+        Py_DECREF(info);
+        ldap_memfree(matched);
+        ldap_memfree(error);
+        ldap_memvfree((void **)refs);
+        ldap_controls_free(serverctrls);
+        return PyErr_NoMemory();
+    }
+    ldap_controls_free(serverctrls);
+    PyDict_SetItemString(info, "ctrls", pyctrls);
+    Py_XDECREF(pyctrls);
+
+    if (matched != NULL) {
+        if (*matched != '\0') {
+            str = PyUnicode_FromString(matched);
+            if (str)
+                PyDict_SetItemString(info, "matched", str);
+            Py_XDECREF(str);
         }
+        ldap_memfree(matched);
+    }
 
-        pyresult = PyInt_FromLong(errnum);
-        if (pyresult)
-            PyDict_SetItemString(info, "result", pyresult);
-        Py_XDECREF(pyresult);
+    if (errnum == LDAP_REFERRAL && refs != NULL && refs[0] != NULL) {
+        /* Keep old behaviour, overshadow error message */
+        char err[1024];
 
-        str = PyUnicode_FromString(ldap_err2string(errnum));
+        snprintf(err, sizeof(err), "Referral:\n%s", refs[0]);
+        str = PyUnicode_FromString(err);
+        PyDict_SetItemString(info, "info", str);
+        Py_XDECREF(str);
+    }
+    else if (error != NULL && *error != '\0') {
+        str = PyUnicode_FromString(error);
         if (str)
-            PyDict_SetItemString(info, "desc", str);
+            PyDict_SetItemString(info, "info", str);
         Py_XDECREF(str);
+    }
 
-        if (myerrno != 0) {
-            pyerrno = PyInt_FromLong(myerrno);
-            if (pyerrno)
-                PyDict_SetItemString(info, "errno", pyerrno);
-            Py_XDECREF(pyerrno);
-        }
+    PyErr_SetObject(errobj, info);
+    Py_DECREF(info);
+    ldap_memvfree((void **)refs);
+    ldap_memfree(error);
+    return NULL;
+}
 
-        if (!(pyctrls = LDAPControls_to_List(serverctrls))) {
-            int err = LDAP_NO_MEMORY;
+/* Frees an error state saved by LDAPerror_save() which is not raised */
+void
+LDAPerror_discard(LDAPErrorState *state)
+{
+    ldap_memfree(state->matched);
+    ldap_memfree(state->error);
+    ldap_memvfree((void **)state->refs);
+    ldap_controls_free(state->serverctrls);
+}
 
-            ldap_set_option(l, LDAP_OPT_ERROR_NUMBER, &err);
-            ldap_memfree(matched);
-            ldap_memfree(error);
-            ldap_memvfree((void **)refs);
-            ldap_controls_free(serverctrls);
-            return PyErr_NoMemory();
-        }
-        ldap_controls_free(serverctrls);
-        PyDict_SetItemString(info, "ctrls", pyctrls);
-        Py_XDECREF(pyctrls);
-
-        if (matched != NULL) {
-            if (*matched != '\0') {
-                str = PyUnicode_FromString(matched);
-                if (str)
-                    PyDict_SetItemString(info, "matched", str);
-                Py_XDECREF(str);
-            }
-            ldap_memfree(matched);
-        }
+/* Raises the exception for an error state saved by LDAPerror_save() */
+PyObject *
+LDAPerror_raise(LDAPErrorState *state)
+{
+    return raise_error(state);
+}
 
-        if (errnum == LDAP_REFERRAL && refs != NULL && refs[0] != NULL) {
-            /* Keep old behaviour, overshadow error message */
-            char err[1024];
+/*
+ * Raises the exception for the error errnum returned by a libldap call,
+ * without the details kept by the connection
+ */
+PyObject *
+LDAPerror_code(int errnum)
+{
+    LDAPErrorState state;
+
+    state.errnum = errnum;
+    state.myerrno = 0;
+    state.matched = NULL;
+    state.error = NULL;
+    state.msgid = -1;
+    state.msgtype = 0;
+    state.refs = NULL;
+    state.serverctrls = NULL;
+    return raise_error(&state);
+}
 
-            snprintf(err, sizeof(err), "Referral:\n%s", refs[0]);
-            str = PyUnicode_FromString(err);
-            PyDict_SetItemString(info, "info", str);
-            Py_XDECREF(str);
+/* Convert an LDAP error into an informative python exception */
+PyObject *
+LDAPraise_for_message(LDAP *l, LDAPMessage *m)
+{
+    if (l == NULL) {
+        PyErr_SetFromErrno(LDAPexception_class);
+        ldap_msgfree(m);
+        return NULL;
+    }
+    else {
+        LDAPErrorState state;
+
+        if (m == NULL) {
+            LDAPerror_save(l, &state);
         }
-        else if (error != NULL && *error != '\0') {
-            str = PyUnicode_FromString(error);
-            if (str)
-                PyDict_SetItemString(info, "info", str);
-            Py_XDECREF(str);
+        else {
+            LDAPerror_save_message(l, m, &state);
+            ldap_msgfree(m);
         }
-
-        PyErr_SetObject(errobj, info);
-        Py_DECREF(info);
-        ldap_memvfree((void **)refs);
-        ldap_memfree(error);
-        return NULL;
+        return raise_error(&state);
     }
 }
 
+/*
+ * Raises the exception for the last error of l. On connections used by
+ * several threads, call LDAPerror_save() or LDAPerror_save_message()
+ * holding the lock instead.
+ */
 PyObject *
 LDAPerror(LDAP *l)
 {
@@ -205,6 +295,17 @@ LDAPinit_constants(PyObject *m)
     if (PyModule_AddIntConstant(m, "OPT_OFF", 0) != 0)
         return -1;
 
+    /* decode modes of set_value_decoders() */
+    if (PyModule_AddIntConstant(m, "DECODE_BYTES", LDAP_DECODE_BYTES) != 0)
+        return -1;
+    if (PyModule_AddIntConstant(m, "DECODE_STR", LDAP_DECODE_STR) != 0)
+        return -1;
+    if (PyModule_AddIntConstant(m, "DECODE_INT", LDAP_DECODE_INT) != 0)
+        return -1;
+    if (PyModule_AddIntConstant(m, "DECODE_GENERALIZED_TIME",
+                                LDAP_DECODE_GENERALIZED_TIME) != 0)
+        return -1;
+
     /* exceptions */
 
     LDAPexception_class = PyErr_NewException("ldap.LDAPError", NULL, NULL);
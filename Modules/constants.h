@@ -8,8 +8,27 @@
 extern int LDAPinit_constants(PyObject *m);
 extern PyObject *LDAPconstant(int);
 
+/* Error state of a connection, see LDAPerror_save() */
+typedef struct {
+    int errnum;
+    int myerrno;
+    char *matched;
+    char *error;
+    /* the parts of a failed result, see LDAPerror_save_message() */
+    int msgid;
+    int msgtype;
+    char **refs;
+    LDAPControl **serverctrls;
+} LDAPErrorState;
+
 extern PyObject *LDAPexception_class;
 extern PyObject *LDAPerror(LDAP *);
+extern void LDAPerror_save(LDAP *, LDAPErrorState *state);
+extern void LDAPerror_save_message(LDAP *, LDAPMessage *m,
+                                   LDAPErrorState *state);
+extern void LDAPerror_discard(LDAPErrorState *state);
+extern PyObject *LDAPerror_raise(LDAPErrorState *state);
+extern PyObject *LDAPerror_code(int errnum);
 extern PyObject *LDAPraise_for_message(LDAP *, LDAPMessage *m);
 PyObject *LDAPerr(int errnum);
 
@@ -0,0 +1,370 @@
+/* See https://www.python-ldap.org/ for details. */
+
+#include "common.h"
+#include "filter.h"
+
+/*
+ * Escaping of assertion values for filter strings (RFC 4515) and
+ * compiled filter templates used by ldap.filter.
+ */
+
+static const char hexdigits[] = "0123456789abcdef";
+
+/* Returns non-zero if c has to be escaped in escape_mode */
+static int
+needs_escape(Py_UCS4 c, int escape_mode)
+{
+    switch (escape_mode) {
+    case 0:
+        return (c == '\\' || c == '*' || c == '(' || c == ')' || c == 0);
+    case 1:
+        return (c < '0' || c > 'z' || c == '\\' || c == '*' || c == '(' ||
+                c == ')');
+    default:
+        return 1;
+    }
+}
+
+/* Number of hex digits written for c, like "%02x" does */
+static Py_ssize_t
+hex_len(Py_UCS4 c)
+{
+    Py_ssize_t n = 0;
+
+    do {
+        n++;
+        c >>= 4;
+    } while (c);
+    return n < 2 ? 2 : n;
+}
+
+/*
+ * Returns assertion_value with special characters replaced by their
+ * quoted notation, see ldap.filter.escape_filter_chars() for the modes.
+ * Returns a new reference to value itself if nothing needs escaping.
+ */
+PyObject *
+LDAPescape_filter_value(PyObject *value, int escape_mode)
+{
+    Py_ssize_t i, j, n, len, out_len, pos;
+    int kind, out_kind;
+    void *data, *out_data;
+    Py_UCS4 c, maxchar = 0;
+    PyObject *result;
+
+    if (!PyUnicode_Check(value)) {
+        LDAPerror_TypeError("escape_filter_chars(): expected str", value);
+        return NULL;
+    }
+    if (escape_mode < 0 || escape_mode > 2) {
+        PyErr_SetString(PyExc_ValueError, "escape_mode must be 0, 1 or 2.");
+        return NULL;
+    }
+    if (PyUnicode_READY(value) == -1)
+        return NULL;
+
+    len = PyUnicode_GET_LENGTH(value);
+    kind = PyUnicode_KIND(value);
+    data = PyUnicode_DATA(value);
+
+    out_len = 0;
+    for (i = 0; i < len; i++) {
+        c = PyUnicode_READ(kind, data, i);
+        if (needs_escape(c, escape_mode)) {
+            out_len += 1 + hex_len(c);
+        }
+        else {
+            out_len++;
+            if (c > maxchar)
+                maxchar = c;
+        }
+    }
+
+    if (out_len == len) {
+        /* the common case, nothing to escape */
+        Py_INCREF(value);
+        return value;
+    }
+
+    /* the escape sequences are ASCII */
+    if (maxchar < 127)
+        maxchar = 127;
+    result = PyUnicode_New(out_len, maxchar);
+    if (result == NULL)
+        return NULL;
+    out_kind = PyUnicode_KIND(result);
+    out_data = PyUnicode_DATA(result);
+
+    pos = 0;
+    for (i = 0; i < len; i++) {
+        c = PyUnicode_READ(kind, data, i);
+        if (needs_escape(c, escape_mode)) {
+            PyUnicode_WRITE(out_kind, out_data, pos++, '\\');
+            n = hex_len(c);
+            for (j = n - 1; j >= 0; j--) {
+                PyUnicode_WRITE(out_kind, out_data, pos++,
+                                hexdigits[(c >> (4 * j)) & 0xf]);
+            }
+        }
+        else {
+            PyUnicode_WRITE(out_kind, out_data, pos++, c);
+        }
+    }
+    return result;
+}
+
+/* escape_filter_chars(assertion_value [, escape_mode]) */
+
+static PyObject *
+l_escape_filter_chars(PyObject *unused, PyObject *args)
+{
+    PyObject *value;
+    int escape_mode = 0;
+
+    if (!PyArg_ParseTuple(args, "O|i:escape_filter_chars", &value,
+                          &escape_mode))
+        return NULL;
+
+    return LDAPescape_filter_value(value, escape_mode);
+}
+
+/*
+ * Filter template parsed once, %s placeholders are replaced by escaped
+ * assertion values when rendering.
+ */
+
+typedef struct {
+    PyObject_HEAD PyObject *template;   /* the original template */
+    PyObject *literals;         /* tuple of the strings around the %s */
+    int escape_mode;
+} LDAPFilterTemplateObject;
+
+static void
+LDAPFilterTemplate_dealloc(LDAPFilterTemplateObject *self)
+{
+    Py_XDECREF(self->template);
+    Py_XDECREF(self->literals);
+    PyObject_DEL(self);
+}
+
+static PyObject *
+LDAPFilterTemplate_repr(LDAPFilterTemplateObject *self)
+{
+    return PyUnicode_FromFormat("<FilterTemplate %R>", self->template);
+}
+
+/*
+ * Returns the filter string of the FilterTemplate template with the
+ * placeholders replaced by the escaped assertion values in the sequence
+ * values, or NULL with an exception set.
+ */
+PyObject *
+LDAPfilter_render(PyObject *template, PyObject *values)
+{
+    LDAPFilterTemplateObject *self = (LDAPFilterTemplateObject *)template;
+    PyObject *seq, *parts, *empty, *result = NULL;
+    Py_ssize_t i, num_values;
+
+    seq = PySequence_Fast(values, "render(): expected list or tuple");
+    if (seq == NULL)
+        return NULL;
+
+    num_values = PyTuple_GET_SIZE(self->literals) - 1;
+    if (PySequence_Fast_GET_SIZE(seq) != num_values) {
+        PyErr_Format(PyExc_TypeError,
+                     "filter template expects %zd assertion values, "
+                     "got %zd", num_values, PySequence_Fast_GET_SIZE(seq));
+        Py_DECREF(seq);
+        return NULL;
+    }
+
+    parts = PyList_New(2 * num_values + 1);
+    if (parts == NULL) {
+        Py_DECREF(seq);
+        return NULL;
+    }
+    for (i = 0; i <= num_values; i++) {
+        PyObject *item = PyTuple_GET_ITEM(self->literals, i);
+
+        Py_INCREF(item);
+        PyList_SET_ITEM(parts, 2 * i, item);
+        if (i == num_values)
+            break;
+        item = LDAPescape_filter_value(PySequence_Fast_GET_ITEM(seq, i),
+                                       self->escape_mode);
+        if (item == NULL)
+            goto failed;
+        PyList_SET_ITEM(parts, 2 * i + 1, item);
+    }
+
+    empty = PyUnicode_FromStringAndSize(NULL, 0);
+    if (empty != NULL) {
+        result = PyUnicode_Join(empty, parts);
+        Py_DECREF(empty);
+    }
+
+  failed:
+    Py_DECREF(parts);
+    Py_DECREF(seq);
+    return result;
+}
+
+/* render(assertion_values) */
+
+static PyObject *
+LDAPFilterTemplate_render(LDAPFilterTemplateObject *self, PyObject *args)
+{
+    PyObject *values;
+
+    if (!PyArg_ParseTuple(args, "O:render", &values))
+        return NULL;
+    return LDAPfilter_render((PyObject *)self, values);
+}
+
+static PyMethodDef LDAPFilterTemplate_methods[] = {
+    {"render", (PyCFunction)LDAPFilterTemplate_render, METH_VARARGS},
+    {NULL, NULL}
+};
+
+PyTypeObject LDAPFilterTemplate_Type = {
+    PyVarObject_HEAD_INIT(NULL, 0)
+        "FilterTemplate",       /*tp_name */
+    sizeof(LDAPFilterTemplateObject),   /*tp_basicsize */
+    0,                  /*tp_itemsize */
+    /* methods */
+    (destructor) LDAPFilterTemplate_dealloc,    /*tp_dealloc */
+    0,                  /*tp_print */
+    0,                  /*tp_getattr */
+    0,                  /*tp_setattr */
+    0,                  /*tp_compare */
+    (reprfunc) LDAPFilterTemplate_repr, /*tp_repr */
+    0,                  /*tp_as_number */
+    0,                  /*tp_as_sequence */
+    0,                  /*tp_as_mapping */
+    0,                  /*tp_hash */
+    0,                  /*tp_call */
+    0,                  /*tp_str */
+    0,                  /*tp_getattro */
+    0,                  /*tp_setattro */
+    0,                  /*tp_as_buffer */
+    Py_TPFLAGS_DEFAULT, /*tp_flags */
+    0,                  /*tp_doc */
+    0,                  /*tp_traverse */
+    0,                  /*tp_clear */
+    0,                  /*tp_richcompare */
+    0,                  /*tp_weaklistoffset */
+    0,                  /*tp_iter */
+    0,                  /*tp_iternext */
+    LDAPFilterTemplate_methods, /*tp_methods */
+};
+
+/* compile_filter(filter_template [, escape_mode]) */
+
+static PyObject *
+l_compile_filter(PyObject *unused, PyObject *args)
+{
+    PyObject *template, *literals = NULL, *current = NULL, *literal;
+    LDAPFilterTemplateObject *ft;
+    Py_ssize_t i, start, len;
+    int escape_mode = 0;
+    int kind;
+    void *data;
+    Py_UCS4 c;
+
+    if (!PyArg_ParseTuple(args, "U|i:compile_filter", &template,
+                          &escape_mode))
+        return NULL;
+    if (escape_mode < 0 || escape_mode > 2) {
+        PyErr_SetString(PyExc_ValueError, "escape_mode must be 0, 1 or 2.");
+        return NULL;
+    }
+    if (PyUnicode_READY(template) == -1)
+        return NULL;
+
+    len = PyUnicode_GET_LENGTH(template);
+    kind = PyUnicode_KIND(template);
+    data = PyUnicode_DATA(template);
+
+    literals = PyList_New(0);
+    if (literals == NULL)
+        return NULL;
+    current = PyUnicode_FromStringAndSize(NULL, 0);
+    if (current == NULL)
+        goto failed;
+
+    /* split at %s, %% stands for a literal % like with the % operator */
+    start = 0;
+    for (i = 0; i < len; i++) {
+        if (PyUnicode_READ(kind, data, i) != '%')
+            continue;
+        c = (i + 1 < len) ? PyUnicode_READ(kind, data, i + 1) : 0;
+        if (c != 's' && c != '%') {
+            PyErr_Format(PyExc_ValueError,
+                         "unsupported format character at index %zd, "
+                         "only %%s and %%%% are allowed", i);
+            goto failed;
+        }
+        /* text up to here, including one % for %% */
+        literal = PyUnicode_Substring(template, start, c == '%' ? i + 1 : i);
+        if (literal == NULL)
+            goto failed;
+        PyUnicode_Append(&current, literal);
+        Py_DECREF(literal);
+        if (current == NULL)
+            goto failed;
+        if (c == 's') {
+            if (PyList_Append(literals, current) == -1)
+                goto failed;
+            Py_DECREF(current);
+            current = PyUnicode_FromStringAndSize(NULL, 0);
+            if (current == NULL)
+                goto failed;
+        }
+        start = i + 2;
+        i++;
+    }
+    literal = PyUnicode_Substring(template, start, len);
+    if (literal == NULL)
+        goto failed;
+    PyUnicode_Append(&current, literal);
+    Py_DECREF(literal);
+    if (current == NULL || PyList_Append(literals, current) == -1)
+        goto failed;
+    Py_CLEAR(current);
+
+    ft = PyObject_NEW(LDAPFilterTemplateObject, &LDAPFilterTemplate_Type);
+    if (ft == NULL)
+        goto failed;
+    Py_INCREF(template);
+    ft->template = template;
+    ft->literals = PyList_AsTuple(literals);
+    ft->escape_mode = escape_mode;
+    Py_DECREF(literals);
+    if (ft->literals == NULL) {
+        Py_DECREF(ft);
+        return NULL;
+    }
+    return (PyObject *)ft;
+
+  failed:
+    Py_XDECREF(current);
+    Py_XDECREF(literals);
+    return NULL;
+}
+
+/* methods */
+
+static PyMethodDef methods[] = {
+    {"escape_filter_chars", (PyCFunction)l_escape_filter_chars,
+     METH_VARARGS},
+    {"compile_filter", (PyCFunction)l_compile_filter, METH_VARARGS},
+    {NULL, NULL}
+};
+
+/* initialisation */
+
+void
+LDAPinit_filter(PyObject *d)
+{
+    LDAPadd_methods(d, methods);
+}
@@ -0,0 +1,14 @@
+/* See https://www.python-ldap.org/ for details. */
+
+#ifndef __h_filter_
+#define __h_filter_
+
+#include "common.h"
+
+extern PyTypeObject LDAPFilterTemplate_Type;
+
+extern PyObject *LDAPescape_filter_value(PyObject *value, int escape_mode);
+extern PyObject *LDAPfilter_render(PyObject *template, PyObject *values);
+extern void LDAPinit_filter(PyObject *);
+
+#endif /* __h_filter_ */
@@ -0,0 +1,252 @@
+/* See https://www.python-ldap.org/ for details. */
+
+#include "common.h"
+#include "flow.h"
+#include "stats.h"
+
+/*
+ * Flow control for searches read one message at a time. libldap reads
+ * every message arriving on the socket while waiting for the result of
+ * any operation and queues those of the other operations without limit.
+ * For searches registered with LDAPObject.set_flow_control(), these
+ * messages are moved into a queue of their own right after each read,
+ * so that their number and size is known. While a queue is above its
+ * high-water mark, no more messages are read from the socket for other
+ * operations, and TCP flow control eventually makes the server pause
+ * sending.
+ *
+ * The table is only used holding the lock of its connection, and
+ * everything except LDAPflow_set() and LDAPflow_to_python() is called
+ * without the GIL, therefore only the raw memory allocator is used.
+ */
+
+/* zero timeout for reading messages which have arrived already */
+static struct timeval tv_poll = { 0, 0 };
+
+/* Returns non-zero if res_type is the last message of an operation */
+static int
+is_final(int res_type)
+{
+    return (res_type != LDAP_RES_SEARCH_ENTRY &&
+            res_type != LDAP_RES_SEARCH_REFERENCE &&
+            res_type != LDAP_RES_INTERMEDIATE);
+}
+
+/* Returns non-zero if the queue of f has reached one of its marks */
+static int
+over_mark(LDAPFlow *f)
+{
+    return ((f->max_entries > 0 && f->entries >= f->max_entries) ||
+            (f->max_bytes > 0 && f->bytes >= f->max_bytes));
+}
+
+void
+LDAPflow_init(LDAPFlowTable *t)
+{
+    t->flows = NULL;
+    t->num = 0;
+    t->alloc = 0;
+}
+
+static void
+flow_free(LDAPFlow *f)
+{
+    Py_ssize_t i;
+
+    for (i = f->head; i < f->len; i++)
+        ldap_msgfree(f->queue[i]);
+    PyMem_RawFree(f->queue);
+}
+
+/* Frees all queued messages and the table */
+void
+LDAPflow_clear(LDAPFlowTable *t)
+{
+    int i;
+
+    for (i = 0; i < t->num; i++)
+        flow_free(&t->flows[i]);
+    PyMem_RawFree(t->flows);
+    LDAPflow_init(t);
+}
+
+LDAPFlow *
+LDAPflow_find(LDAPFlowTable *t, int msgid)
+{
+    int i;
+
+    for (i = 0; i < t->num; i++) {
+        if (t->flows[i].msgid == msgid)
+            return &t->flows[i];
+    }
+    return NULL;
+}
+
+/*
+ * Sets the high-water marks of msgid, registering it if necessary.
+ * Returns -1 with an exception set if out of memory. Called with the GIL
+ * and the lock of the connection.
+ */
+int
+LDAPflow_set(LDAPFlowTable *t, int msgid, Py_ssize_t max_entries,
+             Py_ssize_t max_bytes)
+{
+    LDAPFlow *f = LDAPflow_find(t, msgid);
+
+    if (f == NULL) {
+        if (t->num == t->alloc) {
+            int alloc = t->alloc ? 2 * t->alloc : 4;
+            LDAPFlow *flows = PyMem_RawRealloc(t->flows,
+                                               alloc * sizeof(LDAPFlow));
+
+            if (flows == NULL) {
+                PyErr_NoMemory();
+                return -1;
+            }
+            t->flows = flows;
+            t->alloc = alloc;
+        }
+        f = &t->flows[t->num++];
+        memset(f, 0, sizeof(LDAPFlow));
+        f->msgid = msgid;
+    }
+    f->max_entries = max_entries;
+    f->max_bytes = max_bytes;
+    return 0;
+}
+
+/* Unregisters msgid, freeing the messages still held back */
+void
+LDAPflow_remove(LDAPFlowTable *t, int msgid)
+{
+    LDAPFlow *f = LDAPflow_find(t, msgid);
+
+    if (f == NULL)
+        return;
+    flow_free(f);
+    t->num--;
+    memmove(f, f + 1, (t->flows + t->num - f) * sizeof(LDAPFlow));
+}
+
+/* Makes room for one more message, returns 0 if out of memory */
+static int
+reserve(LDAPFlow *f)
+{
+    LDAPMessage **queue;
+    Py_ssize_t alloc;
+
+    if (f->len < f->alloc)
+        return 1;
+    if (f->head > 0) {
+        memmove(f->queue, f->queue + f->head,
+                (f->len - f->head) * sizeof(LDAPMessage *));
+        f->len -= f->head;
+        f->head = 0;
+        return 1;
+    }
+    alloc = f->alloc ? 2 * f->alloc : 16;
+    queue = PyMem_RawRealloc(f->queue, alloc * sizeof(LDAPMessage *));
+    if (queue == NULL)
+        return 0;
+    f->queue = queue;
+    f->alloc = alloc;
+    return 1;
+}
+
+/*
+ * Moves the messages which libldap has queued for the other flow
+ * controlled searches into their own queues, up to their marks
+ */
+static void
+drain(LDAPFlowTable *t, LDAP *ld, int msgid)
+{
+    LDAPFlow *f;
+    LDAPMessage *m;
+    int i;
+
+    for (i = 0; i < t->num; i++) {
+        f = &t->flows[i];
+        if (f->msgid == msgid)
+            continue;
+        while (!over_mark(f) && reserve(f) &&
+               ldap_result(ld, f->msgid, LDAP_MSG_ONE, &tv_poll, &m) > 0) {
+            f->queue[f->len++] = m;
+            f->entries++;
+            f->bytes += LDAPstats_message_bytes(m);
+            if (f->entries > f->peak_entries)
+                f->peak_entries = f->entries;
+            if (f->bytes > f->peak_bytes)
+                f->peak_bytes = f->bytes;
+        }
+    }
+}
+
+/*
+ * Like ldap_result() with LDAP_MSG_ONE but returns held back messages
+ * first and LDAP_FLOW_STALLED instead of reading from the socket while a
+ * queue of another search is above its high-water mark. Searches are
+ * unregistered when their final result is returned.
+ */
+int
+LDAPflow_result(LDAPFlowTable *t, LDAP *ld, int msgid,
+                struct timeval *timeout, LDAPMessage **msg)
+{
+    LDAPFlow *f;
+    int i, res_type;
+
+    if (t->num == 0)
+        return ldap_result(ld, msgid, LDAP_MSG_ONE, timeout, msg);
+
+    for (i = 0; i < t->num; i++) {
+        f = &t->flows[i];
+        if (f->head < f->len &&
+            (msgid == LDAP_RES_ANY || f->msgid == msgid)) {
+            *msg = f->queue[f->head++];
+            f->entries--;
+            f->bytes -= LDAPstats_message_bytes(*msg);
+            res_type = ldap_msgtype(*msg);
+            if (is_final(res_type))
+                LDAPflow_remove(t, f->msgid);
+            return res_type;
+        }
+    }
+    for (i = 0; i < t->num; i++) {
+        if (over_mark(&t->flows[i]))
+            return LDAP_FLOW_STALLED;
+    }
+
+    res_type = ldap_result(ld, msgid, LDAP_MSG_ONE, timeout, msg);
+    if (res_type > 0) {
+        if (is_final(res_type))
+            LDAPflow_remove(t, ldap_msgid(*msg));
+        if (msgid != LDAP_RES_ANY)
+            drain(t, ld, msgid);
+    }
+    return res_type;
+}
+
+/* Counts a wait held up by the searches above their marks */
+void
+LDAPflow_count_stall(LDAPFlowTable *t)
+{
+    int i;
+
+    for (i = 0; i < t->num; i++) {
+        if (over_mark(&t->flows[i]))
+            t->flows[i].stalls++;
+    }
+}
+
+/* Returns the state of f as dictionary */
+PyObject *
+LDAPflow_to_python(LDAPFlow *f)
+{
+    return Py_BuildValue("{s:n,s:n,s:n,s:n,s:n,s:n,s:n}",
+                         "entries", f->entries,
+                         "bytes", f->bytes,
+                         "max_entries", f->max_entries,
+                         "max_bytes", f->max_bytes,
+                         "peak_entries", f->peak_entries,
+                         "peak_bytes", f->peak_bytes,
+                         "stalls", f->stalls);
+}
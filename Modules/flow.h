@@ -0,0 +1,45 @@
+/* See https://www.python-ldap.org/ for details. */
+
+#ifndef __h_flow
+#define __h_flow
+
+#include "common.h"
+
+/* returned by LDAPflow_result() instead of reading beyond a high-water mark */
+#define LDAP_FLOW_STALLED       (-2)
+
+/* flow control of one outstanding search, see set_flow_control() */
+typedef struct {
+    int msgid;
+    Py_ssize_t max_entries;     /* high-water marks, 0 for none */
+    Py_ssize_t max_bytes;
+    Py_ssize_t entries;         /* messages held back and their BER size */
+    Py_ssize_t bytes;
+    Py_ssize_t peak_entries;
+    Py_ssize_t peak_bytes;
+    Py_ssize_t stalls;          /* waits held up because of the marks */
+    LDAPMessage **queue;        /* held back messages are queue[head:len] */
+    Py_ssize_t head;
+    Py_ssize_t len;
+    Py_ssize_t alloc;
+} LDAPFlow;
+
+/* flow controlled searches of a connection, kept in LDAPObject */
+typedef struct {
+    LDAPFlow *flows;
+    int num;
+    int alloc;
+} LDAPFlowTable;
+
+extern void LDAPflow_init(LDAPFlowTable *t);
+extern void LDAPflow_clear(LDAPFlowTable *t);
+extern LDAPFlow *LDAPflow_find(LDAPFlowTable *t, int msgid);
+extern int LDAPflow_set(LDAPFlowTable *t, int msgid, Py_ssize_t max_entries,
+                        Py_ssize_t max_bytes);
+extern void LDAPflow_remove(LDAPFlowTable *t, int msgid);
+extern void LDAPflow_count_stall(LDAPFlowTable *t);
+extern int LDAPflow_result(LDAPFlowTable *t, LDAP *ld, int msgid,
+                           struct timeval *timeout, LDAPMessage **msg);
+extern PyObject *LDAPflow_to_python(LDAPFlow *f);
+
+#endif /* __h_flow */
@@ -85,37 +85,75 @@ l_ldap_initialize_fd(PyObject *unused, PyObject *args)
 }
 #endif
 
-/* ldap_str2dn */
+/*
+ * Bounded cache of str2dn() results, an OrderedDict in least recently
+ * used order or NULL if disabled. Keys are the DN for flags 0, else
+ * (dn, flags). Values are tuples of RDN tuples, str2dn() returns fresh
+ * lists built from them so that callers may modify the results.
+ */
+static PyObject *dn_cache = NULL;
+static Py_ssize_t dn_cache_maxsize = 0;
+static Py_ssize_t dn_cache_hits = 0;
+static Py_ssize_t dn_cache_misses = 0;
+static PyObject *move_to_end_name;      /* interned "move_to_end" */
+
+/*
+ * The variables above are guarded by dn_cache_mutex on free-threaded
+ * builds, elsewhere by the GIL. Only exact str and bytes are cached, so
+ * that no Python code runs while the mutex is held.
+ */
+#ifdef Py_GIL_DISABLED
+static PyMutex dn_cache_mutex;
+#define DN_CACHE_LOCK() PyMutex_Lock(&dn_cache_mutex)
+#define DN_CACHE_UNLOCK() PyMutex_Unlock(&dn_cache_mutex)
+#else
+#define DN_CACHE_LOCK()
+#define DN_CACHE_UNLOCK()
+#endif
 
-static PyObject *
-l_ldap_str2dn(PyObject *unused, PyObject *args)
+/* Gets the string of dn like the z# format does, for str, bytes and None */
+static int
+dn_to_berval(PyObject *dn, struct berval *bv)
 {
-    struct berval str;
-    LDAPDN dn;
-    int flags = 0;
-    PyObject *result = NULL, *tmp;
-    int res, i, j;
-    Py_ssize_t str_len;
+    Py_ssize_t len = 0;
 
-    /*
-     * From a DN string such as "a=b,c=d;e=f", build
-     * a list-equivalent of AVA structures; namely:
-     * ((('a','b',1),('c','d',1)),(('e','f',1),))
-     * The integers are a bit combination of the AVA_* flags
-     */
-    if (!PyArg_ParseTuple(args, "z#|i:str2dn", &str.bv_val, &str_len, &flags))
-        return NULL;
-    str.bv_len = (ber_len_t) str_len;
+    if (dn == Py_None) {
+        bv->bv_val = NULL;
+    }
+    else if (PyUnicode_Check(dn)) {
+        bv->bv_val = (char *)PyUnicode_AsUTF8AndSize(dn, &len);
+        if (bv->bv_val == NULL)
+            return -1;
+    }
+    else if (PyBytes_Check(dn)) {
+        bv->bv_val = PyBytes_AS_STRING(dn);
+        len = PyBytes_GET_SIZE(dn);
+    }
+    else {
+        LDAPerror_TypeError("expected a DN string", dn);
+        return -1;
+    }
+    bv->bv_len = (ber_len_t) len;
+    return 0;
+}
 
-    res = ldap_bv2dn(&str, &dn, flags);
-    if (res != LDAP_SUCCESS)
-        return LDAPerr(res);
+/*
+ * From a parsed DN such as "a=b,c=d;e=f", build
+ * a list-equivalent of AVA structures; namely:
+ * ((('a','b',1),('c','d',1)),(('e','f',1),))
+ * The integers are a bit combination of the AVA_* flags
+ */
+static PyObject *
+LDAPDN_to_list(LDAPDN dn)
+{
+    PyObject *result = NULL, *tmp;
+    int i, j;
 
     tmp = PyList_New(0);
     if (!tmp)
         goto failed;
 
-    for (i = 0; dn[i]; i++) {
+    for (i = 0; dn != NULL && dn[i]; i++) {
         LDAPRDN rdn;
         PyObject *rdnlist;
 
@@ -156,7 +194,730 @@ l_ldap_str2dn(PyObject *unused, PyObject *args)
 
   failed:
     Py_XDECREF(tmp);
+    return result;
+}
+
+/* Returns non-zero if str2dn() results for dn are cached */
+static int
+dn_cache_enabled(PyObject *dn)
+{
+    int enabled;
+
+    if (!PyUnicode_CheckExact(dn) && !PyBytes_CheckExact(dn))
+        return 0;
+    DN_CACHE_LOCK();
+    enabled = (dn_cache != NULL);
+    DN_CACHE_UNLOCK();
+    return enabled;
+}
+
+static PyObject *
+dn_cache_key(PyObject *dn, int flags)
+{
+    if (flags == 0) {
+        Py_INCREF(dn);
+        return dn;
+    }
+    return Py_BuildValue("(Oi)", dn, flags);
+}
+
+/*
+ * Returns a new list for a cached DN. Returns NULL without an exception
+ * set if key is not cached.
+ */
+static PyObject *
+dn_cache_get(PyObject *key)
+{
+    PyObject *cached = NULL, *res, *result;
+    Py_ssize_t i, len;
+
+    DN_CACHE_LOCK();
+    if (dn_cache != NULL)
+        cached = PyDict_GetItemWithError(dn_cache, key);
+    if (cached != NULL) {
+        Py_INCREF(cached);
+        res = PyObject_CallMethodObjArgs(dn_cache, move_to_end_name, key,
+                                         NULL);
+        if (res == NULL)
+            Py_CLEAR(cached);
+        else
+            dn_cache_hits++;
+        Py_XDECREF(res);
+    }
+    else if (dn_cache != NULL && !PyErr_Occurred()) {
+        dn_cache_misses++;
+    }
+    DN_CACHE_UNLOCK();
+    if (cached == NULL)
+        return NULL;
+
+    len = PyTuple_GET_SIZE(cached);
+    result = PyList_New(len);
+    if (result == NULL)
+        goto failed;
+    for (i = 0; i < len; i++) {
+        PyObject *rdnlist = PySequence_List(PyTuple_GET_ITEM(cached, i));
+
+        if (rdnlist == NULL) {
+            Py_CLEAR(result);
+            goto failed;
+        }
+        PyList_SET_ITEM(result, i, rdnlist);
+    }
+
+  failed:
+    Py_DECREF(cached);
+    return result;
+}
+
+/* Remembers the str2dn() result dnlist for key */
+static int
+dn_cache_put(PyObject *key, PyObject *dnlist)
+{
+    PyObject *cached, *item;
+    Py_ssize_t i, len = PyList_GET_SIZE(dnlist);
+    int rc;
+
+    cached = PyTuple_New(len);
+    if (cached == NULL)
+        return -1;
+    for (i = 0; i < len; i++) {
+        PyObject *rdn = PyList_AsTuple(PyList_GET_ITEM(dnlist, i));
+
+        if (rdn == NULL) {
+            Py_DECREF(cached);
+            return -1;
+        }
+        PyTuple_SET_ITEM(cached, i, rdn);
+    }
+
+    DN_CACHE_LOCK();
+    rc = 0;
+    if (dn_cache != NULL)
+        rc = PyObject_SetItem(dn_cache, key, cached);
+    /* evict the least recently used DNs */
+    while (rc == 0 && dn_cache != NULL &&
+           PyObject_Length(dn_cache) > dn_cache_maxsize) {
+        item = PyObject_CallMethod(dn_cache, "popitem", "O", Py_False);
+        if (item == NULL)
+            rc = -1;
+        Py_XDECREF(item);
+    }
+    DN_CACHE_UNLOCK();
+    Py_DECREF(cached);
+    return rc;
+}
+
+/* ldap_str2dn */
+
+static PyObject *
+l_ldap_str2dn(PyObject *unused, PyObject *args)
+{
+    struct berval str;
+    LDAPDN dn;
+    int flags = 0;
+    PyObject *dnobj, *key = NULL, *result;
+    int res;
+
+    if (!PyArg_ParseTuple(args, "O|i:str2dn", &dnobj, &flags))
+        return NULL;
+    if (dn_to_berval(dnobj, &str) == -1)
+        return NULL;
+
+    if (str.bv_len > 0 && dn_cache_enabled(dnobj)) {
+        key = dn_cache_key(dnobj, flags);
+        if (key == NULL)
+            return NULL;
+        result = dn_cache_get(key);
+        if (result != NULL || PyErr_Occurred()) {
+            Py_DECREF(key);
+            return result;
+        }
+    }
+
+    res = ldap_bv2dn(&str, &dn, flags);
+    if (res != LDAP_SUCCESS) {
+        Py_XDECREF(key);
+        return LDAPerr(res);
+    }
+
+    result = LDAPDN_to_list(dn);
     ldap_dnfree(dn);
+
+    if (result != NULL && key != NULL && dn_cache_put(key, result) == -1)
+        Py_CLEAR(result);
+    Py_XDECREF(key);
+    return result;
+}
+
+/* str2dn_batch(dns [, flags]) */
+
+static PyObject *
+l_ldap_str2dn_batch(PyObject *unused, PyObject *args)
+{
+    PyObject *dns_arg, *dns = NULL, *result = NULL, *item, *key;
+    int flags = 0;
+    Py_ssize_t i, num_dns, num_todo = 0;
+    Py_ssize_t *todo = NULL;    /* indexes of DNs to parse */
+    struct berval *strs = NULL;
+    LDAPDN *parsed = NULL;
+    int *rcs = NULL;
+    PyThreadState *save;
+
+    if (!PyArg_ParseTuple(args, "O|i:str2dn_batch", &dns_arg, &flags))
+        return NULL;
+
+    /* the strings must stay alive while the GIL is released */
+    dns = PySequence_List(dns_arg);
+    if (dns == NULL)
+        return NULL;
+    num_dns = PyList_GET_SIZE(dns);
+
+    result = PyList_New(num_dns);
+    todo = PyMem_NEW(Py_ssize_t, num_dns + 1);
+    strs = PyMem_NEW(struct berval, num_dns + 1);
+    parsed = PyMem_NEW(LDAPDN, num_dns + 1);
+    rcs = PyMem_NEW(int, num_dns + 1);
+    if (result == NULL || todo == NULL || strs == NULL || parsed == NULL ||
+        rcs == NULL) {
+        PyErr_NoMemory();
+        goto failed;
+    }
+
+    for (i = 0; i < num_dns; i++) {
+        item = PyList_GET_ITEM(dns, i);
+        if (dn_to_berval(item, &strs[num_todo]) == -1)
+            goto failed;
+        if (strs[num_todo].bv_len == 0) {
+            PyObject *empty = PyList_New(0);
+
+            if (empty == NULL)
+                goto failed;
+            PyList_SET_ITEM(result, i, empty);
+            continue;
+        }
+        if (dn_cache_enabled(item)) {
+            PyObject *cached;
+
+            key = dn_cache_key(item, flags);
+            if (key == NULL)
+                goto failed;
+            cached = dn_cache_get(key);
+            Py_DECREF(key);
+            if (cached != NULL) {
+                PyList_SET_ITEM(result, i, cached);
+                continue;
+            }
+            if (PyErr_Occurred())
+                goto failed;
+        }
+        parsed[num_todo] = NULL;
+        todo[num_todo++] = i;
+    }
+
+    save = PyEval_SaveThread();
+    for (i = 0; i < num_todo; i++)
+        rcs[i] = ldap_bv2dn(&strs[i], &parsed[i], flags);
+    PyEval_RestoreThread(save);
+
+    for (i = 0; i < num_todo; i++) {
+        PyObject *dnlist;
+
+        if (rcs[i] != LDAP_SUCCESS) {
+            LDAPerr(rcs[i]);
+            goto failed;
+        }
+        dnlist = LDAPDN_to_list(parsed[i]);
+        if (dnlist == NULL)
+            goto failed;
+        PyList_SET_ITEM(result, todo[i], dnlist);
+        item = PyList_GET_ITEM(dns, todo[i]);
+        if (dn_cache_enabled(item)) {
+            key = dn_cache_key(item, flags);
+            if (key == NULL || dn_cache_put(key, dnlist) == -1) {
+                Py_XDECREF(key);
+                goto failed;
+            }
+            Py_DECREF(key);
+        }
+    }
+
+    for (i = 0; i < num_todo; i++)
+        ldap_dnfree(parsed[i]);
+    PyMem_DEL(todo);
+    PyMem_DEL(strs);
+    PyMem_DEL(parsed);
+    PyMem_DEL(rcs);
+    Py_DECREF(dns);
+    return result;
+
+  failed:
+    if (parsed != NULL) {
+        for (i = 0; i < num_todo; i++) {
+            if (parsed[i] != NULL)
+                ldap_dnfree(parsed[i]);
+        }
+    }
+    PyMem_DEL(todo);
+    PyMem_DEL(strs);
+    PyMem_DEL(parsed);
+    PyMem_DEL(rcs);
+    Py_XDECREF(result);
+    Py_DECREF(dns);
+    return NULL;
+}
+
+/* set_dn_cache_size(maxsize) */
+
+static PyObject *
+l_set_dn_cache_size(PyObject *unused, PyObject *args)
+{
+    Py_ssize_t maxsize;
+    PyObject *cache = NULL, *old;
+
+    if (!PyArg_ParseTuple(args, "n:set_dn_cache_size", &maxsize))
+        return NULL;
+
+    if (maxsize > 0) {
+        PyObject *collections = PyImport_ImportModule("collections");
+
+        if (collections == NULL)
+            return NULL;
+        cache = PyObject_CallMethod(collections, "OrderedDict", NULL);
+        Py_DECREF(collections);
+        if (cache == NULL)
+            return NULL;
+    }
+
+    DN_CACHE_LOCK();
+    old = dn_cache;
+    dn_cache = cache;
+    dn_cache_maxsize = (cache != NULL) ? maxsize : 0;
+    dn_cache_hits = 0;
+    dn_cache_misses = 0;
+    DN_CACHE_UNLOCK();
+    /* the old results are freed outside of the mutex */
+    Py_XDECREF(old);
+
+    Py_INCREF(Py_None);
+    return Py_None;
+}
+
+/* dn_cache_info() */
+
+static PyObject *
+l_dn_cache_info(PyObject *unused, PyObject *args)
+{
+    Py_ssize_t hits, misses, maxsize, currsize;
+
+    if (!PyArg_ParseTuple(args, ":dn_cache_info"))
+        return NULL;
+
+    DN_CACHE_LOCK();
+    hits = dn_cache_hits;
+    misses = dn_cache_misses;
+    maxsize = dn_cache_maxsize;
+    currsize = (dn_cache != NULL) ? PyObject_Length(dn_cache) : 0;
+    DN_CACHE_UNLOCK();
+
+    return Py_BuildValue("{s:n,s:n,s:n,s:n}",
+                         "hits", hits,
+                         "misses", misses,
+                         "maxsize", maxsize,
+                         "currsize", currsize);
+}
+
+/*
+ * Normalised DNs: attribute types and string values are lower-cased
+ * (ASCII only), the AVAs of multi-valued RDNs are sorted and the DN is
+ * written in LDAPv3 format, so that equal DNs give the same string.
+ */
+
+static void
+ascii_lower(struct berval *bv)
+{
+    ber_len_t i;
+
+    for (i = 0; i < bv->bv_len; i++) {
+        if (bv->bv_val[i] >= 'A' && bv->bv_val[i] <= 'Z')
+            bv->bv_val[i] += 'a' - 'A';
+    }
+}
+
+static int
+berval_cmp(const struct berval *a, const struct berval *b)
+{
+    int rc = memcmp(a->bv_val, b->bv_val,
+                    a->bv_len < b->bv_len ? a->bv_len : b->bv_len);
+
+    if (rc == 0 && a->bv_len != b->bv_len)
+        rc = a->bv_len < b->bv_len ? -1 : 1;
+    return rc;
+}
+
+static int
+ava_cmp(const void *a, const void *b)
+{
+    const LDAPAVA *ava_a = *(const LDAPAVA *const *)a;
+    const LDAPAVA *ava_b = *(const LDAPAVA *const *)b;
+    int rc = berval_cmp(&ava_a->la_attr, &ava_b->la_attr);
+
+    if (rc == 0)
+        rc = berval_cmp(&ava_a->la_value, &ava_b->la_value);
+    return rc;
+}
+
+/*
+ * Normalises the DN in buf, which is modified. Does not need the GIL.
+ * On success out holds the normalised DN to be freed by ldap_memfree().
+ */
+static int
+normalize_dn(struct berval *buf, int flags, struct berval *out)
+{
+    LDAPDN dn;
+    int i, j, rc;
+
+    out->bv_val = NULL;
+    out->bv_len = 0;
+    rc = ldap_bv2dn(buf, &dn, flags);
+    if (rc != LDAP_SUCCESS || dn == NULL)
+        return rc;
+
+    for (i = 0; dn[i]; i++) {
+        for (j = 0; dn[i][j]; j++) {
+            ascii_lower(&dn[i][j]->la_attr);
+            if (!(dn[i][j]->la_flags & LDAP_AVA_BINARY))
+                ascii_lower(&dn[i][j]->la_value);
+        }
+        if (j > 1)
+            qsort(dn[i], j, sizeof(LDAPAVA *), ava_cmp);
+    }
+
+    rc = ldap_dn2bv(dn, out, LDAP_DN_FORMAT_LDAPV3);
+    ldap_dnfree(dn);
+    return rc;
+}
+
+/* Returns a private copy of the string of dn, the AVAs may point into it */
+static char *
+dn_copy(PyObject *dn, struct berval *bv)
+{
+    char *copy;
+
+    if (dn_to_berval(dn, bv) == -1)
+        return NULL;
+    copy = PyMem_NEW(char, bv->bv_len + 1);
+    if (copy == NULL) {
+        PyErr_NoMemory();
+        return NULL;
+    }
+    if (bv->bv_len > 0)
+        memcpy(copy, bv->bv_val, bv->bv_len);
+    copy[bv->bv_len] = '\0';
+    bv->bv_val = copy;
+    return copy;
+}
+
+static PyObject *
+normalized_to_python(struct berval *out)
+{
+    PyObject *result;
+
+    if (out->bv_val == NULL)
+        return PyUnicode_FromStringAndSize(NULL, 0);
+    result = PyUnicode_FromStringAndSize(out->bv_val, out->bv_len);
+    ldap_memfree(out->bv_val);
+    out->bv_val = NULL;
+    return result;
+}
+
+/* normalize_dn(dn [, flags]) */
+
+static PyObject *
+l_ldap_normalize_dn(PyObject *unused, PyObject *args)
+{
+    PyObject *dnobj;
+    struct berval buf, out;
+    int flags = 0;
+    int rc;
+
+    if (!PyArg_ParseTuple(args, "O|i:normalize_dn", &dnobj, &flags))
+        return NULL;
+    if (dn_copy(dnobj, &buf) == NULL)
+        return NULL;
+
+    rc = normalize_dn(&buf, flags, &out);
+    PyMem_DEL(buf.bv_val);
+    if (rc != LDAP_SUCCESS)
+        return LDAPerr(rc);
+    return normalized_to_python(&out);
+}
+
+/* normalize_dn_batch(dns [, flags]) */
+
+static PyObject *
+l_ldap_normalize_dn_batch(PyObject *unused, PyObject *args)
+{
+    PyObject *dns_arg, *dns = NULL, *result = NULL;
+    int flags = 0;
+    Py_ssize_t i, num_dns = 0;
+    struct berval *bufs = NULL, *outs = NULL;
+    int *rcs = NULL;
+    PyThreadState *save;
+
+    if (!PyArg_ParseTuple(args, "O|i:normalize_dn_batch", &dns_arg, &flags))
+        return NULL;
+
+    dns = PySequence_List(dns_arg);
+    if (dns == NULL)
+        return NULL;
+    num_dns = PyList_GET_SIZE(dns);
+
+    bufs = PyMem_NEW(struct berval, num_dns + 1);
+    outs = PyMem_NEW(struct berval, num_dns + 1);
+    rcs = PyMem_NEW(int, num_dns + 1);
+    if (bufs == NULL || outs == NULL || rcs == NULL) {
+        PyErr_NoMemory();
+        num_dns = 0;
+        goto failed;
+    }
+    for (i = 0; i < num_dns; i++) {
+        outs[i].bv_val = NULL;
+        if (dn_copy(PyList_GET_ITEM(dns, i), &bufs[i]) == NULL) {
+            num_dns = i;
+            goto failed;
+        }
+    }
+
+    save = PyEval_SaveThread();
+    for (i = 0; i < num_dns; i++)
+        rcs[i] = normalize_dn(&bufs[i], flags, &outs[i]);
+    PyEval_RestoreThread(save);
+
+    for (i = 0; i < num_dns; i++) {
+        if (rcs[i] != LDAP_SUCCESS) {
+            LDAPerr(rcs[i]);
+            goto failed;
+        }
+    }
+    result = PyList_New(num_dns);
+    if (result == NULL)
+        goto failed;
+    for (i = 0; i < num_dns; i++) {
+        PyObject *item = normalized_to_python(&outs[i]);
+
+        if (item == NULL) {
+            Py_CLEAR(result);
+            goto failed;
+        }
+        PyList_SET_ITEM(result, i, item);
+    }
+
+  failed:
+    for (i = 0; i < num_dns; i++) {
+        PyMem_DEL(bufs[i].bv_val);
+        if (outs[i].bv_val != NULL)
+            ldap_memfree(outs[i].bv_val);
+    }
+    PyMem_DEL(bufs);
+    PyMem_DEL(outs);
+    PyMem_DEL(rcs);
+    Py_DECREF(dns);
+    return result;
+}
+
+/* Returns non-zero if c is escaped by escape_dn_chars() everywhere */
+static int
+dn_special(Py_UCS4 c)
+{
+    return (c == '\\' || c == ',' || c == '+' || c == '"' || c == '<' ||
+            c == '>' || c == ';' || c == '=' || c == 0);
+}
+
+/*
+ * Escapes the DN special characters in value (RFC 4514, section 2.4)
+ * exactly like the former Python version of ldap.dn.escape_dn_chars() did.
+ */
+static PyObject *
+escape_dn_value(PyObject *value)
+{
+    Py_ssize_t i, len, out_len, pos;
+    int kind, out_kind, leading;
+    void *data, *out_data;
+    Py_UCS4 c, maxchar = 0;
+    PyObject *result;
+
+    if (!PyUnicode_Check(value)) {
+        LDAPerror_TypeError("escape_dn_chars(): expected str", value);
+        return NULL;
+    }
+    if (PyUnicode_READY(value) == -1)
+        return NULL;
+
+    len = PyUnicode_GET_LENGTH(value);
+    kind = PyUnicode_KIND(value);
+    data = PyUnicode_DATA(value);
+    if (len == 0) {
+        Py_INCREF(value);
+        return value;
+    }
+
+    /* a trailing space is escaped, a leading '#' or space too */
+    c = PyUnicode_READ(kind, data, 0);
+    leading = (!dn_special(c) && (c == '#' || (c == ' ' && len > 1)));
+    out_len = len + leading;
+    for (i = 0; i < len; i++) {
+        c = PyUnicode_READ(kind, data, i);
+        if (dn_special(c) || (i == len - 1 && c == ' '))
+            out_len++;
+        if (c > maxchar)
+            maxchar = c;
+    }
+    if (out_len == len) {
+        Py_INCREF(value);
+        return value;
+    }
+
+    if (maxchar < 127)
+        maxchar = 127;
+    result = PyUnicode_New(out_len, maxchar);
+    if (result == NULL)
+        return NULL;
+    out_kind = PyUnicode_KIND(result);
+    out_data = PyUnicode_DATA(result);
+
+    pos = 0;
+    if (leading)
+        PyUnicode_WRITE(out_kind, out_data, pos++, '\\');
+    for (i = 0; i < len; i++) {
+        c = PyUnicode_READ(kind, data, i);
+        if (dn_special(c) || (i == len - 1 && c == ' '))
+            PyUnicode_WRITE(out_kind, out_data, pos++, '\\');
+        PyUnicode_WRITE(out_kind, out_data, pos++, c);
+    }
+    return result;
+}
+
+/* escape_dn_chars(value) */
+
+static PyObject *
+l_escape_dn_chars(PyObject *unused, PyObject *args)
+{
+    PyObject *value;
+
+    if (!PyArg_ParseTuple(args, "O:escape_dn_chars", &value))
+        return NULL;
+    if (value == Py_None) {
+        Py_INCREF(value);
+        return value;
+    }
+    return escape_dn_value(value);
+}
+
+/* Returns sep.join(parts) for a C string sep */
+static PyObject *
+join_parts(const char *sep, PyObject *parts)
+{
+    PyObject *sepobj, *result;
+
+    sepobj = PyUnicode_FromString(sep);
+    if (sepobj == NULL)
+        return NULL;
+    result = PyUnicode_Join(sepobj, parts);
+    Py_DECREF(sepobj);
+    return result;
+}
+
+/* Returns 'atype=escaped value' for an AVA tuple (atype, avalue, flags) */
+static PyObject *
+ava_to_str(PyObject *ava)
+{
+    PyObject *seq, *atype, *value, *escaped, *result = NULL;
+    int truth;
+
+    seq = PySequence_Fast(ava, "dn2str(): expected AVA tuple");
+    if (seq == NULL)
+        return NULL;
+    if (PySequence_Fast_GET_SIZE(seq) != 3) {
+        PyErr_Format(PyExc_ValueError,
+                     "dn2str(): expected AVA of 3 items, got %zd",
+                     PySequence_Fast_GET_SIZE(seq));
+        goto failed;
+    }
+    atype = PySequence_Fast_GET_ITEM(seq, 0);
+    if (!PyUnicode_Check(atype)) {
+        LDAPerror_TypeError("dn2str(): expected str attribute type", atype);
+        goto failed;
+    }
+    value = PySequence_Fast_GET_ITEM(seq, 1);
+    truth = PyObject_IsTrue(value);
+    if (truth == -1)
+        goto failed;
+    if (truth)
+        escaped = escape_dn_value(value);
+    else
+        escaped = PyUnicode_FromStringAndSize(NULL, 0);
+    if (escaped == NULL)
+        goto failed;
+    result = PyUnicode_FromFormat("%U=%U", atype, escaped);
+    Py_DECREF(escaped);
+
+  failed:
+    Py_DECREF(seq);
+    return result;
+}
+
+/* dn2str(dn) */
+
+static PyObject *
+l_ldap_dn2str(PyObject *unused, PyObject *args)
+{
+    PyObject *dn, *dnseq, *rdnseq, *rdns = NULL, *avas, *str, *result = NULL;
+    Py_ssize_t i, j, num_rdns, num_avas;
+
+    if (!PyArg_ParseTuple(args, "O:dn2str", &dn))
+        return NULL;
+
+    dnseq = PySequence_Fast(dn, "dn2str(): expected list of RDNs");
+    if (dnseq == NULL)
+        return NULL;
+    num_rdns = PySequence_Fast_GET_SIZE(dnseq);
+    rdns = PyList_New(num_rdns);
+    if (rdns == NULL)
+        goto failed;
+
+    for (i = 0; i < num_rdns; i++) {
+        rdnseq = PySequence_Fast(PySequence_Fast_GET_ITEM(dnseq, i),
+                                 "dn2str(): expected list of AVAs");
+        if (rdnseq == NULL)
+            goto failed;
+        num_avas = PySequence_Fast_GET_SIZE(rdnseq);
+        avas = PyList_New(num_avas);
+        if (avas == NULL) {
+            Py_DECREF(rdnseq);
+            goto failed;
+        }
+        for (j = 0; j < num_avas; j++) {
+            str = ava_to_str(PySequence_Fast_GET_ITEM(rdnseq, j));
+            if (str == NULL) {
+                Py_DECREF(avas);
+                Py_DECREF(rdnseq);
+                goto failed;
+            }
+            PyList_SET_ITEM(avas, j, str);
+        }
+        Py_DECREF(rdnseq);
+        str = join_parts("+", avas);
+        Py_DECREF(avas);
+        if (str == NULL)
+            goto failed;
+        PyList_SET_ITEM(rdns, i, str);
+    }
+    result = join_parts(",", rdns);
+
+  failed:
+    Py_XDECREF(rdns);
+    Py_DECREF(dnseq);
     return result;
 }
 
@@ -196,6 +957,14 @@ static PyMethodDef methods[] = {
     {"initialize_fd", (PyCFunction)l_ldap_initialize_fd, METH_VARARGS},
 #endif
     {"str2dn", (PyCFunction)l_ldap_str2dn, METH_VARARGS},
+    {"str2dn_batch", (PyCFunction)l_ldap_str2dn_batch, METH_VARARGS},
+    {"set_dn_cache_size", (PyCFunction)l_set_dn_cache_size, METH_VARARGS},
+    {"dn_cache_info", (PyCFunction)l_dn_cache_info, METH_VARARGS},
+    {"normalize_dn", (PyCFunction)l_ldap_normalize_dn, METH_VARARGS},
+    {"normalize_dn_batch", (PyCFunction)l_ldap_normalize_dn_batch,
+     METH_VARARGS},
+    {"dn2str", (PyCFunction)l_ldap_dn2str, METH_VARARGS},
+    {"escape_dn_chars", (PyCFunction)l_escape_dn_chars, METH_VARARGS},
     {"set_option", (PyCFunction)l_ldap_set_option, METH_VARARGS},
     {"get_option", (PyCFunction)l_ldap_get_option, METH_VARARGS},
     {NULL, NULL}
@@ -206,5 +975,8 @@ static PyMethodDef methods[] = {
 void
 LDAPinit_functions(PyObject *d)
 {
+    move_to_end_name = PyUnicode_InternFromString("move_to_end");
+    if (move_to_end_name == NULL)
+        return;
     LDAPadd_methods(d, methods);
 }
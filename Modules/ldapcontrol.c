@@ -197,6 +197,24 @@ LDAPControls_to_List(LDAPControl **ldcs)
 
 /* --------------- en-/decoders ------------- */
 
+/*
+ * Returns a decoder BerElement for a control value. liblber does not cope
+ * with an empty buffer, so empty values are rejected here.
+ */
+static BerElement *
+decoder_init(struct berval *ldctl_value)
+{
+    BerElement *ber;
+
+    if (ldctl_value->bv_len == 0) {
+        LDAPerr(LDAP_DECODING_ERROR);
+        return NULL;
+    }
+    if (!(ber = ber_init(ldctl_value)))
+        LDAPerr(LDAP_NO_MEMORY);
+    return ber;
+}
+
 /* Matched Values, aka, Values Return Filter */
 static PyObject *
 encode_rfc3876(PyObject *self, PyObject *args)
@@ -312,10 +330,8 @@ decode_rfc2696(PyObject *self, PyObject *args)
     }
     ldctl_value.bv_len = (ber_len_t) ldctl_value_len;
 
-    if (!(ber = ber_init(&ldctl_value))) {
-        LDAPerr(LDAP_NO_MEMORY);
+    if (!(ber = decoder_init(&ldctl_value)))
         goto endlbl;
-    }
 
     tag = ber_scanf(ber, "{iO", &count, &cookiep);
     if (tag == LBER_ERROR) {
@@ -379,11 +395,1021 @@ encode_assertion_control(PyObject *self, PyObject *args)
     return res;
 }
 
+/* Content Synchronization (RFC 4533) */
+
+#ifndef LDAP_TAG_SYNC_NEW_COOKIE
+#define LDAP_TAG_SYNC_NEW_COOKIE        ((ber_tag_t) 0x80U)
+#define LDAP_TAG_SYNC_REFRESH_DELETE    ((ber_tag_t) 0xa1U)
+#define LDAP_TAG_SYNC_REFRESH_PRESENT   ((ber_tag_t) 0xa2U)
+#define LDAP_TAG_SYNC_ID_SET            ((ber_tag_t) 0xa3U)
+#endif
+
+/* Returns the syncUUID bv in the usual string form */
+static PyObject *
+sync_uuid_to_str(const struct berval *bv)
+{
+    static const char hex[] = "0123456789abcdef";
+    char buf[36];
+    ber_len_t i;
+    int j = 0;
+
+    if (bv->bv_len != 16)
+        return LDAPerr(LDAP_DECODING_ERROR);
+    for (i = 0; i < 16; i++) {
+        unsigned char c = bv->bv_val[i];
+
+        if (i == 4 || i == 6 || i == 8 || i == 10)
+            buf[j++] = '-';
+        buf[j++] = hex[c >> 4];
+        buf[j++] = hex[c & 0x0f];
+    }
+    return PyUnicode_FromStringAndSize(buf, sizeof(buf));
+}
+
+/*
+ * Returns the syncCookie bv as str like pyasn1 did, None if bv is NULL.
+ * The cookies of OpenLDAP and 389-DS are ASCII.
+ */
+static PyObject *
+sync_cookie_to_str(const struct berval *bv)
+{
+    if (bv == NULL) {
+        Py_INCREF(Py_None);
+        return Py_None;
+    }
+    return PyUnicode_DecodeLatin1(bv->bv_val, bv->bv_len, NULL);
+}
+
+/*
+ * Reads the optional syncCookie and BOOLEAN following it in a sequence.
+ * *cookie is set to NULL and *flag is unchanged if they are absent.
+ * Returns 1 if the BOOLEAN was read, 0 if not and -1 on errors.
+ */
+static int
+sync_scan_cookie_flag(BerElement *ber, struct berval *cookie_bv,
+                      struct berval **cookie, ber_int_t *flag)
+{
+    ber_len_t len;
+
+    *cookie = NULL;
+    if (ber_peek_tag(ber, &len) == LBER_OCTETSTRING) {
+        if (ber_scanf(ber, "m", cookie_bv) == LBER_ERROR)
+            return -1;
+        *cookie = cookie_bv;
+    }
+    if (ber_peek_tag(ber, &len) == LBER_BOOLEAN) {
+        if (ber_scanf(ber, "b", flag) == LBER_ERROR)
+            return -1;
+        return 1;
+    }
+    return 0;
+}
+
+/* decode_syncstate_control(value) -> (state, entryUUID, cookie) */
+
+static PyObject *
+decode_syncstate_control(PyObject *self, PyObject *args)
+{
+    PyObject *res = 0, *uuid = 0, *cookie = 0;
+    BerElement *ber = 0;
+    struct berval ldctl_value, uuid_bv, cookie_bv;
+    Py_ssize_t ldctl_value_len;
+    ber_int_t state;
+    ber_len_t len;
+
+    if (!PyArg_ParseTuple(args, "y#:decode_syncstate_control",
+                          &ldctl_value.bv_val, &ldctl_value_len)) {
+        goto endlbl;
+    }
+    ldctl_value.bv_len = (ber_len_t) ldctl_value_len;
+
+    if (!(ber = decoder_init(&ldctl_value)))
+        goto endlbl;
+
+    if (ber_scanf(ber, "{em", &state, &uuid_bv) == LBER_ERROR ||
+        state < 0 || state > 3) {
+        LDAPerr(LDAP_DECODING_ERROR);
+        goto endlbl;
+    }
+    if (ber_peek_tag(ber, &len) == LBER_OCTETSTRING) {
+        if (ber_scanf(ber, "m", &cookie_bv) == LBER_ERROR) {
+            LDAPerr(LDAP_DECODING_ERROR);
+            goto endlbl;
+        }
+        cookie = sync_cookie_to_str(&cookie_bv);
+    }
+    else {
+        cookie = sync_cookie_to_str(NULL);
+    }
+    uuid = sync_uuid_to_str(&uuid_bv);
+    if (uuid != NULL && cookie != NULL)
+        res = Py_BuildValue("(iOO)", state, uuid, cookie);
+
+  endlbl:
+    Py_XDECREF(uuid);
+    Py_XDECREF(cookie);
+    if (ber)
+        ber_free(ber, 1);
+    return res;
+}
+
+/*
+ * decode_syncdone_control(value) -> (cookie, refreshDeletes)
+ *
+ * refreshDeletes is None if it is absent.
+ */
+
+static PyObject *
+decode_syncdone_control(PyObject *self, PyObject *args)
+{
+    PyObject *res = 0, *cookie, *pyrefresh;
+    BerElement *ber = 0;
+    struct berval ldctl_value, cookie_bv, *cookiep;
+    Py_ssize_t ldctl_value_len;
+    ber_int_t refresh_deletes = 0;
+    int has_refresh;
+
+    if (!PyArg_ParseTuple(args, "y#:decode_syncdone_control",
+                          &ldctl_value.bv_val, &ldctl_value_len)) {
+        goto endlbl;
+    }
+    ldctl_value.bv_len = (ber_len_t) ldctl_value_len;
+
+    if (!(ber = decoder_init(&ldctl_value)))
+        goto endlbl;
+
+    if (ber_scanf(ber, "{") == LBER_ERROR ||
+        (has_refresh = sync_scan_cookie_flag(ber, &cookie_bv, &cookiep,
+                                             &refresh_deletes)) == -1) {
+        LDAPerr(LDAP_DECODING_ERROR);
+        goto endlbl;
+    }
+    cookie = sync_cookie_to_str(cookiep);
+    if (cookie != NULL) {
+        if (has_refresh) {
+            pyrefresh = PyBool_FromLong(refresh_deletes);
+        }
+        else {
+            pyrefresh = Py_None;
+            Py_INCREF(pyrefresh);
+        }
+        res = Py_BuildValue("(ON)", cookie, pyrefresh);
+        Py_DECREF(cookie);
+    }
+
+  endlbl:
+    if (ber)
+        ber_free(ber, 1);
+    return res;
+}
+
+/*
+ * decode_syncinfo_value(value) -> (choice, cookie, flag, uuids)
+ *
+ * choice is the number of the syncInfoValue CHOICE: 0 for newcookie,
+ * 1 for refreshDelete, 2 for refreshPresent and 3 for syncIdSet. flag is
+ * refreshDone for 1 and 2 and refreshDeletes for 3, uuids the list of
+ * syncUUIDs of a syncIdSet, otherwise None.
+ */
+
+static PyObject *
+decode_syncinfo_value(PyObject *self, PyObject *args)
+{
+    PyObject *res = 0, *cookie = 0, *uuids = 0, *uuid;
+    BerElement *ber = 0;
+    struct berval ldctl_value, cookie_bv, uuid_bv, *cookiep = NULL;
+    Py_ssize_t ldctl_value_len;
+    ber_tag_t tag;
+    ber_len_t len;
+    ber_int_t flag = 0;
+    char *last;
+    int choice;
+
+    if (!PyArg_ParseTuple(args, "y#:decode_syncinfo_value",
+                          &ldctl_value.bv_val, &ldctl_value_len)) {
+        goto endlbl;
+    }
+    ldctl_value.bv_len = (ber_len_t) ldctl_value_len;
+
+    if (!(ber = decoder_init(&ldctl_value)))
+        goto endlbl;
+
+    tag = ber_peek_tag(ber, &len);
+    switch (tag) {
+    case LDAP_TAG_SYNC_NEW_COOKIE:
+        choice = 0;
+        if (ber_scanf(ber, "m", &cookie_bv) == LBER_ERROR) {
+            LDAPerr(LDAP_DECODING_ERROR);
+            goto endlbl;
+        }
+        cookiep = &cookie_bv;
+        break;
+    case LDAP_TAG_SYNC_REFRESH_DELETE:
+    case LDAP_TAG_SYNC_REFRESH_PRESENT:
+        choice = (tag == LDAP_TAG_SYNC_REFRESH_DELETE) ? 1 : 2;
+        /* refreshDone defaults to TRUE */
+        flag = 1;
+        if (ber_scanf(ber, "{") == LBER_ERROR ||
+            sync_scan_cookie_flag(ber, &cookie_bv, &cookiep, &flag) == -1) {
+            LDAPerr(LDAP_DECODING_ERROR);
+            goto endlbl;
+        }
+        break;
+    case LDAP_TAG_SYNC_ID_SET:
+        choice = 3;
+        if (ber_scanf(ber, "{") == LBER_ERROR ||
+            sync_scan_cookie_flag(ber, &cookie_bv, &cookiep, &flag) == -1) {
+            LDAPerr(LDAP_DECODING_ERROR);
+            goto endlbl;
+        }
+        if (!(uuids = PyList_New(0)))
+            goto endlbl;
+        for (tag = ber_first_element(ber, &len, &last);
+             tag != LBER_DEFAULT; tag = ber_next_element(ber, &len, last)) {
+            if (ber_scanf(ber, "m", &uuid_bv) == LBER_ERROR) {
+                LDAPerr(LDAP_DECODING_ERROR);
+                goto endlbl;
+            }
+            uuid = sync_uuid_to_str(&uuid_bv);
+            if (uuid == NULL || PyList_Append(uuids, uuid) == -1) {
+                Py_XDECREF(uuid);
+                goto endlbl;
+            }
+            Py_DECREF(uuid);
+        }
+        break;
+    default:
+        LDAPerr(LDAP_DECODING_ERROR);
+        goto endlbl;
+    }
+
+    cookie = sync_cookie_to_str(cookiep);
+    if (cookie != NULL)
+        res = Py_BuildValue("(iONO)", choice, cookie, PyBool_FromLong(flag),
+                            uuids ? uuids : Py_None);
+
+  endlbl:
+    Py_XDECREF(cookie);
+    Py_XDECREF(uuids);
+    if (ber)
+        ber_free(ber, 1);
+    return res;
+}
+
+/* Common response and request controls */
+
+#define PPOLICY_WARNING         ((ber_tag_t) 0xa0U)
+#define PPOLICY_ERROR           ((ber_tag_t) 0x81U)
+#define PPOLICY_EXPIRE          ((ber_tag_t) 0x80U)
+#define PPOLICY_GRACE           ((ber_tag_t) 0x81U)
+#define SSS_ORDERING_RULE       ((ber_tag_t) 0x80U)
+#define SSS_REVERSE_ORDER       ((ber_tag_t) 0x81U)
+#define SSS_ATTRIBUTE_TYPE      ((ber_tag_t) 0x80U)
+#define VLV_BY_OFFSET           ((ber_tag_t) 0xa0U)
+#define VLV_GREATER_THAN_OR_EQUAL ((ber_tag_t) 0x81U)
+#define DEREF_ATTR_VALS         ((ber_tag_t) 0xa0U)
+
+/* Returns the contents of an encoder BerElement as bytes */
+static PyObject *
+flatten_ber(BerElement *ber)
+{
+    PyObject *res;
+    struct berval *bv;
+
+    if (ber_flatten(ber, &bv) == -1)
+        return LDAPerr(LDAP_NO_MEMORY);
+    res = LDAPberval_to_object(bv);
+    ber_bvfree(bv);
+    return res;
+}
+
+/* Returns an int or None if the optional element was absent */
+static PyObject *
+int_or_none(int present, ber_int_t value)
+{
+    if (!present) {
+        Py_INCREF(Py_None);
+        return Py_None;
+    }
+    return PyLong_FromLong(value);
+}
+
+/*
+ * Decodes SEQUENCE OF PartialAttribute at the current position of ber
+ * into dict, values become str if text is set, otherwise bytes.
+ * Returns 0 on success and -1 with an exception set on failure.
+ */
+static int
+decode_partial_attrs(BerElement *ber, PyObject *dict, int text)
+{
+    PyObject *type, *values, *value;
+    struct berval type_bv, value_bv;
+    ber_tag_t tag, vtag;
+    ber_len_t len;
+    char *last, *vlast;
+    int rc;
+
+    for (tag = ber_first_element(ber, &len, &last);
+         tag != LBER_DEFAULT; tag = ber_next_element(ber, &len, last)) {
+        if (ber_scanf(ber, "{m", &type_bv) == LBER_ERROR) {
+            LDAPerr(LDAP_DECODING_ERROR);
+            return -1;
+        }
+        if (!(values = PyList_New(0)))
+            return -1;
+        for (vtag = ber_first_element(ber, &len, &vlast);
+             vtag != LBER_DEFAULT; vtag = ber_next_element(ber, &len, vlast)) {
+            if (ber_scanf(ber, "m", &value_bv) == LBER_ERROR) {
+                Py_DECREF(values);
+                LDAPerr(LDAP_DECODING_ERROR);
+                return -1;
+            }
+            value = text ? LDAPberval_to_unicode_object(&value_bv)
+                : LDAPberval_to_object(&value_bv);
+            if (value == NULL || PyList_Append(values, value) == -1) {
+                Py_XDECREF(value);
+                Py_DECREF(values);
+                return -1;
+            }
+            Py_DECREF(value);
+        }
+        if (vlast == NULL) {
+            /* SET OF vals is missing */
+            Py_DECREF(values);
+            LDAPerr(LDAP_DECODING_ERROR);
+            return -1;
+        }
+        type = LDAPberval_to_unicode_object(&type_bv);
+        if (type == NULL) {
+            Py_DECREF(values);
+            return -1;
+        }
+        rc = PyDict_SetItem(dict, type, values);
+        Py_DECREF(type);
+        Py_DECREF(values);
+        if (rc == -1)
+            return -1;
+    }
+    if (last == NULL) {
+        LDAPerr(LDAP_DECODING_ERROR);
+        return -1;
+    }
+    return 0;
+}
+
+/* Encodes a sequence of str as SEQUENCE OF OCTET STRING */
+static int
+encode_str_list(BerElement *ber, PyObject *list, const char *errmsg)
+{
+    PyObject *seq, *item;
+    Py_ssize_t i;
+    const char *s;
+
+    if (!(seq = PySequence_Fast(list, errmsg)))
+        return -1;
+    if (ber_printf(ber, "{") == LBER_ERROR)
+        goto encerr;
+    for (i = 0; i < PySequence_Fast_GET_SIZE(seq); i++) {
+        item = PySequence_Fast_GET_ITEM(seq, i);
+        if (!PyUnicode_Check(item)) {
+            LDAPerror_TypeError(errmsg, item);
+            Py_DECREF(seq);
+            return -1;
+        }
+        if (!(s = PyUnicode_AsUTF8(item))) {
+            Py_DECREF(seq);
+            return -1;
+        }
+        if (ber_printf(ber, "s", s) == LBER_ERROR)
+            goto encerr;
+    }
+    if (ber_printf(ber, /*{ */ "N}") == LBER_ERROR)
+        goto encerr;
+    Py_DECREF(seq);
+    return 0;
+
+  encerr:
+    Py_DECREF(seq);
+    LDAPerr(LDAP_ENCODING_ERROR);
+    return -1;
+}
+
+/*
+ * decode_ppolicy_control(value)
+ *     -> (timeBeforeExpiration, graceAuthNsRemaining, error)
+ */
+
+static PyObject *
+decode_ppolicy_control(PyObject *self, PyObject *args)
+{
+    PyObject *res = 0;
+    BerElement *ber = 0;
+    struct berval ldctl_value;
+    Py_ssize_t ldctl_value_len;
+    ber_tag_t tag;
+    ber_len_t len;
+    ber_int_t expire = 0, grace = 0, error = 0, value;
+    int has_expire = 0, has_grace = 0, has_error = 0;
+
+    if (!PyArg_ParseTuple(args, "y#:decode_ppolicy_control",
+                          &ldctl_value.bv_val, &ldctl_value_len)) {
+        goto endlbl;
+    }
+    ldctl_value.bv_len = (ber_len_t) ldctl_value_len;
+
+    if (!(ber = decoder_init(&ldctl_value)))
+        goto endlbl;
+
+    if (ber_scanf(ber, "{") == LBER_ERROR)
+        goto decerr;
+    tag = ber_peek_tag(ber, &len);
+    if (tag == PPOLICY_WARNING) {
+        if (ber_skip_tag(ber, &len) == LBER_DEFAULT)
+            goto decerr;
+        tag = ber_peek_tag(ber, &len);
+        if (ber_scanf(ber, "i", &value) == LBER_ERROR)
+            goto decerr;
+        if (tag == PPOLICY_EXPIRE) {
+            expire = value;
+            has_expire = 1;
+        }
+        else if (tag == PPOLICY_GRACE) {
+            grace = value;
+            has_grace = 1;
+        }
+        else {
+            goto decerr;
+        }
+        tag = ber_peek_tag(ber, &len);
+    }
+    if (tag == PPOLICY_ERROR) {
+        if (ber_scanf(ber, "e", &error) == LBER_ERROR)
+            goto decerr;
+        has_error = 1;
+    }
+
+    res = Py_BuildValue("(NNN)", int_or_none(has_expire, expire),
+                        int_or_none(has_grace, grace),
+                        int_or_none(has_error, error));
+    goto endlbl;
+
+  decerr:
+    LDAPerr(LDAP_DECODING_ERROR);
+  endlbl:
+    if (ber)
+        ber_free(ber, 1);
+    return res;
+}
+
+/*
+ * encode_sss_control(keys) -> bytes
+ *
+ * keys is a list of (attributeType, orderingRule or None, reverseOrder)
+ */
+
+static PyObject *
+encode_sss_control(PyObject *self, PyObject *args)
+{
+    PyObject *res = 0, *keys, *seq = 0, *item;
+    BerElement *ber = 0;
+    Py_ssize_t i;
+    char *attr, *rule;
+    int reverse;
+
+    if (!PyArg_ParseTuple(args, "O:encode_sss_control", &keys)) {
+        goto endlbl;
+    }
+    if (!(seq = PySequence_Fast(keys, "encode_sss_control(): expected a list")))
+        goto endlbl;
+
+    if (!(ber = ber_alloc_t(LBER_USE_DER))) {
+        LDAPerr(LDAP_NO_MEMORY);
+        goto endlbl;
+    }
+
+    if (ber_printf(ber, "{") == LBER_ERROR)
+        goto encerr;
+    for (i = 0; i < PySequence_Fast_GET_SIZE(seq); i++) {
+        item = PySequence_Fast_GET_ITEM(seq, i);
+        if (!PyTuple_Check(item)) {
+            LDAPerror_TypeError("encode_sss_control(): expected a tuple",
+                                item);
+            goto endlbl;
+        }
+        if (!PyArg_ParseTuple(item, "szp:encode_sss_control",
+                              &attr, &rule, &reverse))
+            goto endlbl;
+        if (ber_printf(ber, "{s", attr) == LBER_ERROR)
+            goto encerr;
+        if (rule && ber_printf(ber, "ts", SSS_ORDERING_RULE,
+                               rule) == LBER_ERROR)
+            goto encerr;
+        /* reverseOrder is DEFAULT FALSE */
+        if (reverse && ber_printf(ber, "tb", SSS_REVERSE_ORDER,
+                                  (ber_int_t) reverse) == LBER_ERROR)
+            goto encerr;
+        if (ber_printf(ber, /*{ */ "N}") == LBER_ERROR)
+            goto encerr;
+    }
+    if (ber_printf(ber, /*{ */ "N}") == LBER_ERROR)
+        goto encerr;
+
+    res = flatten_ber(ber);
+    goto endlbl;
+
+  encerr:
+    LDAPerr(LDAP_ENCODING_ERROR);
+  endlbl:
+    Py_XDECREF(seq);
+    if (ber)
+        ber_free(ber, 1);
+    return res;
+}
+
+/* decode_sss_control(value) -> (sortResult, attributeType) */
+
+static PyObject *
+decode_sss_control(PyObject *self, PyObject *args)
+{
+    PyObject *res = 0;
+    BerElement *ber = 0;
+    struct berval ldctl_value, attr_bv, *attrp = NULL;
+    Py_ssize_t ldctl_value_len;
+    ber_int_t result;
+    ber_len_t len;
+
+    if (!PyArg_ParseTuple(args, "y#:decode_sss_control",
+                          &ldctl_value.bv_val, &ldctl_value_len)) {
+        goto endlbl;
+    }
+    ldctl_value.bv_len = (ber_len_t) ldctl_value_len;
+
+    if (!(ber = decoder_init(&ldctl_value)))
+        goto endlbl;
+
+    if (ber_scanf(ber, "{e", &result) == LBER_ERROR)
+        goto decerr;
+    if (ber_peek_tag(ber, &len) == SSS_ATTRIBUTE_TYPE) {
+        if (ber_scanf(ber, "m", &attr_bv) == LBER_ERROR)
+            goto decerr;
+        attrp = &attr_bv;
+    }
+
+    res = Py_BuildValue("(iN)", result, LDAPberval_to_unicode_object(attrp));
+    goto endlbl;
+
+  decerr:
+    LDAPerr(LDAP_DECODING_ERROR);
+  endlbl:
+    if (ber)
+        ber_free(ber, 1);
+    return res;
+}
+
+/*
+ * encode_vlv_control(beforeCount, afterCount, offset, contentCount,
+ *                    greaterThanOrEqual, contextID) -> bytes
+ *
+ * The target is byOffset unless greaterThanOrEqual is not None.
+ */
+
+static PyObject *
+encode_vlv_control(PyObject *self, PyObject *args)
+{
+    PyObject *res = 0;
+    BerElement *ber = 0;
+    struct berval gte, context_id;
+    Py_ssize_t gte_len, context_id_len;
+    int before, after, offset, content_count;
+
+    if (!PyArg_ParseTuple(args, "iiiiz#z#:encode_vlv_control",
+                          &before, &after, &offset, &content_count,
+                          &gte.bv_val, &gte_len,
+                          &context_id.bv_val, &context_id_len)) {
+        goto endlbl;
+    }
+    gte.bv_len = (ber_len_t) gte_len;
+    context_id.bv_len = (ber_len_t) context_id_len;
+
+    if (!(ber = ber_alloc_t(LBER_USE_DER))) {
+        LDAPerr(LDAP_NO_MEMORY);
+        goto endlbl;
+    }
+
+    if (ber_printf(ber, "{ii", before, after) == LBER_ERROR)
+        goto encerr;
+    if (gte.bv_val != NULL) {
+        if (ber_printf(ber, "tO", VLV_GREATER_THAN_OR_EQUAL,
+                       &gte) == LBER_ERROR)
+            goto encerr;
+    }
+    else if (ber_printf(ber, "t{ii}", VLV_BY_OFFSET, offset,
+                        content_count) == LBER_ERROR) {
+        goto encerr;
+    }
+    if (context_id.bv_val != NULL &&
+        ber_printf(ber, "O", &context_id) == LBER_ERROR)
+        goto encerr;
+    if (ber_printf(ber, /*{ */ "N}") == LBER_ERROR)
+        goto encerr;
+
+    res = flatten_ber(ber);
+    goto endlbl;
+
+  encerr:
+    LDAPerr(LDAP_ENCODING_ERROR);
+  endlbl:
+    if (ber)
+        ber_free(ber, 1);
+    return res;
+}
+
+/*
+ * decode_vlv_control(value)
+ *     -> (targetPosition, contentCount, virtualListViewResult, contextID)
+ */
+
+static PyObject *
+decode_vlv_control(PyObject *self, PyObject *args)
+{
+    PyObject *res = 0;
+    BerElement *ber = 0;
+    struct berval ldctl_value, context_bv, *contextp = NULL;
+    Py_ssize_t ldctl_value_len;
+    ber_int_t position, count, result;
+    ber_len_t len;
+
+    if (!PyArg_ParseTuple(args, "y#:decode_vlv_control",
+                          &ldctl_value.bv_val, &ldctl_value_len)) {
+        goto endlbl;
+    }
+    ldctl_value.bv_len = (ber_len_t) ldctl_value_len;
+
+    if (!(ber = decoder_init(&ldctl_value)))
+        goto endlbl;
+
+    if (ber_scanf(ber, "{iie", &position, &count, &result) == LBER_ERROR)
+        goto decerr;
+    if (ber_peek_tag(ber, &len) == LBER_OCTETSTRING) {
+        if (ber_scanf(ber, "m", &context_bv) == LBER_ERROR)
+            goto decerr;
+        contextp = &context_bv;
+    }
+
+    res = Py_BuildValue("(iiiO&)", position, count, result,
+                        LDAPberval_to_object, contextp);
+    goto endlbl;
+
+  decerr:
+    LDAPerr(LDAP_DECODING_ERROR);
+  endlbl:
+    if (ber)
+        ber_free(ber, 1);
+    return res;
+}
+
+/* encode_psearch_control(changeTypes, changesOnly, returnECs) -> bytes */
+
+static PyObject *
+encode_psearch_control(PyObject *self, PyObject *args)
+{
+    PyObject *res = 0;
+    BerElement *ber = 0;
+    int change_types, changes_only, return_ecs;
+
+    if (!PyArg_ParseTuple(args, "ipp:encode_psearch_control",
+                          &change_types, &changes_only, &return_ecs)) {
+        goto endlbl;
+    }
+
+    if (!(ber = ber_alloc_t(LBER_USE_DER))) {
+        LDAPerr(LDAP_NO_MEMORY);
+        goto endlbl;
+    }
+
+    if (ber_printf(ber, "{ibb}", change_types, (ber_int_t) changes_only,
+                   (ber_int_t) return_ecs) == LBER_ERROR) {
+        LDAPerr(LDAP_ENCODING_ERROR);
+        goto endlbl;
+    }
+
+    res = flatten_ber(ber);
+
+  endlbl:
+    if (ber)
+        ber_free(ber, 1);
+    return res;
+}
+
+/*
+ * decode_entrychange_control(value)
+ *     -> (changeType, previousDN, changeNumber)
+ */
+
+static PyObject *
+decode_entrychange_control(PyObject *self, PyObject *args)
+{
+    PyObject *res = 0;
+    BerElement *ber = 0;
+    struct berval ldctl_value, dn_bv, *dnp = NULL;
+    Py_ssize_t ldctl_value_len;
+    ber_int_t change_type, change_number = 0;
+    ber_len_t len;
+    int has_change_number = 0;
+
+    if (!PyArg_ParseTuple(args, "y#:decode_entrychange_control",
+                          &ldctl_value.bv_val, &ldctl_value_len)) {
+        goto endlbl;
+    }
+    ldctl_value.bv_len = (ber_len_t) ldctl_value_len;
+
+    if (!(ber = decoder_init(&ldctl_value)))
+        goto endlbl;
+
+    if (ber_scanf(ber, "{e", &change_type) == LBER_ERROR)
+        goto decerr;
+    if (ber_peek_tag(ber, &len) == LBER_OCTETSTRING) {
+        if (ber_scanf(ber, "m", &dn_bv) == LBER_ERROR)
+            goto decerr;
+        dnp = &dn_bv;
+    }
+    if (ber_peek_tag(ber, &len) == LBER_INTEGER) {
+        if (ber_scanf(ber, "i", &change_number) == LBER_ERROR)
+            goto decerr;
+        has_change_number = 1;
+    }
+
+    res = Py_BuildValue("(iNN)", change_type, LDAPberval_to_unicode_object(dnp),
+                        int_or_none(has_change_number, change_number));
+    goto endlbl;
+
+  decerr:
+    LDAPerr(LDAP_DECODING_ERROR);
+  endlbl:
+    if (ber)
+        ber_free(ber, 1);
+    return res;
+}
+
+/* encode_readentry_control(attrList) -> bytes */
+
+static PyObject *
+encode_readentry_control(PyObject *self, PyObject *args)
+{
+    PyObject *res = 0, *attrlist;
+    BerElement *ber = 0;
+
+    if (!PyArg_ParseTuple(args, "O:encode_readentry_control", &attrlist)) {
+        goto endlbl;
+    }
+
+    if (!(ber = ber_alloc_t(LBER_USE_DER))) {
+        LDAPerr(LDAP_NO_MEMORY);
+        goto endlbl;
+    }
+
+    if (encode_str_list(ber, attrlist,
+                        "encode_readentry_control(): expected a list of str")
+        == -1)
+        goto endlbl;
+
+    res = flatten_ber(ber);
+
+  endlbl:
+    if (ber)
+        ber_free(ber, 1);
+    return res;
+}
+
+/* decode_readentry_control(value) -> (dn, entry) */
+
+static PyObject *
+decode_readentry_control(PyObject *self, PyObject *args)
+{
+    PyObject *res = 0, *entry = 0, *dn;
+    BerElement *ber = 0;
+    struct berval ldctl_value, dn_bv;
+    Py_ssize_t ldctl_value_len;
+
+    if (!PyArg_ParseTuple(args, "y#:decode_readentry_control",
+                          &ldctl_value.bv_val, &ldctl_value_len)) {
+        goto endlbl;
+    }
+    ldctl_value.bv_len = (ber_len_t) ldctl_value_len;
+
+    if (!(ber = decoder_init(&ldctl_value)))
+        goto endlbl;
+
+    /* SearchResultEntry */
+    if (ber_scanf(ber, "{m", &dn_bv) == LBER_ERROR) {
+        LDAPerr(LDAP_DECODING_ERROR);
+        goto endlbl;
+    }
+    if (!(entry = PyDict_New()))
+        goto endlbl;
+    if (decode_partial_attrs(ber, entry, 0) == -1)
+        goto endlbl;
+    if (!(dn = LDAPberval_to_unicode_object(&dn_bv)))
+        goto endlbl;
+    res = Py_BuildValue("(NO)", dn, entry);
+
+  endlbl:
+    Py_XDECREF(entry);
+    if (ber)
+        ber_free(ber, 1);
+    return res;
+}
+
+/*
+ * encode_deref_control(derefSpecs) -> bytes
+ *
+ * derefSpecs is a list of (derefAttr, attributes)
+ */
+
+static PyObject *
+encode_deref_control(PyObject *self, PyObject *args)
+{
+    PyObject *res = 0, *specs, *seq = 0, *item, *attributes;
+    BerElement *ber = 0;
+    Py_ssize_t i;
+    char *deref_attr;
+
+    if (!PyArg_ParseTuple(args, "O:encode_deref_control", &specs)) {
+        goto endlbl;
+    }
+    if (!(seq = PySequence_Fast(specs,
+                                "encode_deref_control(): expected a list")))
+        goto endlbl;
+
+    if (!(ber = ber_alloc_t(LBER_USE_DER))) {
+        LDAPerr(LDAP_NO_MEMORY);
+        goto endlbl;
+    }
+
+    if (ber_printf(ber, "{") == LBER_ERROR)
+        goto encerr;
+    for (i = 0; i < PySequence_Fast_GET_SIZE(seq); i++) {
+        item = PySequence_Fast_GET_ITEM(seq, i);
+        if (!PyTuple_Check(item)) {
+            LDAPerror_TypeError("encode_deref_control(): expected a tuple",
+                                item);
+            goto endlbl;
+        }
+        if (!PyArg_ParseTuple(item, "sO:encode_deref_control",
+                              &deref_attr, &attributes))
+            goto endlbl;
+        if (ber_printf(ber, "{s", deref_attr) == LBER_ERROR)
+            goto encerr;
+        if (encode_str_list(ber, attributes,
+                            "encode_deref_control(): expected a list of str")
+            == -1)
+            goto endlbl;
+        if (ber_printf(ber, /*{ */ "N}") == LBER_ERROR)
+            goto encerr;
+    }
+    if (ber_printf(ber, /*{ */ "N}") == LBER_ERROR)
+        goto encerr;
+
+    res = flatten_ber(ber);
+    goto endlbl;
+
+  encerr:
+    LDAPerr(LDAP_ENCODING_ERROR);
+  endlbl:
+    Py_XDECREF(seq);
+    if (ber)
+        ber_free(ber, 1);
+    return res;
+}
+
+/*
+ * decode_deref_control(value) -> [(derefAttr, derefVal, attrVals), ...]
+ *
+ * attrVals is a dict mapping attribute types to lists of str values.
+ */
+
+static PyObject *
+decode_deref_control(PyObject *self, PyObject *args)
+{
+    PyObject *res = 0, *attr, *val, *attrs, *item;
+    BerElement *ber = 0;
+    struct berval ldctl_value, attr_bv, val_bv;
+    Py_ssize_t ldctl_value_len;
+    ber_tag_t tag;
+    ber_len_t len;
+    char *last;
+
+    if (!PyArg_ParseTuple(args, "y#:decode_deref_control",
+                          &ldctl_value.bv_val, &ldctl_value_len)) {
+        goto endlbl;
+    }
+    ldctl_value.bv_len = (ber_len_t) ldctl_value_len;
+
+    if (!(ber = decoder_init(&ldctl_value)))
+        goto endlbl;
+
+    if (!(res = PyList_New(0)))
+        goto endlbl;
+    for (tag = ber_first_element(ber, &len, &last);
+         tag != LBER_DEFAULT; tag = ber_next_element(ber, &len, last)) {
+        if (ber_scanf(ber, "{mm", &attr_bv, &val_bv) == LBER_ERROR) {
+            LDAPerr(LDAP_DECODING_ERROR);
+            goto failed;
+        }
+        if (!(attrs = PyDict_New()))
+            goto failed;
+        if (ber_peek_tag(ber, &len) == DEREF_ATTR_VALS &&
+            decode_partial_attrs(ber, attrs, 1) == -1) {
+            Py_DECREF(attrs);
+            goto failed;
+        }
+        attr = LDAPberval_to_unicode_object(&attr_bv);
+        val = LDAPberval_to_unicode_object(&val_bv);
+        if (attr == NULL || val == NULL) {
+            Py_XDECREF(attr);
+            Py_XDECREF(val);
+            Py_DECREF(attrs);
+            goto failed;
+        }
+        item = Py_BuildValue("(NNN)", attr, val, attrs);
+        if (item == NULL || PyList_Append(res, item) == -1) {
+            Py_XDECREF(item);
+            goto failed;
+        }
+        Py_DECREF(item);
+    }
+    if (last == NULL) {
+        LDAPerr(LDAP_DECODING_ERROR);
+        goto failed;
+    }
+    goto endlbl;
+
+  failed:
+    Py_CLEAR(res);
+  endlbl:
+    if (ber)
+        ber_free(ber, 1);
+    return res;
+}
+
+/*
+ * encode_sessiontrack_control(sessionSourceIp, sessionSourceName,
+ *                             formatOID, sessionTrackingIdentifier) -> bytes
+ */
+
+static PyObject *
+encode_sessiontrack_control(PyObject *self, PyObject *args)
+{
+    PyObject *res = 0;
+    BerElement *ber = 0;
+    char *source_ip, *source_name, *format_oid, *identifier;
+
+    if (!PyArg_ParseTuple(args, "ssss:encode_sessiontrack_control",
+                          &source_ip, &source_name, &format_oid,
+                          &identifier)) {
+        goto endlbl;
+    }
+
+    if (!(ber = ber_alloc_t(LBER_USE_DER))) {
+        LDAPerr(LDAP_NO_MEMORY);
+        goto endlbl;
+    }
+
+    if (ber_printf(ber, "{ssss}", source_ip, source_name, format_oid,
+                   identifier) == LBER_ERROR) {
+        LDAPerr(LDAP_ENCODING_ERROR);
+        goto endlbl;
+    }
+
+    res = flatten_ber(ber);
+
+  endlbl:
+    if (ber)
+        ber_free(ber, 1);
+    return res;
+}
+
 static PyMethodDef methods[] = {
     {"encode_page_control", encode_rfc2696, METH_VARARGS},
     {"decode_page_control", decode_rfc2696, METH_VARARGS},
     {"encode_valuesreturnfilter_control", encode_rfc3876, METH_VARARGS},
     {"encode_assertion_control", encode_assertion_control, METH_VARARGS},
+    {"decode_syncstate_control", decode_syncstate_control, METH_VARARGS},
+    {"decode_syncdone_control", decode_syncdone_control, METH_VARARGS},
+    {"decode_syncinfo_value", decode_syncinfo_value, METH_VARARGS},
+    {"decode_ppolicy_control", decode_ppolicy_control, METH_VARARGS},
+    {"encode_sss_control", encode_sss_control, METH_VARARGS},
+    {"decode_sss_control", decode_sss_control, METH_VARARGS},
+    {"encode_vlv_control", encode_vlv_control, METH_VARARGS},
+    {"decode_vlv_control", decode_vlv_control, METH_VARARGS},
+    {"encode_psearch_control", encode_psearch_control, METH_VARARGS},
+    {"decode_entrychange_control", decode_entrychange_control, METH_VARARGS},
+    {"encode_readentry_control", encode_readentry_control, METH_VARARGS},
+    {"decode_readentry_control", decode_readentry_control, METH_VARARGS},
+    {"encode_deref_control", encode_deref_control, METH_VARARGS},
+    {"decode_deref_control", decode_deref_control, METH_VARARGS},
+    {"encode_sessiontrack_control", encode_sessiontrack_control,
+     METH_VARARGS},
     {NULL, NULL}
 };
 
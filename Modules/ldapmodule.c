@@ -1,11 +1,18 @@
 /* See https://www.python-ldap.org/ for details. */
 
 #include "common.h"
+#include "cidict.h"
 #include "constants.h"
+#include "filter.h"
 #include "functions.h"
 #include "ldapcontrol.h"
+#include "ldif.h"
 
 #include "LDAPObject.h"
+#include "message.h"
+#include "modlist.h"
+#include "schema.h"
+#include "berval.h"
 
 #if PY_MAJOR_VERSION >= 3
 PyMODINIT_FUNC PyInit__ldap(void);
@@ -51,6 +58,13 @@ init_ldap_module(void)
         methods,        /* m_methods */
     };
     m = PyModule_Create(&ldap_moduledef);
+#ifdef Py_GIL_DISABLED
+    /* connections serialise their libldap calls with a lock of their own
+     * and guard their other state with critical sections, like CIDict
+     * does, and the DN cache has a mutex */
+    if (m != NULL)
+        PyUnstable_Module_SetGIL(m, Py_MOD_GIL_NOT_USED);
+#endif
 #else
     m = Py_InitModule("_ldap", methods);
 #endif
@@ -59,6 +73,39 @@ init_ldap_module(void)
         Py_DECREF(m);
         return NULL;
     }
+    if (PyType_Ready(&LDAPPagedSearch_Type) < 0) {
+        Py_DECREF(m);
+        return NULL;
+    }
+    if (PyType_Ready(&LDAPPreparedSearch_Type) < 0) {
+        Py_DECREF(m);
+        return NULL;
+    }
+    if (PyType_Ready(&LDAPMessageIter_Type) < 0) {
+        Py_DECREF(m);
+        return NULL;
+    }
+    if (PyType_Ready(&LDAPMessageOwner_Type) < 0) {
+        Py_DECREF(m);
+        return NULL;
+    }
+    if (PyType_Ready(&LDAPBervalView_Type) < 0) {
+        Py_DECREF(m);
+        return NULL;
+    }
+    if (PyType_Ready(&LDAPFilterTemplate_Type) < 0) {
+        Py_DECREF(m);
+        return NULL;
+    }
+    if (PyType_Ready(&LDAPLDIFReader_Type) < 0) {
+        Py_DECREF(m);
+        return NULL;
+    }
+    LDAPCIDict_Type.tp_base = &PyDict_Type;
+    if (PyType_Ready(&LDAPCIDict_Type) < 0) {
+        Py_DECREF(m);
+        return NULL;
+    }
 
     /* Add some symbolic constants to the module */
     d = PyModule_GetDict(m);
@@ -70,7 +117,13 @@ init_ldap_module(void)
     }
 
     LDAPinit_functions(d);
+    LDAPinit_modlist(d);
+    LDAPinit_filter(d);
+    LDAPinit_ldif(d);
+    LDAPinit_schema(d);
+    LDAPinit_cidict(d);
     LDAPinit_control(d);
+    LDAPinit_berval();
 
     /* Check for errors */
     if (PyErr_Occurred())
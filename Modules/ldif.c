@@ -0,0 +1,863 @@
+/* See https://www.python-ldap.org/ for details. */
+
+#include "common.h"
+#include "ldif.h"
+#include "structmember.h"
+
+/*
+ * Native LDIF tokenizer behind ldif.LDIFParser(native=True) and
+ * writer behind ldif.LDIFWriter(native=True).
+ *
+ * The reader works on any object supporting the buffer protocol, usually
+ * a memory-mapped file. Line unfolding, comments and the value specs of
+ * RFC 2849 are handled here with the same results as the pure Python
+ * LDIFParser._next_key_and_value().
+ */
+
+typedef struct {
+    PyObject_HEAD Py_buffer view;       /* the whole LDIF input */
+    Py_ssize_t pos;             /* offset of the next line */
+    Py_ssize_t line_counter;
+    PyObject *url_handler;      /* called for :< values or NULL */
+    PyObject *ignored;          /* set of lower-cased types or NULL */
+    PyObject *dn_check;         /* called for the DN of records or NULL */
+    PyObject *version;          /* value of the version: line or None */
+    PyObject *error_type;       /* error held back by next_entries() */
+    PyObject *error_value;
+    PyObject *error_tb;
+    int started;                /* first record has been looked at */
+    char *scratch;              /* buffer for unfolded lines */
+    Py_ssize_t scratch_size;
+} LDAPLDIFReaderObject;
+
+static PyObject *a2b_base64;    /* binascii.a2b_base64 */
+static PyObject *lower_name;    /* interned "lower" */
+
+static const char ldif_whitespace[] = " \t\n\r\x0b\x0c\x1c\x1d\x1e\x1f";
+
+static void
+LDAPLDIFReader_dealloc(LDAPLDIFReaderObject *self)
+{
+    if (self->view.obj != NULL)
+        PyBuffer_Release(&self->view);
+    Py_XDECREF(self->url_handler);
+    Py_XDECREF(self->ignored);
+    Py_XDECREF(self->dn_check);
+    Py_XDECREF(self->version);
+    Py_XDECREF(self->error_type);
+    Py_XDECREF(self->error_value);
+    Py_XDECREF(self->error_tb);
+    PyMem_DEL(self->scratch);
+    PyObject_DEL(self);
+}
+
+/*
+ * Reads the next physical line without its line separator.
+ * Returns 0 at the end of the input.
+ */
+static int
+read_line(LDAPLDIFReaderObject *self, const char **line, Py_ssize_t *len)
+{
+    const char *buf = (const char *)self->view.buf;
+    const char *nl;
+    Py_ssize_t end;
+
+    if (self->pos >= self->view.len)
+        return 0;
+
+    *line = buf + self->pos;
+    nl = memchr(*line, '\n', self->view.len - self->pos);
+    if (nl == NULL) {
+        end = self->view.len;
+        self->pos = end;
+    }
+    else {
+        end = nl - buf;
+        self->pos = end + 1;
+        if (end > 0 && buf[end - 1] == '\r' && *line < buf + end)
+            end--;
+    }
+    *len = (buf + end) - *line;
+    self->line_counter++;
+    return 1;
+}
+
+/* Appends len bytes to the scratch buffer at offset used */
+static int
+scratch_append(LDAPLDIFReaderObject *self, Py_ssize_t used,
+               const char *data, Py_ssize_t len)
+{
+    if (used + len > self->scratch_size) {
+        Py_ssize_t size = self->scratch_size ? self->scratch_size : 1024;
+        char *scratch;
+
+        while (size < used + len)
+            size *= 2;
+        scratch = PyMem_Realloc(self->scratch, size);
+        if (scratch == NULL) {
+            PyErr_NoMemory();
+            return -1;
+        }
+        self->scratch = scratch;
+        self->scratch_size = size;
+    }
+    memcpy(self->scratch + used, data, len);
+    return 0;
+}
+
+/*
+ * Reads the next logical line, joining continuation lines starting with
+ * a space. Returns -1 on error, 0 at the end of the input and 1 otherwise.
+ */
+static int
+unfold_line(LDAPLDIFReaderObject *self, const char **line, Py_ssize_t *len)
+{
+    const char *buf = (const char *)self->view.buf;
+    const char *cont;
+    Py_ssize_t cont_len, used;
+
+    if (!read_line(self, line, len))
+        return 0;
+    if (self->pos >= self->view.len || buf[self->pos] != ' ')
+        return 1;
+
+    if (scratch_append(self, 0, *line, *len) == -1)
+        return -1;
+    used = *len;
+    while (self->pos < self->view.len && buf[self->pos] == ' ') {
+        read_line(self, &cont, &cont_len);
+        if (scratch_append(self, used, cont + 1, cont_len - 1) == -1)
+            return -1;
+        used += cont_len - 1;
+    }
+    *line = self->scratch;
+    *len = used;
+    return 1;
+}
+
+/*
+ * Parses the next attribute type and value pair. Both are set to NULL
+ * for an empty line and the value is None for "-" and ignored URLs.
+ * Returns -1 on error, 0 at the end of the input and 1 otherwise.
+ */
+static int
+next_key_and_value(LDAPLDIFReaderObject *self, PyObject **key,
+                   PyObject **value)
+{
+    const char *line, *colon, *rest;
+    Py_ssize_t len, rest_len;
+    PyObject *tmp;
+    int rc;
+
+    *key = *value = NULL;
+    /* comments can also be folded */
+    do {
+        rc = unfold_line(self, &line, &len);
+        if (rc <= 0)
+            return rc;
+    } while (len > 0 && line[0] == '#');
+
+    if (len == 0)
+        return 1;
+
+    if (len == 1 && line[0] == '-') {
+        *key = PyUnicode_FromStringAndSize("-", 1);
+        if (*key == NULL)
+            return -1;
+        Py_INCREF(Py_None);
+        *value = Py_None;
+        return 1;
+    }
+
+    colon = memchr(line, ':', len);
+    if (colon == NULL) {
+        tmp = PyUnicode_DecodeUTF8(line, len, "replace");
+        if (tmp != NULL) {
+            PyErr_Format(PyExc_ValueError, "no value-spec in %R", tmp);
+            Py_DECREF(tmp);
+        }
+        return -1;
+    }
+    *key = PyUnicode_DecodeUTF8(line, colon - line, "strict");
+    if (*key == NULL)
+        return -1;
+
+    rest = colon + 2;
+    rest_len = len - (rest - line);
+    if (rest_len >= 0 && colon[1] == ' ') {
+        while (rest_len > 0 && memchr(ldif_whitespace, *rest,
+                                      sizeof(ldif_whitespace) - 1)) {
+            rest++;
+            rest_len--;
+        }
+        *value = PyBytes_FromStringAndSize(rest, rest_len);
+    }
+    else if (rest_len >= 0 && colon[1] == ':') {
+        /* attribute value needs base64-decoding */
+        tmp = PyBytes_FromStringAndSize(rest, rest_len);
+        if (tmp != NULL) {
+            *value = PyObject_CallFunctionObjArgs(a2b_base64, tmp, NULL);
+            Py_DECREF(tmp);
+        }
+    }
+    else if (rest_len >= 0 && colon[1] == '<') {
+        /* fetch attribute value from URL */
+        if (self->url_handler == NULL) {
+            Py_INCREF(Py_None);
+            *value = Py_None;
+        }
+        else {
+            tmp = PyUnicode_DecodeUTF8(rest, rest_len, "strict");
+            if (tmp != NULL) {
+                PyObject *url = PyObject_CallMethod(tmp, "strip", NULL);
+
+                Py_DECREF(tmp);
+                if (url != NULL) {
+                    *value = PyObject_CallFunctionObjArgs(self->url_handler,
+                                                          url, NULL);
+                    Py_DECREF(url);
+                }
+            }
+        }
+    }
+    else {
+        *value = PyBytes_FromStringAndSize(colon + 1, len - (colon + 1 - line));
+    }
+    if (*value == NULL) {
+        Py_CLEAR(*key);
+        return -1;
+    }
+    return 1;
+}
+
+/* Skips empty lines, returns like next_key_and_value() */
+static int
+next_nonempty(LDAPLDIFReaderObject *self, PyObject **key, PyObject **value)
+{
+    int rc;
+
+    do {
+        rc = next_key_and_value(self, key, value);
+    } while (rc == 1 && *key == NULL);
+    return rc;
+}
+
+/* next_key_and_value() */
+
+static PyObject *
+LDAPLDIFReader_next_key_and_value(LDAPLDIFReaderObject *self,
+                                  PyObject *unused)
+{
+    PyObject *key, *value, *result;
+    int rc;
+
+    rc = next_key_and_value(self, &key, &value);
+    if (rc == -1)
+        return NULL;
+    if (rc == 0) {
+        PyErr_Format(PyExc_EOFError, "EOF reached after %zd lines (%zd bytes)",
+                     self->line_counter, self->pos);
+        return NULL;
+    }
+    if (key == NULL)
+        return Py_BuildValue("(OO)", Py_None, Py_None);
+    result = PyTuple_Pack(2, key, value);
+    Py_DECREF(key);
+    Py_DECREF(value);
+    return result;
+}
+
+/* Appends value to the list of key in entry unless key is ignored */
+static int
+entry_add(LDAPLDIFReaderObject *self, PyObject *entry, PyObject *key,
+          PyObject *value)
+{
+    PyObject *values;
+    int rc;
+
+    if (self->ignored != NULL) {
+        PyObject *low = PyObject_CallMethodObjArgs(key, lower_name, NULL);
+
+        if (low == NULL)
+            return -1;
+        rc = PySet_Contains(self->ignored, low);
+        Py_DECREF(low);
+        if (rc != 0)
+            return rc == -1 ? -1 : 0;
+    }
+
+    values = PyDict_GetItemWithError(entry, key);
+    if (values != NULL)
+        return PyList_Append(values, value);
+    if (PyErr_Occurred())
+        return -1;
+    values = PyList_New(1);
+    if (values == NULL)
+        return -1;
+    Py_INCREF(value);
+    PyList_SET_ITEM(values, 0, value);
+    rc = PyDict_SetItem(entry, key, values);
+    Py_DECREF(values);
+    return rc;
+}
+
+/* Reads one content record, returns like next_key_and_value() */
+static int
+next_entry(LDAPLDIFReaderObject *self, PyObject **record)
+{
+    PyObject *key, *value, *dn = NULL, *entry = NULL;
+    int rc;
+
+    *record = NULL;
+    rc = next_nonempty(self, &key, &value);
+    if (rc <= 0)
+        return rc;
+
+    if (!self->started) {
+        self->started = 1;
+        if (PyUnicode_CompareWithASCIIString(key, "version") == 0) {
+            Py_DECREF(self->version);
+            self->version = value;
+            Py_DECREF(key);
+            rc = next_nonempty(self, &key, &value);
+            if (rc <= 0)
+                return rc;
+        }
+    }
+
+    if (PyUnicode_CompareWithASCIIString(key, "dn") != 0) {
+        PyErr_Format(PyExc_ValueError,
+                     "Line %zd: First line of record does not start "
+                     "with \"dn:\": %R", self->line_counter, key);
+        goto failed;
+    }
+    if (!PyBytes_Check(value)) {
+        PyErr_Format(PyExc_ValueError,
+                     "Line %zd: Not a valid string-representation for dn: "
+                     "%R.", self->line_counter, value);
+        goto failed;
+    }
+    /* Value of a 'dn' field *has* to be valid UTF-8 */
+    dn = PyUnicode_DecodeUTF8(PyBytes_AS_STRING(value),
+                              PyBytes_GET_SIZE(value), "strict");
+    if (dn == NULL)
+        goto failed;
+    /* checked right away, so that errors point at the record's DN */
+    if (self->dn_check != NULL) {
+        PyObject *ok = PyObject_CallFunctionObjArgs(self->dn_check, dn, NULL);
+
+        rc = ok == NULL ? -1 : PyObject_IsTrue(ok);
+        Py_XDECREF(ok);
+        if (rc == -1)
+            goto failed;
+        if (rc == 0) {
+            /* counted like the pure Python parser, which has read the
+             * next line already */
+            PyErr_Format(PyExc_ValueError,
+                         "Line %zd: Not a valid string-representation for "
+                         "dn: %R.", self->line_counter + 1, dn);
+            goto failed;
+        }
+    }
+    Py_CLEAR(key);
+    Py_CLEAR(value);
+
+    entry = PyDict_New();
+    if (entry == NULL)
+        goto failed;
+    while ((rc = next_key_and_value(self, &key, &value)) == 1 && key != NULL) {
+        if (entry_add(self, entry, key, value) == -1)
+            goto failed;
+        Py_CLEAR(key);
+        Py_CLEAR(value);
+    }
+    if (rc == -1)
+        goto failed;
+
+    *record = PyTuple_Pack(2, dn, entry);
+    Py_DECREF(dn);
+    Py_DECREF(entry);
+    return *record == NULL ? -1 : 1;
+
+  failed:
+    Py_XDECREF(key);
+    Py_XDECREF(value);
+    Py_XDECREF(dn);
+    Py_XDECREF(entry);
+    return -1;
+}
+
+/* next_entries(max_records) */
+
+static PyObject *
+LDAPLDIFReader_next_entries(LDAPLDIFReaderObject *self, PyObject *args)
+{
+    PyObject *records, *record;
+    Py_ssize_t max_records, i;
+    int rc;
+
+    if (!PyArg_ParseTuple(args, "n:next_entries", &max_records))
+        return NULL;
+
+    /* the error after the records returned by the previous call */
+    if (self->error_type != NULL) {
+        PyErr_Restore(self->error_type, self->error_value, self->error_tb);
+        self->error_type = self->error_value = self->error_tb = NULL;
+        return NULL;
+    }
+
+    records = PyList_New(0);
+    if (records == NULL)
+        return NULL;
+    for (i = 0; i < max_records; i++) {
+        rc = next_entry(self, &record);
+        if (rc == -1) {
+            /* return the records before a bad one first, like the pure
+             * Python parser handles them before raising */
+            if (PyList_GET_SIZE(records) > 0 &&
+                !PyErr_ExceptionMatches(PyExc_MemoryError)) {
+                PyErr_Fetch(&self->error_type, &self->error_value,
+                            &self->error_tb);
+                return records;
+            }
+            Py_DECREF(records);
+            return NULL;
+        }
+        if (rc == 0)
+            break;
+        rc = PyList_Append(records, record);
+        Py_DECREF(record);
+        if (rc == -1) {
+            Py_DECREF(records);
+            return NULL;
+        }
+    }
+    return records;
+}
+
+static PyMethodDef LDAPLDIFReader_methods[] = {
+    {"next_key_and_value",
+     (PyCFunction)LDAPLDIFReader_next_key_and_value, METH_NOARGS},
+    {"next_entries", (PyCFunction)LDAPLDIFReader_next_entries, METH_VARARGS},
+    {NULL, NULL}
+};
+
+static PyMemberDef LDAPLDIFReader_members[] = {
+    {"line_counter", T_PYSSIZET, offsetof(LDAPLDIFReaderObject, line_counter),
+     READONLY},
+    {"byte_counter", T_PYSSIZET, offsetof(LDAPLDIFReaderObject, pos),
+     READONLY},
+    {"version", T_OBJECT, offsetof(LDAPLDIFReaderObject, version), READONLY},
+    {NULL}
+};
+
+PyTypeObject LDAPLDIFReader_Type = {
+    PyVarObject_HEAD_INIT(NULL, 0)
+        "LDIFReader",   /*tp_name */
+    sizeof(LDAPLDIFReaderObject),       /*tp_basicsize */
+    0,                  /*tp_itemsize */
+    /* methods */
+    (destructor) LDAPLDIFReader_dealloc,        /*tp_dealloc */
+    0,                  /*tp_print */
+    0,                  /*tp_getattr */
+    0,                  /*tp_setattr */
+    0,                  /*tp_compare */
+    0,                  /*tp_repr */
+    0,                  /*tp_as_number */
+    0,                  /*tp_as_sequence */
+    0,                  /*tp_as_mapping */
+    0,                  /*tp_hash */
+    0,                  /*tp_call */
+    0,                  /*tp_str */
+    0,                  /*tp_getattro */
+    0,                  /*tp_setattro */
+    0,                  /*tp_as_buffer */
+    Py_TPFLAGS_DEFAULT, /*tp_flags */
+    0,                  /*tp_doc */
+    0,                  /*tp_traverse */
+    0,                  /*tp_clear */
+    0,                  /*tp_richcompare */
+    0,                  /*tp_weaklistoffset */
+    0,                  /*tp_iter */
+    0,                  /*tp_iternext */
+    LDAPLDIFReader_methods,     /*tp_methods */
+    LDAPLDIFReader_members,     /*tp_members */
+};
+
+/*
+ * ldif_reader(data [, offset [, url_handler [, ignored_attr_types
+ *             [, dn_check]]]])
+ */
+
+static PyObject *
+l_ldif_reader(PyObject *unused, PyObject *args)
+{
+    PyObject *data, *url_handler = Py_None, *ignored = Py_None;
+    PyObject *dn_check = Py_None;
+    Py_ssize_t offset = 0;
+    LDAPLDIFReaderObject *reader;
+
+    if (!PyArg_ParseTuple(args, "O|nOOO:ldif_reader", &data, &offset,
+                          &url_handler, &ignored, &dn_check))
+        return NULL;
+    if (ignored != Py_None && !PyAnySet_Check(ignored)) {
+        LDAPerror_TypeError("ldif_reader(): expected set or None", ignored);
+        return NULL;
+    }
+
+    reader = PyObject_NEW(LDAPLDIFReaderObject, &LDAPLDIFReader_Type);
+    if (reader == NULL)
+        return NULL;
+    reader->view.obj = NULL;
+    reader->url_handler = NULL;
+    reader->ignored = NULL;
+    reader->dn_check = NULL;
+    Py_INCREF(Py_None);
+    reader->version = Py_None;
+    reader->error_type = reader->error_value = reader->error_tb = NULL;
+    reader->started = 0;
+    reader->line_counter = 0;
+    reader->scratch = NULL;
+    reader->scratch_size = 0;
+
+    if (PyObject_GetBuffer(data, &reader->view, PyBUF_SIMPLE) == -1) {
+        reader->view.obj = NULL;
+        Py_DECREF(reader);
+        return NULL;
+    }
+    if (offset < 0 || offset > reader->view.len) {
+        PyErr_SetString(PyExc_ValueError, "offset out of range");
+        Py_DECREF(reader);
+        return NULL;
+    }
+    reader->pos = offset;
+    if (url_handler != Py_None) {
+        Py_INCREF(url_handler);
+        reader->url_handler = url_handler;
+    }
+    if (ignored != Py_None && PySet_GET_SIZE(ignored) > 0) {
+        Py_INCREF(ignored);
+        reader->ignored = ignored;
+    }
+    if (dn_check != Py_None) {
+        Py_INCREF(dn_check);
+        reader->dn_check = dn_check;
+    }
+    return (PyObject *)reader;
+}
+
+/*
+ * Native LDIF writer behind ldif.LDIFWriter(native=True), producing the
+ * same output as LDIFWriter.unparse() for entry records.
+ */
+
+typedef struct {
+    char *data;
+    Py_ssize_t len;
+    Py_ssize_t size;
+} LDIFBuffer;
+
+static int
+ldifbuf_append(LDIFBuffer *b, const char *data, Py_ssize_t len)
+{
+    if (b->len + len > b->size) {
+        Py_ssize_t size = b->size ? b->size : 65536;
+        char *newdata;
+
+        while (size < b->len + len)
+            size *= 2;
+        newdata = PyMem_Realloc(b->data, size);
+        if (newdata == NULL) {
+            PyErr_NoMemory();
+            return -1;
+        }
+        b->data = newdata;
+        b->size = size;
+    }
+    memcpy(b->data + b->len, data, len);
+    b->len += len;
+    return 0;
+}
+
+static const char b64chars[] =
+    "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+static int
+ldifbuf_append_base64(LDIFBuffer *b, const unsigned char *data,
+                      Py_ssize_t len)
+{
+    char quad[4];
+    Py_ssize_t i;
+
+    for (i = 0; i + 2 < len; i += 3) {
+        quad[0] = b64chars[data[i] >> 2];
+        quad[1] = b64chars[((data[i] & 0x03) << 4) | (data[i + 1] >> 4)];
+        quad[2] = b64chars[((data[i + 1] & 0x0f) << 2) | (data[i + 2] >> 6)];
+        quad[3] = b64chars[data[i + 2] & 0x3f];
+        if (ldifbuf_append(b, quad, 4) == -1)
+            return -1;
+    }
+    if (i < len) {
+        quad[0] = b64chars[data[i] >> 2];
+        if (i + 1 < len) {
+            quad[1] = b64chars[((data[i] & 0x03) << 4) | (data[i + 1] >> 4)];
+            quad[2] = b64chars[(data[i + 1] & 0x0f) << 2];
+        }
+        else {
+            quad[1] = b64chars[(data[i] & 0x03) << 4];
+            quad[2] = '=';
+        }
+        quad[3] = '=';
+        if (ldifbuf_append(b, quad, 4) == -1)
+            return -1;
+    }
+    return 0;
+}
+
+/* Returns non-zero if value matches ldif.SAFE_STRING_PATTERN */
+static int
+unsafe_string(const unsigned char *value, Py_ssize_t len)
+{
+    Py_ssize_t i;
+
+    if (len == 0)
+        return 0;
+    if (value[0] == ' ' || value[0] == ':' || value[0] == '<' ||
+        value[len - 1] == ' ')
+        return 1;
+    for (i = 0; i < len; i++) {
+        if (value[i] == '\0' || value[i] == '\n' || value[i] == '\r' ||
+            value[i] >= 0x80)
+            return 1;
+    }
+    return 0;
+}
+
+typedef struct {
+    LDIFBuffer out;
+    LDIFBuffer line;            /* the current unfolded line */
+    PyObject *base64_attrs;     /* lower-cased types or NULL */
+    Py_ssize_t cols;
+    const char *sep;
+    Py_ssize_t sep_len;
+} LDIFWriterState;
+
+/* Writes the line buffer folded after cols characters */
+static int
+write_folded(LDIFWriterState *w)
+{
+    const char *line = w->line.data;
+    Py_ssize_t len = w->line.len, pos = 0, end, n, limit = w->cols;
+
+    do {
+        /* count characters, not UTF-8 continuation bytes */
+        for (end = pos, n = 0; end < len && n < limit; n++) {
+            end++;
+            while (end < len && (line[end] & 0xc0) == 0x80)
+                end++;
+        }
+        if (pos > 0 && ldifbuf_append(&w->out, " ", 1) == -1)
+            return -1;
+        if (ldifbuf_append(&w->out, line + pos, end - pos) == -1 ||
+            ldifbuf_append(&w->out, w->sep, w->sep_len) == -1)
+            return -1;
+        pos = end;
+        limit = w->cols - 1;
+    } while (pos < len);
+    return 0;
+}
+
+/* Writes "type: value" or "type:: base64" for bytes value */
+static int
+write_attr_value(LDIFWriterState *w, const char *type, Py_ssize_t type_len,
+                 int force_base64, PyObject *value)
+{
+    const unsigned char *data;
+    Py_ssize_t len;
+
+    if (!PyBytes_Check(value)) {
+        LDAPerror_TypeError("LDIFWriter: expected bytes value", value);
+        return -1;
+    }
+    data = (const unsigned char *)PyBytes_AS_STRING(value);
+    len = PyBytes_GET_SIZE(value);
+
+    w->line.len = 0;
+    if (ldifbuf_append(&w->line, type, type_len) == -1)
+        return -1;
+    if (force_base64 || unsafe_string(data, len)) {
+        if (ldifbuf_append(&w->line, ":: ", 3) == -1 ||
+            ldifbuf_append_base64(&w->line, data, len) == -1)
+            return -1;
+    }
+    else {
+        if (ldifbuf_append(&w->line, ": ", 2) == -1 ||
+            ldifbuf_append(&w->line, (const char *)data, len) == -1)
+            return -1;
+    }
+    return write_folded(w);
+}
+
+/* Returns 1 if attribute type name is in base64_attrs, -1 on error */
+static int
+is_base64_attr(LDIFWriterState *w, PyObject *name)
+{
+    PyObject *low;
+    int rc;
+
+    if (w->base64_attrs == NULL)
+        return 0;
+    low = PyObject_CallMethodObjArgs(name, lower_name, NULL);
+    if (low == NULL)
+        return -1;
+    rc = PySequence_Contains(w->base64_attrs, low);
+    Py_DECREF(low);
+    return rc;
+}
+
+static int
+write_entry(LDIFWriterState *w, PyObject *dn, PyObject *entry)
+{
+    PyObject *items, *name, *values, *dn_bytes, *value;
+    const char *type;
+    Py_ssize_t type_len, i, j, num_values;
+    int force_base64, rc = -1;
+
+    name = PyUnicode_FromString("dn");
+    if (name == NULL)
+        return -1;
+    force_base64 = is_base64_attr(w, name);
+    Py_DECREF(name);
+    if (force_base64 == -1)
+        return -1;
+    dn_bytes = PyUnicode_AsUTF8String(dn);
+    if (dn_bytes == NULL)
+        return -1;
+    rc = write_attr_value(w, "dn", 2, force_base64, dn_bytes);
+    Py_DECREF(dn_bytes);
+    if (rc == -1)
+        return -1;
+
+    items = PyDict_Items(entry);
+    if (items == NULL || PyList_Sort(items) == -1)
+        goto failed;
+    for (i = 0; i < PyList_GET_SIZE(items); i++) {
+        name = PyTuple_GET_ITEM(PyList_GET_ITEM(items, i), 0);
+        values = PySequence_Fast(PyTuple_GET_ITEM(PyList_GET_ITEM(items, i),
+                                                  1),
+                                 "LDIFWriter: expected list of values");
+        if (values == NULL)
+            goto failed;
+        type = PyUnicode_AsUTF8AndSize(name, &type_len);
+        force_base64 = type ? is_base64_attr(w, name) : -1;
+        if (force_base64 == -1) {
+            Py_DECREF(values);
+            goto failed;
+        }
+        num_values = PySequence_Fast_GET_SIZE(values);
+        for (j = 0; j < num_values; j++) {
+            value = PySequence_Fast_GET_ITEM(values, j);
+            if (write_attr_value(w, type, type_len, force_base64,
+                                 value) == -1) {
+                Py_DECREF(values);
+                goto failed;
+            }
+        }
+        Py_DECREF(values);
+    }
+    /* empty line separating the records */
+    rc = ldifbuf_append(&w->out, w->sep, w->sep_len);
+    Py_DECREF(items);
+    return rc;
+
+  failed:
+    Py_XDECREF(items);
+    return -1;
+}
+
+/* ldif_unparse(records, base64_attrs, cols, line_sep) */
+
+static PyObject *
+l_ldif_unparse(PyObject *unused, PyObject *args)
+{
+    PyObject *records, *seq, *base64_attrs, *item, *text, *result = NULL;
+    LDIFWriterState w;
+    Py_ssize_t i, count = 0;
+
+    memset(&w, 0, sizeof(w));
+    if (!PyArg_ParseTuple(args, "OOns#:ldif_unparse", &records,
+                          &base64_attrs, &w.cols, &w.sep, &w.sep_len))
+        return NULL;
+    if (w.cols < 2) {
+        PyErr_SetString(PyExc_ValueError, "cols must be at least 2");
+        return NULL;
+    }
+    if (base64_attrs != Py_None && PyObject_Size(base64_attrs) > 0)
+        w.base64_attrs = base64_attrs;
+    else if (PyErr_Occurred())
+        return NULL;
+
+    seq = PySequence_Fast(records, "ldif_unparse(): expected list");
+    if (seq == NULL)
+        return NULL;
+    for (i = 0; i < PySequence_Fast_GET_SIZE(seq); i++) {
+        PyObject *dn, *entry;
+
+        item = PySequence_Fast_GET_ITEM(seq, i);
+        if (!PyTuple_Check(item) || PyTuple_GET_SIZE(item) < 2) {
+            LDAPerror_TypeError("ldif_unparse(): expected (dn, entry)", item);
+            goto failed;
+        }
+        dn = PyTuple_GET_ITEM(item, 0);
+        entry = PyTuple_GET_ITEM(item, 1);
+        /* search continuations are skipped */
+        if (!PyDict_Check(entry))
+            continue;
+        if (!PyUnicode_Check(dn)) {
+            LDAPerror_TypeError("ldif_unparse(): expected str DN", dn);
+            goto failed;
+        }
+        if (write_entry(&w, dn, entry) == -1)
+            goto failed;
+        count++;
+    }
+
+    text = PyUnicode_DecodeUTF8(w.out.data, w.out.len, "strict");
+    if (text != NULL) {
+        result = Py_BuildValue("(Nn)", text, count);
+    }
+
+  failed:
+    PyMem_DEL(w.out.data);
+    PyMem_DEL(w.line.data);
+    Py_DECREF(seq);
+    return result;
+}
+
+/* methods */
+
+static PyMethodDef methods[] = {
+    {"ldif_reader", (PyCFunction)l_ldif_reader, METH_VARARGS},
+    {"ldif_unparse", (PyCFunction)l_ldif_unparse, METH_VARARGS},
+    {NULL, NULL}
+};
+
+/* initialisation */
+
+void
+LDAPinit_ldif(PyObject *d)
+{
+    PyObject *binascii;
+
+    lower_name = PyUnicode_InternFromString("lower");
+    if (lower_name == NULL)
+        return;
+    binascii = PyImport_ImportModule("binascii");
+    if (binascii == NULL)
+        return;
+    a2b_base64 = PyObject_GetAttrString(binascii, "a2b_base64");
+    Py_DECREF(binascii);
+    if (a2b_base64 == NULL)
+        return;
+    LDAPadd_methods(d, methods);
+}
@@ -0,0 +1,12 @@
+/* See https://www.python-ldap.org/ for details. */
+
+#ifndef __h_ldif_
+#define __h_ldif_
+
+#include "common.h"
+
+extern PyTypeObject LDAPLDIFReader_Type;
+
+extern void LDAPinit_ldif(PyObject *);
+
+#endif /* __h_ldif_ */
@@ -2,240 +2,811 @@
 
 #include "common.h"
 #include "message.h"
+#include "cidict.h"
 #include "berval.h"
 #include "ldapcontrol.h"
 #include "constants.h"
 
 /*
- * Converts an LDAP message into a Python structure.
- *
- * On success, returns a list of dictionaries.
- * On failure, returns NULL, and sets an error.
- *
- * The message m is always freed, regardless of return value.
+ * Per-connection cache of attribute names.
  *
- * If add_ctrls is non-zero, per-entry/referral/partial/intermediate
- * controls will be added as a third item to each entry tuple
- *
- * If add_intermediates is non-zero, intermediate/partial results will
- * be returned
+ * Search results usually contain the same few attribute types over and
+ * over again. Looking up the C string in a small open addressing table
+ * hands out one interned str object per name and connection, instead of
+ * allocating and hashing a fresh string for each attribute of each entry.
+ * To bound memory, names seen after the table has filled up are no longer
+ * cached. The table is shared by the threads using the connection, which
+ * only touch it in a critical section, and Python objects are created
+ * outside of it.
+ */
+
+static Py_uhash_t
+attrcache_hash(const char *s, size_t len)
+{
+    /* FNV-1a */
+    Py_uhash_t hash = 2166136261U;
+    size_t i;
+
+    for (i = 0; i < len; i++) {
+        hash ^= (unsigned char)s[i];
+        hash *= 16777619U;
+    }
+    return hash;
+}
+
+/*
+ * Returns a new reference to the cached name for the len bytes at attr,
+ * or NULL with *slot set to the free slot for it. Called in a critical
+ * section.
+ */
+static PyObject *
+attrcache_find(LDAPObject *l, Py_uhash_t hash, const char *attr,
+               size_t len, LDAPAttrCacheSlot **slot)
+{
+    size_t i;
+
+    /* never full, LDAP_ATTRCACHE_MAX < LDAP_ATTRCACHE_SIZE */
+    for (i = hash & (LDAP_ATTRCACHE_SIZE - 1);;
+         i = (i + 1) & (LDAP_ATTRCACHE_SIZE - 1)) {
+        *slot = &l->attrcache[i];
+        if ((*slot)->name == NULL)
+            return NULL;
+        if ((*slot)->hash == hash && strncmp((*slot)->key, attr, len) == 0 &&
+            (*slot)->key[len] == '\0') {
+            Py_INCREF((*slot)->name);
+            return (*slot)->name;
+        }
+    }
+}
+
+/*
+ * Returns a new reference to a str object for the len bytes at attr, or
+ * NULL with an exception set on failure. attr need not be NUL-terminated.
  */
 PyObject *
-LDAPmessage_to_python(LDAP *ld, LDAPMessage *m, int add_ctrls,
-                      int add_intermediates)
+LDAPattrcache_get(LDAPObject *l, const char *attr, size_t len)
 {
-    /* we convert an LDAP message into a python structure.
-     * It is always a list of dictionaries.
-     * We always free m.
-     */
+    Py_uhash_t hash = attrcache_hash(attr, len);
+    LDAPAttrCacheSlot *slot = NULL;
+    PyObject *name = NULL, *cached;
+    char *key;
+    int cache = 0;
 
-    PyObject *result, *pyctrls = 0;
-    LDAPMessage *entry;
-    LDAPControl **serverctrls = 0;
-    int rc;
+    Py_BEGIN_CRITICAL_SECTION(l);
+    if (l->attrcache == NULL) {
+        l->attrcache = PyMem_Calloc(LDAP_ATTRCACHE_SIZE,
+                                    sizeof(LDAPAttrCacheSlot));
+    }
+    if (l->attrcache != NULL) {
+        name = attrcache_find(l, hash, attr, len, &slot);
+        cache = (l->attrcache_used < LDAP_ATTRCACHE_MAX);
+    }
+    Py_END_CRITICAL_SECTION();
+    if (name != NULL)
+        return name;
 
-    result = PyList_New(0);
-    if (result == NULL) {
-        ldap_msgfree(m);
+    name = PyUnicode_FromStringAndSize(attr, len);
+    if (name == NULL || !cache)
+        return name;
+
+    /* intern and precompute the hash used by dict lookups */
+    PyUnicode_InternInPlace(&name);
+    if (PyObject_Hash(name) == -1) {
+        Py_DECREF(name);
         return NULL;
     }
 
-    for (entry = ldap_first_entry(ld, m);
-         entry != NULL; entry = ldap_next_entry(ld, entry)) {
-        char *dn;
-        char *attr;
-        BerElement *ber = NULL;
-        PyObject *entrytuple;
-        PyObject *attrdict;
-        PyObject *pydn;
-
-        dn = ldap_get_dn(ld, entry);
-        if (dn == NULL) {
-            Py_DECREF(result);
-            ldap_msgfree(m);
-            return LDAPerror(ld);
-        }
+    key = PyMem_Malloc(len + 1);
+    if (key == NULL)
+        return name;
+    memcpy(key, attr, len);
+    key[len] = '\0';
 
-        attrdict = PyDict_New();
-        if (attrdict == NULL) {
-            Py_DECREF(result);
-            ldap_msgfree(m);
-            ldap_memfree(dn);
-            return NULL;
-        }
+    /* another thread may have added it meanwhile */
+    Py_BEGIN_CRITICAL_SECTION(l);
+    cached = attrcache_find(l, hash, attr, len, &slot);
+    if (cached == NULL && l->attrcache_used < LDAP_ATTRCACHE_MAX) {
+        slot->key = key;
+        slot->hash = hash;
+        Py_INCREF(name);
+        slot->name = name;
+        l->attrcache_used++;
+        key = NULL;
+    }
+    Py_END_CRITICAL_SECTION();
 
-        rc = ldap_get_entry_controls(ld, entry, &serverctrls);
-        if (rc) {
-            Py_DECREF(result);
-            ldap_msgfree(m);
-            ldap_memfree(dn);
-            return LDAPerror(ld);
+    PyMem_Free(key);
+    if (cached != NULL) {
+        Py_DECREF(name);
+        return cached;
+    }
+    return name;
+}
+
+/* Drops all cached attribute names of a connection */
+void
+LDAPattrcache_clear(LDAPObject *l)
+{
+    Py_ssize_t i;
+
+    if (l->attrcache == NULL)
+        return;
+
+    for (i = 0; i < LDAP_ATTRCACHE_SIZE; i++) {
+        if (l->attrcache[i].name != NULL) {
+            PyMem_Free(l->attrcache[i].key);
+            Py_DECREF(l->attrcache[i].name);
         }
+    }
+    PyMem_Free(l->attrcache);
+    l->attrcache = NULL;
+    l->attrcache_used = 0;
+}
 
-        /* convert serverctrls to list of tuples */
-        if (!(pyctrls = LDAPControls_to_List(serverctrls))) {
-            int err = LDAP_NO_MEMORY;
+/*
+ * Two-phase conversion of search entries.
+ *
+ * Phase one walks the BER encoding of the entries in place with
+ * ldap_get_dn_ber() and ldap_get_attribute_ber() and records DNs,
+ * attribute names and values as bervals pointing into the message buffer.
+ * It neither calls into the Python API nor uses the Python object
+ * allocator, so callers run it without holding the GIL, right after
+ * ldap_result(). Phase two then creates all Python objects of an entry
+ * in one tight loop with the GIL held.
+ */
 
-            ldap_set_option(ld, LDAP_OPT_ERROR_NUMBER, &err);
-            Py_DECREF(result);
-            ldap_msgfree(m);
-            ldap_memfree(dn);
-            ldap_controls_free(serverctrls);
-            return LDAPerror(ld);
+void
+LDAPdecode_init(LDAPDecodeArena *a)
+{
+    memset(a, 0, sizeof(*a));
+}
+
+/* Forgets all decoded entries but keeps the memory for reuse */
+void
+LDAPdecode_reset(LDAPDecodeArena *a)
+{
+    size_t i;
+
+    for (i = 0; i < a->nentries; i++) {
+        if (a->entries[i].ctrls != NULL)
+            ldap_controls_free(a->entries[i].ctrls);
+    }
+    a->nentries = 0;
+    a->nattrs = 0;
+    a->nvalues = 0;
+    a->err = LDAP_SUCCESS;
+}
+
+void
+LDAPdecode_clear(LDAPDecodeArena *a)
+{
+    LDAPdecode_reset(a);
+    PyMem_RawFree(a->entries);
+    PyMem_RawFree(a->attrs);
+    PyMem_RawFree(a->values);
+    LDAPdecode_init(a);
+}
+
+/* Makes room for one more item in *array, returns 0 if out of memory */
+static int
+arena_reserve(void **array, size_t *size, size_t used, size_t itemsize)
+{
+    size_t newsize;
+    void *tmp;
+
+    if (used < *size)
+        return 1;
+    newsize = *size ? *size * 2 : 16;
+    tmp = PyMem_RawRealloc(*array, newsize * itemsize);
+    if (tmp == NULL)
+        return 0;
+    *array = tmp;
+    *size = newsize;
+    return 1;
+}
+
+/*
+ * Phase one for a single search entry, appended to the arena.
+ *
+ * Returns LDAP_SUCCESS or an LDAP error code. Does not need the GIL.
+ */
+static int
+LDAPentry_decode(LDAP *ld, LDAPMessage *entry, LDAPDecodeArena *a)
+{
+    BerElement *ber = NULL;
+    LDAPDecodedEntry *e;
+    struct berval attr;
+    struct berval *bvals = NULL;
+    size_t i;
+    int rc;
+
+    if (!arena_reserve((void **)&a->entries, &a->entries_size, a->nentries,
+                       sizeof(LDAPDecodedEntry)))
+        return LDAP_NO_MEMORY;
+    e = &a->entries[a->nentries];
+    e->ctrls = NULL;
+    e->attrs = a->nattrs;
+    e->nattrs = 0;
+
+    rc = ldap_get_dn_ber(ld, entry, &ber, &e->dn);
+    if (rc != LDAP_SUCCESS)
+        return rc;
+    /* from here on the arena owns e->ctrls */
+    a->nentries++;
+
+    rc = ldap_get_entry_controls(ld, entry, &e->ctrls);
+    if (rc != LDAP_SUCCESS) {
+        ber_free(ber, 0);
+        return rc;
+    }
+
+    for (rc = ldap_get_attribute_ber(ld, entry, ber, &attr, &bvals);
+         rc == LDAP_SUCCESS && attr.bv_val != NULL;
+         rc = ldap_get_attribute_ber(ld, entry, ber, &attr, &bvals)
+        ) {
+        LDAPDecodedAttr *at;
+
+        if (!arena_reserve((void **)&a->attrs, &a->attrs_size, a->nattrs,
+                           sizeof(LDAPDecodedAttr))) {
+            rc = LDAP_NO_MEMORY;
+            break;
         }
-        ldap_controls_free(serverctrls);
+        at = &a->attrs[a->nattrs++];
+        at->name = attr;
+        at->values = a->nvalues;
+        at->nvalues = 0;
+        e->nattrs++;
 
-        /* Fill attrdict with lists */
-        for (attr = ldap_first_attribute(ld, entry, &ber);
-             attr != NULL; attr = ldap_next_attribute(ld, entry, ber)
-            ) {
-            PyObject *valuelist;
-            PyObject *pyattr;
-            struct berval **bvals;
-
-            pyattr = PyUnicode_FromString(attr);
-
-            bvals = ldap_get_values_len(ld, entry, attr);
-
-            /* Find which list to append to */
-            if (PyDict_Contains(attrdict, pyattr)) {
-                /* Multiple attribute entries with same name. This code path
-                 * is rarely used and cannot be exhausted with OpenLDAP
-                 * tests. 389-DS sometimes triggeres it, see
-                 * https://github.com/python-ldap/python-ldap/issues/218
-                 */
-                valuelist = PyDict_GetItem(attrdict, pyattr);
-                /* Turn borrowed reference into owned reference */
-                if (valuelist != NULL)
-                    Py_INCREF(valuelist);
-            }
-            else {
-                valuelist = PyList_New(0);
-                if (valuelist != NULL && PyDict_SetItem(attrdict,
-                                                        pyattr,
-                                                        valuelist) == -1) {
-                    Py_DECREF(valuelist);
-                    valuelist = NULL;   /* catch error later */
+        if (bvals != NULL) {
+            for (i = 0; bvals[i].bv_val != NULL; i++) {
+                if (!arena_reserve((void **)&a->values, &a->values_size,
+                                   a->nvalues, sizeof(struct berval))) {
+                    rc = LDAP_NO_MEMORY;
+                    break;
                 }
+                a->values[a->nvalues++] = bvals[i];
+                at->nvalues++;
             }
+            /* only the array is allocated, values point into the message */
+            ber_memfree(bvals);
+            bvals = NULL;
+            if (rc != LDAP_SUCCESS)
+                break;
+        }
+    }
+    ber_free(ber, 0);
+    return rc;
+}
 
-            if (valuelist == NULL) {
+/*
+ * Phase one for all search entries of the message chain m.
+ *
+ * Returns LDAP_SUCCESS or an LDAP error code, which is also kept in the
+ * arena for phase two. Does not need the GIL.
+ */
+int
+LDAPmessage_decode(LDAP *ld, LDAPMessage *m, LDAPDecodeArena *a)
+{
+    LDAPMessage *entry;
+
+    for (entry = ldap_first_entry(ld, m);
+         entry != NULL && a->err == LDAP_SUCCESS;
+         entry = ldap_next_entry(ld, entry)) {
+        a->err = LDAPentry_decode(ld, entry, a);
+    }
+    return a->err;
+}
+
+/* Raises the error of a failed phase one */
+static PyObject *
+LDAPdecode_error(LDAP *ld, int err)
+{
+    return LDAPerror_code(err);
+}
+
+/*
+ * Returns a new reference to the lower-cased form of the attribute name
+ * pyattr received as name. Like the names themselves, the lower-cased
+ * ASCII names are taken from the attribute name cache of l.
+ */
+static PyObject *
+LDAPattr_fold(LDAPObject *l, const struct berval *name, PyObject *pyattr)
+{
+    char buf[64], *lower;
+    PyObject *folded;
+    ber_len_t i;
+    int upper = 0;
+
+    for (i = 0; i < name->bv_len; i++) {
+        unsigned char c = name->bv_val[i];
+
+        if (c >= 0x80)
+            return LDAPcidict_fold(pyattr);
+        if (c >= 'A' && c <= 'Z')
+            upper = 1;
+    }
+    if (!upper) {
+        Py_INCREF(pyattr);
+        return pyattr;
+    }
+
+    lower = buf;
+    if (name->bv_len > sizeof(buf)) {
+        lower = PyMem_Malloc(name->bv_len);
+        if (lower == NULL)
+            return PyErr_NoMemory();
+    }
+    for (i = 0; i < name->bv_len; i++) {
+        char c = name->bv_val[i];
+
+        lower[i] = (c >= 'A' && c <= 'Z') ? c - 'A' + 'a' : c;
+    }
+    folded = LDAPattrcache_get(l, lower, name->bv_len);
+    if (lower != buf)
+        PyMem_Free(lower);
+    return folded;
+}
+
+/*
+ * Returns the LDAP_DECODE_* mode set with set_value_decoders() for
+ * the lower-cased attribute name folded in decoders, falling back to the name
+ * without options like ";binary" or ";lang-de". Returns -1 with an
+ * exception set on failure.
+ */
+static int
+LDAPattr_decode_mode(PyObject *decoders, PyObject *folded)
+{
+    PyObject *mode, *base;
+    Py_ssize_t semicolon;
+
+    mode = PyDict_GetItemWithError(decoders, folded);
+    if (mode == NULL && !PyErr_Occurred()) {
+        semicolon = PyUnicode_FindChar(folded, ';', 0,
+                                       PyUnicode_GET_LENGTH(folded), 1);
+        if (semicolon == -2)
+            return -1;
+        if (semicolon < 0)
+            return LDAP_DECODE_BYTES;
+        base = PyUnicode_Substring(folded, 0, semicolon);
+        if (base == NULL)
+            return -1;
+        mode = PyDict_GetItemWithError(decoders, base);
+        Py_DECREF(base);
+    }
+    if (mode == NULL)
+        return PyErr_Occurred() ? -1 : LDAP_DECODE_BYTES;
+    return (int)PyLong_AsLong(mode);
+}
+
+/*
+ * Phase two: converts a decoded search entry into a Python tuple
+ * (dn, attrs) or (dn, attrs, ctrls) if add_ctrls is non-zero.
+ *
+ * If owner is NULL, each value is copied into a bytes object. Otherwise
+ * values are returned as read-only LDAPBervalView objects pointing into
+ * the message buffer and holding a reference to owner, which must keep
+ * the message alive.
+ *
+ * If cidict is non-zero, attrs is a CIDict and the values of attribute
+ * names only differing in case are merged under the first name seen.
+ *
+ * Values of attributes with a decode mode set with set_value_decoders()
+ * are converted with LDAPberval_decode() instead, also if owner is set.
+ *
+ * Returns a new reference on success, or NULL with an exception set.
+ */
+static PyObject *
+LDAPdecoded_entry_to_python(LDAPObject *l, const LDAPDecodeArena *a,
+                            const LDAPDecodedEntry *e, int add_ctrls,
+                            PyObject *owner, int cidict)
+{
+    PyObject *entrytuple = NULL;
+    PyObject *attrdict = NULL;
+    PyObject *pydn = NULL;
+    PyObject *pyctrls = NULL;
+    PyObject *decoders;
+    size_t i, j;
+
+    /* convert serverctrls to list of tuples */
+    if (!(pyctrls = LDAPControls_to_List(e->ctrls))) {
+        return LDAPdecode_error(l->ldap, LDAP_NO_MEMORY);
+    }
+
+    /* may be replaced by another thread meanwhile */
+    Py_BEGIN_CRITICAL_SECTION(l);
+    decoders = l->value_decoders;
+    Py_XINCREF(decoders);
+    Py_END_CRITICAL_SECTION();
+
+    attrdict = cidict ? LDAPcidict_new() : PyDict_New();
+    if (attrdict == NULL)
+        goto failed;
+
+    /* Fill attrdict with lists */
+    for (i = 0; i < e->nattrs; i++) {
+        const LDAPDecodedAttr *at = &a->attrs[e->attrs + i];
+        PyObject *valuelist;
+        PyObject *pyattr;
+        PyObject *folded = NULL;
+        PyObject *stored;
+        int append = 0;
+        int mode = LDAP_DECODE_BYTES;
+
+        pyattr = LDAPattrcache_get(l, at->name.bv_val, at->name.bv_len);
+        if (pyattr == NULL)
+            goto failed;
+
+        if (cidict || decoders != NULL) {
+            folded = LDAPattr_fold(l, &at->name, pyattr);
+            if (folded == NULL) {
                 Py_DECREF(pyattr);
-                Py_DECREF(attrdict);
-                Py_DECREF(result);
-                if (ber != NULL)
-                    ber_free(ber, 0);
-                ldap_msgfree(m);
-                ldap_memfree(attr);
-                ldap_memfree(dn);
-                Py_XDECREF(pyctrls);
-                return NULL;
+                goto failed;
             }
-
-            if (bvals != NULL) {
-                Py_ssize_t i;
-
-                for (i = 0; bvals[i]; i++) {
-                    PyObject *valuestr;
-
-                    valuestr = LDAPberval_to_object(bvals[i]);
-                    if (PyList_Append(valuelist, valuestr) == -1) {
-                        Py_DECREF(pyattr);
-                        Py_DECREF(attrdict);
-                        Py_DECREF(result);
-                        Py_DECREF(valuestr);
-                        Py_DECREF(valuelist);
-                        if (ber != NULL)
-                            ber_free(ber, 0);
-                        ldap_msgfree(m);
-                        ldap_memfree(attr);
-                        ldap_memfree(dn);
-                        Py_XDECREF(pyctrls);
-                        return NULL;
-                    }
-                    Py_DECREF(valuestr);
-                }
-                ldap_value_free_len(bvals);
+        }
+        if (decoders != NULL) {
+            mode = LDAPattr_decode_mode(decoders, folded);
+            if (mode == -1) {
+                Py_DECREF(folded);
+                Py_DECREF(pyattr);
+                goto failed;
             }
-            Py_DECREF(pyattr);
-            Py_DECREF(valuelist);
-            ldap_memfree(attr);
         }
 
-        pydn = PyUnicode_FromString(dn);
-        if (pydn == NULL) {
-            Py_DECREF(result);
-            ldap_msgfree(m);
-            ldap_memfree(dn);
-            return NULL;
+        /* Find which list to append to */
+        stored = pyattr;
+        if (cidict)
+            stored = LDAPcidict_lookup_folded(attrdict, folded);
+        valuelist = NULL;
+        if (stored != NULL)
+            valuelist = PyDict_GetItemWithError(attrdict, stored);
+        if (valuelist != NULL) {
+            /* Multiple attribute entries with same name. This code path
+             * is rarely used and cannot be exhausted with OpenLDAP
+             * tests. 389-DS sometimes triggeres it, see
+             * https://github.com/python-ldap/python-ldap/issues/218
+             */
+            /* Turn borrowed reference into owned reference */
+            Py_INCREF(valuelist);
+            append = 1;
         }
-
-        if (add_ctrls) {
-            entrytuple = Py_BuildValue("(OOO)", pydn, attrdict, pyctrls);
+        else if (!PyErr_Occurred()) {
+            /* the common case, values are filled into a list of the
+             * right size, which is inserted below */
+            valuelist = PyList_New(at->nvalues);
         }
-        else {
-            entrytuple = Py_BuildValue("(OO)", pydn, attrdict);
+        if (valuelist == NULL) {
+            Py_XDECREF(folded);
+            Py_DECREF(pyattr);
+            goto failed;
         }
-        Py_DECREF(pydn);
-        ldap_memfree(dn);
-        Py_DECREF(attrdict);
-        Py_XDECREF(pyctrls);
-        PyList_Append(result, entrytuple);
-        Py_DECREF(entrytuple);
-        if (ber != NULL)
-            ber_free(ber, 0);
-    }
-    for (entry = ldap_first_reference(ld, m);
-         entry != NULL; entry = ldap_next_reference(ld, entry)) {
-        char **refs = NULL;
-        PyObject *entrytuple;
-        PyObject *reflist = PyList_New(0);
 
-        if (reflist == NULL) {
-            Py_DECREF(result);
-            ldap_msgfree(m);
-            return NULL;
+        for (j = 0; j < at->nvalues; j++) {
+            const struct berval *bv = &a->values[at->values + j];
+            PyObject *valuestr;
+
+            if (mode != LDAP_DECODE_BYTES)
+                valuestr = LDAPberval_decode(bv, mode);
+            else if (owner != NULL)
+                valuestr = LDAPberval_to_view(bv, owner);
+            else
+                valuestr = LDAPberval_to_object(bv);
+            if (valuestr == NULL)
+                break;
+            if (!append) {
+                PyList_SET_ITEM(valuelist, j, valuestr);
+            }
+            else {
+                int rc = PyList_Append(valuelist, valuestr);
+
+                Py_DECREF(valuestr);
+                if (rc == -1)
+                    break;
+            }
         }
-        if (ldap_parse_reference(ld, entry, &refs, &serverctrls, 0) !=
-            LDAP_SUCCESS) {
-            Py_DECREF(reflist);
-            Py_DECREF(result);
-            ldap_msgfree(m);
-            return LDAPerror(ld);
+        if (j < at->nvalues ||
+            (!append && cidict &&
+             LDAPcidict_insert(attrdict, pyattr, folded, valuelist) == -1) ||
+            (!append && !cidict &&
+             PyDict_SetItem(attrdict, pyattr, valuelist) == -1)) {
+            Py_DECREF(valuelist);
+            Py_XDECREF(folded);
+            Py_DECREF(pyattr);
+            goto failed;
         }
-        /* convert serverctrls to list of tuples */
-        if (!(pyctrls = LDAPControls_to_List(serverctrls))) {
-            int err = LDAP_NO_MEMORY;
+        Py_DECREF(valuelist);
+        Py_XDECREF(folded);
+        Py_DECREF(pyattr);
+    }
 
-            ldap_set_option(ld, LDAP_OPT_ERROR_NUMBER, &err);
-            Py_DECREF(reflist);
-            Py_DECREF(result);
-            ldap_msgfree(m);
-            ldap_controls_free(serverctrls);
-            return LDAPerror(ld);
-        }
+    pydn = LDAPberval_to_unicode_object(&e->dn);
+    if (pydn == NULL)
+        goto failed;
+
+    if (add_ctrls) {
+        entrytuple = Py_BuildValue("(OOO)", pydn, attrdict, pyctrls);
+    }
+    else {
+        entrytuple = Py_BuildValue("(OO)", pydn, attrdict);
+    }
+
+  failed:
+    Py_XDECREF(pydn);
+    Py_XDECREF(attrdict);
+    Py_XDECREF(pyctrls);
+    Py_XDECREF(decoders);
+    return entrytuple;
+}
+
+/*
+ * Converts a single search entry with both phases, reusing the arena a.
+ *
+ * Returns a new reference on success, or NULL with an exception set.
+ * The message itself is not freed.
+ */
+static PyObject *
+LDAPentry_to_python(LDAPObject *l, LDAPMessage *entry, int add_ctrls,
+                    PyObject *owner, int cidict, LDAPDecodeArena *a)
+{
+    int rc;
+
+    LDAPdecode_reset(a);
+    rc = LDAPentry_decode(l->ldap, entry, a);
+    if (rc != LDAP_SUCCESS)
+        return LDAPdecode_error(l->ldap, rc);
+    return LDAPdecoded_entry_to_python(l, a, &a->entries[0], add_ctrls,
+                                       owner, cidict);
+}
+
+/*
+ * Converts a single search continuation reference into a Python tuple
+ * (None, [url, ...]) or (None, [url, ...], ctrls) if add_ctrls is non-zero.
+ *
+ * Returns a new reference on success, or NULL with an exception set.
+ * The message itself is not freed.
+ */
+static PyObject *
+LDAPreference_to_python(LDAP *ld, LDAPMessage *entry, int add_ctrls)
+{
+    char **refs = NULL;
+    LDAPControl **serverctrls = 0;
+    PyObject *entrytuple = NULL;
+    PyObject *pyctrls;
+    PyObject *reflist = PyList_New(0);
+    int rc;
+
+    if (reflist == NULL) {
+        return NULL;
+    }
+    rc = ldap_parse_reference(ld, entry, &refs, &serverctrls, 0);
+    if (rc != LDAP_SUCCESS) {
+        Py_DECREF(reflist);
+        return LDAPerror_code(rc);
+    }
+    /* convert serverctrls to list of tuples */
+    if (!(pyctrls = LDAPControls_to_List(serverctrls))) {
+        Py_DECREF(reflist);
         ldap_controls_free(serverctrls);
-        if (refs) {
-            Py_ssize_t i;
+        ber_memvfree((void **)refs);
+        return PyErr_NoMemory();
+    }
+    ldap_controls_free(serverctrls);
+    if (refs) {
+        Py_ssize_t i;
 
-            for (i = 0; refs[i] != NULL; i++) {
-                /* A referal is a distinguishedName => unicode */
-                PyObject *refstr = PyUnicode_FromString(refs[i]);
+        for (i = 0; refs[i] != NULL; i++) {
+            /* A referal is a distinguishedName => unicode */
+            PyObject *refstr = PyUnicode_FromString(refs[i]);
 
-                PyList_Append(reflist, refstr);
-                Py_DECREF(refstr);
+            if (refstr == NULL || PyList_Append(reflist, refstr) == -1) {
+                Py_XDECREF(refstr);
+                ber_memvfree((void **)refs);
+                goto failed;
             }
-            ber_memvfree((void **)refs);
-        }
-        if (add_ctrls) {
-            entrytuple = Py_BuildValue("(sOO)", NULL, reflist, pyctrls);
+            Py_DECREF(refstr);
         }
-        else {
-            entrytuple = Py_BuildValue("(sO)", NULL, reflist);
+        ber_memvfree((void **)refs);
+    }
+    if (add_ctrls) {
+        entrytuple = Py_BuildValue("(sOO)", NULL, reflist, pyctrls);
+    }
+    else {
+        entrytuple = Py_BuildValue("(sO)", NULL, reflist);
+    }
+
+  failed:
+    Py_DECREF(reflist);
+    Py_DECREF(pyctrls);
+    return entrytuple;
+}
+
+/*
+ * Converts a single intermediate response into a Python tuple
+ * (oid, value, ctrls).
+ *
+ * Returns a new reference on success, or NULL with an exception set.
+ * The message itself is not freed.
+ */
+static PyObject *
+LDAPintermediate_to_python(LDAP *ld, LDAPMessage *entry)
+{
+    PyObject *valuestr;
+    PyObject *pyctrls;
+    PyObject *pyoid;
+    char *retoid = 0;
+    struct berval *retdata = 0;
+    LDAPControl **serverctrls = 0;
+    int rc;
+
+    rc = ldap_parse_intermediate(ld, entry, &retoid, &retdata, &serverctrls,
+                                 0);
+    if (rc != LDAP_SUCCESS) {
+        return LDAPerror_code(rc);
+    }
+    /* convert serverctrls to list of tuples */
+    if (!(pyctrls = LDAPControls_to_List(serverctrls))) {
+        ldap_controls_free(serverctrls);
+        ldap_memfree(retoid);
+        ber_bvfree(retdata);
+        return PyErr_NoMemory();
+    }
+    ldap_controls_free(serverctrls);
+
+    valuestr = LDAPberval_to_object(retdata);
+    ber_bvfree(retdata);
+    if (valuestr == NULL) {
+        ldap_memfree(retoid);
+        Py_DECREF(pyctrls);
+        return NULL;
+    }
+
+    pyoid = PyUnicode_FromString(retoid);
+    ldap_memfree(retoid);
+    if (pyoid == NULL) {
+        Py_DECREF(valuestr);
+        Py_DECREF(pyctrls);
+        return NULL;
+    }
+
+    return Py_BuildValue("(NNN)", pyoid, valuestr, pyctrls);
+}
+
+/*
+ * Owner of a message chain referenced by LDAPBervalView objects.
+ *
+ * Every view holds a reference to the owner, the chain is freed when the
+ * last view (and the converter that created it) has let go of it.
+ */
+
+typedef struct {
+    PyObject_HEAD LDAPMessage *msg;     /* owned message chain */
+} LDAPMessageOwnerObject;
+
+/*
+ * Wraps m in a new owner object. Returns a new reference, or NULL with an
+ * exception set, in which case m has been freed.
+ */
+static PyObject *
+LDAPmessage_owner_new(LDAPMessage *m)
+{
+    LDAPMessageOwnerObject *self;
+
+    self = PyObject_NEW(LDAPMessageOwnerObject, &LDAPMessageOwner_Type);
+    if (self == NULL) {
+        ldap_msgfree(m);
+        return NULL;
+    }
+    self->msg = m;
+    return (PyObject *)self;
+}
+
+static void
+LDAPMessageOwner_dealloc(LDAPMessageOwnerObject *self)
+{
+    ldap_msgfree(self->msg);
+    PyObject_DEL(self);
+}
+
+PyTypeObject LDAPMessageOwner_Type = {
+    PyVarObject_HEAD_INIT(NULL, 0)
+        "LDAPMessageOwner",     /*tp_name */
+    sizeof(LDAPMessageOwnerObject),     /*tp_basicsize */
+    0,                  /*tp_itemsize */
+    /* methods */
+    (destructor) LDAPMessageOwner_dealloc,      /*tp_dealloc */
+    0,                  /*tp_print */
+    0,                  /*tp_getattr */
+    0,                  /*tp_setattr */
+    0,                  /*tp_compare */
+    0,                  /*tp_repr */
+    0,                  /*tp_as_number */
+    0,                  /*tp_as_sequence */
+    0,                  /*tp_as_mapping */
+    0,                  /*tp_hash */
+    0,                  /*tp_call */
+    0,                  /*tp_str */
+    0,                  /*tp_getattro */
+    0,                  /*tp_setattro */
+    0,                  /*tp_as_buffer */
+    Py_TPFLAGS_DEFAULT, /*tp_flags */
+};
+
+/*
+ * Converts an LDAP message into a Python structure.
+ *
+ * On success, returns a list of dictionaries.
+ * On failure, returns NULL, and sets an error.
+ *
+ * The message m is always freed, regardless of return value.
+ *
+ * If add_ctrls is non-zero, per-entry/referral/partial/intermediate
+ * controls will be added as a third item to each entry tuple
+ *
+ * If add_intermediates is non-zero, intermediate/partial results will
+ * be returned
+ *
+ * If zero_copy is non-zero, attribute values are returned as
+ * LDAPBervalView objects sharing the message buffer, and m is only freed
+ * once the last of them is gone.
+ *
+ * If cidict is non-zero, the attributes of each entry are returned in a
+ * case-insensitive CIDict instead of a dict.
+ *
+ * If arena is not NULL, it holds the entries of m already decoded by
+ * LDAPmessage_decode(), otherwise m is decoded here with the GIL held.
+ * The arena stays owned by the caller.
+ */
+PyObject *
+LDAPmessage_to_python(LDAPObject *l, LDAPMessage *m, int add_ctrls,
+                      int add_intermediates, int zero_copy, int cidict,
+                      LDAPDecodeArena *arena)
+{
+    /* we convert an LDAP message into a python structure.
+     * It is always a list of dictionaries.
+     * We always free m.
+     */
+
+    LDAP *ld = l->ldap;
+    PyObject *result = NULL, *entrytuple = NULL;
+    PyObject *owner = NULL;
+    LDAPMessage *entry;
+    LDAPDecodeArena local;
+    size_t i;
+
+    LDAPdecode_init(&local);
+    if (arena == NULL) {
+        arena = &local;
+        LDAPmessage_decode(ld, m, arena);
+    }
+    if (arena->err != LDAP_SUCCESS) {
+        LDAPdecode_error(ld, arena->err);
+        goto failed;
+    }
+
+    if (zero_copy) {
+        owner = LDAPmessage_owner_new(m);
+        if (owner == NULL) {
+            LDAPdecode_clear(&local);
+            return NULL;
         }
-        Py_DECREF(reflist);
-        Py_XDECREF(pyctrls);
-        PyList_Append(result, entrytuple);
+    }
+
+    result = PyList_New(0);
+    if (result == NULL)
+        goto failed;
+
+    for (i = 0; i < arena->nentries; i++) {
+        entrytuple = LDAPdecoded_entry_to_python(l, arena,
+                                                 &arena->entries[i],
+                                                 add_ctrls, owner, cidict);
+        if (entrytuple == NULL || PyList_Append(result, entrytuple) == -1)
+            goto failed;
+        Py_DECREF(entrytuple);
+    }
+    for (entry = ldap_first_reference(ld, m);
+         entry != NULL; entry = ldap_next_reference(ld, entry)) {
+        entrytuple = LDAPreference_to_python(ld, entry, add_ctrls);
+        if (entrytuple == NULL || PyList_Append(result, entrytuple) == -1)
+            goto failed;
         Py_DECREF(entrytuple);
     }
     if (add_intermediates) {
@@ -244,68 +815,176 @@ LDAPmessage_to_python(LDAP *ld, LDAPMessage *m, int add_ctrls,
             /* list of tuples */
             /* each tuple is OID, Berval, controllist */
             if (LDAP_RES_INTERMEDIATE == ldap_msgtype(entry)) {
-                PyObject *valtuple;
-                PyObject *valuestr;
-                char *retoid = 0;
-                PyObject *pyoid;
-                struct berval *retdata = 0;
-
-                if (ldap_parse_intermediate
-                    (ld, entry, &retoid, &retdata, &serverctrls,
-                     0) != LDAP_SUCCESS) {
-                    Py_DECREF(result);
-                    ldap_msgfree(m);
-                    return LDAPerror(ld);
-                }
-                /* convert serverctrls to list of tuples */
-                if (!(pyctrls = LDAPControls_to_List(serverctrls))) {
-                    int err = LDAP_NO_MEMORY;
-
-                    ldap_set_option(ld, LDAP_OPT_ERROR_NUMBER, &err);
-                    Py_DECREF(result);
-                    ldap_msgfree(m);
-                    ldap_controls_free(serverctrls);
-                    ldap_memfree(retoid);
-                    ber_bvfree(retdata);
-                    return LDAPerror(ld);
-                }
-                ldap_controls_free(serverctrls);
-
-                valuestr = LDAPberval_to_object(retdata);
-                ber_bvfree(retdata);
-                if (valuestr == NULL) {
-                    ldap_memfree(retoid);
-                    Py_DECREF(result);
-                    ldap_msgfree(m);
-                    return NULL;
-                }
+                entrytuple = LDAPintermediate_to_python(ld, entry);
+                if (entrytuple == NULL ||
+                    PyList_Append(result, entrytuple) == -1)
+                    goto failed;
+                Py_DECREF(entrytuple);
+            }
+        }
+    }
+    LDAPdecode_clear(&local);
+    if (owner != NULL)
+        Py_DECREF(owner);
+    else
+        ldap_msgfree(m);
+    return result;
 
-                pyoid = PyUnicode_FromString(retoid);
-                ldap_memfree(retoid);
-                if (pyoid == NULL) {
-                    Py_DECREF(valuestr);
-                    Py_DECREF(result);
-                    ldap_msgfree(m);
-                    return NULL;
-                }
+  failed:
+    LDAPdecode_clear(&local);
+    Py_XDECREF(entrytuple);
+    Py_XDECREF(result);
+    if (owner != NULL)
+        Py_DECREF(owner);
+    else
+        ldap_msgfree(m);
+    return NULL;
+}
 
-                valtuple = Py_BuildValue("(NNN)", pyoid, valuestr, pyctrls);
-                if (valtuple == NULL) {
-                    Py_DECREF(result);
-                    ldap_msgfree(m);
-                    return NULL;
-                }
+/*
+ * Lazy iterator over a chained LDAP message.
+ *
+ * The iterator owns the message chain and converts one search entry,
+ * search reference or (optionally) intermediate response per __next__()
+ * call, in the order they were received. The chain is freed as soon as
+ * the iterator is exhausted or deallocated. In zero-copy mode it is
+ * handed to an LDAPMessageOwner instead and lives as long as the
+ * returned values do.
+ */
 
-                if (PyList_Append(result, valtuple) == -1) {
-                    Py_DECREF(valtuple);
-                    Py_DECREF(result);
-                    ldap_msgfree(m);
-                    return NULL;
-                }
-                Py_DECREF(valtuple);
-            }
+typedef struct {
+    PyObject_HEAD LDAPObject *ldo;      /* keeps the LDAP handle alive */
+    LDAPMessage *msg;           /* owned message chain */
+    LDAPMessage *next;          /* next message to look at */
+    PyObject *owner;            /* owner of msg in zero-copy mode */
+    LDAPDecodeArena arena;      /* reused for each entry */
+    int add_ctrls;
+    int add_intermediates;
+    int cidict;
+} LDAPMessageIterObject;
+
+PyObject *
+LDAPmessage_iter_new(LDAPObject *l, LDAPMessage *m, int add_ctrls,
+                     int add_intermediates, int zero_copy, int cidict)
+{
+    LDAPMessageIterObject *self;
+    PyObject *owner = NULL;
+
+    if (zero_copy) {
+        owner = LDAPmessage_owner_new(m);
+        if (owner == NULL)
+            return NULL;
+    }
+
+    self = PyObject_NEW(LDAPMessageIterObject, &LDAPMessageIter_Type);
+    if (self == NULL) {
+        if (owner != NULL)
+            Py_DECREF(owner);
+        else
+            ldap_msgfree(m);
+        return NULL;
+    }
+    Py_INCREF(l);
+    self->ldo = l;
+    self->msg = m;
+    self->next = ldap_first_message(l->ldap, m);
+    self->owner = owner;
+    LDAPdecode_init(&self->arena);
+    self->add_ctrls = add_ctrls;
+    self->add_intermediates = add_intermediates;
+    self->cidict = cidict;
+    return (PyObject *)self;
+}
+
+/* Lets go of the message chain */
+static void
+LDAPMessageIter_release(LDAPMessageIterObject *self)
+{
+    if (self->owner != NULL) {
+        Py_CLEAR(self->owner);
+    }
+    else if (self->msg != NULL) {
+        ldap_msgfree(self->msg);
+    }
+    self->msg = NULL;
+    self->next = NULL;
+    LDAPdecode_clear(&self->arena);
+}
+
+static void
+LDAPMessageIter_dealloc(LDAPMessageIterObject *self)
+{
+    LDAPMessageIter_release(self);
+    Py_XDECREF(self->ldo);
+    PyObject_DEL(self);
+}
+
+static PyObject *
+LDAPMessageIter_next(LDAPMessageIterObject *self)
+{
+    LDAPMessage *entry;
+    LDAP *ld;
+
+    if (self->msg == NULL)
+        return NULL;
+
+    if (!self->ldo->valid) {
+        PyErr_SetString(LDAPexception_class, "LDAP connection invalid");
+        return NULL;
+    }
+    ld = self->ldo->ldap;
+
+    while ((entry = self->next) != NULL) {
+        self->next = ldap_next_message(ld, entry);
+
+        switch (ldap_msgtype(entry)) {
+        case LDAP_RES_SEARCH_ENTRY:
+            return LDAPentry_to_python(self->ldo, entry, self->add_ctrls,
+                                       self->owner, self->cidict,
+                                       &self->arena);
+        case LDAP_RES_SEARCH_REFERENCE:
+            return LDAPreference_to_python(ld, entry, self->add_ctrls);
+        case LDAP_RES_INTERMEDIATE:
+            if (self->add_intermediates)
+                return LDAPintermediate_to_python(ld, entry);
+            break;
+        default:
+            break;
         }
     }
-    ldap_msgfree(m);
-    return result;
+
+    /* Exhausted, release the message chain right away */
+    LDAPMessageIter_release(self);
+    return NULL;
 }
+
+PyTypeObject LDAPMessageIter_Type = {
+    PyVarObject_HEAD_INIT(NULL, 0)
+        "LDAPMessageIter",      /*tp_name */
+    sizeof(LDAPMessageIterObject),      /*tp_basicsize */
+    0,                  /*tp_itemsize */
+    /* methods */
+    (destructor) LDAPMessageIter_dealloc,       /*tp_dealloc */
+    0,                  /*tp_print */
+    0,                  /*tp_getattr */
+    0,                  /*tp_setattr */
+    0,                  /*tp_compare */
+    0,                  /*tp_repr */
+    0,                  /*tp_as_number */
+    0,                  /*tp_as_sequence */
+    0,                  /*tp_as_mapping */
+    0,                  /*tp_hash */
+    0,                  /*tp_call */
+    0,                  /*tp_str */
+    0,                  /*tp_getattro */
+    0,                  /*tp_setattro */
+    0,                  /*tp_as_buffer */
+    Py_TPFLAGS_DEFAULT, /*tp_flags */
+    0,                  /*tp_doc */
+    0,                  /*tp_traverse */
+    0,                  /*tp_clear */
+    0,                  /*tp_richcompare */
+    0,                  /*tp_weaklistoffset */
+    PyObject_SelfIter,  /*tp_iter */
+    (iternextfunc) LDAPMessageIter_next,        /*tp_iternext */
+};
@@ -4,8 +4,48 @@
 #define __h_message
 
 #include "common.h"
+#include "LDAPObject.h"
 
-extern PyObject *LDAPmessage_to_python(LDAP *ld, LDAPMessage *m, int add_ctrls,
-                                       int add_intermediates);
+/* search entries decoded by LDAPmessage_decode(), see message.c */
+typedef struct {
+    struct berval dn;           /* points into the message */
+    LDAPControl **ctrls;        /* owned, may be NULL */
+    size_t attrs;               /* index of the first attribute */
+    size_t nattrs;
+} LDAPDecodedEntry;
+
+typedef struct {
+    struct berval name;         /* points into the message */
+    size_t values;              /* index of the first value */
+    size_t nvalues;
+} LDAPDecodedAttr;
+
+typedef struct {
+    LDAPDecodedEntry *entries;
+    LDAPDecodedAttr *attrs;
+    struct berval *values;      /* all point into the message */
+    size_t nentries, entries_size;
+    size_t nattrs, attrs_size;
+    size_t nvalues, values_size;
+    int err;                    /* LDAP error code of the decoding */
+} LDAPDecodeArena;
+
+extern PyTypeObject LDAPMessageIter_Type;
+extern PyTypeObject LDAPMessageOwner_Type;
+
+extern void LDAPdecode_init(LDAPDecodeArena *a);
+extern void LDAPdecode_reset(LDAPDecodeArena *a);
+extern void LDAPdecode_clear(LDAPDecodeArena *a);
+extern int LDAPmessage_decode(LDAP *ld, LDAPMessage *m, LDAPDecodeArena *a);
+extern PyObject *LDAPmessage_to_python(LDAPObject *l, LDAPMessage *m,
+                                       int add_ctrls, int add_intermediates,
+                                       int zero_copy, int cidict,
+                                       LDAPDecodeArena *arena);
+extern PyObject *LDAPmessage_iter_new(LDAPObject *l, LDAPMessage *m,
+                                      int add_ctrls, int add_intermediates,
+                                      int zero_copy, int cidict);
+extern PyObject *LDAPattrcache_get(LDAPObject *l, const char *attr,
+                                   size_t len);
+extern void LDAPattrcache_clear(LDAPObject *l);
 
 #endif /* __h_message_ */
@@ -0,0 +1,413 @@
+/* See https://www.python-ldap.org/ for details. */
+
+#include "common.h"
+#include "modlist.h"
+
+/*
+ * Diff engine behind ldap.modlist.addModlist() and modifyModlist().
+ *
+ * The semantics are exactly those of the former pure Python version,
+ * attribute values are compared as hashed sets.
+ */
+
+static PyObject *lower_name;    /* interned "lower" */
+
+/* Returns o.lower() */
+static PyObject *
+lowered(PyObject *o)
+{
+    return PyObject_CallMethodObjArgs(o, lower_name, NULL);
+}
+
+/* Returns {v.lower() for v in iterable or []} */
+static PyObject *
+lowered_set(PyObject *iterable)
+{
+    PyObject *set, *iter, *item, *low;
+
+    set = PySet_New(NULL);
+    if (set == NULL || iterable == Py_None)
+        return set;
+    iter = PyObject_GetIter(iterable);
+    if (iter == NULL)
+        goto failed;
+    while ((item = PyIter_Next(iter)) != NULL) {
+        low = lowered(item);
+        Py_DECREF(item);
+        if (low == NULL || PySet_Add(set, low) == -1) {
+            Py_XDECREF(low);
+            Py_DECREF(iter);
+            goto failed;
+        }
+        Py_DECREF(low);
+    }
+    Py_DECREF(iter);
+    if (PyErr_Occurred())
+        goto failed;
+    return set;
+
+  failed:
+    Py_DECREF(set);
+    return NULL;
+}
+
+/* Returns [item for item in value if item is not None] */
+static PyObject *
+without_none(PyObject *value)
+{
+    PyObject *list, *iter, *item;
+
+    list = PyList_New(0);
+    if (list == NULL)
+        return NULL;
+    iter = PyObject_GetIter(value);
+    if (iter == NULL)
+        goto failed;
+    while ((item = PyIter_Next(iter)) != NULL) {
+        if (item != Py_None && PyList_Append(list, item) == -1) {
+            Py_DECREF(item);
+            Py_DECREF(iter);
+            goto failed;
+        }
+        Py_DECREF(item);
+    }
+    Py_DECREF(iter);
+    if (PyErr_Occurred())
+        goto failed;
+    return list;
+
+  failed:
+    Py_DECREF(list);
+    return NULL;
+}
+
+/* Returns the set of values of list, lowered if case_ignore is true */
+static PyObject *
+value_set(PyObject *list, int case_ignore)
+{
+    if (case_ignore)
+        return lowered_set(list);
+    return PySet_New(list);
+}
+
+/*
+ * Compares two lists of attribute values of the same length as sets.
+ * Returns 1 if equal, 0 if not and -1 on error.
+ */
+static int
+values_equal(PyObject *old_value, PyObject *new_value, int case_ignore)
+{
+    PyObject *old_set, *new_set;
+    Py_ssize_t i, n = PyList_GET_SIZE(old_value);
+    int rc;
+
+    /* values are usually unchanged and in the same order */
+    for (i = 0; i < n; i++) {
+        rc = PyObject_RichCompareBool(PyList_GET_ITEM(old_value, i),
+                                      PyList_GET_ITEM(new_value, i), Py_EQ);
+        if (rc == -1)
+            return -1;
+        if (rc == 0)
+            break;
+    }
+    if (i == n)
+        return 1;
+
+    old_set = value_set(old_value, case_ignore);
+    if (old_set == NULL)
+        return -1;
+    new_set = value_set(new_value, case_ignore);
+    if (new_set == NULL) {
+        Py_DECREF(old_set);
+        return -1;
+    }
+    rc = PyObject_RichCompareBool(old_set, new_set, Py_EQ);
+    Py_DECREF(old_set);
+    Py_DECREF(new_set);
+    return rc;
+}
+
+/* Appends (mod_op, attrtype, value) to modlist, returns -1 on error */
+static int
+append_mod(PyObject *modlist, int mod_op, PyObject *attrtype,
+           PyObject *value)
+{
+    PyObject *mod;
+    int rc;
+
+    mod = Py_BuildValue("(iOO)", mod_op, attrtype, value);
+    if (mod == NULL)
+        return -1;
+    rc = PyList_Append(modlist, mod);
+    Py_DECREF(mod);
+    return rc;
+}
+
+/* add_modlist(entry [, ignore_attr_types]) */
+
+static PyObject *
+l_add_modlist(PyObject *self, PyObject *args)
+{
+    PyObject *entry, *ignore_attr_types = Py_None;
+    PyObject *ignore = NULL, *items = NULL, *modlist = NULL;
+    Py_ssize_t i;
+
+    if (!PyArg_ParseTuple(args, "O|O:add_modlist", &entry,
+                          &ignore_attr_types))
+        return NULL;
+
+    if ((ignore = lowered_set(ignore_attr_types)) == NULL)
+        goto failed;
+    if ((items = PyMapping_Items(entry)) == NULL)
+        goto failed;
+    if ((modlist = PyList_New(0)) == NULL)
+        goto failed;
+
+    for (i = 0; i < PyList_GET_SIZE(items); i++) {
+        PyObject *attrtype, *value, *low, *iter, *item;
+        int found = 0, rc;
+
+        if (!PyArg_ParseTuple(PyList_GET_ITEM(items, i), "OO",
+                              &attrtype, &value))
+            goto failed;
+
+        if ((low = lowered(attrtype)) == NULL)
+            goto failed;
+        rc = PySet_Contains(ignore, low);
+        Py_DECREF(low);
+        if (rc == -1)
+            goto failed;
+        if (rc)
+            /* This attribute type is ignored */
+            continue;
+
+        /* Skip attributes without any values other than None */
+        if ((iter = PyObject_GetIter(value)) == NULL)
+            goto failed;
+        while (!found && (item = PyIter_Next(iter)) != NULL) {
+            found = (item != Py_None);
+            Py_DECREF(item);
+        }
+        Py_DECREF(iter);
+        if (PyErr_Occurred())
+            goto failed;
+
+        if (found) {
+            PyObject *mod = PyTuple_Pack(2, attrtype, value);
+
+            if (mod == NULL || PyList_Append(modlist, mod) == -1) {
+                Py_XDECREF(mod);
+                goto failed;
+            }
+            Py_DECREF(mod);
+        }
+    }
+
+    Py_DECREF(ignore);
+    Py_DECREF(items);
+    return modlist;
+
+  failed:
+    Py_XDECREF(ignore);
+    Py_XDECREF(items);
+    Py_XDECREF(modlist);
+    return NULL;
+}
+
+/* modify_modlist(old_entry, new_entry [, ignore_attr_types
+ *                [, ignore_oldexistent [, case_ignore_attr_types]]]) */
+
+static PyObject *
+l_modify_modlist(PyObject *self, PyObject *args)
+{
+    PyObject *old_entry, *new_entry;
+    PyObject *ignore_attr_types = Py_None, *case_ignore_attr_types = Py_None;
+    int ignore_oldexistent = 0;
+    PyObject *ignore = NULL, *case_ignore = NULL;
+    PyObject *lower_map = NULL, *items = NULL, *modlist = NULL;
+    PyObject *iter, *key, *val;
+    Py_ssize_t i, pos;
+
+    if (!PyArg_ParseTuple(args, "OO|OpO:modify_modlist",
+                          &old_entry, &new_entry, &ignore_attr_types,
+                          &ignore_oldexistent, &case_ignore_attr_types))
+        return NULL;
+
+    if ((ignore = lowered_set(ignore_attr_types)) == NULL)
+        goto failed;
+    if ((case_ignore = lowered_set(case_ignore_attr_types)) == NULL)
+        goto failed;
+    if ((modlist = PyList_New(0)) == NULL)
+        goto failed;
+
+    /* map lower-cased attribute types to those used in old_entry */
+    if ((lower_map = PyDict_New()) == NULL)
+        goto failed;
+    if ((iter = PyObject_GetIter(old_entry)) == NULL)
+        goto failed;
+    while ((key = PyIter_Next(iter)) != NULL) {
+        PyObject *low = lowered(key);
+
+        if (low == NULL || PyDict_SetItem(lower_map, low, key) == -1) {
+            Py_XDECREF(low);
+            Py_DECREF(key);
+            Py_DECREF(iter);
+            goto failed;
+        }
+        Py_DECREF(low);
+        Py_DECREF(key);
+    }
+    Py_DECREF(iter);
+    if (PyErr_Occurred())
+        goto failed;
+
+    if ((items = PyMapping_Items(new_entry)) == NULL)
+        goto failed;
+
+    for (i = 0; i < PyList_GET_SIZE(items); i++) {
+        PyObject *attrtype, *value, *low, *old_attrtype;
+        PyObject *new_value = NULL, *old_value = NULL;
+        Py_ssize_t num_old, num_new;
+        int rc;
+
+        if (!PyArg_ParseTuple(PyList_GET_ITEM(items, i), "OO",
+                              &attrtype, &value))
+            goto failed;
+
+        if ((low = lowered(attrtype)) == NULL)
+            goto failed;
+        rc = PySet_Contains(ignore, low);
+        if (rc != 0) {
+            Py_DECREF(low);
+            if (rc == -1)
+                goto failed;
+            /* This attribute type is ignored */
+            continue;
+        }
+
+        /* Filter away null-strings */
+        if ((new_value = without_none(value)) == NULL)
+            goto failed_attr;
+
+        old_attrtype = PyDict_GetItemWithError(lower_map, low);
+        if (old_attrtype != NULL) {
+            PyObject *ov = PyObject_GetItem(old_entry, old_attrtype);
+
+            if (ov == NULL) {
+                if (!PyErr_ExceptionMatches(PyExc_KeyError))
+                    goto failed_attr;
+                PyErr_Clear();
+                old_value = PyList_New(0);
+            }
+            else {
+                old_value = without_none(ov);
+                Py_DECREF(ov);
+            }
+            if (old_value == NULL || PyDict_DelItem(lower_map, low) == -1)
+                goto failed_attr;
+        }
+        else if (PyErr_Occurred()) {
+            goto failed_attr;
+        }
+        else if ((old_value = PyList_New(0)) == NULL) {
+            goto failed_attr;
+        }
+
+        num_old = PyList_GET_SIZE(old_value);
+        num_new = PyList_GET_SIZE(new_value);
+        rc = 0;
+        if (!num_old && num_new) {
+            /* Add a new attribute to entry */
+            rc = append_mod(modlist, LDAP_MOD_ADD, attrtype, new_value);
+        }
+        else if (num_old && num_new) {
+            /* Replace existing attribute */
+            int replace = (num_old != num_new);
+
+            if (!replace) {
+                int case_ignore_attr = PySet_Contains(case_ignore, low);
+
+                if (case_ignore_attr == -1)
+                    goto failed_attr;
+                replace = values_equal(old_value, new_value,
+                                       case_ignore_attr);
+                if (replace == -1)
+                    goto failed_attr;
+                replace = !replace;
+            }
+            if (replace) {
+                rc = append_mod(modlist, LDAP_MOD_DELETE, attrtype, Py_None);
+                if (rc == 0)
+                    rc = append_mod(modlist, LDAP_MOD_ADD, attrtype,
+                                    new_value);
+            }
+        }
+        else if (num_old && !num_new) {
+            /* Completely delete an existing attribute */
+            rc = append_mod(modlist, LDAP_MOD_DELETE, attrtype, Py_None);
+        }
+        if (rc == -1)
+            goto failed_attr;
+
+        Py_DECREF(low);
+        Py_DECREF(new_value);
+        Py_DECREF(old_value);
+        continue;
+
+      failed_attr:
+        Py_DECREF(low);
+        Py_XDECREF(new_value);
+        Py_XDECREF(old_value);
+        goto failed;
+    }
+
+    if (!ignore_oldexistent) {
+        /* Remove all attributes of old_entry which are not present
+         * in new_entry at all */
+        pos = 0;
+        while (PyDict_Next(lower_map, &pos, &key, &val)) {
+            int rc = PySet_Contains(ignore, key);
+
+            if (rc == -1)
+                goto failed;
+            if (rc)
+                /* This attribute type is ignored */
+                continue;
+            if (append_mod(modlist, LDAP_MOD_DELETE, val, Py_None) == -1)
+                goto failed;
+        }
+    }
+
+    Py_DECREF(ignore);
+    Py_DECREF(case_ignore);
+    Py_DECREF(lower_map);
+    Py_DECREF(items);
+    return modlist;
+
+  failed:
+    Py_XDECREF(ignore);
+    Py_XDECREF(case_ignore);
+    Py_XDECREF(lower_map);
+    Py_XDECREF(items);
+    Py_XDECREF(modlist);
+    return NULL;
+}
+
+/* methods */
+
+static PyMethodDef methods[] = {
+    {"add_modlist", (PyCFunction)l_add_modlist, METH_VARARGS},
+    {"modify_modlist", (PyCFunction)l_modify_modlist, METH_VARARGS},
+    {NULL, NULL}
+};
+
+/* initialisation */
+
+void
+LDAPinit_modlist(PyObject *d)
+{
+    lower_name = PyUnicode_InternFromString("lower");
+    if (lower_name == NULL)
+        return;
+    LDAPadd_methods(d, methods);
+}
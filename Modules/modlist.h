@@ -0,0 +1,9 @@
+/* See https://www.python-ldap.org/ for details. */
+
+#ifndef __h_modlist_
+#define __h_modlist_
+
+#include "common.h"
+extern void LDAPinit_modlist(PyObject *);
+
+#endif /* __h_modlist_ */
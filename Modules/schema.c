@@ -0,0 +1,272 @@
+/* See https://www.python-ldap.org/ for details. */
+
+#include "common.h"
+#include "schema.h"
+
+/*
+ * Tokenizer for schema element descriptions (RFC 4512) behind
+ * ldap.schema.tokenizer. The results are exactly those of the former
+ * regular expression based implementation.
+ */
+
+static PyObject *open_paren;    /* "(" */
+static PyObject *close_paren;   /* ")" */
+
+/* Returns non-zero if item is the str s */
+static int
+is_token(PyObject *item, const char *s)
+{
+    return PyUnicode_Check(item) && PyUnicode_CompareWithASCIIString(item, s) == 0;
+}
+
+/*
+ * Returns the length of a quoted string starting at pos, including the
+ * quotes, or 0 if pos does not start a valid quoted string.
+ */
+static Py_ssize_t
+quoted_len(int kind, const void *data, Py_ssize_t len, Py_ssize_t pos)
+{
+    Py_ssize_t i = pos + 1;
+    Py_UCS4 c;
+
+    while (i < len) {
+        c = PyUnicode_READ(kind, data, i);
+        if (c == '\'') {
+            /* right quote must not be followed by an alphanumeric char */
+            if (i + 1 < len) {
+                c = PyUnicode_READ(kind, data, i + 1);
+                if (Py_UNICODE_ISALNUM(c) || c == '_')
+                    return 0;
+            }
+            return i + 1 - pos;
+        }
+        if (c == '\\') {
+            if (i + 1 >= len || PyUnicode_READ(kind, data, i + 1) == '\n')
+                return 0;
+            i += 2;
+        }
+        else {
+            i++;
+        }
+    }
+    return 0;
+}
+
+/* Returns the quoted string at pos without quotes and escaping */
+static PyObject *
+unquote(PyObject *s, int kind, const void *data, Py_ssize_t pos,
+        Py_ssize_t qlen)
+{
+    Py_ssize_t i, n = 0, end = pos + qlen - 1;
+    Py_UCS4 *buf, c;
+    PyObject *result;
+
+    for (i = pos + 1; i < end; i++) {
+        if (PyUnicode_READ(kind, data, i) == '\\')
+            break;
+    }
+    if (i == end)
+        return PyUnicode_Substring(s, pos + 1, end);
+
+    buf = PyMem_NEW(Py_UCS4, qlen);
+    if (buf == NULL)
+        return PyErr_NoMemory();
+    for (i = pos + 1; i < end; i++) {
+        c = PyUnicode_READ(kind, data, i);
+        if (c == '\\')
+            c = PyUnicode_READ(kind, data, ++i);
+        buf[n++] = c;
+    }
+    result = PyUnicode_FromKindAndData(PyUnicode_4BYTE_KIND, buf, n);
+    PyMem_DEL(buf);
+    return result;
+}
+
+/* split_tokens(s) */
+
+static PyObject *
+l_split_tokens(PyObject *unused, PyObject *args)
+{
+    PyObject *s, *parts, *part;
+    Py_ssize_t pos, end, len, qlen;
+    int kind, parens = 0;
+    const void *data;
+    Py_UCS4 c;
+
+    if (!PyArg_ParseTuple(args, "U:split_tokens", &s))
+        return NULL;
+    if (PyUnicode_READY(s) == -1)
+        return NULL;
+    len = PyUnicode_GET_LENGTH(s);
+    kind = PyUnicode_KIND(s);
+    data = PyUnicode_DATA(s);
+
+    parts = PyList_New(0);
+    if (parts == NULL)
+        return NULL;
+
+    pos = 0;
+    while (pos < len) {
+        c = PyUnicode_READ(kind, data, pos);
+        if (Py_UNICODE_ISSPACE(c)) {
+            pos++;
+            continue;
+        }
+        if (c == '(' || c == ')') {
+            parens += (c == '(') ? 1 : -1;
+            part = (c == '(') ? open_paren : close_paren;
+            Py_INCREF(part);
+            pos++;
+        }
+        else if (c != '\'' && c != '$') {
+            /* string without '$() or whitespace */
+            for (end = pos + 1; end < len; end++) {
+                c = PyUnicode_READ(kind, data, end);
+                if (c == '\'' || c == '$' || c == '(' || c == ')' ||
+                    Py_UNICODE_ISSPACE(c))
+                    break;
+            }
+            part = PyUnicode_Substring(s, pos, end);
+            pos = end;
+        }
+        else if (c == '\'' && (qlen = quoted_len(kind, data, len, pos)) > 0) {
+            part = unquote(s, kind, data, pos, qlen);
+            pos += qlen;
+        }
+        else if (c == '$') {
+            if (!parens) {
+                PyErr_Format(PyExc_ValueError,
+                             "'$' outside parenthesis in %R", s);
+                goto failed;
+            }
+            pos++;
+            continue;
+        }
+        else {
+            /* unbalanced quote */
+            PyObject *residue = PyUnicode_Substring(s, pos, pos + 1);
+
+            if (residue != NULL) {
+                PyObject *exc_args = PyTuple_Pack(2, residue, s);
+
+                if (exc_args != NULL) {
+                    PyErr_SetObject(PyExc_ValueError, exc_args);
+                    Py_DECREF(exc_args);
+                }
+                Py_DECREF(residue);
+            }
+            goto failed;
+        }
+        if (part == NULL)
+            goto failed;
+        if (PyList_Append(parts, part) == -1) {
+            Py_DECREF(part);
+            goto failed;
+        }
+        Py_DECREF(part);
+    }
+
+    if (parens) {
+        PyErr_Format(PyExc_ValueError, "Unbalanced parenthesis in %R", s);
+        goto failed;
+    }
+    return parts;
+
+  failed:
+    Py_DECREF(parts);
+    return NULL;
+}
+
+/* extract_tokens(l, known_tokens) */
+
+static PyObject *
+l_extract_tokens(PyObject *unused, PyObject *args)
+{
+    PyObject *l, *known_tokens, *result, *token, *value, *item;
+    Py_ssize_t i, start, j, l_len;
+    int rc;
+
+    if (!PyArg_ParseTuple(args, "O!O:extract_tokens", &PyList_Type, &l,
+                          &known_tokens))
+        return NULL;
+
+    result = PyDict_New();
+    if (result == NULL)
+        return NULL;
+    if (PyDict_Merge(result, known_tokens, 1) == -1)
+        goto failed;
+
+    i = 0;
+    l_len = PyList_GET_SIZE(l);
+    while (i < l_len) {
+        token = PyList_GET_ITEM(l, i);
+        rc = PyDict_Contains(result, token);
+        if (rc == -1)
+            goto failed;
+        i++;
+        if (!rc || i >= l_len)
+            /* unrecognized item or last token without value */
+            continue;
+
+        item = PyList_GET_ITEM(l, i);
+        rc = PyDict_Contains(result, item);
+        if (rc == -1)
+            goto failed;
+        if (rc) {
+            /* non-valued */
+            value = PyTuple_New(0);
+        }
+        else if (is_token(item, "(")) {
+            /* multi-valued */
+            start = ++i;
+            while (i < l_len && !is_token(PyList_GET_ITEM(l, i), ")"))
+                i++;
+            value = PyList_New(0);
+            for (j = start; value != NULL && j < i; j++) {
+                item = PyList_GET_ITEM(l, j);
+                if (!is_token(item, "$") && PyList_Append(value, item) == -1)
+                    Py_CLEAR(value);
+            }
+            if (value != NULL) {
+                Py_SETREF(value, PyList_AsTuple(value));
+            }
+            i++;
+        }
+        else {
+            /* single-valued */
+            value = PyTuple_Pack(1, item);
+            i++;
+        }
+        if (value == NULL)
+            goto failed;
+        rc = PyDict_SetItem(result, token, value);
+        Py_DECREF(value);
+        if (rc == -1)
+            goto failed;
+    }
+    return result;
+
+  failed:
+    Py_DECREF(result);
+    return NULL;
+}
+
+/* methods */
+
+static PyMethodDef methods[] = {
+    {"split_tokens", (PyCFunction)l_split_tokens, METH_VARARGS},
+    {"extract_tokens", (PyCFunction)l_extract_tokens, METH_VARARGS},
+    {NULL, NULL}
+};
+
+/* initialisation */
+
+void
+LDAPinit_schema(PyObject *d)
+{
+    open_paren = PyUnicode_InternFromString("(");
+    close_paren = PyUnicode_InternFromString(")");
+    if (open_paren == NULL || close_paren == NULL)
+        return;
+    LDAPadd_methods(d, methods);
+}
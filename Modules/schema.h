@@ -0,0 +1,10 @@
+/* See https://www.python-ldap.org/ for details. */
+
+#ifndef __h_schema_
+#define __h_schema_
+
+#include "common.h"
+
+extern void LDAPinit_schema(PyObject *);
+
+#endif /* __h_schema_ */
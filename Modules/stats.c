@@ -0,0 +1,242 @@
+/* See https://www.python-ldap.org/ for details. */
+
+#include "common.h"
+#include "stats.h"
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <time.h>
+#endif
+
+/*
+ * Per-connection counters and latency histograms behind
+ * LDAPObject.stats(). Everything is updated while attached, in a
+ * critical section of the connection, except the lock counters, which
+ * are updated holding its lock. Only the clock is read without either.
+ */
+
+static const char *op_names[LDAP_STATS_NUM_OPS] = {
+    "bind", "search", "modify", "add", "delete", "modrdn", "compare",
+    "extended", "intermediate"
+};
+
+LDAPStatsCount
+LDAPstats_now(void)
+{
+#ifdef _WIN32
+    static LARGE_INTEGER freq;
+    LARGE_INTEGER count;
+
+    if (freq.QuadPart == 0)
+        QueryPerformanceFrequency(&freq);
+    QueryPerformanceCounter(&count);
+    return (LDAPStatsCount)((double)count.QuadPart * 1e9 / freq.QuadPart);
+#else
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (LDAPStatsCount)ts.tv_sec * 1000000000 + ts.tv_nsec;
+#endif
+}
+
+/* Returns the operation type of a message type, -1 if unknown */
+int
+LDAPstats_op(int res_type)
+{
+    switch (res_type) {
+    case LDAP_RES_BIND:
+        return LDAP_STATS_BIND;
+    case LDAP_RES_SEARCH_ENTRY:
+    case LDAP_RES_SEARCH_REFERENCE:
+    case LDAP_RES_SEARCH_RESULT:
+        return LDAP_STATS_SEARCH;
+    case LDAP_RES_MODIFY:
+        return LDAP_STATS_MODIFY;
+    case LDAP_RES_ADD:
+        return LDAP_STATS_ADD;
+    case LDAP_RES_DELETE:
+        return LDAP_STATS_DELETE;
+    case LDAP_RES_MODRDN:
+        return LDAP_STATS_MODRDN;
+    case LDAP_RES_COMPARE:
+        return LDAP_STATS_COMPARE;
+    case LDAP_RES_EXTENDED:
+        return LDAP_STATS_EXTENDED;
+    case LDAP_RES_INTERMEDIATE:
+        return LDAP_STATS_INTERMEDIATE;
+    default:
+        return -1;
+    }
+}
+
+void
+LDAPstats_reset(LDAPStats *s)
+{
+    memset(s, 0, sizeof(*s));
+}
+
+static void
+hist_add(LDAPStatsCount *hist, LDAPStatsCount ns)
+{
+    LDAPStatsCount us = ns / 1000;
+    int i = 0;
+
+    while (us > 0 && i < LDAP_STATS_BUCKETS - 1) {
+        us >>= 1;
+        i++;
+    }
+    hist[i]++;
+}
+
+/*
+ * Records a call of ldap_result() which waited for wait_ns and returned a
+ * message of res_type, or none if res_type <= 0. decode_ns is the time
+ * LDAPmessage_decode() took afterwards.
+ */
+void
+LDAPstats_result(LDAPStats *s, int res_type, LDAPStatsCount wait_ns,
+                 LDAPStatsCount decode_ns)
+{
+    int op = res_type > 0 ? LDAPstats_op(res_type) : -1;
+    LDAPOpStats *o;
+
+    if (op < 0) {
+        s->empty_results++;
+        s->empty_wait_ns += wait_ns;
+        return;
+    }
+    o = &s->ops[op];
+    o->results++;
+    o->result_wait_ns += wait_ns;
+    o->decode_ns += decode_ns;
+    hist_add(o->result_wait_hist, wait_ns);
+}
+
+/* Counts the messages of a chain returned by ldap_result() */
+void
+LDAPstats_received(LDAPStats *s, LDAP *ld, LDAPMessage *chain)
+{
+    LDAPMessage *m;
+    LDAPOpStats *o;
+    int op, res_type;
+
+    for (m = ldap_first_message(ld, chain); m != NULL;
+         m = ldap_next_message(ld, m)) {
+        res_type = ldap_msgtype(m);
+        if ((op = LDAPstats_op(res_type)) < 0)
+            continue;
+        o = &s->ops[op];
+        o->messages++;
+        if (res_type == LDAP_RES_SEARCH_ENTRY)
+            o->entries++;
+        o->bytes += LDAPstats_message_bytes(m);
+    }
+}
+
+/* Returns the size of the BER encoding of a single message, 0 if unknown */
+LDAPStatsCount
+LDAPstats_message_bytes(LDAPMessage *m)
+{
+#ifdef LBER_OPT_BER_TOTAL_BYTES
+    BerElement *ber = ldap_get_message_ber(m);
+    ber_len_t len;
+
+    if (ber != NULL &&
+        ber_get_option(ber, LBER_OPT_BER_TOTAL_BYTES,
+                       &len) == LBER_OPT_SUCCESS)
+        return len;
+#endif
+    return 0;
+}
+
+/* Records a call of LDAPmessage_to_python() for a message of res_type */
+void
+LDAPstats_convert(LDAPStats *s, int res_type, LDAPStatsCount convert_ns)
+{
+    int op = LDAPstats_op(res_type);
+    LDAPOpStats *o;
+
+    if (op < 0)
+        return;
+    o = &s->ops[op];
+    o->conversions++;
+    o->convert_ns += convert_ns;
+    hist_add(o->convert_hist, convert_ns);
+}
+
+static PyObject *
+hist_to_python(const LDAPStatsCount *hist)
+{
+    PyObject *list = PyList_New(LDAP_STATS_BUCKETS);
+    PyObject *count;
+    int i;
+
+    if (list == NULL)
+        return NULL;
+    for (i = 0; i < LDAP_STATS_BUCKETS; i++) {
+        if (!(count = PyLong_FromUnsignedLongLong(hist[i]))) {
+            Py_DECREF(list);
+            return NULL;
+        }
+        PyList_SET_ITEM(list, i, count);
+    }
+    return list;
+}
+
+/*
+ * Returns the counters as dict. Operation types without any requests or
+ * messages are left out.
+ */
+PyObject *
+LDAPstats_to_python(LDAPStats *s)
+{
+    PyObject *result, *ops, *item, *wait_hist, *convert_hist;
+    LDAPOpStats *o;
+    int i;
+
+    ops = PyDict_New();
+    if (ops == NULL)
+        return NULL;
+    for (i = 0; i < LDAP_STATS_NUM_OPS; i++) {
+        o = &s->ops[i];
+        if (o->requests == 0 && o->messages == 0 && o->results == 0 &&
+            o->conversions == 0)
+            continue;
+        wait_hist = hist_to_python(o->result_wait_hist);
+        convert_hist = hist_to_python(o->convert_hist);
+        if (wait_hist == NULL || convert_hist == NULL) {
+            Py_XDECREF(wait_hist);
+            Py_XDECREF(convert_hist);
+            Py_DECREF(ops);
+            return NULL;
+        }
+        item = Py_BuildValue("{sKsKsKsKsKsKsKsKsKsNsN}",
+                             "requests", o->requests,
+                             "messages", o->messages,
+                             "entries", o->entries,
+                             "bytes", o->bytes,
+                             "results", o->results,
+                             "result_wait_ns", o->result_wait_ns,
+                             "decode_ns", o->decode_ns,
+                             "conversions", o->conversions,
+                             "convert_ns", o->convert_ns,
+                             "result_wait_histogram", wait_hist,
+                             "convert_histogram", convert_hist);
+        if (item == NULL || PyDict_SetItemString(ops, op_names[i], item) == -1) {
+            Py_XDECREF(item);
+            Py_DECREF(ops);
+            return NULL;
+        }
+        Py_DECREF(item);
+    }
+    result = Py_BuildValue("{sNsKsKsKsKsKsK}",
+                           "operations", ops,
+                           "empty_results", s->empty_results,
+                           "empty_wait_ns", s->empty_wait_ns,
+                           "gil_waits", s->gil_waits,
+                           "gil_wait_ns", s->gil_wait_ns,
+                           "lock_waits", s->lock_waits,
+                           "lock_wait_ns", s->lock_wait_ns);
+    return result;
+}
@@ -0,0 +1,67 @@
+/* See https://www.python-ldap.org/ for details. */
+
+#ifndef __h_stats
+#define __h_stats
+
+#include "common.h"
+
+/* operation types counted separately, see LDAPstats_op() */
+enum {
+    LDAP_STATS_BIND,
+    LDAP_STATS_SEARCH,
+    LDAP_STATS_MODIFY,
+    LDAP_STATS_ADD,
+    LDAP_STATS_DELETE,
+    LDAP_STATS_MODRDN,
+    LDAP_STATS_COMPARE,
+    LDAP_STATS_EXTENDED,
+    LDAP_STATS_INTERMEDIATE,
+    LDAP_STATS_NUM_OPS
+};
+
+/* latency buckets for < 1, 2, 4, ... 2**22 microseconds and the rest */
+#define LDAP_STATS_BUCKETS      24
+
+typedef unsigned long long LDAPStatsCount;
+
+/* counters of one operation type */
+typedef struct {
+    LDAPStatsCount requests;    /* requests sent */
+    LDAPStatsCount messages;    /* messages received */
+    LDAPStatsCount entries;     /* search entries received */
+    LDAPStatsCount bytes;       /* BER size of the messages received */
+    LDAPStatsCount results;     /* ldap_result() calls returning a message */
+    LDAPStatsCount result_wait_ns;      /* blocked in ldap_result() */
+    LDAPStatsCount decode_ns;   /* decoding entries without the GIL */
+    LDAPStatsCount conversions; /* calls of LDAPmessage_to_python() */
+    LDAPStatsCount convert_ns;  /* in LDAPmessage_to_python() */
+    LDAPStatsCount result_wait_hist[LDAP_STATS_BUCKETS];
+    LDAPStatsCount convert_hist[LDAP_STATS_BUCKETS];
+} LDAPOpStats;
+
+/* counters of a connection, kept in LDAPObject */
+typedef struct {
+    LDAPOpStats ops[LDAP_STATS_NUM_OPS];
+    LDAPStatsCount empty_results;       /* ldap_result() without message */
+    LDAPStatsCount empty_wait_ns;
+    LDAPStatsCount gil_waits;   /* re-acquiring the GIL after libldap calls */
+    LDAPStatsCount gil_wait_ns;
+    LDAPStatsCount lock_waits;  /* waiting for another thread's libldap call */
+    LDAPStatsCount lock_wait_ns;
+} LDAPStats;
+
+/* monotonic clock in nanoseconds, callable without the GIL */
+extern LDAPStatsCount LDAPstats_now(void);
+extern int LDAPstats_op(int res_type);
+extern void LDAPstats_reset(LDAPStats *s);
+extern void LDAPstats_result(LDAPStats *s, int res_type,
+                             LDAPStatsCount wait_ns, LDAPStatsCount decode_ns);
+extern void LDAPstats_received(LDAPStats *s, LDAP *ld, LDAPMessage *chain);
+extern LDAPStatsCount LDAPstats_message_bytes(LDAPMessage *m);
+extern void LDAPstats_convert(LDAPStats *s, int res_type,
+                              LDAPStatsCount convert_ns);
+extern PyObject *LDAPstats_to_python(LDAPStats *s);
+
+#define LDAPstats_request(s, op)        ((s)->ops[op].requests++)
+
+#endif /* __h_stats */
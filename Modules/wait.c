@@ -0,0 +1,156 @@
+/* See https://www.python-ldap.org/ for details. */
+
+#include "common.h"
+#include "wait.h"
+#include "flow.h"
+
+#if !defined(MS_WINDOWS)
+#include <poll.h>
+#endif
+
+/*
+ * Waiting for results while other threads use the same connection.
+ *
+ * ldap_result() holds a mutex of the LDAP handle for as long as it
+ * waits, so a thread waiting for a slow search would hold up the calls
+ * of all other threads on the connection, even those whose results
+ * have arrived already. Instead, ldap_result() is only called with a
+ * zero timeout while holding the lock of the connection. In between,
+ * the socket is waited for without the lock, for at most one slice at a
+ * time, so that messages which another thread has read and queued are
+ * noticed one slice later at the latest.
+ *
+ * While flow controlled searches are above their high-water marks, the
+ * socket must not be read. Waits for single messages are then held up
+ * until another thread has consumed the messages held back, checking
+ * once per slice, or until the timeout has passed.
+ *
+ * Everything here is called without the GIL.
+ */
+
+/* longest wait for the socket without looking at libldap's queue */
+#define LDAP_WAIT_SLICE_MS      50
+
+/* zero timeout for reading messages which have arrived already */
+static struct timeval tv_poll = { 0, 0 };
+
+/* Reads a result like ldap_result(), called with the lock of l */
+static int
+read_result(LDAPObject *l, int msgid, int all, struct timeval *timeout,
+            LDAPMessage **msg)
+{
+    if (all == LDAP_MSG_ONE)
+        return LDAPflow_result(&l->flow, l->ldap, msgid, timeout, msg);
+    return ldap_result(l->ldap, msgid, all, timeout, msg);
+}
+
+/* Sleeps for ms milliseconds */
+static void
+wait_slice(int ms)
+{
+#if defined(MS_WINDOWS)
+    Sleep(ms);
+#else
+    poll(NULL, 0, ms);
+#endif
+}
+
+/* Waits at most ms milliseconds for fd to become readable */
+static void
+wait_readable(ber_socket_t fd, int ms)
+{
+#if defined(MS_WINDOWS)
+    fd_set readfds;
+    struct timeval tv;
+
+    FD_ZERO(&readfds);
+    FD_SET(fd, &readfds);
+    tv.tv_sec = 0;
+    tv.tv_usec = ms * 1000;
+    select((int)fd + 1, &readfds, NULL, NULL, &tv);
+#else
+    struct pollfd pfd;
+
+    pfd.fd = fd;
+    pfd.events = POLLIN;
+    pfd.revents = 0;
+    poll(&pfd, 1, ms);
+#endif
+}
+
+/*
+ * Like ldap_result(), or LDAPflow_result() for LDAP_MSG_ONE, for
+ * connection l, but without holding its lock while waiting. timeout is
+ * NULL to wait indefinitely. Returns LDAP_WAIT_CLOSED if l has been
+ * unbound by another thread and never LDAP_FLOW_STALLED: a stalled wait
+ * returns 0 if timeout passes first. On -1 the error of l is saved in
+ * err before another thread can overwrite it.
+ */
+int
+LDAPwait_result(LDAPObject *l, int msgid, int all, struct timeval *timeout,
+                LDAPMessage **msg, LDAPErrorState *err)
+{
+    LDAPStatsCount deadline = 0, now;
+    struct timeval tv;
+    ber_socket_t fd;
+    int res, ms, stalled = 0;
+
+    if (timeout != NULL) {
+        deadline = LDAPstats_now() +
+            (LDAPStatsCount)timeout->tv_sec * 1000000000 +
+            (LDAPStatsCount)timeout->tv_usec * 1000;
+    }
+
+    for (;;) {
+        fd = -1;
+        LDAPlock_nogil(l);
+        if (!l->valid) {
+            LDAPunlock(l);
+            return LDAP_WAIT_CLOSED;
+        }
+        res = read_result(l, msgid, all, &tv_poll, msg);
+        if (res == -1)
+            LDAPerror_save(l->ldap, err);
+        else if (res == 0)
+            ldap_get_option(l->ldap, LDAP_OPT_DESC, &fd);
+        else if (res == LDAP_FLOW_STALLED && !stalled) {
+            LDAPflow_count_stall(&l->flow);
+            stalled = 1;
+        }
+        LDAPunlock(l);
+        if (res != 0 && res != LDAP_FLOW_STALLED)
+            return res;
+
+        ms = LDAP_WAIT_SLICE_MS;
+        if (timeout != NULL) {
+            now = LDAPstats_now();
+            if (now >= deadline)
+                return 0;
+            if (deadline - now < (LDAPStatsCount)ms * 1000000)
+                ms = (int)((deadline - now + 999999) / 1000000);
+        }
+
+        if (res == LDAP_FLOW_STALLED) {
+            wait_slice(ms);
+            continue;
+        }
+        if (fd >= 0) {
+            wait_readable(fd, ms);
+            continue;
+        }
+
+        /* not connected yet, which ldap_result() does while waiting */
+        tv.tv_sec = 0;
+        tv.tv_usec = ms * 1000;
+        LDAPlock_nogil(l);
+        if (l->valid)
+            res = read_result(l, msgid, all, &tv, msg);
+        else
+            res = LDAP_WAIT_CLOSED;
+        if (res == -1)
+            LDAPerror_save(l->ldap, err);
+        LDAPunlock(l);
+        if (res != 0 && res != LDAP_FLOW_STALLED)
+            return res;
+    }
+}
@@ -0,0 +1,17 @@
+/* See https://www.python-ldap.org/ for details. */
+
+#ifndef __h_wait
+#define __h_wait
+
+#include "common.h"
+#include "constants.h"
+#include "LDAPObject.h"
+
+/* returned by LDAPwait_result() if the connection has been unbound */
+#define LDAP_WAIT_CLOSED        (-3)
+
+extern int LDAPwait_result(LDAPObject *l, int msgid, int all,
+                           struct timeval *timeout, LDAPMessage **msg,
+                           LDAPErrorState *err);
+
+#endif /* __h_wait */
@@ -7,6 +7,9 @@ import contextlib
 import errno
 import os
 import socket
+import sys
+import threading
+import time
 import unittest
 
 # Switch off processing .ldaprc or ldap.conf before importing _ldap
@@ -338,6 +341,232 @@ class TestLdapCExtension(SlapdTestCase):
         self.assertEqual(msgid, m)
         self.assertEqual(ctrls, [])
 
+    def test_result_batch(self):
+        l = self._open_conn()
+        m = l.search_ext(self.server.suffix, _ldap.SCOPE_SUBTREE, '(objectClass=*)')
+        results = []
+        while not results or results[-1][0] != _ldap.RES_SEARCH_RESULT:
+            batch = l.result_batch(m, 2, self.timeout)
+            self.assertTrue(1 <= len(batch) <= 2)
+            results.extend(batch)
+        self.assertTrue(len(results) >= 3)
+        for result, pmsg, msgid, ctrls in results[:-1]:
+            self.assertEqual(result, _ldap.RES_SEARCH_ENTRY)
+            self.assertEqual(len(pmsg), 1)
+            self.assertEqual(msgid, m)
+            self.assertEqual(ctrls, [])
+        self.assertEqual(results[-1], (_ldap.RES_SEARCH_RESULT, [], m, []))
+        with self.assertRaises(ValueError):
+            l.result_batch(m, 0, self.timeout)
+
+    def test_result_batch_error_held_back(self):
+        l = self._open_conn()
+        m = l.search_ext(
+            self.server.suffix, _ldap.SCOPE_SUBTREE, '(objectClass=*)',
+            None, 0, None, None, -1, 1
+        )
+        entries = []
+        with self.assertRaises(_ldap.SIZELIMIT_EXCEEDED):
+            while True:
+                entries.extend(l.result_batch(m, 10, self.timeout))
+        # the entry received before the error is not lost
+        self.assertEqual(len(entries), 1)
+        self.assertEqual(entries[0][0], _ldap.RES_SEARCH_ENTRY)
+
+    def test_result_batch_errors_held_back(self):
+        # two searches on one connection both ending in an error
+        l = self._open_conn()
+        ids = [
+            l.search_ext(
+                self.server.suffix, _ldap.SCOPE_SUBTREE, '(objectClass=*)',
+                None, 0, None, None, -1, 1
+            )
+            for _ in range(2)
+        ]
+        # let both complete, so that each batch ends with the error
+        time.sleep(0.5)
+        for m in ids:
+            batch = l.result_batch(m, 10, self.timeout)
+            self.assertEqual(
+                [(result, msgid) for result, _, msgid, _ in batch],
+                [(_ldap.RES_SEARCH_ENTRY, m)]
+            )
+        for m in ids:
+            with self.assertRaises(_ldap.SIZELIMIT_EXCEEDED) as cm:
+                l.result_batch(m, 10, self.timeout)
+            self.assertEqual(cm.exception.args[0]['msgid'], m)
+
+    def test_flow_control(self):
+        l = self._open_conn()
+        m = l.search_ext(self.server.suffix, _ldap.SCOPE_SUBTREE, '(objectClass=*)')
+        expected = sorted(l.result4(m, _ldap.MSG_ALL, self.timeout)[1])
+        ma = l.search_ext(self.server.suffix, _ldap.SCOPE_SUBTREE, '(objectClass=*)')
+        l.set_flow_control(ma, 2)
+        self.assertEqual(l.flow_control(ma)['max_entries'], 2)
+        with self.assertRaises(ValueError):
+            l.result4(ma, _ldap.MSG_ALL, self.timeout)
+        # reading another search moves the messages of ma arriving
+        # meanwhile into its queue, up to the high-water mark
+        mb = l.search_ext(self.server.suffix, _ldap.SCOPE_BASE, '(objectClass=*)')
+        mb_types = []
+        try:
+            # held up until the timeout while ma is above its mark
+            while _ldap.RES_SEARCH_RESULT not in mb_types:
+                mb_types.append(l.result4(mb, _ldap.MSG_ONE, 0.5)[0])
+        except _ldap.TIMEOUT:
+            info = l.flow_control(ma)
+            self.assertEqual(info['entries'], 2)
+            self.assertEqual(info['stalls'], 1)
+        self.assertLessEqual(l.flow_control(ma)['peak_entries'], 2)
+        results = []
+        while not results or results[-1][0] != _ldap.RES_SEARCH_RESULT:
+            batch = l.result_batch(ma, 100, self.timeout)
+            self.assertTrue(1 <= len(batch) <= 2)
+            results.extend(batch)
+        self.assertEqual(sorted(r[1][0] for r in results[:-1]), expected)
+        # flow control ends with the final result
+        self.assertIsNone(l.flow_control(ma))
+        while _ldap.RES_SEARCH_RESULT not in mb_types:
+            mb_types.append(l.result4(mb, _ldap.MSG_ONE, self.timeout)[0])
+        # and when the search is abandoned
+        mc = l.search_ext(self.server.suffix, _ldap.SCOPE_SUBTREE, '(objectClass=*)')
+        l.set_flow_control(mc, 0, 1)
+        l.abandon_ext(mc)
+        self.assertIsNone(l.flow_control(mc))
+        with self.assertRaises(ValueError):
+            l.set_flow_control(mc, -1)
+
+    def test_flow_control_blocking_wait(self):
+        l = self._open_conn()
+        ma = l.search_ext(self.server.suffix, _ldap.SCOPE_SUBTREE, '(objectClass=*)')
+        l.set_flow_control(ma, 2)
+        mb = l.search_ext(self.server.suffix, _ldap.SCOPE_BASE, '(objectClass=*)')
+        mb_types = []
+        # poll mb until ma's messages read meanwhile reach the mark
+        deadline = time.monotonic() + self.timeout
+        while (_ldap.RES_SEARCH_RESULT not in mb_types and
+               l.flow_control(ma)['entries'] < 2 and
+               time.monotonic() < deadline):
+            res_type = l.result4(mb, _ldap.MSG_ONE, 0)[0]
+            if res_type is not None:
+                mb_types.append(res_type)
+        if _ldap.RES_SEARCH_RESULT in mb_types:
+            self.skipTest('search results did not arrive interleaved')
+        self.assertEqual(l.flow_control(ma)['entries'], 2)
+        # synchronous calls are not held up by the marks
+        self.assertIsInstance(l.whoami_s(), str)
+        # a blocking read waits until the messages of ma are consumed
+        def read_mb():
+            while _ldap.RES_SEARCH_RESULT not in mb_types:
+                mb_types.append(l.result4(mb, _ldap.MSG_ONE, -1)[0])
+        thread = threading.Thread(target=read_mb)
+        thread.start()
+        time.sleep(0.2)
+        self.assertTrue(thread.is_alive())
+        results = []
+        while not results or results[-1][0] != _ldap.RES_SEARCH_RESULT:
+            results.extend(l.result_batch(ma, 100, self.timeout))
+        thread.join(self.timeout)
+        self.assertFalse(thread.is_alive())
+        self.assertIn(_ldap.RES_SEARCH_RESULT, mb_types)
+
+    def test_search_concurrent_connections(self):
+        def search(l):
+            m = l.search_ext(
+                self.server.suffix, _ldap.SCOPE_SUBTREE, '(objectClass=*)'
+            )
+            return sorted(l.result4(m, _ldap.MSG_ALL, self.timeout)[1])
+
+        expected = search(self._open_conn())
+        conns = [self._open_conn() for _ in range(4)]
+        results = [None] * len(conns)
+
+        def worker(i):
+            for _ in range(10):
+                results[i] = search(conns[i])
+
+        threads = [
+            threading.Thread(target=worker, args=(i,))
+            for i in range(len(conns))
+        ]
+        for thread in threads:
+            thread.start()
+        for thread in threads:
+            thread.join()
+        self.assertEqual(results, [expected] * len(conns))
+
+    @unittest.skipUnless(_ldap.LIBLDAP_R, "needs a thread-safe libldap")
+    def test_errors_of_concurrent_calls(self):
+        # the error of a call is not replaced by the success of another one
+        l = self._open_conn()
+        errors = []
+
+        def search():
+            for _ in range(200):
+                l.search_ext(
+                    self.server.suffix, _ldap.SCOPE_BASE, '(objectClass=*)'
+                )
+
+        thread = threading.Thread(target=search)
+        thread.start()
+        try:
+            for _ in range(200):
+                try:
+                    l.search_ext(
+                        self.server.suffix, _ldap.SCOPE_SUBTREE,
+                        'bogus filter expr'
+                    )
+                except _ldap.LDAPError as e:
+                    errors.append(type(e))
+        finally:
+            thread.join()
+        self.assertEqual(errors, [_ldap.FILTER_ERROR] * 200)
+
+    def test_paged_search_ext(self):
+        l = self._open_conn()
+        m = l.search_ext(self.server.suffix, _ldap.SCOPE_SUBTREE, '(objectClass=*)')
+        expected = l.result4(m, _ldap.MSG_ALL, self.timeout)[1]
+        self.assertTrue(len(expected) >= 3)
+        pages = l.paged_search_ext(
+            self.server.suffix, _ldap.SCOPE_SUBTREE, '(objectClass=*)', 2,
+            None, 0, None, self.timeout
+        )
+        results = []
+        while True:
+            page = pages.next_page()
+            if page is None:
+                break
+            self.assertTrue(len(page) <= 2)
+            results.extend(page)
+        self.assertEqual(sorted(results), sorted(expected))
+        self.assertIsNone(pages.next_page())
+        with self.assertRaises(ValueError):
+            l.paged_search_ext(
+                self.server.suffix, _ldap.SCOPE_SUBTREE, '(objectClass=*)', 0
+            )
+
+    def test_paged_search_ext_abandon(self):
+        l = self._open_conn()
+        pages = l.paged_search_ext(
+            self.server.suffix, _ldap.SCOPE_SUBTREE, '(objectClass=*)', 1
+        )
+        self.assertEqual(len(pages.next_page()), 1)
+        pages.abandon()
+        self.assertIsNone(pages.next_page())
+        # the connection is still usable
+        m = l.search_ext(self.server.suffix, _ldap.SCOPE_BASE, '(objectClass=*)')
+        self.assertEqual(len(l.result4(m, _ldap.MSG_ALL, self.timeout)[1]), 1)
+
+    def test_paged_search_ext_error(self):
+        l = self._open_conn()
+        pages = l.paged_search_ext(
+            'cn=nothere,' + self.server.suffix, _ldap.SCOPE_SUBTREE,
+            '(objectClass=*)', 10
+        )
+        with self.assertRaises(_ldap.NO_SUCH_OBJECT):
+            pages.next_page()
+        self.assertIsNone(pages.next_page())
+
     def test_abandon(self):
         l = self._open_conn()
         m = l.search_ext(self.server.suffix, _ldap.SCOPE_SUBTREE, '(objectClass=*)')
@@ -362,6 +591,121 @@ class TestLdapCExtension(SlapdTestCase):
         self.assertEqual(msgid, m)
         self.assertEqual(ctrls, [])
 
+    def test_search_attr_names_shared(self):
+        l = self._open_conn()
+        m = l.search_ext(self.server.suffix, _ldap.SCOPE_SUBTREE, '(objectClass=*)')
+        result, pmsg, msgid, ctrls = l.result4(m, _ldap.MSG_ALL, self.timeout)
+        self.assertTrue(len(pmsg) >= 2)
+        keys = [
+            key
+            for dn, attrs in pmsg
+            for key in attrs
+            if key == 'objectClass'
+        ]
+        self.assertEqual(len(keys), len(pmsg))
+        # one interned str object per attribute name and connection
+        for key in keys:
+            self.assertIs(key, sys.intern('objectClass'))
+
+    def test_search_ext_all_lazy(self):
+        l = self._open_conn()
+        m = l.search_ext(self.server.suffix, _ldap.SCOPE_SUBTREE, '(objectClass=*)')
+        result, pmsg, msgid, ctrls = l.result4(
+            m, _ldap.MSG_ALL, self.timeout, 0, 0, 0, 1
+        )
+        self.assertEqual(result, _ldap.RES_SEARCH_RESULT)
+        self.assertEqual(msgid, m)
+        self.assertEqual(ctrls, [])
+        self.assertFalse(isinstance(pmsg, list))
+        self.assertIs(iter(pmsg), pmsg)
+        entries = list(pmsg)
+        self.assertTrue(len(entries) >= 2)
+        dns = [dn for dn, attrs in entries]
+        self.assertIn(self.server.suffix, dns)
+        for dn, attrs in entries:
+            self.assertIsInstance(dn, str)
+            self.assertIn('objectClass', attrs)
+        # exhausted iterator stays exhausted
+        self.assertEqual(list(pmsg), [])
+
+    def test_search_ext_lazy_after_unbind(self):
+        l = self._open_conn()
+        m = l.search_ext(self.server.suffix, _ldap.SCOPE_SUBTREE, '(objectClass=*)')
+        result, pmsg, msgid, ctrls = l.result4(
+            m, _ldap.MSG_ALL, self.timeout, 0, 0, 0, 1
+        )
+        l.unbind_ext()
+        with self.assertRaises(_ldap.LDAPError):
+            next(pmsg)
+
+    def test_search_ext_all_zero_copy(self):
+        l = self._open_conn()
+        m = l.search_ext(self.server.suffix, _ldap.SCOPE_SUBTREE, '(objectClass=*)')
+        result, expected, msgid, ctrls = l.result4(m, _ldap.MSG_ALL, self.timeout)
+        m = l.search_ext(self.server.suffix, _ldap.SCOPE_SUBTREE, '(objectClass=*)')
+        result, pmsg, msgid, ctrls = l.result4(
+            m, _ldap.MSG_ALL, self.timeout, 0, 0, 0, 0, 1
+        )
+        self.assertEqual(result, _ldap.RES_SEARCH_RESULT)
+        self.assertEqual(len(pmsg), len(expected))
+        for (dn, attrs), (edn, eattrs) in zip(sorted(pmsg), sorted(expected)):
+            self.assertEqual(dn, edn)
+            self.assertEqual(sorted(attrs), sorted(eattrs))
+            for attr, values in attrs.items():
+                for value, evalue in zip(values, eattrs[attr]):
+                    self.assertNotIsInstance(value, bytes)
+                    self.assertEqual(value, evalue)
+                    self.assertEqual(bytes(value), evalue)
+                    self.assertEqual(len(value), len(evalue))
+                    view = memoryview(value)
+                    self.assertTrue(view.readonly)
+                    self.assertEqual(view.tobytes(), evalue)
+        # views keep the message alive after the connection is gone
+        value = pmsg[0][1]['objectClass'][0]
+        del pmsg
+        l.unbind_ext()
+        self.assertEqual(bytes(value), bytes(memoryview(value)))
+        with self.assertRaises(TypeError):
+            hash(value)
+
+    def test_search_ext_lazy_zero_copy(self):
+        l = self._open_conn()
+        m = l.search_ext(self.server.suffix, _ldap.SCOPE_SUBTREE, '(objectClass=*)')
+        result, pmsg, msgid, ctrls = l.result4(
+            m, _ldap.MSG_ALL, self.timeout, 0, 0, 0, 1, 1
+        )
+        values = [
+            value
+            for dn, attrs in pmsg
+            for value in attrs['objectClass']
+        ]
+        self.assertTrue(values)
+        for value in values:
+            self.assertEqual(value, bytes(value))
+
+    def test_search_ext_cidict(self):
+        l = self._open_conn()
+        m = l.search_ext(self.server.suffix, _ldap.SCOPE_SUBTREE, '(objectClass=*)')
+        result, expected, msgid, ctrls = l.result4(m, _ldap.MSG_ALL, self.timeout)
+        m = l.search_ext(self.server.suffix, _ldap.SCOPE_SUBTREE, '(objectClass=*)')
+        result, pmsg, msgid, ctrls = l.result4(
+            m, _ldap.MSG_ALL, self.timeout, 0, 0, 0, 0, 0, 1
+        )
+        self.assertEqual(result, _ldap.RES_SEARCH_RESULT)
+        self.assertEqual(sorted(pmsg), sorted(expected))
+        for dn, attrs in pmsg:
+            self.assertIsInstance(attrs, _ldap.CIDict)
+            self.assertEqual(attrs['OBJECTCLASS'], attrs['objectClass'])
+            self.assertIn('objectclass', attrs)
+        # lazy iterator
+        m = l.search_ext(self.server.suffix, _ldap.SCOPE_SUBTREE, '(objectClass=*)')
+        result, pmsg, msgid, ctrls = l.result4(
+            m, _ldap.MSG_ALL, self.timeout, 0, 0, 0, 1, 0, 1
+        )
+        for dn, attrs in pmsg:
+            self.assertIsInstance(attrs, _ldap.CIDict)
+            self.assertIn('objectclass', attrs)
+
     def test_invalid_search_filter(self):
         l = self._open_conn()
         with self.assertRaises(_ldap.FILTER_ERROR):
@@ -493,6 +837,72 @@ class TestLdapCExtension(SlapdTestCase):
         self.assertEqual(pmsg, [])
         self.assertEqual(ctrls, [])
 
+    def test_submit_batch(self):
+        l = self._open_conn()
+        dns = ['cn=Batch{},{}'.format(i, self.writesuffix) for i in range(10)]
+        ops = [
+            (_ldap.REQ_ADD, dn, [
+                ('objectClass', b'organizationalRole'),
+                ('cn', dn[3:].split(',')[0].encode()),
+            ])
+            for dn in dns
+        ]
+        msgids = l.submit_batch(ops)
+        self.assertEqual(len(msgids), len(ops))
+        for msgid in msgids:
+            self.assertIsInstance(msgid, int)
+        results = l.collect_batch(msgids, self.timeout)
+        self.assertEqual(
+            results, [(_ldap.RES_ADD, [], m, []) for m in msgids]
+        )
+        # the server may process the operations of a batch in any order
+        msgids = l.submit_batch([
+            ops[0],
+            (_ldap.REQ_MODIFY, dns[1],
+             [(_ldap.MOD_ADD, 'description', b'testing')], None),
+        ])
+        results = l.collect_batch(msgids, self.timeout)
+        self.assertIsInstance(results[0], _ldap.ALREADY_EXISTS)
+        self.assertEqual(results[0].args[0]['msgid'], msgids[0])
+        self.assertEqual(results[1], (_ldap.RES_MODIFY, [], msgids[1], []))
+        msgids = l.submit_batch([(_ldap.REQ_DELETE, dn, None) for dn in dns])
+        results = l.collect_batch(msgids, self.timeout)
+        self.assertEqual(
+            results, [(_ldap.RES_DELETE, [], m, []) for m in msgids]
+        )
+
+    def test_submit_batch_invalid(self):
+        l = self._open_conn()
+        self.assertEqual(l.submit_batch([]), [])
+        self.assertEqual(l.collect_batch([]), [])
+        with self.assertRaises(ValueError):
+            l.submit_batch([(_ldap.REQ_COMPARE, self.writesuffix, None)])
+        with self.assertRaises(TypeError):
+            l.submit_batch([(_ldap.REQ_ADD, self.writesuffix, None)])
+        with self.assertRaises(ValueError):
+            l.collect_batch([0])
+        # anything but a msgid is passed through unchanged
+        self.assertEqual(l.collect_batch([None]), [None])
+
+    def test_collect_batch_timeout(self):
+        l = self._open_conn()
+        # the result of an abandoned operation never arrives
+        m = l.search_ext(self.server.suffix, _ldap.SCOPE_SUBTREE, '(objectClass=*)')
+        l.abandon_ext(m)
+        results = l.collect_batch([m], 0.1)
+        self.assertIsInstance(results[0], _ldap.TIMEOUT)
+        # the timeout is a deadline for the whole batch
+        msgids = []
+        for i in range(10):
+            m = l.search_ext(self.server.suffix, _ldap.SCOPE_SUBTREE, '(objectClass=*)')
+            l.abandon_ext(m)
+            msgids.append(m)
+        start = time.monotonic()
+        results = l.collect_batch(msgids, 0.2)
+        self.assertLess(time.monotonic() - start, 1.0)
+        for res in results:
+            self.assertIsInstance(res, _ldap.TIMEOUT)
+
     def test_modify_no_such_object(self):
         l = self._open_conn()
 
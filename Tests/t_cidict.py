@@ -5,6 +5,7 @@ See https://www.python-ldap.org/ for details.
 """
 
 import os
+import threading
 import unittest
 import warnings
 
@@ -85,5 +86,89 @@ class TestCidict(unittest.TestCase):
         self.assertEqual(list(cix2.keys()), ["a", "B", "C"])
 
 
+class TestCIDict(unittest.TestCase):
+    """
+    test ldap.cidict.CIDict implemented in the C extension module
+    """
+
+    def test_lookup(self):
+        cix = ldap.cidict.CIDict({'AbCDeF': 123})
+        self.assertIsInstance(cix, dict)
+        self.assertEqual(cix['ABCDEF'], 123)
+        self.assertEqual(cix.get('abcdef'), 123)
+        self.assertIsNone(cix.get('not existent'))
+        self.assertEqual(cix.get('not existent', 1), 1)
+        self.assertIn('abcdef', cix)
+        self.assertTrue(cix.has_key('ABCDEF'))
+        self.assertNotIn('abc', cix)
+        with self.assertRaises(KeyError):
+            cix['abc']
+        self.assertEqual(list(cix), ['AbCDeF'])
+        self.assertEqual(cix, {'AbCDeF': 123})
+        self.assertEqual(dict(cix), {'AbCDeF': 123})
+
+    def test_modify(self):
+        cix = ldap.cidict.CIDict(a=1)
+        cix['xYZ'] = 987
+        cix['XYZ'] = 988
+        self.assertEqual(len(cix), 2)
+        self.assertEqual(sorted(cix.items()), [('XYZ', 988), ('a', 1)])
+        cix.update([('A', 2)], b=3)
+        self.assertEqual(sorted(cix), ['A', 'XYZ', 'b'])
+        del cix['xyz']
+        self.assertNotIn('xyz', cix)
+        with self.assertRaises(KeyError):
+            del cix['xyz']
+        self.assertEqual(cix.pop('B'), 3)
+        self.assertIsNone(cix.pop('B', None))
+        self.assertEqual(cix.setdefault('a', 5), 2)
+        self.assertEqual(cix.setdefault('C', 5), 5)
+        self.assertEqual(cix['c'], 5)
+        key, value = cix.popitem()
+        self.assertNotIn(key, cix)
+        cix.clear()
+        self.assertEqual(len(cix), 0)
+        self.assertNotIn('a', cix)
+
+    def test_copy(self):
+        cix1 = ldap.cidict.CIDict({'a': 1, 'B': 2})
+        cix2 = cix1.copy()
+        self.assertIsInstance(cix2, ldap.cidict.CIDict)
+        self.assertEqual(cix1, cix2)
+        cix1['c'] = 3
+        self.assertNotIn('C', cix2)
+        self.assertEqual(cix2['b'], 2)
+        self.assertEqual(ldap.cidict.cidict(cix1)['C'], 3)
+
+    def test_threads(self):
+        cix = ldap.cidict.CIDict()
+        errors = []
+
+        def modify(n):
+            try:
+                for i in range(500):
+                    key = 'Attr%d' % (i % 10)
+                    cix[key.upper() if n % 2 else key] = n
+                    cix.get(key.lower())
+                    cix.pop(key, None)
+                    cix.setdefault(key, n)
+            except Exception as e:
+                errors.append(e)
+
+        threads = [threading.Thread(target=modify, args=(n,))
+                   for n in range(4)]
+        for thread in threads:
+            thread.start()
+        for thread in threads:
+            thread.join()
+        self.assertEqual(errors, [])
+        # the keys and their lower-cased forms have been kept in sync
+        self.assertEqual(len(cix), 10)
+        for i in range(10):
+            self.assertIn('ATTR%d' % i, cix)
+            del cix['attr%d' % i]
+        self.assertEqual(len(cix), 0)
+
+
 if __name__ == '__main__':
     unittest.main()
@@ -0,0 +1,181 @@
+"""
+Automatic tests for python-ldap's module ldap.aio
+
+See https://www.python-ldap.org/ for details.
+"""
+import asyncio
+import os
+import unittest
+
+# Switch off processing .ldaprc or ldap.conf before importing _ldap
+os.environ['LDAPNOINIT'] = '1'
+
+import ldap
+from ldap.aio import AIOLDAPObject
+
+from slapdtest import SlapdTestCase
+
+
+LDIF_TEMPLATE = """dn: %(suffix)s
+objectClass: dcObject
+objectClass: organization
+dc: %(dc)s
+o: %(dc)s
+
+dn: %(rootdn)s
+objectClass: applicationProcess
+objectClass: simpleSecurityObject
+cn: %(rootcn)s
+userPassword: %(rootpw)s
+
+"""
+
+NUM_ENTRIES = 50
+
+
+class TestAIOLDAPObject(SlapdTestCase):
+
+    @classmethod
+    def setUpClass(cls):
+        super().setUpClass()
+        ldif = [
+            LDIF_TEMPLATE % {
+                'suffix': cls.server.suffix,
+                'rootdn': cls.server.root_dn,
+                'rootcn': cls.server.root_cn,
+                'rootpw': cls.server.root_pw,
+                'dc': cls.server.suffix.split(',')[0][3:],
+            }
+        ]
+        for i in range(NUM_ENTRIES):
+            ldif.append(
+                'dn: cn=Foo{i},{suffix}\n'
+                'objectClass: organizationalRole\n'
+                'cn: Foo{i}\n\n'.format(i=i, suffix=cls.server.suffix)
+            )
+        cls.server.ldapadd(''.join(ldif))
+
+    def setUp(self):
+        self.loop = asyncio.new_event_loop()
+        asyncio.set_event_loop(self.loop)
+        self.addCleanup(asyncio.set_event_loop, None)
+        self.addCleanup(self.loop.close)
+
+    def run_async(self, coro):
+        return self.loop.run_until_complete(asyncio.wait_for(coro, 10))
+
+    async def _open_conn(self):
+        conn = AIOLDAPObject(self.server.ldap_uri)
+        await conn.simple_bind(self.server.root_dn, self.server.root_pw)
+        return conn
+
+    def test_search(self):
+        async def search():
+            async with await self._open_conn() as conn:
+                return await conn.search(
+                    self.server.suffix, ldap.SCOPE_ONELEVEL, '(cn=Foo*)',
+                    ['cn']
+                )
+
+        result = self.run_async(search())
+        self.assertEqual(len(result), NUM_ENTRIES)
+        for dn, entry in result:
+            self.assertEqual(
+                dn, 'cn={},{}'.format(entry['cn'][0].decode(), self.server.suffix)
+            )
+
+    def test_created_outside_loop(self):
+        # the event loop is looked up by the first operation
+        asyncio.set_event_loop(None)
+        conn = AIOLDAPObject(self.server.ldap_uri)
+
+        async def bind():
+            try:
+                return await conn.simple_bind(
+                    self.server.root_dn, self.server.root_pw
+                )
+            finally:
+                conn.unbind()
+
+        res_type = self.run_async(bind())[0]
+        self.assertEqual(res_type, ldap.RES_BIND)
+
+    def test_concurrent_searches(self):
+        async def search(conn, i):
+            return await conn.search(
+                self.server.suffix, ldap.SCOPE_ONELEVEL,
+                '(cn=Foo{})'.format(i), ['cn']
+            )
+
+        async def searches():
+            async with await self._open_conn() as conn:
+                return await asyncio.gather(
+                    *[search(conn, i) for i in range(NUM_ENTRIES)]
+                )
+
+        results = self.run_async(searches())
+        for i, result in enumerate(results):
+            self.assertEqual(
+                result,
+                [('cn=Foo{},{}'.format(i, self.server.suffix),
+                  {'cn': ['Foo{}'.format(i).encode()]})]
+            )
+
+    def test_search_iter_close(self):
+        async def first():
+            async with await self._open_conn() as conn:
+                results = conn.search_iter(
+                    self.server.suffix, ldap.SCOPE_SUBTREE, '(objectClass=*)'
+                )
+                async for dn, entry in results:
+                    break
+                await results.aclose()
+                # connection is still usable after abandoning the search
+                return dn, await conn.compare(
+                    self.server.suffix, 'objectClass', b'organization'
+                )
+
+        dn, equal = self.run_async(first())
+        self.assertIsInstance(dn, str)
+        self.assertTrue(equal)
+
+    def test_errors(self):
+        async def errors():
+            async with await self._open_conn() as conn:
+                with self.assertRaises(ldap.NO_SUCH_OBJECT):
+                    await conn.search(
+                        'cn=nothere,' + self.server.suffix, ldap.SCOPE_BASE
+                    )
+                with self.assertRaises(ldap.SIZELIMIT_EXCEEDED):
+                    await conn.search(
+                        self.server.suffix, ldap.SCOPE_SUBTREE,
+                        sizelimit=1
+                    )
+                self.assertFalse(await conn.compare(
+                    self.server.suffix, 'objectClass', b'person'
+                ))
+
+        self.run_async(errors())
+
+    def test_add_modify_delete(self):
+        dn = 'cn=Bar,' + self.server.suffix
+
+        async def write():
+            async with await self._open_conn() as conn:
+                await conn.add(dn, [
+                    ('objectClass', [b'organizationalRole']),
+                    ('cn', [b'Bar']),
+                ])
+                await conn.modify(
+                    dn, [(ldap.MOD_ADD, 'description', [b'some text'])]
+                )
+                entry = await conn.search(dn, ldap.SCOPE_BASE)
+                await conn.delete(dn)
+                return entry
+
+        entry = self.run_async(write())
+        self.assertEqual(entry[0][1]['description'], [b'some text'])
+
+
+if __name__ == '__main__':
+    unittest.main()
@@ -0,0 +1,59 @@
+import os
+import unittest
+
+# Switch off processing .ldaprc or ldap.conf before importing _ldap
+os.environ['LDAPNOINIT'] = '1'
+
+import ldap
+from ldap.controls import DecodeControlTuples
+from ldap.controls import deref
+
+
+DEREF_SPECS = {'member': ['uid', 'cn']}
+DEREF_REQ = b'0\x150\x13\x04\x06member0\t\x04\x03uid\x04\x02cn'
+DEREF_RES = (
+    b'070#\x04\x06member\x04\x06cn=one\xa0\x110\x0f\x04\x03uid'
+    b'1\x08\x04\x03one\x04\x01x0\x10\x04\x06member\x04\x06cn=two'
+)
+# last DerefRes lacks derefVal
+DEREF_RES_INVALID = (
+    b'0A0#\x04\x06member\x04\x06cn=one\xa0\x110\x0f\x04\x03uid'
+    b'1\x08\x04\x03one\x04\x01x0\x10\x04\x06member\x04\x06cn=two'
+    b'0\x08\x04\x06member'
+)
+
+
+class TestControlsDeref(unittest.TestCase):
+    def test_deref_encode(self):
+        dc = deref.DereferenceControl(True, DEREF_SPECS)
+        self.assertEqual(dc.encodeControlValue(), DEREF_REQ)
+
+    def test_deref_decode(self):
+        dc = deref.DereferenceControl()
+        dc.decodeControlValue(DEREF_RES)
+        self.assertEqual(dc.derefRes, {
+            'member': [
+                ('cn=one', {'uid': ['one', 'x']}),
+                ('cn=two', {}),
+            ],
+        })
+        with self.assertRaises(ldap.DECODING_ERROR):
+            dc.decodeControlValue(DEREF_RES_INVALID)
+
+    def test_decode_control_tuples(self):
+        ctrls = DecodeControlTuples([
+            (deref.DEREF_CONTROL_OID, False, DEREF_RES),
+            # invalid value of a non-critical control is ignored
+            (deref.DEREF_CONTROL_OID, False, DEREF_RES_INVALID),
+        ])
+        self.assertEqual(len(ctrls), 1)
+        self.assertIsInstance(ctrls[0], deref.DereferenceControl)
+        self.assertEqual(len(ctrls[0].derefRes['member']), 2)
+        with self.assertRaises(ldap.DECODING_ERROR):
+            DecodeControlTuples([
+                (deref.DEREF_CONTROL_OID, True, DEREF_RES_INVALID),
+            ])
+
+
+if __name__ == '__main__':
+    unittest.main()
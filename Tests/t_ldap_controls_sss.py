@@ -12,6 +12,25 @@ class TestControlsPPolicy(unittest.TestCase):
         control = sss.SSSRequestControl(ordering_rules=['-uidNumber'])
         self.assertEqual(control.ordering_rules, ['-uidNumber'])
 
+    def test_encode_sss_request_control(self):
+        control = sss.SSSRequestControl(
+            ordering_rules=['cn', '-uid:caseIgnoreOrderingMatch']
+        )
+        self.assertEqual(
+            control.encodeControlValue(),
+            b'0)0\x04\x04\x02cn0!\x04\x03uid'
+            b'\x80\x17caseIgnoreOrderingMatch\x81\x01\xff'
+        )
+
+    def test_decode_sss_response_control(self):
+        control = sss.SSSResponseControl()
+        control.decodeControlValue(b'0\x07\n\x01\x10\x80\x02cn')
+        self.assertEqual(control.sortResult, 16)
+        self.assertEqual(control.attributeType, 'cn')
+        control.decodeControlValue(b'0\x03\n\x01\x00')
+        self.assertEqual(control.result, 0)
+        self.assertIsNone(control.attribute_type_error)
+
 
 if __name__ == '__main__':
     unittest.main()
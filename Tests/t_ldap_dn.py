@@ -5,6 +5,7 @@ See https://www.python-ldap.org/ for details.
 """
 # from Python's standard lib
 import os
+import threading
 import unittest
 
 # Switch off processing .ldaprc or ldap.conf before importing _ldap
@@ -119,6 +120,129 @@ class TestDN(unittest.TestCase):
             ]
         )
 
+    def test_str2dn_batch(self):
+        """
+        test function str2dn_batch()
+        """
+        dns = [
+            'uid=test42,ou=Testing,dc=example,dc=com',
+            '',
+            'cn=foo+mail=foo@example.com,dc=example,dc=com',
+            'uid=test42,ou=Testing,dc=example,dc=com',
+        ]
+        self.assertEqual(
+            ldap.dn.str2dn_batch(dns),
+            [ldap.dn.str2dn(dn) for dn in dns]
+        )
+        self.assertEqual(ldap.dn.str2dn_batch([]), [])
+        with self.assertRaises(ldap.DECODING_ERROR):
+            ldap.dn.str2dn_batch(['dc=example', 'foobar,dc=example'])
+        with self.assertRaises(TypeError):
+            ldap.dn.str2dn_batch(['dc=example', 42])
+
+    def test_dn_cache(self):
+        """
+        test the str2dn() LRU cache
+        """
+        self.addCleanup(ldap.dn.set_dn_cache_size, 0)
+        dn = 'uid=test42,ou=Testing,dc=example,dc=com'
+        expected = ldap.dn.str2dn(dn)
+        ldap.dn.set_dn_cache_size(2)
+        self.assertEqual(
+            ldap.dn.dn_cache_info(),
+            {'hits': 0, 'misses': 0, 'maxsize': 2, 'currsize': 0}
+        )
+        self.assertEqual(ldap.dn.str2dn(dn), expected)
+        result = ldap.dn.str2dn(dn)
+        self.assertEqual(result, expected)
+        # cached results are copies
+        result[0].append(('cn', 'foo', 1))
+        self.assertEqual(ldap.dn.str2dn(dn), expected)
+        self.assertEqual(
+            ldap.dn.dn_cache_info(),
+            {'hits': 2, 'misses': 1, 'maxsize': 2, 'currsize': 1}
+        )
+        # flags are part of the key
+        ldap.dn.str2dn(dn, ldap.DN_FORMAT_LDAPV3)
+        self.assertEqual(ldap.dn.dn_cache_info()['misses'], 2)
+        # least recently used DNs are evicted
+        self.assertEqual(
+            ldap.dn.str2dn_batch(['dc=example', 'dc=com', dn]),
+            [[[('dc', 'example', 1)]], [[('dc', 'com', 1)]], expected]
+        )
+        self.assertEqual(ldap.dn.dn_cache_info()['currsize'], 2)
+        self.assertEqual(ldap.dn.dn_cache_info()['misses'], 4)
+        # subclasses of str are not cached
+        class DN(str):
+            pass
+        self.assertEqual(ldap.dn.str2dn(DN(dn)), expected)
+        self.assertEqual(ldap.dn.dn_cache_info()['misses'], 4)
+        ldap.dn.set_dn_cache_size(0)
+        self.assertEqual(
+            ldap.dn.dn_cache_info(),
+            {'hits': 0, 'misses': 0, 'maxsize': 0, 'currsize': 0}
+        )
+
+    def test_dn_cache_threads(self):
+        """
+        test the str2dn() cache used and resized by several threads
+        """
+        self.addCleanup(ldap.dn.set_dn_cache_size, 0)
+        dns = ['uid=test%d,ou=Testing,dc=example,dc=com' % i
+               for i in range(20)]
+        expected = [ldap.dn.str2dn(dn) for dn in dns]
+        errors = []
+
+        def parse():
+            try:
+                for _ in range(50):
+                    self.assertEqual(ldap.dn.str2dn_batch(dns), expected)
+                    for dn, result in zip(dns, expected):
+                        self.assertEqual(ldap.dn.str2dn(dn), result)
+            except Exception as e:
+                errors.append(e)
+
+        ldap.dn.set_dn_cache_size(10)
+        threads = [threading.Thread(target=parse) for _ in range(4)]
+        for thread in threads:
+            thread.start()
+        for maxsize in range(50):
+            ldap.dn.set_dn_cache_size(maxsize % 15)
+        for thread in threads:
+            thread.join()
+        self.assertEqual(errors, [])
+        self.assertLessEqual(ldap.dn.dn_cache_info()['currsize'], 15)
+
+
+    def test_normalize_dn(self):
+        """
+        test functions normalize_dn() and normalize_dn_batch()
+        """
+        self.assertEqual(ldap.dn.normalize_dn(''), '')
+        self.assertEqual(
+            ldap.dn.normalize_dn('UID=Test42, OU=Testing,dc=Example,DC=COM'),
+            'uid=test42,ou=testing,dc=example,dc=com'
+        )
+        self.assertEqual(
+            ldap.dn.normalize_dn('mail=Foo@example.com+CN=Foo,dc=example'),
+            ldap.dn.normalize_dn('cn=foo+mail=foo@example.com,dc=example'),
+        )
+        self.assertEqual(
+            ldap.dn.normalize_dn('cn=\\c3\\a4,dc=example'),
+            ldap.dn.normalize_dn('cn=\u00e4,dc=example'),
+        )
+        dns = ['dc=Example,dc=COM', '', 'cn=Foo+uid=bar,dc=example']
+        self.assertEqual(
+            ldap.dn.normalize_dn_batch(dns),
+            [ldap.dn.normalize_dn(dn) for dn in dns]
+        )
+        self.assertEqual(len(set(ldap.dn.normalize_dn_batch(
+            ['dc=example,dc=com', 'DC=Example, DC=Com']))), 1)
+        with self.assertRaises(ldap.DECODING_ERROR):
+            ldap.dn.normalize_dn('foobar,dc=example')
+        with self.assertRaises(ldap.DECODING_ERROR):
+            ldap.dn.normalize_dn_batch(['dc=example', 'foobar,dc=example'])
+
     def test_dn2str(self):
         """
         test function dn2str()
@@ -168,6 +292,9 @@ class TestDN(unittest.TestCase):
             ]),
             'cn=äöüÄÖÜß,dc=example,dc=com'
         )
+        for atype in (b'cn', 42, None):
+            with self.assertRaises(TypeError):
+                ldap.dn.dn2str([[(atype, 'test', 1)]])
 
     def test_explode_dn(self):
         """
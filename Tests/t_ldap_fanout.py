@@ -0,0 +1,128 @@
+"""
+Automatic tests for python-ldap's module ldap.fanout
+
+See https://www.python-ldap.org/ for details.
+"""
+import os
+import unittest
+
+# Switch off processing .ldaprc or ldap.conf before importing _ldap
+os.environ['LDAPNOINIT'] = '1'
+
+import ldap
+from ldap.fanout import FanoutSearch, fanout_search_s, naming_context_targets
+from ldap.ldapobject import SimpleLDAPObject
+
+from slapdtest import SlapdTestCase
+
+LDIF = """dn: {suffix}
+objectClass: dcObject
+objectClass: organization
+dc: {dc}
+o: {dc}
+
+dn: ou=A,{suffix}
+objectClass: organizationalUnit
+ou: A
+
+dn: ou=B,{suffix}
+objectClass: organizationalUnit
+ou: B
+
+"""
+
+
+class TestFanoutSearch(SlapdTestCase):
+    ldap_object_class = SimpleLDAPObject
+
+    @classmethod
+    def setUpClass(cls):
+        super().setUpClass()
+        suffix = cls.server.suffix
+        ldif = [LDIF.format(suffix=suffix, dc=suffix.split(',')[0][3:])]
+        for ou, count in (('A', 20), ('B', 5)):
+            for num in range(count):
+                ldif.append(
+                    'dn: cn={ou}{num},ou={ou},{suffix}\n'
+                    'objectClass: organizationalRole\n'
+                    'cn: {ou}{num}\n'.format(ou=ou, num=num, suffix=suffix)
+                )
+        cls.server.ldapadd('\n'.join(ldif))
+
+    def setUp(self):
+        self.conns = [self._open_ldap_conn() for _ in range(2)]
+        for conn in self.conns:
+            self.addCleanup(conn.unbind_s)
+        self.base_a = 'ou=A,' + self.server.suffix
+        self.base_b = 'ou=B,' + self.server.suffix
+
+    def test_merge(self):
+        c1, c2 = self.conns
+        search = FanoutSearch(
+            [(c1, self.base_a), (c2, self.base_b), (c1, self.base_b)],
+            ldap.SCOPE_ONELEVEL, '(objectClass=organizationalRole)', ['cn'],
+        )
+        result = list(search)
+        self.assertEqual(len(result), 30)
+        self.assertEqual(search.counts, [20, 5, 5])
+        self.assertFalse(search.truncated)
+        expected = c1.search_s(
+            self.server.suffix, ldap.SCOPE_SUBTREE,
+            '(objectClass=organizationalRole)', ['cn'],
+        )
+        self.assertEqual(sorted(set(result)), sorted(expected))
+        with self.assertRaises(RuntimeError):
+            list(search)
+
+    def test_dedup(self):
+        c1, c2 = self.conns
+        search = FanoutSearch(
+            [(c1, self.server.suffix), (c2, self.base_b)],
+            ldap.SCOPE_SUBTREE, '(objectClass=organizationalRole)',
+            dedup=True,
+        )
+        dns = [dn for dn, _ in search]
+        self.assertEqual(len(dns), 25)
+        self.assertEqual(len(set(dns)), 25)
+        self.assertEqual(sum(search.counts), 25)
+
+    def test_sizelimit(self):
+        c1, c2 = self.conns
+        search = FanoutSearch(
+            [(c1, self.base_a), (c2, self.base_b)],
+            ldap.SCOPE_ONELEVEL, sizelimit=7,
+        )
+        self.assertEqual(len(list(search)), 7)
+        self.assertTrue(search.truncated)
+        # the connections are still usable
+        for conn in self.conns:
+            self.assertEqual(len(conn.search_s(self.base_b, ldap.SCOPE_ONELEVEL)), 5)
+
+    def test_errors(self):
+        c1, c2 = self.conns
+        missing = 'ou=missing,' + self.server.suffix
+        targets = [(c1, self.base_b), (c2, missing)]
+        with self.assertRaises(ldap.NO_SUCH_OBJECT):
+            fanout_search_s(targets, ldap.SCOPE_ONELEVEL)
+        search = FanoutSearch(
+            targets, ldap.SCOPE_ONELEVEL, ignore_errors=(ldap.NO_SUCH_OBJECT,)
+        )
+        self.assertEqual(len(list(search)), 5)
+        self.assertEqual(list(search.errors), [1])
+        self.assertIsInstance(search.errors[1], ldap.NO_SUCH_OBJECT)
+
+    def test_naming_context_targets(self):
+        targets = naming_context_targets(self.conns)
+        self.assertEqual(
+            targets,
+            [(conn, self.server.suffix) for conn in self.conns]
+        )
+        result = fanout_search_s(
+            targets, ldap.SCOPE_BASE, attrlist=['dc'], dedup=True
+        )
+        self.assertEqual(len(result), 1)
+        self.assertEqual(result[0][0], self.server.suffix)
+
+
+if __name__ == '__main__':
+    unittest.main()
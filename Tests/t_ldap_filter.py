@@ -10,7 +10,7 @@ import unittest
 # Switch off processing .ldaprc or ldap.conf before importing _ldap
 os.environ['LDAPNOINIT'] = '1'
 
-from ldap.filter import escape_filter_chars
+from ldap.filter import escape_filter_chars, filter_format, compile_filter
 
 
 class TestDN(unittest.TestCase):
@@ -62,6 +62,49 @@ class TestDN(unittest.TestCase):
             r'\66\6f\6f\62\61\72'
         )
 
+    def test_escape_filter_chars_special(self):
+        self.assertEqual(
+            escape_filter_chars('a*b(c)d\\e\x00'),
+            r'a\2ab\28c\29d\5ce\00'
+        )
+        # code points above 0xff get more than two hex digits
+        self.assertEqual(
+            escape_filter_chars('\u20ac\U0001f600', escape_mode=1),
+            r'\20ac\1f600'
+        )
+        self.assertEqual(escape_filter_chars('', escape_mode=2), '')
+        with self.assertRaises(ValueError):
+            escape_filter_chars('foo', escape_mode=3)
+        with self.assertRaises(TypeError):
+            escape_filter_chars(b'foo')
+
+    def test_filter_format(self):
+        self.assertEqual(
+            filter_format('(&(cn=%s)(uid=%s))', ['foo*', 'b(a)r']),
+            r'(&(cn=foo\2a)(uid=b\28a\29r))'
+        )
+
+    def test_compile_filter(self):
+        template = '(&(cn=%s)(description=100%%)(uid=%s))'
+        compiled = compile_filter(template)
+        for values in (['foo', 'bar'], ('foo*', 'b(a)r'), ['', '\\']):
+            self.assertEqual(
+                compiled.render(values), filter_format(template, values)
+            )
+        self.assertEqual(compile_filter('(cn=*)').render([]), '(cn=*)')
+        self.assertEqual(
+            compile_filter('(cn=%s)', escape_mode=2).render(['ab']),
+            r'(cn=\61\62)'
+        )
+        with self.assertRaises(TypeError):
+            compiled.render(['foo'])
+        with self.assertRaises(TypeError):
+            compiled.render(['foo', b'bar'])
+        with self.assertRaises(ValueError):
+            compile_filter('(uid=%d)')
+        with self.assertRaises(ValueError):
+            compile_filter('(uid=%')
+
 
 if __name__ == '__main__':
     unittest.main()
@@ -154,5 +154,59 @@ class TestModlist(unittest.TestCase):
             )
 
 
+    def test_addModlist_ignore_attr_types(self):
+        entry = {
+            'objectClass': [b'person'],
+            'userPassword': [b'secret'],
+            'cn': [None, b'foo'],
+            'sn': (None,),
+        }
+        self.assertEqual(
+            addModlist(entry, ignore_attr_types=['USERPASSWORD']),
+            [('objectClass', [b'person']), ('cn', [None, b'foo'])]
+        )
+
+    def test_modifyModlist_options(self):
+        old_entry = {
+            'objectClass': [b'person'],
+            'cn': [b'foo', b'bar'],
+            'description': [b'old'],
+            'userPassword': [b'secret'],
+        }
+        new_entry = {
+            'OBJECTCLASS': (b'person',),
+            'cn': [b'bar', b'foo', None],
+            'mail': [b'foo@example.com'],
+        }
+        self.assertEqual(
+            modifyModlist(old_entry, new_entry, ['userPassword']),
+            [
+                (ldap.MOD_ADD, 'mail', [b'foo@example.com']),
+                (ldap.MOD_DELETE, 'description', None),
+            ]
+        )
+        self.assertEqual(
+            modifyModlist(old_entry, new_entry, ignore_oldexistent=1),
+            [(ldap.MOD_ADD, 'mail', [b'foo@example.com'])]
+        )
+
+    def test_modifyModlist_duplicate_values(self):
+        # values are compared as sets, with None filtered out
+        self.assertEqual(
+            modifyModlist({'cn': [b'a', b'a']}, {'cn': [b'a', b'b']}),
+            [(ldap.MOD_DELETE, 'cn', None), (ldap.MOD_ADD, 'cn', [b'a', b'b'])]
+        )
+        self.assertEqual(
+            modifyModlist({'cn': [b'a', b'b']}, {'cn': [b'b', None, b'a']}),
+            []
+        )
+
+    def test_modifyModlist_errors(self):
+        with self.assertRaises(TypeError):
+            modifyModlist({'cn': [[b'a']]}, {'cn': [[b'b']]})
+        with self.assertRaises(AttributeError):
+            modifyModlist({1: [b'a']}, {'cn': [b'b']})
+
+
 if __name__ == '__main__':
     unittest.main()
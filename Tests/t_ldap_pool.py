@@ -0,0 +1,152 @@
+"""
+Automatic tests for python-ldap's module ldap.pool
+
+See https://www.python-ldap.org/ for details.
+"""
+import os
+import threading
+import time
+import unittest
+
+# Switch off processing .ldaprc or ldap.conf before importing _ldap
+os.environ['LDAPNOINIT'] = '1'
+
+import ldap
+from ldap.pool import ConnectionPool, PoolTimeout
+
+from slapdtest import SlapdTestCase
+
+
+class TestConnectionPool(SlapdTestCase):
+
+    @classmethod
+    def setUpClass(cls):
+        super().setUpClass()
+        cls.server.ldapadd(
+            "dn: {suffix}\n"
+            "objectClass: dcObject\n"
+            "objectClass: organization\n"
+            "dc: {dc}\n"
+            "o: {dc}\n".format(
+                suffix=cls.server.suffix,
+                dc=cls.server.suffix.split(',')[0][3:],
+            )
+        )
+
+    def _pool(self, **kwargs):
+        pool = ConnectionPool(
+            self.server.ldap_uri,
+            who=self.server.root_dn, cred=self.server.root_pw,
+            **kwargs
+        )
+        self.addCleanup(pool.close)
+        return pool
+
+    def test_checkout_checkin(self):
+        pool = self._pool(size=2)
+        self.assertEqual(len(pool), 2)
+        conn1 = pool.checkout()
+        conn2 = pool.checkout()
+        self.assertIsNot(conn1, conn2)
+        self.assertEqual(conn1.whoami_s(), 'dn:' + self.server.root_dn)
+        with self.assertRaises(PoolTimeout):
+            pool.checkout(timeout=0.1)
+        pool.checkin(conn2)
+        self.assertIs(pool.checkout(timeout=0.1), conn2)
+        pool.checkin(conn1)
+        pool.checkin(conn2)
+
+    def test_affinity(self):
+        pool = self._pool(size=3)
+        with pool.connection() as conn:
+            first = conn
+        for _ in range(3):
+            with pool.connection() as conn:
+                self.assertIs(conn, first)
+
+    def test_lazy_open(self):
+        pool = self._pool(size=2, prefill=False)
+        self.assertEqual(len(pool), 0)
+        with pool.connection() as conn:
+            self.assertEqual(len(pool), 1)
+            conn.whoami_s()
+
+    def test_discard_on_error(self):
+        pool = self._pool(size=1)
+        with self.assertRaises(ldap.NO_SUCH_OBJECT):
+            with pool.connection() as conn:
+                first = conn
+                conn.search_s('cn=nothere,' + self.server.suffix, ldap.SCOPE_BASE)
+        # LDAP errors leave the connection usable
+        with pool.connection() as conn:
+            self.assertIs(conn, first)
+        with self.assertRaises(RuntimeError):
+            with pool.connection() as conn:
+                raise RuntimeError()
+        with pool.connection() as conn:
+            self.assertIsNot(conn, first)
+
+    def test_max_lifetime(self):
+        pool = self._pool(size=1, max_lifetime=0)
+        with pool.connection() as conn:
+            first = conn
+        self.assertEqual(len(pool), 0)
+        with pool.connection() as conn:
+            self.assertIsNot(conn, first)
+
+    def test_idle_timeout(self):
+        pool = self._pool(size=1, idle_timeout=0)
+        first = pool.checkout()
+        pool.checkin(first)
+        time.sleep(0.01)
+        second = pool.checkout()
+        self.assertIsNot(second, first)
+        pool.checkin(second)
+
+    def test_probe(self):
+        pool = self._pool(size=1, probe_interval=0)
+        conn = pool.checkout()
+        pool.checkin(conn)
+        # still alive
+        self.assertIs(pool.checkout(), conn)
+        # simulate a dropped connection
+        conn._l.unbind_ext()
+        pool.checkin(conn)
+        replaced = pool.checkout()
+        self.assertIsNot(replaced, conn)
+        self.assertEqual(replaced.whoami_s(), 'dn:' + self.server.root_dn)
+        pool.checkin(replaced)
+
+    def test_threads(self):
+        pool = self._pool(size=4)
+        errors = []
+
+        def worker():
+            try:
+                for _ in range(20):
+                    with pool.connection() as conn:
+                        conn.search_s(self.server.suffix, ldap.SCOPE_BASE)
+            except Exception as e:
+                errors.append(e)
+
+        threads = [threading.Thread(target=worker) for _ in range(8)]
+        for thread in threads:
+            thread.start()
+        for thread in threads:
+            thread.join()
+        self.assertEqual(errors, [])
+        self.assertEqual(len(pool), 4)
+
+    def test_close(self):
+        pool = self._pool(size=2)
+        conn = pool.checkout()
+        pool.close()
+        self.assertEqual(len(pool), 1)
+        with self.assertRaises(ValueError):
+            pool.checkout()
+        pool.checkin(conn)
+        self.assertEqual(len(pool), 0)
+
+
+if __name__ == '__main__':
+    unittest.main()
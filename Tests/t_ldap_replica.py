@@ -0,0 +1,187 @@
+"""
+Automatic tests for python-ldap's module ldap.replica
+
+See https://www.python-ldap.org/ for details.
+"""
+import os
+import threading
+import time
+import unittest
+
+# Switch off processing .ldaprc or ldap.conf before importing _ldap
+os.environ['LDAPNOINIT'] = '1'
+
+import ldap
+from ldap.ldapobject import SimpleLDAPObject
+from ldap.replica import LocalReplica, ReplicaConsumer, dn_value
+
+from slapdtest import SlapdTestCase
+from t_ldap_syncrepl import SyncreplProvider
+
+LDIF = """dn: {suffix}
+objectClass: dcObject
+objectClass: organization
+dc: {dc}
+o: {dc}
+
+dn: cn=Alice,{suffix}
+objectClass: organizationalRole
+objectClass: uidObject
+cn: Alice
+uid: alice
+
+dn: cn=Bob,{suffix}
+objectClass: organizationalRole
+objectClass: uidObject
+cn: Bob
+uid: bob
+
+dn: cn=Staff,{suffix}
+objectClass: groupOfNames
+cn: Staff
+member: cn=Alice,{suffix}
+member: cn=Bob,{suffix}
+
+"""
+
+
+class TestLocalReplica(unittest.TestCase):
+
+    def setUp(self):
+        self.replica = LocalReplica()
+        self.replica.begin_refresh(True)
+        self.replica.put([
+            ('cn=Alice,dc=example', {'uid': [b'alice']}, b'1'),
+            ('cn=Bob,dc=example', {'UID': [b'Bob']}, b'2'),
+            ('cn=Staff,dc=example',
+             {'member': [b'cn=Alice,dc=example', b'CN=bob, dc=example']},
+             b'3'),
+        ])
+        self.replica.mark_present([b'1', b'2', b'3'])
+        self.replica.end_refresh()
+
+    def test_lookups(self):
+        replica = self.replica
+        self.assertTrue(replica.wait_refreshed(0))
+        self.assertEqual(len(replica), 3)
+        self.assertIn('CN=alice,DC=Example', replica)
+        self.assertEqual(replica.get('cn=ALICE, dc=example'),
+                         {'uid': [b'alice']})
+        self.assertIsNone(replica.get('cn=Carol,dc=example'))
+        self.assertEqual(replica.find('uid', 'BOB'),
+                         [('cn=Bob,dc=example', {'UID': [b'Bob']})])
+        self.assertEqual(
+            [dn for dn, entry in replica.find('Member', b'cn=Bob,dc=example')],
+            ['cn=Staff,dc=example']
+        )
+        self.assertEqual(replica.find('uid', 'carol'), [])
+        with self.assertRaises(ValueError):
+            replica.find('cn', 'Alice')
+
+    def test_modrdn_and_delete(self):
+        replica = self.replica
+        replica.put([('cn=Robert,dc=example', {'uid': [b'robert']}, b'2')])
+        self.assertNotIn('cn=Bob,dc=example', replica)
+        self.assertIn('cn=Robert,dc=example', replica)
+        self.assertEqual(replica.find('uid', 'bob'), [])
+        self.assertEqual(len(replica.find('uid', 'robert')), 1)
+        replica.delete([b'1', b'4'])
+        self.assertIsNone(replica.get('cn=Alice,dc=example'))
+        self.assertEqual(replica.find('uid', 'alice'), [])
+        self.assertEqual(len(replica), 2)
+
+    def test_present_phase(self):
+        replica = self.replica
+        replica.begin_refresh(False)
+        replica.mark_present([b'1', b'3'])
+        replica.end_present(False)
+        replica.end_refresh()
+        self.assertEqual(len(replica), 2)
+        self.assertEqual(replica.find('uid', 'bob'), [])
+
+    def test_full_refresh(self):
+        replica = self.replica
+        replica.begin_refresh(True)
+        replica.put([('cn=Alice,dc=example', {'uid': [b'alice']}, b'1')])
+        replica.mark_present([b'1'])
+        replica.end_refresh()
+        self.assertEqual(len(replica), 1)
+        self.assertEqual(replica.find('member', 'cn=alice,dc=example'), [])
+
+    def test_indexes(self):
+        replica = LocalReplica(['CN'])
+        replica.put([('cn=Alice,dc=example', {'cn': [b'Alice']}, b'1')])
+        self.assertEqual(len(replica.find('cn', 'alice')), 1)
+        with self.assertRaises(ValueError):
+            replica.find('uid', 'alice')
+        self.assertEqual(dn_value(b'CN=Alice, DC=example'),
+                         dn_value(b'cn=alice,dc=example'))
+
+
+class TestReplicaConsumer(SlapdTestCase):
+    server_class = SyncreplProvider
+    ldap_object_class = SimpleLDAPObject
+
+    @classmethod
+    def setUpClass(cls):
+        super().setUpClass()
+        cls.server.ldapadd(LDIF.format(
+            suffix=cls.server.suffix,
+            dc=cls.server.suffix.split(',')[0][3:],
+        ))
+
+    def setUp(self):
+        super().setUp()
+        self.replica = LocalReplica()
+        self.consumer = ReplicaConsumer(
+            self.server.ldap_uri, self.replica, self.server.suffix,
+            batch_size=10,
+        )
+        self.consumer.simple_bind_s(self.server.root_dn, self.server.root_pw)
+        self.thread = threading.Thread(
+            target=self.consumer.run, kwargs={'poll_interval': 0.1}
+        )
+        self.thread.start()
+
+    def tearDown(self):
+        self.consumer.stop()
+        self.thread.join()
+        self.consumer.unbind_s()
+        super().tearDown()
+
+    def wait_for(self, predicate, timeout=10):
+        deadline = time.monotonic() + timeout
+        while not predicate():
+            if time.monotonic() > deadline:
+                self.fail('replica not updated')
+            time.sleep(0.05)
+
+    def test_refresh_and_persist(self):
+        suffix = self.server.suffix
+        self.assertTrue(self.replica.wait_refreshed(10))
+        self.assertEqual(
+            [dn for dn, entry in self.replica.find('uid', 'ALICE')],
+            ['cn=Alice,' + suffix]
+        )
+        self.assertEqual(
+            [dn for dn, entry in self.replica.find('member',
+                                                   'CN=bob,' + suffix)],
+            ['cn=Staff,' + suffix]
+        )
+        self.assertIn('CN=Alice,' + suffix.upper(), self.replica)
+
+        conn = self._open_ldap_conn(bytes_mode=False)
+        conn.modify_s('cn=Bob,' + suffix,
+                      [(ldap.MOD_REPLACE, 'uid', [b'robert'])])
+        self.wait_for(lambda: self.replica.find('uid', 'robert'))
+        self.assertEqual(self.replica.find('uid', 'bob'), [])
+        conn.delete_s('cn=Alice,' + suffix)
+        self.wait_for(lambda: 'cn=Alice,' + suffix not in self.replica)
+        self.assertEqual(self.replica.find('uid', 'alice'), [])
+        # the cookie of the last change applied is kept for resuming
+        self.assertIsNotNone(self.replica.cookie)
+        conn.unbind_s()
+
+
+if __name__ == '__main__':
+    unittest.main()
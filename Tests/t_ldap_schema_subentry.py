@@ -5,7 +5,10 @@ See https://www.python-ldap.org/ for details.
 """
 
 import os
+import shutil
+import tempfile
 import unittest
+from unittest import mock
 
 # Switch off processing .ldaprc or ldap.conf before importing _ldap
 os.environ['LDAPNOINIT'] = '1'
@@ -49,6 +52,96 @@ class TestSubschemaLDIF(unittest.TestCase):
                     self.assertEqual(attributetype.oid, oid)
 
 
+    def test_value_decoders(self):
+        with open(TEST_SUBSCHEMA_FILES[1], 'rb') as ldif_file:
+            ldif_parser = ldif.LDIFRecordList(ldif_file, max_entries=1)
+            ldif_parser.parse()
+        _, subschema_subentry = ldif_parser.all_records[0]
+        sub_schema = ldap.schema.SubSchema(subschema_subentry)
+        decoders = sub_schema.value_decoders()
+        # syntax inherited from name
+        self.assertEqual(decoders['cn'], ldap.DECODE_STR)
+        self.assertEqual(decoders['commonName'], ldap.DECODE_STR)
+        self.assertEqual(decoders['2.5.4.3'], ldap.DECODE_STR)
+        self.assertEqual(decoders['modifyTimestamp'],
+                         ldap.DECODE_GENERALIZED_TIME)
+        self.assertEqual(decoders['uidNumber'], ldap.DECODE_INT)
+        self.assertNotIn('userPassword', decoders)
+        self.assertNotIn('jpegPhoto', decoders)
+        decoders = sub_schema.value_decoders({
+            '1.3.6.1.4.1.1466.115.121.1.40': ldap.DECODE_STR,
+        })
+        self.assertEqual(decoders['userPassword'], ldap.DECODE_STR)
+        self.assertNotIn('cn', decoders)
+
+
+class TestCompiledSubschema(unittest.TestCase):
+    """
+    test SubSchema.dumps() and SubSchema.loads()
+    """
+
+    def test_dumps_loads(self):
+        for test_file in TEST_SUBSCHEMA_FILES:
+            with open(test_file, 'rb') as ldif_file:
+                ldif_parser = ldif.LDIFRecordList(ldif_file, max_entries=1)
+                ldif_parser.parse()
+            _, subschema_subentry = ldif_parser.all_records[0]
+            sub_schema = ldap.schema.SubSchema(subschema_subentry)
+            loaded = ldap.schema.SubSchema.loads(sub_schema.dumps())
+            self.assertEqual(loaded.ldap_entry(), sub_schema.ldap_entry())
+            self.assertEqual(loaded.non_unique_oids, sub_schema.non_unique_oids)
+            for se_class in sub_schema.sed:
+                self.assertEqual(
+                    dict(loaded.name2oid[se_class]),
+                    dict(sub_schema.name2oid[se_class])
+                )
+                self.assertEqual(
+                    loaded.listall(se_class), sub_schema.listall(se_class)
+                )
+            self.assertEqual(
+                str(loaded.get_obj(ObjectClass, 'top')),
+                str(sub_schema.get_obj(ObjectClass, 'top'))
+            )
+
+    def test_loads_invalid(self):
+        with self.assertRaises(ValueError):
+            ldap.schema.SubSchema.loads(b'foo')
+
+    def test_urlfetch_cache(self):
+        tmp_dir = tempfile.mkdtemp()
+        self.addCleanup(shutil.rmtree, tmp_dir)
+        cache_dir = os.path.join(tmp_dir, 'cache')
+        os.mkdir(cache_dir)
+        ldif_name = os.path.join(tmp_dir, 'subschema.ldif')
+        with open(TEST_SUBSCHEMA_FILES[0], 'rb') as f:
+            lines = f.read().split(b'\n')
+        dn_index = [
+            i for i, line in enumerate(lines) if line.startswith(b'dn:')
+        ][0]
+        lines.insert(dn_index + 1, b'modifyTimestamp: 20240101000000Z')
+        with open(ldif_name, 'wb') as f:
+            f.write(b'\n'.join(lines))
+        uri = 'file://{}'.format(ldif_name)
+
+        dn, schema = ldap.schema.urlfetch(uri, cache_dir=cache_dir)
+        self.assertEqual(schema.modify_timestamp, '20240101000000Z')
+        self.assertEqual(len(os.listdir(cache_dir)), 1)
+        # the cache is used instead of parsing the schema again
+        with mock.patch.object(
+            ldap.schema.SubSchema, '__init__', side_effect=AssertionError
+        ):
+            dn2, schema2 = ldap.schema.urlfetch(uri, cache_dir=cache_dir)
+        self.assertEqual(dn2, dn)
+        self.assertEqual(schema2.ldap_entry(), schema.ldap_entry())
+        # a changed modifyTimestamp invalidates the cache
+        with open(ldif_name, 'wb') as f:
+            f.write(b'\n'.join(lines).replace(
+                b'20240101000000Z', b'20240102000000Z'
+            ))
+        dn3, schema3 = ldap.schema.urlfetch(uri, cache_dir=cache_dir)
+        self.assertEqual(schema3.modify_timestamp, '20240102000000Z')
+
+
 class TestSubschemaUrlfetch(unittest.TestCase):
     def test_urlfetch_file(self):
         freeipa_uri = 'file://{}'.format(TEST_SUBSCHEMA_FILES[0])
@@ -62,6 +155,23 @@ class TestSubschemaUrlfetch(unittest.TestCase):
             "MAY ( member $ businessCategory $ seeAlso $ owner $ ou $ o "
             "$ description ) X-ORIGIN 'RFC 4519' )"
         )
+        self.assertIsNone(schema.modify_timestamp)
+
+    def test_urlfetch_file_modify_timestamp(self):
+        tmp_dir = tempfile.mkdtemp()
+        self.addCleanup(shutil.rmtree, tmp_dir)
+        ldif_name = os.path.join(tmp_dir, 'subschema.ldif')
+        with open(TEST_SUBSCHEMA_FILES[1], 'rb') as f:
+            lines = f.read().split(b'\n')
+        dn_index = [
+            i for i, line in enumerate(lines) if line.startswith(b'dn:')
+        ][0]
+        lines.insert(dn_index + 1, b'modifyTimestamp: 20240101000000Z')
+        with open(ldif_name, 'wb') as f:
+            f.write(b'\n'.join(lines))
+        # kept without a cache directory, too
+        dn, schema = ldap.schema.urlfetch('file://{}'.format(ldif_name))
+        self.assertEqual(schema.modify_timestamp, '20240101000000Z')
 
 
 class TestXOrigin(unittest.TestCase):
@@ -264,6 +374,22 @@ class TestSubschemaUrlfetchSlapd(SlapdTestCase):
         dn, schema = ldap.schema.urlfetch(self.server.ldapi_uri)
         self.assertSlapdSchema(dn, schema)
 
+    def test_urlfetch_ldap_cache(self):
+        cache_dir = tempfile.mkdtemp()
+        self.addCleanup(shutil.rmtree, cache_dir)
+        dn, schema = ldap.schema.urlfetch(
+            self.server.ldap_uri, cache_dir=cache_dir
+        )
+        self.assertSlapdSchema(dn, schema)
+        self.assertIsNotNone(schema.modify_timestamp)
+        with mock.patch.object(
+            ldap.schema.SubSchema, '__init__', side_effect=AssertionError
+        ):
+            dn, schema = ldap.schema.urlfetch(
+                self.server.ldap_uri, cache_dir=cache_dir
+            )
+        self.assertSlapdSchema(dn, schema)
+
 
 if __name__ == '__main__':
     unittest.main()
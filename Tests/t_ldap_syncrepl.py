@@ -14,6 +14,7 @@ os.environ['LDAPNOINIT'] = '1'
 import ldap
 from ldap.ldapobject import SimpleLDAPObject
 from ldap.syncrepl import SyncreplConsumer, SyncInfoMessage
+from ldap.syncrepl import SyncStateControl, SyncDoneControl
 
 from slapdtest import SlapdObject, SlapdTestCase
 
@@ -190,14 +191,15 @@ class SyncreplClient(SimpleLDAPObject, SyncreplConsumer):
         """
         SimpleLDAPObject.cancel(self, self.search_id)
 
-    def poll(self, timeout=None, all=0):
+    def poll(self, timeout=None, all=0, batch_size=0):
         """
         Take the params, add the syncrepl search ID, and call the proper poll.
         """
         return self.syncrepl_poll(
             self.search_id,
             timeout=timeout,
-            all=all
+            all=all,
+            batch_size=batch_size,
         )
 
     def syncrepl_get_cookie(self):
@@ -226,6 +228,13 @@ class SyncreplClient(SimpleLDAPObject, SyncreplConsumer):
             del self.dn_attrs[self.uuid_dn[uuid]]
             del self.uuid_dn[uuid]
 
+    def syncrepl_entries(self, entries):
+        """
+        Counts the batches before handling the entries one by one.
+        """
+        self.entry_batches = getattr(self, 'entry_batches', 0) + 1
+        SyncreplConsumer.syncrepl_entries(self, entries)
+
     def syncrepl_entry(self, dn, attrs, uuid):
         """
         Handles adds and changes (including DN changes).
@@ -332,6 +341,25 @@ class BaseSyncreplTests:
         self.assertFalse(poll_result)
         self.assertEqual(self.tester.dn_attrs, LDAP_ENTRIES)
 
+    def test_refreshOnly_poll_batched(self):
+        """
+        Test a full refresh cycle delivering the entries in batches.
+        """
+        self.tester.search(
+            self.suffix,
+            'refreshOnly'
+        )
+        poll_result = self.tester.poll(
+            all=1,
+            timeout=None,
+            batch_size=100,
+        )
+        self.assertFalse(poll_result)
+        self.assertEqual(self.tester.dn_attrs, LDAP_ENTRIES)
+        self.assertGreaterEqual(self.tester.entry_batches, 1)
+        self.assertLess(self.tester.entry_batches, len(LDAP_ENTRIES))
+        self.assertIsNotNone(self.tester.data['cookie'])
+
     def test_refreshAndPersist_poll_only(self):
         """
         Test the refresh part of refresh-and-persist, and check what we got.
@@ -483,6 +511,48 @@ class DecodeSyncreplProtoTests(unittest.TestCase):
             }
         )
 
+    def test_syncstate_control(self):
+        ctrl = SyncStateControl()
+        ctrl.decodeControlValue(binascii.unhexlify(
+            '301d0a0101' '04108dc44601a93611ea8aaff248c5fa5780' '040663736e3d3031'
+        ))
+        self.assertEqual(ctrl.state, 'add')
+        self.assertEqual(ctrl.entryUUID, '8dc44601-a936-11ea-8aaf-f248c5fa5780')
+        self.assertEqual(ctrl.cookie, 'csn=01')
+        ctrl.decodeControlValue(binascii.unhexlify(
+            '30150a0103' '04108dc44601a93611ea8aaff248c5fa5780'
+        ))
+        self.assertEqual(ctrl.state, 'delete')
+        self.assertIsNone(ctrl.cookie)
+        with self.assertRaises(ldap.DECODING_ERROR):
+            ctrl.decodeControlValue(binascii.unhexlify('30070a01010402abcd'))
+
+    def test_syncdone_control(self):
+        ctrl = SyncDoneControl()
+        ctrl.decodeControlValue(binascii.unhexlify('3000'))
+        self.assertIsNone(ctrl.cookie)
+        self.assertIsNone(ctrl.refreshDeletes)
+        ctrl.decodeControlValue(binascii.unhexlify('3003010100'))
+        self.assertIsNone(ctrl.cookie)
+        self.assertIs(ctrl.refreshDeletes, False)
+        ctrl.decodeControlValue(binascii.unhexlify('30090404636f6f6b0101ff'))
+        self.assertEqual(ctrl.cookie, 'cook')
+        self.assertTrue(ctrl.refreshDeletes)
+
+    def test_syncinfo_choices(self):
+        sim = SyncInfoMessage(binascii.unhexlify('8004636f6f6b'))
+        self.assertEqual(sim.newcookie, 'cook')
+        self.assertIsNone(sim.refreshPresent)
+        sim = SyncInfoMessage(binascii.unhexlify('a200'))
+        self.assertEqual(sim.refreshPresent, {'refreshDone': True})
+        self.assertIsNone(sim.newcookie)
+        sim = SyncInfoMessage(binascii.unhexlify('a1090404636f6f6b010100'))
+        self.assertEqual(
+            sim.refreshDelete, {'cookie': 'cook', 'refreshDone': False}
+        )
+        with self.assertRaises(ldap.DECODING_ERROR):
+            SyncInfoMessage(binascii.unhexlify('3000'))
+
 
 if __name__ == '__main__':
     unittest.main()
@@ -3,10 +3,13 @@ Automatic tests for python-ldap's module ldap.ldapobject
 
 See https://www.python-ldap.org/ for details.
 """
+import datetime
 import errno
 import linecache
 import os
 import socket
+import threading
+import time
 import unittest
 import pickle
 
@@ -14,6 +17,8 @@ import pickle
 os.environ['LDAPNOINIT'] = '1'
 
 import ldap
+import ldap.controls.simple
+import ldap.modlist
 from ldap.ldapobject import SimpleLDAPObject, ReconnectLDAPObject
 
 from slapdtest import SlapdTestCase
@@ -219,6 +224,34 @@ class Test00_SimpleLDAPObject(SlapdTestCase):
             ]
         )
 
+    def test001_search_subtree_lazy(self):
+        l = self._ldap_conn
+        msgid = l.search_ext(
+            self.server.suffix,
+            ldap.SCOPE_SUBTREE,
+            '(cn=Foo*)',
+            attrlist=['*'],
+        )
+        resp_type, resp_data, resp_msgid, resp_ctrls, _, _ = l.result4(
+            msgid, all=1, add_ctrls=1, lazy=1
+        )
+        self.assertEqual(resp_type, ldap.RES_SEARCH_RESULT)
+        self.assertEqual(resp_msgid, msgid)
+        self.assertNotIsInstance(resp_data, list)
+        result = sorted(resp_data)
+        expected = sorted(l.search_s(
+            self.server.suffix,
+            ldap.SCOPE_SUBTREE,
+            '(cn=Foo*)',
+            attrlist=['*'],
+        ))
+        self.assertEqual(
+            [(dn, entry) for dn, entry, ctrls in result],
+            expected
+        )
+        for dn, entry, ctrls in result:
+            self.assertEqual(ctrls, [])
+
     def test002_search_onelevel(self):
         result = self._ldap_conn.search_s(
             self.server.suffix,
@@ -286,6 +319,33 @@ class Test00_SimpleLDAPObject(SlapdTestCase):
                 ['*'],
             )
 
+    def test_read_many(self):
+        l = self._ldap_conn
+        base = self.server.suffix
+        dns = ['cn=Foo%d,%s' % (i, base) for i in range(1, 4)]
+        dns.insert(2, 'cn=missing,' + base)
+        results = list(l.read_many(dns, attrlist=['cn'], window=2))
+        self.assertEqual([dn for dn, _ in results], dns)
+        self.assertIsInstance(results[2][1], ldap.NO_SUCH_OBJECT)
+        del results[2]
+        self.assertEqual(
+            results,
+            [('cn=Foo%d,%s' % (i, base), {'cn': [b'Foo%d' % i]})
+             for i in range(1, 4)]
+        )
+        # filterstr not matching
+        self.assertEqual(
+            list(l.read_many(dns[:1], filterstr='(cn=Bar*)')),
+            [(dns[0], None)]
+        )
+        # outstanding searches are abandoned when stopping early
+        reader = l.read_many(dns, window=3)
+        self.assertEqual(next(reader)[0], dns[0])
+        reader.close()
+        self.assertEqual(len(l.search_s(base, ldap.SCOPE_BASE)), 1)
+        with self.assertRaises(ValueError):
+            list(l.read_many(dns, window=0))
+
     def test_search_subschema(self):
         l = self._ldap_conn
         dn = l.search_subschemasubentry_s()
@@ -515,6 +575,206 @@ class Test00_SimpleLDAPObject(SlapdTestCase):
 
         l.delete_s(dn)
 
+    def test_paged_search_ext(self):
+        l = self._ldap_conn
+        expected = l.search_ext_s(self.server.suffix, ldap.SCOPE_SUBTREE)
+        result = list(
+            l.paged_search_ext(self.server.suffix, ldap.SCOPE_SUBTREE, page_size=2)
+        )
+        self.assertEqual(sorted(result), sorted(expected))
+        # closing the generator early abandons the search
+        results = l.paged_search_ext(
+            self.server.suffix, ldap.SCOPE_SUBTREE, page_size=1
+        )
+        next(results)
+        results.close()
+        self.assertEqual(
+            len(l.search_ext_s(self.server.suffix, ldap.SCOPE_BASE)), 1
+        )
+
+    def test_prepare_search(self):
+        l = self._ldap_conn
+        base = self.server.suffix
+        ps = l.prepare_search(base, ldap.SCOPE_SUBTREE, '(cn=%s)', ['cn'])
+        for cn in ('Foo1', 'Foo2', 'nonexisting'):
+            expected = l.search_s(base, ldap.SCOPE_SUBTREE, '(cn=%s)' % cn, ['cn'])
+            self.assertEqual(ps.search_s([cn]), expected)
+        msgid = ps.search(['Foo*'])
+        self.assertEqual(l.result(msgid)[1], [])
+        with self.assertRaises(TypeError):
+            ps.search([])
+        # filter without placeholders
+        ps = l.prepare_search(base, ldap.SCOPE_SUBTREE, '(cn=Foo1)', ['cn'])
+        self.assertEqual(
+            ps.search_s(), l.search_s(base, ldap.SCOPE_SUBTREE, '(cn=Foo1)', ['cn'])
+        )
+        with self.assertRaises(ValueError):
+            l.prepare_search(base, ldap.SCOPE_SUBTREE, '(cn=%d)')
+
+    def test_submit_batch(self):
+        l = self._ldap_conn
+        dns = ['cn=Bulk{},{}'.format(i, self.server.suffix) for i in range(20)]
+        msgids = l.submit_batch([
+            (ldap.REQ_ADD, dn, ldap.modlist.addModlist({
+                'objectClass': [b'organizationalRole'],
+                'cn': [dn.split(',')[0][3:].encode()],
+            }), [ldap.controls.simple.ManageDSAITControl()])
+            for dn in dns
+        ])
+        results = l.collect_batch(msgids)
+        self.assertEqual(
+            [result[:3] for result in results],
+            [(ldap.RES_ADD, [], msgid) for msgid in msgids]
+        )
+        msgids = l.submit_batch(
+            [(ldap.REQ_DELETE, dn, None) for dn in dns] +
+            [(ldap.REQ_DELETE, 'cn=nothere,' + self.server.suffix, None)]
+        )
+        results = l.collect_batch(msgids)
+        self.assertEqual(len(results), len(dns) + 1)
+        self.assertIsInstance(results[-1], ldap.NO_SUCH_OBJECT)
+        for result in results[:-1]:
+            self.assertEqual(result[0], ldap.RES_DELETE)
+
+    def test_stats(self):
+        l = self._ldap_conn
+        l.stats(reset=True)
+        result = l.search_s(self.server.suffix, ldap.SCOPE_SUBTREE, '(cn=Foo*)')
+        stats = l.stats()
+        search = stats['operations']['search']
+        self.assertEqual(search['requests'], 1)
+        self.assertEqual(search['entries'], len(result))
+        self.assertEqual(search['messages'], len(result) + 1)
+        self.assertGreater(search['bytes'], 0)
+        self.assertEqual(search['conversions'], 1)
+        self.assertEqual(len(search['result_wait_histogram']), 24)
+        self.assertEqual(sum(search['result_wait_histogram']), search['results'])
+        self.assertEqual(sum(search['convert_histogram']), 1)
+        self.assertIn('lock_waits', stats)
+        l.stats(reset=True)
+        self.assertNotIn('search', l.stats()['operations'])
+
+    @unittest.skipUnless(ldap.LIBLDAP_R, 'requires a thread-safe libldap')
+    def test_concurrent_wait(self):
+        l = self._ldap_conn
+        errors = []
+
+        def wait():
+            try:
+                # for unsolicited notifications, which do not arrive
+                l._l.result4(ldap.RES_UNSOLICITED, 1, 1.5)
+            except ldap.TIMEOUT:
+                pass
+            except Exception as e:
+                errors.append(e)
+
+        thread = threading.Thread(target=wait)
+        thread.start()
+        try:
+            time.sleep(0.1)
+            start = time.monotonic()
+            result = l.search_s(self.server.suffix, ldap.SCOPE_SUBTREE, '(cn=Foo*)')
+            elapsed = time.monotonic() - start
+        finally:
+            thread.join()
+        self.assertEqual(len(result), 4)
+        # not held up by the waiting thread
+        self.assertLess(elapsed, 1.0)
+        self.assertEqual(errors, [])
+
+    @unittest.skipUnless(ldap.LIBLDAP_R, 'requires a thread-safe libldap')
+    def test_concurrent_search(self):
+        l = self._ldap_conn
+        base = self.server.suffix
+        expected = sorted(l.search_s(base, ldap.SCOPE_SUBTREE, '(cn=Foo*)'))
+        results = []
+        errors = []
+
+        def search():
+            try:
+                for _ in range(20):
+                    results.append(sorted(
+                        l.search_s(base, ldap.SCOPE_SUBTREE, '(cn=Foo*)')
+                    ))
+            except Exception as e:
+                errors.append(e)
+
+        threads = [threading.Thread(target=search) for _ in range(4)]
+        for thread in threads:
+            thread.start()
+        for thread in threads:
+            thread.join()
+        self.assertEqual(errors, [])
+        self.assertEqual(results, [expected] * 80)
+
+    def test_search_columns(self):
+        l = self._ldap_conn
+        base = self.server.suffix
+        columns = l.search_columns_s(
+            base, ldap.SCOPE_SUBTREE, '(|(cn=Foo*)(ou=Container))',
+            ['CN', 'ou', 'cn', 'description'],
+        )
+        self.assertEqual(len(columns), 5)
+        self.assertEqual(columns.attrs, ['CN', 'ou', 'description'])
+        expected = l.search_s(
+            base, ldap.SCOPE_SUBTREE, '(|(cn=Foo*)(ou=Container))',
+            ['cn', 'ou', 'description'],
+        )
+        self.assertEqual(
+            sorted(columns.entries()),
+            sorted(
+                (dn, {attr.upper() if attr == 'cn' else attr: values
+                      for attr, values in entry.items()})
+                for dn, entry in expected
+            )
+        )
+        dns = columns.dns()
+        container = dns.index('ou=Container,' + base)
+        self.assertEqual(columns.values('cn')[container], [])
+        self.assertEqual(columns.values('ou')[container], [b'Container'])
+        list_offsets, value_offsets, data = columns.buffers('cn')
+        self.assertEqual(len(list_offsets), 6)
+        self.assertEqual(list_offsets[-1], 4)
+        self.assertEqual(value_offsets[-1], len(data))
+        self.assertEqual(sorted(data[value_offsets[i]:value_offsets[i+1]]
+                                for i in range(4)),
+                         [b'Foo1', b'Foo2', b'Foo3', b'Foo4'])
+        with self.assertRaises(ldap.NO_SUCH_OBJECT):
+            l.search_columns_s('ou=nothere,' + base, ldap.SCOPE_BASE,
+                               attrlist=['cn'])
+        with self.assertRaises(ValueError):
+            l.search_columns_s(base, ldap.SCOPE_BASE)
+
+    def test_value_decoders(self):
+        l = self._ldap_conn
+        dn = 'cn=Foo1,' + self.server.suffix
+        attrlist = ['cn', 'objectClass', 'modifyTimestamp']
+        l.set_value_decoders({
+            'CN': ldap.DECODE_STR,
+            'modifyTimestamp': ldap.DECODE_GENERALIZED_TIME,
+            # not an integer, returned unchanged
+            'objectClass': ldap.DECODE_INT,
+        })
+        try:
+            _, entry = l.search_s(dn, ldap.SCOPE_BASE, attrlist=attrlist)[0]
+        finally:
+            l.set_value_decoders(None)
+        self.assertEqual(entry['cn'], ['Foo1'])
+        self.assertEqual(entry['objectClass'], [b'organizationalRole'])
+        stamp = entry['modifyTimestamp'][0]
+        self.assertIsInstance(stamp, datetime.datetime)
+        self.assertEqual(stamp.tzinfo, datetime.timezone.utc)
+        _, entry = l.search_s(dn, ldap.SCOPE_BASE, attrlist=attrlist)[0]
+        self.assertEqual(entry['cn'], [b'Foo1'])
+        self.assertEqual(
+            stamp.strftime('%Y%m%d%H%M%SZ').encode('ascii'),
+            entry['modifyTimestamp'][0]
+        )
+        with self.assertRaises(ValueError):
+            l.set_value_decoders({'cn': 42})
+        with self.assertRaises(TypeError):
+            l.set_value_decoders([('cn', ldap.DECODE_STR)])
+
     def test_slapadd(self):
         with self.assertRaises(ldap.INVALID_DN_SYNTAX):
             self._ldap_conn.add_s("myAttribute=foobar,ou=Container,%s" % self.server.suffix, [
@@ -570,6 +830,7 @@ class Test01_ReconnectLDAPObject(Test00_SimpleLDAPObject):
                     (bind_dn, 'user1_pw'),
                     {}
                 ),
+                '_failovers_done': 0,
                 '_options': [(17, 3)],
                 '_reconnects_done': 0,
                 '_retry_delay': 60.0,
@@ -578,6 +839,7 @@ class Test01_ReconnectLDAPObject(Test00_SimpleLDAPObject):
                 '_trace_level': ldap._trace_level,
                 '_trace_stack_limit': 5,
                 '_uri': self.server.ldap_uri,
+                '_uris': [self.server.ldap_uri],
                 'timeout': -1,
             },
         )
@@ -609,6 +871,45 @@ class Test01_ReconnectLDAPObject(Test00_SimpleLDAPObject):
             self.server._start_slapd()
         self.assertEqual(l1.whoami_s(), 'dn:'+bind_dn)
 
+    def _wait_for_standby(self, l):
+        for _ in range(100):
+            if l._standby is not None:
+                return l._standby[0]
+            time.sleep(0.05)
+        self.fail('standby connection not ready')
+
+    @requires_ldapi()
+    def test106_reconnect_standby(self):
+        l = self.ldap_object_class(
+            self.server.ldap_uri, standby_uris=[self.server.ldapi_uri]
+        )
+        bind_dn = 'cn=user1,'+self.server.suffix
+        l.simple_bind_s(bind_dn, 'user1_pw')
+        self.assertEqual(self._wait_for_standby(l), self.server.ldapi_uri)
+        # the current server goes away
+        l._l = _DeadConnection()
+        self.assertEqual(l.whoami_s(), 'dn:'+bind_dn)
+        self.assertEqual(l._uri, self.server.ldapi_uri)
+        self.assertEqual(l._failovers_done, 1)
+        self.assertEqual(l._reconnects_done, 0)
+        # next standby is the first URI again, bound the same way
+        self.assertEqual(self._wait_for_standby(l), self.server.ldap_uri)
+        self.assertEqual(l._standby[1].whoami_s(), 'dn:'+bind_dn)
+        l.unbind_s()
+        l._standby_thread.join(5)
+        self.assertFalse(l._standby_thread.is_alive())
+        self.assertIsNone(l._standby)
+
+
+class _DeadConnection:
+    """
+    Stands in for an _ldap connection object whose server is down
+    """
+    def __getattr__(self, name):
+        def method(*args, **kwargs):
+            raise ldap.SERVER_DOWN({'desc': "Can't contact LDAP server"})
+        return method
+
 
 @requires_init_fd()
 class Test03_SimpleLDAPObjectWithFileno(Test00_SimpleLDAPObject):
@@ -4,8 +4,10 @@ Automatic tests for python-ldap's module ldif
 See https://www.python-ldap.org/ for details.
 """
 import os
+import tempfile
 import textwrap
 import unittest
+from unittest import mock
 
 try:
     from StringIO import StringIO
@@ -22,6 +24,7 @@ class TestLDIFParser(unittest.TestCase):
     """
     Various LDIF test cases
     """
+    native = False
 
     def _parse_records(
             self,
@@ -37,6 +40,7 @@ class TestLDIFParser(unittest.TestCase):
             ldif_file,
             ignored_attr_types=ignored_attr_types,
             max_entries=max_entries,
+            native=self.native,
         )
         parser_method = getattr(
             ldif_parser,
@@ -526,6 +530,29 @@ class TestEntryRecords(TestLDIFParser):
             ],
         )
 
+    def test_bad_dn(self):
+        """
+        records before one with an invalid DN are handled first
+        """
+        ldif_string = (
+            'dn: uid=one,dc=tld\nuid: one\n\n'
+            'dn: uid=two,dc=tld\nuid: two\n\n'
+            'dn: not a dn\nuid: three\n\n'
+            'dn: uid=four,dc=tld\nuid: four\n\n'
+        )
+        parser = ldif.LDIFRecordList(StringIO(ldif_string), native=self.native)
+        with self.assertRaises(ValueError) as cm:
+            parser.parse()
+        self.assertEqual(
+            [dn for dn, entry in parser.all_records],
+            ['uid=one,dc=tld', 'uid=two,dc=tld']
+        )
+        self.assertEqual(parser.records_read, 2)
+        pure = ldif.LDIFRecordList(StringIO(ldif_string))
+        with self.assertRaises(ValueError) as pure_cm:
+            pure.parse()
+        self.assertEqual(str(cm.exception), str(pure_cm.exception))
+
 
 class TestChangeRecords(TestLDIFParser):
     """
@@ -711,5 +738,172 @@ class TestChangeRecords(TestLDIFParser):
         )
 
 
+class TestEntryRecordsNative(TestEntryRecords):
+    """
+    LDIF entry records parsed by the C extension module
+    """
+    native = True
+
+    def test_read_entry_records(self):
+        ldif_string = ''.join(
+            'dn: cn=test%d,dc=example\ncn: test%d\n\n' % (i, i)
+            for i in range(5)
+        )
+        parser = ldif.LDIFParser(StringIO(ldif_string), native=True)
+        self.assertEqual(
+            parser.read_entry_records(3),
+            [
+                ('cn=test%d,dc=example' % i, {'cn': [b'test%d' % i]})
+                for i in range(3)
+            ]
+        )
+        self.assertEqual(parser.records_read, 3)
+        self.assertEqual(len(parser.read_entry_records(3)), 2)
+        self.assertEqual(parser.read_entry_records(3), [])
+        self.assertEqual(parser.records_read, 5)
+
+    def test_read_entry_records_not_native(self):
+        parser = ldif.LDIFParser(StringIO(''))
+        with self.assertRaises(ValueError):
+            parser.read_entry_records()
+
+    def test_mmap(self):
+        with tempfile.NamedTemporaryFile(suffix='.ldif') as f:
+            f.write(
+                b'version: 1\r\n'
+                b'\r\n'
+                b'dn: cn=foo,dc=exa\r\n'
+                b' mple\r\n'
+                b'description:: w6TDtsO8\r\n'
+            )
+            f.flush()
+            with open(f.name, 'rb') as ldif_file:
+                parser = ldif.LDIFRecordList(ldif_file, native=True)
+                parser.parse()
+            self.assertEqual(parser.version, 1)
+            self.assertEqual(
+                parser.all_records,
+                [('cn=foo,dc=example', {'description': ['äöü'.encode()]})]
+            )
+            self.assertEqual(parser.line_counter, 5)
+
+    def test_mmap_text(self):
+        with tempfile.NamedTemporaryFile(suffix='.ldif') as f:
+            f.write(
+                b'dn: cn=foo,dc=example\n'
+                b'description: foo\n'
+            )
+            f.flush()
+            with open(f.name, encoding='utf-8') as ldif_file:
+                with mock.patch.object(
+                    ldif_file, 'read', wraps=ldif_file.read
+                ) as read:
+                    parser = ldif.LDIFRecordList(ldif_file, native=True)
+                parser.parse()
+            # mapped, only read to detect the mode
+            read.assert_called_once_with(0)
+            self.assertEqual(
+                parser.all_records,
+                [('cn=foo,dc=example', {'description': [b'foo']})]
+            )
+
+    def test_text_chunks(self):
+        with tempfile.NamedTemporaryFile(suffix='.ldif') as f:
+            f.write(
+                b'dn: cn=foo,dc=example\n'
+                b'description:: w6TDtsO8\n'
+                b'cn: \xe4\xf6\xfc\n'
+            )
+            f.flush()
+            # not mapped, encoded to UTF-8 chunk-wise
+            with open(f.name, encoding='latin-1') as ldif_file:
+                with mock.patch.object(ldif, 'NATIVE_READ_CHUNK_SIZE', 7):
+                    parser = ldif.LDIFRecordList(ldif_file, native=True)
+                    parser.parse()
+            self.assertEqual(
+                parser.all_records,
+                [('cn=foo,dc=example', {
+                    'description': ['äöü'.encode()],
+                    'cn': ['äöü'.encode()],
+                })]
+            )
+
+    def test_no_value_spec(self):
+        with self.assertRaises(ValueError):
+            self._parse_records('dn: cn=foo,dc=example\nfoobar\n')
+
+
+class TestChangeRecordsNative(TestChangeRecords):
+    """
+    LDIF change records parsed by the C extension module
+    """
+    native = True
+
+
+class TestLDIFWriterNative(unittest.TestCase):
+    """
+    LDIF output written by the C extension module
+    """
+    records = [
+        ('cn=foo,dc=example', {
+            'objectClass': [b'top', b'person'],
+            'cn': [b'foo'],
+            'description': [b'x' * 200, b'', b' leading', b'trailing ',
+                            b':colon', b'<less', b'line\nbreak'],
+            'jpegPhoto': [bytes(range(256))],
+            'userPassword': [b'secret'],
+        }),
+        ('cn=M\u00fcller,dc=example', {
+            'caf\u00e9': ['\u00e4\u00f6\u00fc'.encode('utf-8') * 40],
+            'sn': ['M\u00fcller'.encode('utf-8')],
+        }),
+        ('', {}),
+    ]
+
+    def _unparse(self, native, cols=76, base64_attrs=None):
+        ldif_file = StringIO()
+        writer = ldif.LDIFWriter(
+            ldif_file,
+            base64_attrs=base64_attrs,
+            cols=cols,
+            line_sep='\r\n',
+            native=native,
+        )
+        for dn, entry in self.records:
+            writer.unparse(dn, entry)
+        self.assertEqual(writer.records_written, len(self.records))
+        return ldif_file.getvalue()
+
+    def test_unparse(self):
+        for cols in (2, 3, 10, 76, 1000):
+            self.assertEqual(
+                self._unparse(True, cols=cols),
+                self._unparse(False, cols=cols),
+            )
+        self.assertEqual(
+            self._unparse(True, base64_attrs=['userPassword', 'DN']),
+            self._unparse(False, base64_attrs=['userPassword', 'DN']),
+        )
+
+    def test_unparse_results(self):
+        expected = self._unparse(False).replace('\r\n', '\n')
+        ldif_file = StringIO()
+        writer = ldif.LDIFWriter(ldif_file, native=True)
+        writer.unparse_results(
+            self.records + [(None, ['ldap://ldap.example.com/dc=example'])]
+        )
+        self.assertEqual(writer.records_written, len(self.records))
+        self.assertEqual(ldif_file.getvalue(), expected)
+        # parse it again
+        parser = ldif.LDIFRecordList(StringIO(expected), native=True)
+        parser.parse()
+        self.assertEqual(parser.all_records, self.records)
+
+    def test_bad_values(self):
+        writer = ldif.LDIFWriter(StringIO(), native=True)
+        with self.assertRaises(TypeError):
+            writer.unparse('cn=foo', {'cn': ['foo']})
+
+
 if __name__ == '__main__':
     unittest.main()
@@ -105,24 +105,42 @@ setup(
       [
         'Modules/LDAPObject.c',
         'Modules/ldapcontrol.c',
+        'Modules/cidict.c',
         'Modules/common.c',
         'Modules/constants.c',
+        'Modules/filter.c',
         'Modules/functions.c',
         'Modules/ldapmodule.c',
+        'Modules/ldif.c',
         'Modules/message.c',
+        'Modules/modlist.c',
         'Modules/options.c',
+        'Modules/schema.c',
+        'Modules/stats.c',
+        'Modules/flow.c',
+        'Modules/columns.c',
+        'Modules/wait.c',
         'Modules/berval.c',
       ],
       depends = [
         'Modules/LDAPObject.h',
         'Modules/berval.h',
+        'Modules/cidict.h',
         'Modules/common.h',
         'Modules/constants_generated.h',
         'Modules/constants.h',
+        'Modules/filter.h',
         'Modules/functions.h',
         'Modules/ldapcontrol.h',
+        'Modules/ldif.h',
         'Modules/message.h',
+        'Modules/modlist.h',
         'Modules/options.h',
+        'Modules/schema.h',
+        'Modules/stats.h',
+        'Modules/flow.h',
+        'Modules/columns.h',
+        'Modules/wait.h',
       ],
       libraries = LDAP_CLASS.libs,
       include_dirs = ['Modules'] + LDAP_CLASS.include_dirs,